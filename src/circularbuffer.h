@@ -21,6 +21,11 @@
 #include <iostream>
 #include <iomanip>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 /**
  * @brief The CircularBuffer class provides a template to implement a circular
@@ -38,9 +43,28 @@
  * The default behavior is overwrite older elements when you try to write a number
  * of elements greater then the buffer size.
  *
+ * The elements can be accessed in place: peek() returns the stored elements
+ * and prepare() the free space as two contiguous blocks (the second one is
+ * used when the elements wrap around the end of the array), commit() stores
+ * the elements written in the free space and consume() deletes the elements
+ * read. In mirrored mode (see mirror()) the array is mapped twice in
+ * contiguous virtual memory, so the first block always contains all
+ * elements (or all free space).
+ *
+ * CircularBuffer<T> (N = 0) allocates the array on the heap and its size is
+ * chosen at run time. CircularBuffer<T, N> stores N elements in an inline
+ * array (N must be a power of two) and never allocates memory.
+ *
+ */
+template<typename T, unsigned int N = 0>
+class CircularBuffer;
+
+/**
+ * @brief Circular buffer with the array on the heap (size chosen at run time).
+ *
  */
 template<typename T>
-class CircularBuffer
+class CircularBuffer<T, 0>
 {
     /**
      * @brief Increments an index in cyclic logic.
@@ -58,6 +82,18 @@ class CircularBuffer
     //! Default size of the buffer
     static const unsigned int SIZE = 100;
 
+    /**
+     * @brief Contiguous block of elements of the buffer.
+     */
+    struct Span
+    {
+        /// First element.
+        T *data;
+
+        /// Number of elements.
+        unsigned int size;
+    };
+
     /**
      * @brief Create an empty buffer.
      *
@@ -67,9 +103,10 @@ class CircularBuffer
      *
      */
     CircularBuffer() :
-        m_head(0), m_tail(0), m_size(0), m_max_size(SIZE), m_overwrite(true)
+        m_head(0), m_tail(0), m_size(0), m_max_size(SIZE), m_overwrite(true), m_mapped(0)
     {
       m_buffer = std::vector<T>(m_max_size);
+      m_data = &m_buffer[0];
     }
 
     /**
@@ -85,9 +122,10 @@ class CircularBuffer
      *
      */
     CircularBuffer(bool ow) :
-        m_head(0), m_tail(0), m_size(0), m_max_size(SIZE), m_overwrite(true)
+        m_head(0), m_tail(0), m_size(0), m_max_size(SIZE), m_overwrite(ow), m_mapped(0)
     {
       m_buffer = std::vector<T>(m_max_size);
+      m_data = &m_buffer[0];
     }
 
     /**
@@ -103,9 +141,10 @@ class CircularBuffer
      *
      */
     CircularBuffer(unsigned int maxSize, bool ow) :
-        m_head(0), m_tail(0), m_size(0), m_max_size(maxSize), m_overwrite(true)
+        m_head(0), m_tail(0), m_size(0), m_max_size(maxSize), m_overwrite(ow), m_mapped(0)
     {
       m_buffer = std::vector<T>(m_max_size);
+      m_data = (m_max_size) ? &m_buffer[0] : 0;
     }
 
     /**
@@ -114,14 +153,25 @@ class CircularBuffer
      * @param[in] n source buffer object.
      *
      */
-    CircularBuffer(const CircularBuffer& b)
+    CircularBuffer(const CircularBuffer& b) :
+        m_mapped(0)
     {
-      m_head = b.m_head;
-      m_tail = b.m_tail;
-      m_size = b.m_size;
-      m_max_size = b.m_max_size;
-      m_overwrite = b.m_overwrite;
-      m_buffer = b.m_buffer;
+      copy(b);
+    }
+
+    /**
+     * @brief Move Construct
+     *
+     * The elements (or the mirrored mapping) are moved without copies, the
+     * source buffer becomes empty with size 0.
+     *
+     * @param[in] n source buffer object.
+     *
+     */
+    CircularBuffer(CircularBuffer&& b) :
+        m_mapped(0)
+    {
+      move(b);
     }
 
     /**
@@ -130,6 +180,7 @@ class CircularBuffer
      */
     ~CircularBuffer()
     {
+      unmap();
       m_buffer.clear();
     }
 
@@ -142,12 +193,29 @@ class CircularBuffer
      */
     CircularBuffer & operator=(const CircularBuffer &b)
     {
-      m_head = b.m_head;
-      m_tail = b.m_tail;
-      m_size = b.m_size;
-      m_max_size = b.m_max_size;
-      m_overwrite = b.m_overwrite;
-      m_buffer = b.m_buffer;
+      if (this != &b)
+      {
+        unmap();
+        copy(b);
+      }
+
+      return (*this);
+    }
+
+    /**
+     * @brief Move content.
+     *
+     * @param[in] n source buffer object (it becomes empty with size 0).
+     *
+     * @returns reference to CircularBuffer object.
+     */
+    CircularBuffer & operator=(CircularBuffer &&b)
+    {
+      if (this != &b)
+      {
+        unmap();
+        move(b);
+      }
 
       return (*this);
     }
@@ -181,12 +249,14 @@ class CircularBuffer
     void resize(unsigned int n) throw (std::exception)
     {
       // Clear the buffer
+      unmap();
       m_buffer.clear();
 
       // Resize the empty buffer
       try
       {
         m_buffer.resize(n);
+        m_data = (n) ? &m_buffer[0] : 0;
         m_size = 0;
         m_head = 0;
         m_tail = 0;
@@ -198,6 +268,81 @@ class CircularBuffer
       }
     }
 
+    /**
+     * @brief Enables the mirrored mode.
+     *
+     * This function replaces the array with a shared memory object (memfd)
+     * of at least \a n elements, mapped twice in contiguous virtual memory:
+     * the element after the last one is the first one again, so a block of
+     * up to capacity() elements starting anywhere is contiguous. The size is
+     * rounded up to a multiple of the page size and the buffer becomes
+     * empty. Elements must be trivially copyable.
+     *
+     * @param[in] n Minimum buffer size, expressed in number of elements.
+     *
+     * @returns false if the mapping is not supported (the buffer is
+     * unchanged), true otherwise.
+     */
+    bool mirror(unsigned int n)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "mirrored elements must be trivially copyable");
+
+      size_t page = sysconf(_SC_PAGESIZE);
+      if (n == 0 || page % sizeof(T) != 0)
+        return false;
+
+      size_t bytes = (((size_t) n * sizeof(T) + page - 1) / page) * page;
+
+      int fd = memfd_create("circularbuffer", MFD_CLOEXEC);
+      if (fd < 0)
+        return false;
+
+      if (ftruncate(fd, bytes) < 0)
+      {
+        close(fd);
+        return false;
+      }
+
+      // Reserve the address range, then map the object twice on it
+      uint8_t *base = (uint8_t *) mmap(NULL, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED)
+      {
+        close(fd);
+        return false;
+      }
+
+      if (mmap(base, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+          || mmap(base + bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)
+              == MAP_FAILED)
+      {
+        munmap(base, 2 * bytes);
+        close(fd);
+        return false;
+      }
+      close(fd);
+
+      unmap();
+      std::vector<T>().swap(m_buffer);
+
+      m_data = (T *) base;
+      m_mapped = bytes;
+      m_max_size = bytes / sizeof(T);
+      m_size = 0;
+      m_head = 0;
+      m_tail = 0;
+
+      return true;
+    }
+
+    /**
+     * @brief Returns true in mirrored mode.
+     *
+     */
+    bool mirrored() const
+    {
+      return m_mapped != 0;
+    }
+
     /**
      * @brief Gets the current number of elements stored in the buffer.
      *
@@ -254,7 +399,7 @@ class CircularBuffer
       }
 
       // Get the element of the buffer
-      elt = m_buffer[m_head % m_max_size];
+      elt = m_data[m_head % m_max_size];
 
       // index
       increment(m_head);
@@ -266,33 +411,35 @@ class CircularBuffer
     /**
      * @brief Stores an element in the buffer.
      *
-     * This function stores an element in the buffer. If the overwriting
-     * property is disabled  (false) and buffer is full them the element
-     * will not be stored and the function returns false.
+     * This function stores an element in the buffer. If the buffer is
+     * full and the overwriting property is enabled, the oldest element is
+     * deleted; if it is disabled (false) the element will not be stored
+     * and the function returns false.
      *
      * @param[in] Reference to the element to store in the buffer.
      *
      * @returns false if buffer element has not been stored or there is an error.
      */
-    bool push(T& elt)
+    bool push(const T& elt)
     {
-      // Check if internal index are correct
-      if (!m_overwrite && m_size >= m_max_size)
-      {
-        return false;
-      }
-
-      if (m_size < m_max_size)
+      if (m_size >= m_max_size)
       {
-        // Store element
-        m_buffer[m_tail % m_max_size] = elt;
-        increment(m_tail);
-        m_size++;
+        if (!m_overwrite || m_max_size == 0)
+        {
+          return false;
+        }
 
-        return true;
+        // Evict the oldest element
+        increment(m_head);
+        m_size--;
       }
 
-      return false;
+      // Store element
+      m_data[m_tail] = elt;
+      increment(m_tail);
+      m_size++;
+
+      return true;
     }
 
     /**
@@ -326,18 +473,19 @@ class CircularBuffer
      * This function writes n elements into the circular buffer.
      * If \a overwriting \a property is  disable, when the buffer will be
      * full, this function will terminate and will return the number of
-     * elements written in the buffer.
+     * elements written in the buffer. If it is enabled, all elements are
+     * written and the oldest ones are deleted.
      *
      * @param[in] buf Buffer with the elements to store into the circular buffer.
      * @param[in] n Number of element to write into the circular buffer.
      *
      * @returns The number of elements written.
      */
-    unsigned int write(T buf[], unsigned int n)
+    unsigned int write(const T buf[], unsigned int n)
     {
       unsigned int i = 0;
 
-      for (i = 0; i < n && m_size < m_max_size; i++)
+      for (i = 0; i < n; i++)
       {
         // Try to store element
         if (!push(buf[i]))
@@ -363,8 +511,91 @@ class CircularBuffer
      */
     T& at(unsigned int n) throw (std::exception)
     {
+      if (n >= m_max_size)
+        throw std::out_of_range("CircularBuffer::at");
+
       unsigned int index = (m_head + n) % m_max_size;
-      return m_buffer.at(index);
+      return m_data[index];
+    }
+
+    /**
+     * @brief Gets the stored elements in place.
+     *
+     * The elements are the first block followed by the second one (empty
+     * unless the elements wrap around the end of the array; always empty in
+     * mirrored mode). The blocks are valid until the next consume().
+     *
+     * @param[out] first First block of elements.
+     * @param[out] second Second block of elements.
+     *
+     * @returns The number of elements stored.
+     */
+    unsigned int peek(Span &first, Span &second)
+    {
+      first.data = m_data + m_head;
+      first.size = (m_mapped || m_size <= m_max_size - m_head) ? m_size : m_max_size - m_head;
+      second.data = m_data;
+      second.size = m_size - first.size;
+
+      return m_size;
+    }
+
+    /**
+     * @brief Gets the free space in place.
+     *
+     * The caller writes the new elements in the first block and then in
+     * the second one, then stores them with commit().
+     *
+     * @param[out] first First block of free space.
+     * @param[out] second Second block of free space.
+     *
+     * @returns The number of free elements.
+     */
+    unsigned int prepare(Span &first, Span &second)
+    {
+      unsigned int free = m_max_size - m_size;
+
+      first.data = m_data + m_tail;
+      first.size = (m_mapped || free <= m_max_size - m_tail) ? free : m_max_size - m_tail;
+      second.data = m_data;
+      second.size = free - first.size;
+
+      return free;
+    }
+
+    /**
+     * @brief Stores \a n elements written in the free space (see prepare()).
+     *
+     * @param[in] n Number of elements written.
+     *
+     * @returns The number of elements stored.
+     */
+    unsigned int commit(unsigned int n)
+    {
+      if (n > m_max_size - m_size)
+      {
+        n = m_max_size - m_size;
+      }
+
+      if (n)
+      {
+        m_tail = (m_tail + n) % m_max_size;
+        m_size += n;
+      }
+
+      return n;
+    }
+
+    /**
+     * @brief Deletes \a n elements read in place (see peek()).
+     *
+     * @param[in] n Number of elements read.
+     *
+     * @returns The number of elements deleted.
+     */
+    unsigned int consume(unsigned int n)
+    {
+      return drop(n);
     }
 
     /**
@@ -447,7 +678,7 @@ class CircularBuffer
         for (unsigned int i = 0; i < m_max_size; i++)
         {
           std::cerr << "\t[" << std::right << std::setw(3) << std::setfill(' ') << std::dec << i << "] :"
-               << m_buffer[i] << std::endl;
+               << m_data[i] << std::endl;
         }
       }
       else
@@ -455,12 +686,73 @@ class CircularBuffer
         for (unsigned int i = 0; i < m_size; i++)
         {
           std::cerr << "\t[" << std::left << std::setw(3) << std::setfill(' ') << i << "] :"
-              << m_buffer[(m_head + i) % m_max_size] << std::endl;
+              << m_data[(m_head + i) % m_max_size] << std::endl;
         }
       }
     }
 
   private:
+    /**
+     * @brief Copies the elements and the state of a buffer.
+     *
+     * A mirrored buffer is copied in a normal array.
+     */
+    void copy(const CircularBuffer &b)
+    {
+      m_head = b.m_head;
+      m_tail = b.m_tail;
+      m_size = b.m_size;
+      m_max_size = b.m_max_size;
+      m_overwrite = b.m_overwrite;
+      m_mapped = 0;
+
+      if (b.m_mapped)
+        m_buffer.assign(b.m_data, b.m_data + b.m_max_size);
+      else
+        m_buffer = b.m_buffer;
+
+      m_data = (m_max_size) ? &m_buffer[0] : 0;
+    }
+
+    /**
+     * @brief Takes the elements and the state of a buffer.
+     *
+     * The source buffer becomes empty with size 0.
+     */
+    void move(CircularBuffer &b)
+    {
+      m_head = b.m_head;
+      m_tail = b.m_tail;
+      m_size = b.m_size;
+      m_max_size = b.m_max_size;
+      m_overwrite = b.m_overwrite;
+      m_buffer.swap(b.m_buffer);
+      std::vector<T>().swap(b.m_buffer);
+      m_data = b.m_data;
+      m_mapped = b.m_mapped;
+
+      b.m_head = 0;
+      b.m_tail = 0;
+      b.m_size = 0;
+      b.m_max_size = 0;
+      b.m_data = 0;
+      b.m_mapped = 0;
+    }
+
+    /**
+     * @brief Releases the mapping of the mirrored mode.
+     *
+     */
+    void unmap()
+    {
+      if (m_mapped)
+      {
+        munmap(m_data, 2 * m_mapped);
+        m_mapped = 0;
+        m_data = 0;
+      }
+    }
+
     //! Index of the first element of the buffer
     unsigned int m_head;
 
@@ -476,7 +768,409 @@ class CircularBuffer
     //! Overwriting property
     bool m_overwrite;
 
+    //! Elements (normal mode)
     std::vector<T> m_buffer;
+
+    //! First element of the array (m_buffer or the mirrored mapping)
+    T *m_data;
+
+    //! Bytes of the mirrored mapping (0 in normal mode)
+    size_t m_mapped;
+};
+
+/**
+ * @brief Circular buffer of N elements stored in an inline array.
+ *
+ * N is a power of two: head and tail are free-running counters and the
+ * position in the array is a mask, so the compiler can unroll the loops on
+ * the elements. The buffer never allocates memory. It is movable: the
+ * stored elements are moved and the source buffer becomes empty.
+ *
+ * If the overwriting property is enabled (default), writing in a full
+ * buffer deletes the oldest elements.
+ *
+ */
+template<typename T, unsigned int N>
+class CircularBuffer
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "CircularBuffer size must be a power of two");
+
+    //! Mask of the position in the array
+    static const unsigned int MASK = N - 1;
+
+  public:
+    /**
+     * @brief Contiguous block of elements of the buffer.
+     */
+    struct Span
+    {
+        /// First element.
+        T *data;
+
+        /// Number of elements.
+        unsigned int size;
+    };
+
+    /**
+     * @brief Create an empty buffer.
+     *
+     * @param[in] ow Value to set the \a overwriting \a property. If true, then older elements will be overwritten.
+     *
+     */
+    explicit CircularBuffer(bool ow = true) :
+        m_head(0), m_tail(0), m_overwrite(ow)
+    {
+    }
+
+    /**
+     * @brief Copy Construct
+     *
+     * @param[in] b source buffer object.
+     *
+     */
+    CircularBuffer(const CircularBuffer &b) = default;
+
+    /**
+     * @brief Move Construct
+     *
+     * @param[in] b source buffer object (it becomes empty).
+     *
+     */
+    CircularBuffer(CircularBuffer &&b) :
+        m_head(0), m_tail(0), m_overwrite(b.m_overwrite)
+    {
+      move(b);
+    }
+
+    /**
+     * @brief Assign content.
+     *
+     * @param[in] b source buffer object.
+     *
+     * @returns reference to CircularBuffer object.
+     */
+    CircularBuffer & operator=(const CircularBuffer &b) = default;
+
+    /**
+     * @brief Move content.
+     *
+     * @param[in] b source buffer object (it becomes empty).
+     *
+     * @returns reference to CircularBuffer object.
+     */
+    CircularBuffer & operator=(CircularBuffer &&b)
+    {
+      if (this != &b)
+      {
+        m_overwrite = b.m_overwrite;
+        move(b);
+      }
+
+      return (*this);
+    }
+
+    /**
+     * @brief Sets the \a overwriting \a property.
+     *
+     * @param[in] value Value to set the \a overwriting \a property.
+     *
+     */
+    void setOverWrite(bool value)
+    {
+      m_overwrite = value;
+    }
+
+    /**
+     * @brief Gets the current number of elements stored in the buffer.
+     *
+     */
+    unsigned int size() const
+    {
+      return m_tail - m_head;
+    }
+
+    /**
+     * @brief Gets the capacity of the buffer.
+     *
+     */
+    static constexpr unsigned int capacity()
+    {
+      return N;
+    }
+
+    /**
+     * @brief Returns true if the buffer is empty.
+     *
+     */
+    bool empty() const
+    {
+      return m_tail == m_head;
+    }
+
+    /**
+     * @brief Returns true if the buffer is full.
+     *
+     */
+    bool full() const
+    {
+      return m_tail - m_head == N;
+    }
+
+    /**
+     * @brief Deletes all elements.
+     *
+     */
+    void clear()
+    {
+      m_head = 0;
+      m_tail = 0;
+    }
+
+    /**
+     * @brief Gets the first element of the buffer and deletes it from the buffer.
+     *
+     * @param[out] elt Reference to the element read from the buffer (it is moved).
+     *
+     * @returns false if buffer is empty, true otherwise.
+     */
+    bool pop(T &elt)
+    {
+      if (empty())
+        return false;
+
+      elt = std::move(m_buffer[m_head & MASK]);
+      m_head++;
+
+      return true;
+    }
+
+    /**
+     * @brief Stores an element in the buffer.
+     *
+     * If the buffer is full and the overwriting property is enabled, the
+     * oldest element is deleted.
+     *
+     * @param[in] elt element to store (copied or moved).
+     *
+     * @returns false if the element has not been stored.
+     */
+    template<typename U>
+    bool push(U &&elt)
+    {
+      if (full())
+      {
+        if (!m_overwrite)
+          return false;
+
+        m_head++;
+      }
+
+      m_buffer[m_tail & MASK] = std::forward<U>(elt);
+      m_tail++;
+
+      return true;
+    }
+
+    /**
+     * @brief Reads \a n elements from the buffer and stores them into \a buf array.
+     *
+     * @param[out] buf Buffer where to save the elements read from the circular buffer.
+     * @param[in] n Number of element to read from the circular buffer.
+     *
+     * @returns The number of elements read.
+     */
+    unsigned int read(T buf[], unsigned int n)
+    {
+      if (n > size())
+        n = size();
+
+      for (unsigned int i = 0; i < n; i++)
+      {
+        buf[i] = std::move(m_buffer[(m_head + i) & MASK]);
+      }
+      m_head += n;
+
+      return n;
+    }
+
+    /**
+     * @brief Writes \a n elements into the circular buffer.
+     *
+     * If the overwriting property is disabled, the elements are written
+     * until the buffer is full. If it is enabled, all elements are written
+     * and the oldest ones are deleted (only the last N are kept).
+     *
+     * @param[in] buf Buffer with the elements to store into the circular buffer.
+     * @param[in] n Number of element to write into the circular buffer.
+     *
+     * @returns The number of elements written.
+     */
+    unsigned int write(const T buf[], unsigned int n)
+    {
+      unsigned int written = n;
+      unsigned int free = N - size();
+
+      if (n > free)
+      {
+        if (!m_overwrite)
+        {
+          n = free;
+          written = n;
+        }
+        else
+        {
+          // Older elements are evicted, only the last N are stored
+          if (n > N)
+          {
+            buf += n - N;
+            n = N;
+          }
+          m_head += n - free;
+        }
+      }
+
+      for (unsigned int i = 0; i < n; i++)
+      {
+        m_buffer[(m_tail + i) & MASK] = buf[i];
+      }
+      m_tail += n;
+
+      return written;
+    }
+
+    /**
+     * @brief Gets the element at position n in the buffer.
+     *
+     * The function throws an out_of_range exception if n is greater or
+     * equal than the number of elements.
+     *
+     * @param[in] n Position of an element in the container.
+     *
+     * @returns Element at the specified position in the container.
+     */
+    T& at(unsigned int n)
+    {
+      if (n >= size())
+        throw std::out_of_range("CircularBuffer::at");
+
+      return m_buffer[(m_head + n) & MASK];
+    }
+
+    /**
+     * @brief Gets the element at position n (not checked).
+     *
+     */
+    T& operator[](unsigned int n)
+    {
+      return m_buffer[(m_head + n) & MASK];
+    }
+
+    /**
+     * @brief Deletes \a n elements from the buffer.
+     *
+     * @param[in] n Number of elements to delete.
+     *
+     * @returns The number of elements deleted.
+     */
+    unsigned int drop(unsigned int n)
+    {
+      if (n > size())
+        n = size();
+
+      m_head += n;
+
+      return n;
+    }
+
+    /**
+     * @brief Deletes \a n elements read in place (see peek()).
+     *
+     */
+    unsigned int consume(unsigned int n)
+    {
+      return drop(n);
+    }
+
+    /**
+     * @brief Gets the stored elements in place (see CircularBuffer<T>::peek()).
+     *
+     * @returns The number of elements stored.
+     */
+    unsigned int peek(Span &first, Span &second)
+    {
+      unsigned int pos = m_head & MASK;
+      unsigned int n = size();
+
+      first.data = &m_buffer[pos];
+      first.size = (n <= N - pos) ? n : N - pos;
+      second.data = m_buffer;
+      second.size = n - first.size;
+
+      return n;
+    }
+
+    /**
+     * @brief Gets the free space in place (see CircularBuffer<T>::prepare()).
+     *
+     * @returns The number of free elements.
+     */
+    unsigned int prepare(Span &first, Span &second)
+    {
+      unsigned int pos = m_tail & MASK;
+      unsigned int free = N - size();
+
+      first.data = &m_buffer[pos];
+      first.size = (free <= N - pos) ? free : N - pos;
+      second.data = m_buffer;
+      second.size = free - first.size;
+
+      return free;
+    }
+
+    /**
+     * @brief Stores \a n elements written in the free space (see prepare()).
+     *
+     * @returns The number of elements stored.
+     */
+    unsigned int commit(unsigned int n)
+    {
+      if (n > N - size())
+        n = N - size();
+
+      m_tail += n;
+
+      return n;
+    }
+
+  private:
+    /**
+     * @brief Moves the elements of a buffer, the source becomes empty.
+     *
+     */
+    void move(CircularBuffer &b)
+    {
+      unsigned int n = b.size();
+      for (unsigned int i = 0; i < n; i++)
+      {
+        m_buffer[i] = std::move(b.m_buffer[(b.m_head + i) & MASK]);
+      }
+      m_head = 0;
+      m_tail = n;
+
+      b.clear();
+    }
+
+    //! Elements
+    T m_buffer[N];
+
+    //! Index of the first element (free-running)
+    unsigned int m_head;
+
+    //! Index after the last element (free-running)
+    unsigned int m_tail;
+
+    //! Overwriting property
+    bool m_overwrite;
 };
 
 #endif /* _T2_CIRCULARBUFFER_H_ */
@@ -9,6 +9,8 @@
 #include "lora/utils.h"
 #include "lora/serial.h"
 #include "lora/command.h"
+#include "lora/reactor.h"
+#include "lora/parser.h"
 
 /*****************************************************************************
  * FUNCTIONS
@@ -88,84 +90,79 @@ bool closeSerial(lora::Serial &serial)
 }
 
 
-uint8_t process_buffer(uint8_t *rx_buffer, size_t sz)
+uint8_t process_frame(const lora::Frame &frame)
 {
-  uint8_t payload[buf_sz] = { 0 };
-  uint8_t type = 0;
-  size_t psize = 0;
-  uint16_t crc = 0;
-
   uint8_t f_ret = NO_ERROR;
 
-  V_DEBUG("COMMAND: %s\n", msg_string(rx_buffer, sz).c_str());
+  // Commands parse a private copy of the payload
+  uint8_t payload[buf_sz] = { 0 };
+  size_t psize = (frame.p_size < (size_t) (buf_sz - 1)) ? frame.p_size : (buf_sz - 1);
+  memcpy(payload, frame.payload, psize);
 
-  uint8_t ret = lora::Command::process((uint8_t *) rx_buffer, (size_t) sz, type,
-      (uint8_t *) payload, psize, crc);
+  V_INFO("Received command\n", frame.type);
+  V_INFO("Type    : %d\n", frame.type);
+  if (psize)
+    V_INFO("Payload : %s\n", payload);
+  V_INFO("CRC     : %x\n", frame.crc);
 
-  switch (ret)
+  switch (frame.type)
   {
-    case lora::Command::NO_ERROR:
+    case lora::Command::INFO:
     {
-      V_INFO("Received command\n", type);
-      V_INFO("Type    : %d\n", type);
-      if (psize)
-        V_INFO("Payload : %s\n", payload);
-      V_INFO("CRC     : %x\n", crc);
-
-      switch (type)
-      {
-        case lora::Command::INFO:
-        {
-          V_INFO("Command type is INFO\n");
-
-          lora::command::Info m;
-          m.createFromBuffer((uint8_t *) payload, psize);
-
-          std::cout << "Current configuration:" << std::endl;
-          //std::cout << "\tType    : " << std::dec << (int) m.type() << std::endl;
-          std::cout << "\tAddr    : " << std::dec << (int) m.address() << std::endl;
-          std::cout << "\tFreq    : " << m.frequencyAsString() << " MHz" << std::endl;
-          std::cout << "\tChan    : " << m.channelAsString() << std::endl;
-          std::cout << "\tBW      : " << m.bandwidthAsString() << " KHz" << std::endl;
-          std::cout << "\tCR      : " << m.codingRateAsString() << std::endl;
-          std::cout << "\tSF      : " << m.spreadingFactorAsString() << std::endl;
-          std::cout << "\tSNR     : " << std::dec << (int) m.snr() << std::endl;
-          std::cout << "\tRSSI    : " << std::dec << (int) m.rssi() << std::endl;
-          std::cout << "\tRSSI PCK: " << std::dec << (int) m.rssi_pck() << std::endl;
-        }
-          break;
-
-        case lora::Command::ERROR:
-        {
-          V_INFO("Command type is ERROR\n");
-          lora::command::Error m;
-          m.createFromBuffer((uint8_t *) payload, psize);
+      V_INFO("Command type is INFO\n");
+
+      lora::command::Info m;
+      m.createFromBuffer((uint8_t *) payload, psize);
+
+      std::cout << "Current configuration:" << std::endl;
+      //std::cout << "\tType    : " << std::dec << (int) m.type() << std::endl;
+      std::cout << "\tAddr    : " << std::dec << (int) m.address() << std::endl;
+      std::cout << "\tFreq    : " << m.frequencyAsString() << " MHz" << std::endl;
+      std::cout << "\tChan    : " << m.channelAsString() << std::endl;
+      std::cout << "\tBW      : " << m.bandwidthAsString() << " KHz" << std::endl;
+      std::cout << "\tCR      : " << m.codingRateAsString() << std::endl;
+      std::cout << "\tSF      : " << m.spreadingFactorAsString() << std::endl;
+      std::cout << "\tSNR     : " << std::dec << (int) m.snr() << std::endl;
+      std::cout << "\tRSSI    : " << std::dec << (int) m.rssi() << std::endl;
+      std::cout << "\tRSSI PCK: " << std::dec << (int) m.rssi_pck() << std::endl;
+    }
+      break;
 
-          if (m.error() == "COM_ERROR")
-          {
-            f_ret = COM_ERROR;
-          }
-          else
-          {
-            f_ret = UNKKOWN_ERROR;
-          }
+    case lora::Command::ERROR:
+    {
+      V_INFO("Command type is ERROR\n");
+      lora::command::Error m;
+      m.createFromBuffer((uint8_t *) payload, psize);
 
-          std::cout << "Lo-Ra error : " << m.error() << std::endl;
-        }
-          break;
+      if (m.error() == "COM_ERROR")
+      {
+        f_ret = COM_ERROR;
+      }
+      else
+      {
+        f_ret = UNKKOWN_ERROR;
+      }
 
-        case lora::Command::ACK:
-        {
-          V_INFO("Command type is ACK\n");
+      std::cout << "Lo-Ra error : " << m.error() << std::endl;
+    }
+      break;
 
-          std::cout << "Lo-Ra ACK received" << std::endl;
-        }
-          break;
-      }
+    case lora::Command::ACK:
+    {
+      V_INFO("Command type is ACK\n");
 
+      std::cout << "Lo-Ra ACK received" << std::endl;
     }
       break;
+  }
+
+  return f_ret;
+}
 
+void process_error(uint8_t code)
+{
+  switch (code)
+  {
     case lora::Command::CMD_NOT_FOUND:
     {
       std::cout << "Message not Found!" << std::endl;
@@ -206,7 +203,7 @@ uint8_t process_buffer(uint8_t *rx_buffer, size_t sz)
 
     case lora::Command::INVALID_CRC:
     {
-      std::cerr << "Error: invalid CRC format!" << std::endl;
+      std::cerr << "Error: invalid CRC!" << std::endl;
     }
       break;
 
@@ -217,31 +214,163 @@ uint8_t process_buffer(uint8_t *rx_buffer, size_t sz)
       break;
 
   }
+}
 
-  return f_ret;
+uint8_t process_buffer(uint8_t *rx_buffer, size_t sz)
+{
+  uint8_t payload[buf_sz] = { 0 };
+  uint8_t type = 0;
+  size_t psize = 0;
+  uint16_t crc = 0;
+
+  V_DEBUG("COMMAND: %s\n", msg_string(rx_buffer, sz).c_str());
+
+  uint8_t ret = lora::Command::process((uint8_t *) rx_buffer, (size_t) sz, type,
+      (uint8_t *) payload, psize, crc);
+
+  if (ret != lora::Command::NO_ERROR)
+  {
+    process_error(ret);
+    return NO_ERROR;
+  }
+
+  lora::Frame frame;
+  frame.type = type;
+  frame.data = rx_buffer;
+  frame.size = sz;
+  frame.payload = payload;
+  frame.p_size = psize;
+  frame.crc = crc;
+
+  return process_frame(frame);
 }
 
+/**
+ * @brief Reactor handler that reads the serial device until a deadline.
+ *
+ * It is used by rx_buffer_flush() (bytes are discarded) and by
+ * rx_wait_response() (bytes are saved until EOT is found).
+ */
+class SerialReader: public lora::Reactor::Handler
+{
+  public:
+    SerialReader(lora::Reactor &reactor, lora::Serial &serial, uint8_t *buffer, size_t sz) :
+        m_reactor(reactor), m_serial(serial), m_buffer(buffer), m_sz(sz), m_t(0)
+    {
+    }
+
+    virtual void handleEvent(int fd, uint32_t events)
+    {
+      if (fd != m_serial.fd())
+      {
+        // Deadline fired
+        m_reactor.stop();
+        return;
+      }
+
+      if (m_buffer == 0)
+      {
+        // Flush: received bytes are discarded
+        uint8_t rx_buffer[10] = { 0 };
+        m_serial.receive((char*) rx_buffer, sizeof(rx_buffer));
+        return;
+      }
+
+      ssize_t nb = m_sz - m_t;
+      if (nb == 0)
+      {
+        V_DEBUG("Receiver buffer is full\n");
+        m_reactor.stop();
+        return;
+      }
+
+      ssize_t n = m_serial.receive((char*) &m_buffer[m_t], nb);
+      if (n > 0)
+      {
+        V_DEBUG("Received %d bytes\n", n);
+
+        for (ssize_t i = 0; i < n; i++)
+        {
+          V_DEBUG("[%d] %x\n", m_t + i, m_buffer[m_t + i]);
+          if (m_buffer[m_t + i] == lora::Command::EOT)
+          {
+            V_DEBUG("Found EOT\n");
+            m_reactor.stop();
+          }
+        }
+        m_t += n;
+      }
+    }
+
+    size_t received() const
+    {
+      return m_t;
+    }
+
+  private:
+    //! Event loop
+    lora::Reactor &m_reactor;
+
+    //! Serial device
+    lora::Serial &m_serial;
+
+    //! Receive buffer, NULL to discard bytes
+    uint8_t *m_buffer;
+
+    //! Receive buffer size
+    size_t m_sz;
+
+    //! Number of bytes received
+    size_t m_t;
+};
+
 void rx_buffer_flush (lora::Serial &serial)
 {
   V_INFO("Flush serial receiver buffer\n");
 
-  time_t now;
-  time_t end;
-  size_t n = 0;
+  try
+  {
+    lora::Reactor reactor;
+    SerialReader reader(reactor, serial, NULL, 0);
 
+    reactor.add(serial.fd(), &reader);
+    int tfd = reactor.addTimer(&reader);
+    reactor.armTimer(tfd, (uint64_t) FLUSH_TIMEOUT * 1000000);
 
-  time(&now);
-  end = now + FLUSH_TIMEOUT;
+    reactor.run();
 
-  uint8_t rx_buffer[10];
-  while ((now < end) || n)
+    // Keep reading while bytes are still arriving
+    reactor.removeTimer(tfd);
+    while (reactor.runOnce(0) > 0)
+      ;
+  }
+  catch (lora::Reactor::Exception &e)
+  {
+    V_ERROR("%s\n", e.what());
+  }
+}
+
+size_t rx_wait_response(lora::Serial &serial, uint8_t *buffer, size_t sz, unsigned int timeout)
+{
+  size_t t = 0;
+
+  try
   {
+    lora::Reactor reactor;
+    SerialReader reader(reactor, serial, buffer, sz);
+
+    reactor.add(serial.fd(), &reader);
+    int tfd = reactor.addTimer(&reader);
+    reactor.armTimer(tfd, (uint64_t) timeout * 1000000);
 
-    ssize_t nb = 10;
-    n = serial.receive((char*) rx_buffer, nb);
-    //V_DEBUG("%d %s\n", n, rx_buffer);
-    usleep(100);
-    time(&now);
+    reactor.run();
+
+    t = reader.received();
+  }
+  catch (lora::Reactor::Exception &e)
+  {
+    V_ERROR("%s\n", e.what());
   }
 
+  return t;
 }
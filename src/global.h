@@ -16,6 +16,7 @@
 #include "lora/utils.h"
 #include "lora/serial.h"
 #include "lora/command.h"
+#include "lora/parser.h"
 
 /*****************************************************************************
  * MACROS
@@ -81,7 +82,7 @@ enum _COMMAND
 };
 
 /// Default maximum buffer size
-const uint8_t buf_sz = 255;
+const size_t buf_sz = 255;
 
 
 /*****************************************************************************
@@ -160,6 +161,28 @@ enum _proces_error_codes
  */
 uint8_t process_buffer(uint8_t *rx_buffer, size_t sz);
 
+/**
+ * @brief Processes a Lo-Ra command found by the frame parser.
+ *
+ * This function prints the information of the command, as process_buffer()
+ * does for a command found in a buffer.
+ *
+ * @param[in] frame view of the command.
+ *
+ * @returns COM_ERROR if the command is a COM_ERROR notification, an error
+ * code of _proces_error_codes enum otherwise.
+ */
+uint8_t process_frame(const lora::Frame &frame);
+
+/**
+ * @brief Prints the description of an error returned while looking for a
+ * Lo-Ra command.
+ *
+ * @param[in] code error code, according to lora::Command::_ERROR_CODE enum.
+ *
+ */
+void process_error(uint8_t code);
+
 /**
  * @brief Reads all bytes present into the serial receive buffer.
  *
@@ -170,4 +193,21 @@ uint8_t process_buffer(uint8_t *rx_buffer, size_t sz);
  *
  */
 void rx_buffer_flush (lora::Serial &serial);
+
+/**
+ * @brief Receives a response from the serial device.
+ *
+ * This function waits for bytes from the serial device and stores them into
+ * the buffer until an EOT character is received, the buffer is full or the
+ * timeout expires. The calling thread sleeps until bytes arrive or the
+ * deadline fires.
+ *
+ * @param[out] serial serial device.
+ * @param[out] buffer buffer where received bytes are saved.
+ * @param[in] sz buffer size.
+ * @param[in] timeout maximum waiting time in seconds.
+ *
+ * @returns the number of bytes received.
+ */
+size_t rx_wait_response(lora::Serial &serial, uint8_t *buffer, size_t sz, unsigned int timeout);
 #endif /* GLOBAL_H_ */
@@ -0,0 +1,161 @@
+//============================================================================
+// Name        : linereader.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Splits the byte stream of a pipe in lines
+//============================================================================
+
+#include "linereader.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+LineReader::LineReader(size_t maxLine) :
+    m_maxLine(maxLine), m_scan(0), m_line(0), m_discard(false), m_report(false), m_lines(0), m_oversize(
+        0), m_copied(0), m_bytes(0)
+{
+  // A line and its new line
+  if (!m_ring.mirror(maxLine + 1))
+  {
+    m_ring.resize(maxLine + 1);
+    m_copy.resize(maxLine);
+  }
+}
+
+LineReader::~LineReader()
+{
+}
+
+ssize_t LineReader::fill(int fd)
+{
+  CircularBuffer<uint8_t>::Span first;
+  CircularBuffer<uint8_t>::Span second;
+  m_ring.prepare(first, second);
+
+  if (first.size == 0)
+  {
+    if (m_line)
+    {
+      errno = ENOBUFS;
+      return -1;
+    }
+
+    // Only a part of a line too long
+    m_ring.consume(m_ring.size());
+    m_scan = 0;
+    if (!m_discard)
+    {
+      m_discard = true;
+      m_report = true;
+      m_oversize++;
+    }
+    m_ring.prepare(first, second);
+  }
+
+  ssize_t n = read(fd, first.data, first.size);
+  if (n > 0)
+  {
+    m_ring.commit(n);
+    m_bytes += n;
+  }
+
+  return n;
+}
+
+size_t LineReader::scan(const CircularBuffer<uint8_t>::Span &first,
+    const CircularBuffer<uint8_t>::Span &second, size_t size)
+{
+  if (m_scan < first.size)
+  {
+    const uint8_t *p = (const uint8_t *) memchr(&first.data[m_scan], '\n', first.size - m_scan);
+    if (p)
+      return p - first.data;
+
+    m_scan = first.size;
+  }
+
+  if (m_scan < size)
+  {
+    size_t offset = m_scan - first.size;
+    const uint8_t *p = (const uint8_t *) memchr(&second.data[offset], '\n', second.size - offset);
+    if (p)
+      return first.size + (p - second.data);
+  }
+
+  m_scan = size;
+  return size;
+}
+
+int LineReader::next(const uint8_t *&line, size_t &len)
+{
+  // The last line returned is deleted
+  m_ring.consume(m_line);
+  m_line = 0;
+
+  while (true)
+  {
+    if (m_report)
+    {
+      m_report = false;
+      return LINE_OVERSIZE;
+    }
+
+    CircularBuffer<uint8_t>::Span first;
+    CircularBuffer<uint8_t>::Span second;
+    size_t size = m_ring.peek(first, second);
+
+    size_t pos = scan(first, second, size);
+
+    if (pos == size)
+    {
+      // Incomplete line: it is dropped as soon as it is too long
+      if (m_discard || size > m_maxLine)
+      {
+        m_ring.consume(size);
+        m_scan = 0;
+        if (!m_discard)
+        {
+          m_discard = true;
+          m_oversize++;
+          return LINE_OVERSIZE;
+        }
+      }
+      return LINE_NONE;
+    }
+
+    m_scan = 0;
+
+    if (m_discard || pos > m_maxLine)
+    {
+      // End of a line too long
+      m_ring.consume(pos + 1);
+      if (!m_discard)
+      {
+        m_oversize++;
+        return LINE_OVERSIZE;
+      }
+      m_discard = false;
+      continue;
+    }
+
+    m_line = pos + 1;
+    m_lines++;
+    len = pos;
+
+    if (pos <= first.size)
+    {
+      line = first.data;
+    }
+    else
+    {
+      memcpy(&m_copy[0], first.data, first.size);
+      memcpy(&m_copy[first.size], second.data, pos - first.size);
+      line = &m_copy[0];
+      m_copied++;
+    }
+
+    return LINE_OK;
+  }
+}
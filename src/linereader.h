@@ -0,0 +1,172 @@
+//============================================================================
+// Name        : linereader.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Splits the byte stream of a pipe in lines
+//============================================================================
+#ifndef LINEREADER_H_
+#define LINEREADER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <vector>
+#include "circularbuffer.h"
+
+/**
+ * @brief The LineReader class splits the byte stream of a pipe (or any file
+ * descriptor) in lines.
+ *
+ * fill() reads from the descriptor directly in the free space of a ring
+ * buffer and next() returns the complete lines in place: the new lines are
+ * found with memchr on the contiguous blocks of the ring and the bytes are
+ * scanned only once, also when a line is split across several reads. The
+ * ring is mirrored (CircularBuffer::mirror()) when possible, so every line
+ * is contiguous; otherwise a line that wraps around the end of the ring is
+ * copied.
+ *
+ * Lines longer than the maximum length are discarded as soon as the limit
+ * is exceeded (the rest of the line is skipped when it arrives) and
+ * next() reports them once.
+ *
+ */
+class LineReader
+{
+  public:
+    /**
+     * @brief Results of next().
+     */
+    enum _LINE_STATUS
+    {
+      /// No complete line: more bytes are needed.
+      LINE_NONE = 0,
+
+      /// A line is available.
+      LINE_OK,
+
+      /// A line longer than the maximum length has been discarded.
+      LINE_OVERSIZE,
+    };
+
+    /**
+     * @brief Creates a line reader.
+     *
+     * @param[in] maxLine maximum length of a line (new line excluded).
+     */
+    LineReader(size_t maxLine);
+
+    /**
+     * @brief Destroys the line reader.
+     *
+     */
+    virtual ~LineReader();
+
+    /**
+     * @brief Reads bytes from a file descriptor.
+     *
+     * The bytes are read in the free space of the ring with one read()
+     * call. The line returned by the last call of next() isn't modified.
+     *
+     * @param[in] fd file descriptor.
+     *
+     * @returns number of bytes read, 0 at the end of file, -1 on error
+     * (errno is set; ENOBUFS if the ring is full).
+     */
+    ssize_t fill(int fd);
+
+    /**
+     * @brief Gets the next complete line.
+     *
+     * The line returned by the previous call is deleted from the ring, so
+     * a line is valid until the next call of next().
+     *
+     * @param[out] line first byte of the line (new line excluded).
+     * @param[out] len length of the line.
+     *
+     * @returns LINE_OK if a line is found, LINE_OVERSIZE if a line too
+     * long has been discarded, LINE_NONE if there isn't a complete line.
+     */
+    int next(const uint8_t *&line, size_t &len);
+
+    /**
+     * @brief Returns true if the ring is mirrored (lines are never copied).
+     *
+     */
+    bool mirrored() const
+    {
+      return m_ring.mirrored();
+    }
+
+    /**
+     * @brief Gets the number of bytes waiting in the ring.
+     *
+     */
+    size_t pending()
+    {
+      return m_ring.size();
+    }
+
+    /// Number of lines returned.
+    unsigned long lines() const
+    {
+      return m_lines;
+    }
+
+    /// Number of lines discarded because too long.
+    unsigned long oversize() const
+    {
+      return m_oversize;
+    }
+
+    /// Number of lines copied because they wrap around the ring.
+    unsigned long copied() const
+    {
+      return m_copied;
+    }
+
+    /// Number of bytes read.
+    unsigned long long bytes() const
+    {
+      return m_bytes;
+    }
+
+  private:
+    /**
+     * @brief Looks for a new line after the bytes already scanned.
+     *
+     * @returns position of the new line, or the number of bytes if it
+     * isn't found.
+     */
+    size_t scan(const CircularBuffer<uint8_t>::Span &first,
+        const CircularBuffer<uint8_t>::Span &second, size_t size);
+
+    //! Maximum length of a line
+    size_t m_maxLine;
+
+    //! Bytes received
+    CircularBuffer<uint8_t> m_ring;
+
+    //! Copy of a line that wraps around the ring
+    std::vector<uint8_t> m_copy;
+
+    //! Bytes of the ring already scanned (no new line)
+    size_t m_scan;
+
+    //! Bytes of the last line returned (new line included)
+    size_t m_line;
+
+    //! True while the rest of a line too long is skipped
+    bool m_discard;
+
+    //! True if a line too long has to be reported
+    bool m_report;
+
+    //! Statistics
+    unsigned long m_lines;
+    unsigned long m_oversize;
+    unsigned long m_copied;
+    unsigned long long m_bytes;
+};
+
+#endif /* LINEREADER_H_ */
@@ -0,0 +1,58 @@
+//============================================================================
+// Name        : airtime.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Time on air of Lo-Ra frames and regional parameters
+//============================================================================
+
+#include "airtime.h"
+
+namespace lora
+{
+  // Reference values of the Semtech LoRa calculator (20 bytes, CR 4/5)
+  static_assert(Airtime::compute(7, 125, 5, 20) == 56576, "SF7 time on air");
+  static_assert(Airtime::compute(12, 125, 5, 20) == 1318912, "SF12 time on air");
+
+  // The maximum lengths of the US band respect the dwell time
+  static_assert(Airtime::compute(7, 125, 5, US900.payload(7) + Airtime::FRAME_OVERHEAD)
+      <= US900.dwell, "SF7 dwell time");
+  static_assert(Airtime::compute(8, 125, 5, US900.payload(8) + Airtime::FRAME_OVERHEAD)
+      <= US900.dwell, "SF8 dwell time");
+  static_assert(Airtime::compute(9, 125, 5, US900.payload(9) + Airtime::FRAME_OVERHEAD)
+      <= US900.dwell, "SF9 dwell time");
+  static_assert(Airtime::compute(10, 125, 5, US900.payload(10) + Airtime::FRAME_OVERHEAD)
+      <= US900.dwell, "SF10 dwell time");
+
+  /*************************************************************************
+   * class Airtime
+   ************************************************************************/
+  uint64_t Airtime::compute(ConfigCommand &cfg, size_t len)
+  {
+    uint8_t sf = cfg.spreadingFactor(false);
+    uint16_t bw = cfg.bandwidth(false);
+    uint8_t cr = cfg.codingRate(false);
+
+    return compute(sf, bw, cr, len + FRAME_OVERHEAD);
+  }
+
+  /*************************************************************************
+   * struct Region
+   ************************************************************************/
+  const Region* Region::find(uint8_t band)
+  {
+    switch (band)
+    {
+      case ConfigCommand::F_868:
+        return &EU868;
+
+      case ConfigCommand::F_900:
+        return &US900;
+
+      default:
+        break;
+    }
+    return 0;
+  }
+
+} /* namespace lora */
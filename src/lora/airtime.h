@@ -0,0 +1,312 @@
+//============================================================================
+// Name        : airtime.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Time on air of Lo-Ra frames and regional parameters
+//============================================================================
+#ifndef _LORA_AIRTIME_H_
+#define _LORA_AIRTIME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "interfaces.h"
+
+namespace lora
+{
+  /**
+   * @brief The Airtime class calculates how long a frame occupies the
+   * channel.
+   *
+   * The time on air is given by the Semtech formula (SX1272 datasheet,
+   * section 4.1.1.7):
+   *
+   *    Tsym = 2^SF / BW
+   *    Tpreamble = (Npreamble + 4.25) * Tsym
+   *    Npayload = 8 + max(ceil((8PL - 4SF + 28 + 16CRC - 20IH) / (4(SF - 2DE))) * CR, 0)
+   *    Tframe = Tpreamble + Npayload * Tsym
+   *
+   * where PL is the number of bytes sent by the radio, CR is 5 to 8 (coding
+   * rate 4/CR), CRC is 1 (the module enables the payload CRC), IH is 1 for
+   * the implicit header (required by SF6) and DE is 1 when the low data rate
+   * optimization is enabled (symbols longer than 16 ms).
+   *
+   * All symbol times are a whole number of microseconds, so the results are
+   * exact. The functions can be used in constant expressions.
+   *
+   */
+  class Airtime
+  {
+    public:
+      /// Preamble length programmed by the module (symbols).
+      static const uint16_t PREAMBLE = 8;
+
+      /// Bytes added by the module to a message: destination, source, packet number, length and retry.
+      static const size_t FRAME_OVERHEAD = 5;
+
+      /// Longest symbol without low data rate optimization (usec).
+      static const uint32_t LOW_DATA_RATE_SYMBOL = 16000;
+
+      /**
+       * @brief Calculates the symbol time.
+       *
+       * @param[in] sf spreading factor (6 to 12).
+       * @param[in] bw bandwidth in kHz (125, 250 or 500).
+       *
+       * @returns symbol time in usec, 0 if the parameters are not valid.
+       */
+      static constexpr uint32_t symbolTime(uint8_t sf, uint16_t bw)
+      {
+        return (sf < 6 || sf > 12 || (bw != 125 && bw != 250 && bw != 500)) ?
+            0 : ((uint32_t) 1000 << sf) / bw;
+      }
+
+      /**
+       * @brief Returns true if the low data rate optimization is enabled.
+       *
+       * @param[in] sf spreading factor (6 to 12).
+       * @param[in] bw bandwidth in kHz (125, 250 or 500).
+       *
+       */
+      static constexpr bool lowDataRate(uint8_t sf, uint16_t bw)
+      {
+        return symbolTime(sf, bw) > LOW_DATA_RATE_SYMBOL;
+      }
+
+      /**
+       * @brief Calculates the number of payload symbols (header included).
+       *
+       * @param[in] sf spreading factor (6 to 12).
+       * @param[in] bw bandwidth in kHz (125, 250 or 500).
+       * @param[in] cr coding rate (5 to 8, the rate is 4/cr).
+       * @param[in] payload bytes sent by the radio.
+       *
+       * @returns number of symbols.
+       */
+      static constexpr uint32_t symbols(uint8_t sf, uint16_t bw, uint8_t cr, size_t payload)
+      {
+        const long ih = (sf == 6) ? 1 : 0;
+        const long de = lowDataRate(sf, bw) ? 1 : 0;
+        const long num = 8 * (long) payload - 4 * sf + 28 + 16 - 20 * ih;
+        const long den = 4 * (sf - 2 * de);
+
+        return 8 + ((num > 0) ? ((num + den - 1) / den) * cr : 0);
+      }
+
+      /**
+       * @brief Calculates the time on air of a frame.
+       *
+       * @param[in] sf spreading factor (6 to 12).
+       * @param[in] bw bandwidth in kHz (125, 250 or 500).
+       * @param[in] cr coding rate (5 to 8, the rate is 4/cr).
+       * @param[in] payload bytes sent by the radio.
+       * @param[in] preamble preamble length (symbols).
+       *
+       * @returns time on air in usec, 0 if the parameters are not valid.
+       */
+      static constexpr uint64_t compute(uint8_t sf, uint16_t bw, uint8_t cr, size_t payload,
+          uint16_t preamble = PREAMBLE)
+      {
+        return (symbolTime(sf, bw) == 0 || cr < 5 || cr > 8) ?
+            0 :
+            ((uint64_t) (4 * preamble + 17) * symbolTime(sf, bw)) / 4
+                + (uint64_t) symbols(sf, bw, cr, payload) * symbolTime(sf, bw);
+      }
+
+      /**
+       * @brief Calculates the time on air of a message sent with the
+       * settings of a configuration command.
+       *
+       * The bytes added by the module (FRAME_OVERHEAD) are included.
+       *
+       * @param[in] cfg configuration (INFO or SET command).
+       * @param[in] len message length.
+       *
+       * @returns time on air in usec, 0 if the settings are unknown.
+       */
+      static uint64_t compute(ConfigCommand &cfg, size_t len);
+  };
+
+  /**
+   * @brief Frequency sub-band with a duty cycle limit.
+   */
+  struct SubBand
+  {
+      /// Lowest frequency (kHz).
+      uint32_t low;
+
+      /// Highest frequency (kHz).
+      uint32_t high;
+
+      /// Maximum duty cycle (per mille, 1000 if there is no limit).
+      uint16_t duty;
+  };
+
+  /**
+   * @brief Channel of the module.
+   */
+  struct Channel
+  {
+      /// Channel code (lora::ConfigCommand::_FREQUENCY_CHANNEL).
+      uint8_t code;
+
+      /// Center frequency (kHz).
+      uint32_t frequency;
+
+      /// Index of the sub-band.
+      uint8_t subBand;
+  };
+
+  /**
+   * @brief Regional parameters of a frequency band.
+   */
+  struct Region
+  {
+      /// Number of spreading factors (6 to 12).
+      static const size_t N_SF = 7;
+
+      /// Region name.
+      const char *name;
+
+      /// Frequency band code (lora::ConfigCommand::_FREQUENCY).
+      uint8_t band;
+
+      /// Channels of the module.
+      const Channel *channels;
+
+      /// Number of channels.
+      size_t n_channels;
+
+      /// Sub-bands.
+      const SubBand *subBands;
+
+      /// Number of sub-bands.
+      size_t n_subBands;
+
+      /// Maximum message length at 125 kHz for SF6 to SF12 (0 if the SF isn't allowed).
+      uint8_t maxPayload[N_SF];
+
+      /// Maximum time on air of a frame (usec, 0 if there is no limit).
+      uint32_t dwell;
+
+      /**
+       * @brief Gets a channel.
+       *
+       * @param[in] code channel code.
+       *
+       * @returns channel, 0 if the channel isn't in the band.
+       */
+      constexpr const Channel* channel(uint8_t code) const
+      {
+        for (size_t i = 0; i < n_channels; i++)
+        {
+          if (channels[i].code == code)
+            return &channels[i];
+        }
+        return 0;
+      }
+
+      /**
+       * @brief Gets the sub-band of a channel.
+       *
+       * @param[in] code channel code.
+       *
+       * @returns sub-band, 0 if the channel isn't in the band.
+       */
+      constexpr const SubBand* subBand(uint8_t code) const
+      {
+        return (channel(code)) ? &subBands[channel(code)->subBand] : 0;
+      }
+
+      /**
+       * @brief Gets the maximum message length for a spreading factor.
+       *
+       * @param[in] sf spreading factor (6 to 12).
+       *
+       * @returns maximum length, 0 if the spreading factor isn't allowed.
+       */
+      constexpr uint8_t payload(uint8_t sf) const
+      {
+        return (sf < 6 || sf > 12) ? 0 : maxPayload[sf - 6];
+      }
+
+      /**
+       * @brief Gets the regional parameters of a frequency band.
+       *
+       * @param[in] band frequency band code.
+       *
+       * @returns region, 0 if the band is unknown.
+       */
+      static const Region* find(uint8_t band);
+  };
+
+  /// Channels of the 868 MHz band (Libelium SX1272 module).
+  constexpr Channel EU868_CHANNELS[] =
+  {
+    { ConfigCommand::CH_10, 865200, 1 },
+    { ConfigCommand::CH_11, 865500, 1 },
+    { ConfigCommand::CH_12, 865800, 1 },
+    { ConfigCommand::CH_13, 866100, 1 },
+    { ConfigCommand::CH_14, 866400, 1 },
+    { ConfigCommand::CH_15, 866700, 1 },
+    { ConfigCommand::CH_16, 867000, 1 },
+    { ConfigCommand::CH_17, 868000, 2 },
+  };
+
+  /// Sub-bands of the 863-870 MHz band (ERC Recommendation 70-03, annex 1).
+  constexpr SubBand EU868_SUBBANDS[] =
+  {
+    { 863000, 865000, 1 },
+    { 865000, 868000, 10 },
+    { 868000, 868600, 10 },
+    { 868700, 869200, 1 },
+    { 869400, 869650, 100 },
+    { 869700, 870000, 10 },
+  };
+
+  /// Channels of the 900 MHz band (Libelium SX1272 module).
+  constexpr Channel US900_CHANNELS[] =
+  {
+    { ConfigCommand::CH_00, 903080, 0 },
+    { ConfigCommand::CH_01, 905240, 0 },
+    { ConfigCommand::CH_02, 907400, 0 },
+    { ConfigCommand::CH_03, 909560, 0 },
+    { ConfigCommand::CH_04, 911720, 0 },
+    { ConfigCommand::CH_05, 913880, 0 },
+    { ConfigCommand::CH_06, 916040, 0 },
+    { ConfigCommand::CH_07, 918200, 0 },
+    { ConfigCommand::CH_08, 920360, 0 },
+    { ConfigCommand::CH_09, 922520, 0 },
+    { ConfigCommand::CH_10, 924680, 0 },
+    { ConfigCommand::CH_11, 926840, 0 },
+    { ConfigCommand::CH_12, 915000, 0 },
+  };
+
+  /// The 902-928 MHz band has no duty cycle limit (FCC part 15.247).
+  constexpr SubBand US900_SUBBANDS[] =
+  {
+    { 902000, 928000, 1000 },
+  };
+
+  /// European 868 MHz band. Maximum lengths of the LoRaWAN regional parameters (DR5 to DR0, SF6 as SF7).
+  constexpr Region EU868 =
+  {
+    "EU868", ConfigCommand::F_868,
+    EU868_CHANNELS, sizeof(EU868_CHANNELS) / sizeof(EU868_CHANNELS[0]),
+    EU868_SUBBANDS, sizeof(EU868_SUBBANDS) / sizeof(EU868_SUBBANDS[0]),
+    { 250, 250, 250, 123, 59, 59, 59 },
+    0
+  };
+
+  /// US 900 MHz band. Maximum lengths of the LoRaWAN regional parameters (DR3 to DR0, SF6 as SF7), 400 ms dwell time.
+  constexpr Region US900 =
+  {
+    "US900", ConfigCommand::F_900,
+    US900_CHANNELS, sizeof(US900_CHANNELS) / sizeof(US900_CHANNELS[0]),
+    US900_SUBBANDS, sizeof(US900_SUBBANDS) / sizeof(US900_SUBBANDS[0]),
+    { 250, 250, 133, 61, 19, 0, 0 },
+    400000
+  };
+
+} /* namespace lora */
+#endif /* _LORA_AIRTIME_H_ */
@@ -0,0 +1,409 @@
+//============================================================================
+// Name        : capture.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : In-memory capture of the bytes of a serial device
+//============================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "capture.h"
+
+namespace lora
+{
+  const char Capture::MAGIC[8] = { 'L', 'O', 'R', 'A', 'C', 'A', 'P', '\0' };
+
+  /**
+   * @brief Writes all bytes in a file.
+   *
+   * @returns false in case of errors.
+   */
+  static bool writeAll(int fd, const uint8_t *buffer, size_t size)
+  {
+    while (size)
+    {
+      ssize_t n = ::write(fd, buffer, size);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      buffer += n;
+      size -= n;
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Appends a record to a buffer.
+   *
+   * @returns size of the record.
+   */
+  static size_t encode(uint8_t *buffer, uint64_t time, uint8_t dir, const uint8_t *data,
+      uint16_t size)
+  {
+    memcpy(buffer, &time, sizeof(time));
+    memcpy(&buffer[8], &size, sizeof(size));
+    buffer[10] = dir;
+    buffer[11] = 0;
+    memcpy(&buffer[Capture::RECORD_HEADER], data, size);
+
+    return Capture::RECORD_HEADER + size;
+  }
+
+  Capture::Capture(size_t slots) :
+      m_slots(0), m_mask(0), m_running(false), m_stop(false), m_sync(false), m_ok(true),
+          m_flushed(0), m_fd(-1), m_size(0), m_maxSize(0), m_files(0), m_period(0)
+  {
+    static_assert(sizeof(Slot) == 64, "A capture slot is a cache line");
+
+    size_t c = 1;
+    while (c < slots)
+      c <<= 1;
+
+    m_slots = new Slot[c];
+    m_mask = c - 1;
+    for (size_t i = 0; i < c; i++)
+    {
+      m_slots[i].seq.store(0, std::memory_order_relaxed);
+    }
+
+    m_head.store(0, std::memory_order_relaxed);
+    m_lost.store(0, std::memory_order_relaxed);
+
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_wake, NULL);
+  }
+
+  Capture::~Capture()
+  {
+    stop();
+
+    pthread_cond_destroy(&m_wake);
+    pthread_mutex_destroy(&m_lock);
+
+    delete[] m_slots;
+  }
+
+  uint64_t Capture::now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+  void Capture::record(Direction dir, const void *data, size_t size)
+  {
+    if (size == 0)
+      return;
+
+    const uint8_t *p = (const uint8_t *) data;
+    uint64_t t = now();
+
+    // All the slots of the record at once
+    uint64_t n = (size + SLOT_DATA - 1) / SLOT_DATA;
+    uint64_t pos = m_head.fetch_add(n, std::memory_order_relaxed);
+
+    for (uint64_t i = 0; i < n; i++, pos++)
+    {
+      Slot &s = m_slots[pos & m_mask];
+      size_t len = (size > SLOT_DATA) ? SLOT_DATA : size;
+
+      // Readers see 0 until the slot is complete
+      s.seq.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      s.time = t;
+      s.size = len;
+      s.dir = dir;
+      memcpy(s.data, p, len);
+
+      s.seq.store(pos + 1, std::memory_order_release);
+
+      p += len;
+      size -= len;
+    }
+  }
+
+  ssize_t Capture::write(int fd, uint64_t &pos, uint64_t &lost)
+  {
+    uint8_t buffer[16 * 1024];
+    size_t len = 0;
+    ssize_t total = 0;
+    uint64_t gap = 0;
+
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    if (head - pos > m_mask + 1)
+    {
+      gap = head - (m_mask + 1) - pos;
+      pos = head - (m_mask + 1);
+    }
+
+    while (pos < head)
+    {
+      Slot &s = m_slots[pos & m_mask];
+
+      uint64_t seq = s.seq.load(std::memory_order_acquire);
+      if (seq < pos + 1)
+        break;
+
+      uint64_t time = s.time;
+      uint16_t size = s.size;
+      uint8_t dir = s.dir;
+      uint8_t data[SLOT_DATA];
+      memcpy(data, s.data, sizeof(data));
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq != pos + 1 || s.seq.load(std::memory_order_relaxed) != seq || size > SLOT_DATA)
+      {
+        // Overwritten by a newer record
+        gap++;
+        pos++;
+        continue;
+      }
+
+      if (len + 2 * (RECORD_HEADER + SLOT_DATA) > sizeof(buffer))
+      {
+        if (!writeAll(fd, buffer, len))
+          return -1;
+        total += len;
+        len = 0;
+      }
+
+      if (gap)
+      {
+        len += encode(&buffer[len], time, LOST, (const uint8_t *) &gap, sizeof(gap));
+        lost += gap;
+        gap = 0;
+      }
+
+      len += encode(&buffer[len], time, dir, data, size);
+      pos++;
+    }
+
+    if (gap)
+    {
+      uint64_t t = now();
+      len += encode(&buffer[len], t, LOST, (const uint8_t *) &gap, sizeof(gap));
+      lost += gap;
+    }
+
+    if (len && !writeAll(fd, buffer, len))
+      return -1;
+
+    return total + len;
+  }
+
+  int Capture::create(const std::string &path)
+  {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+      return -1;
+
+    uint8_t header[HEADER_SIZE] = { 0 };
+    uint32_t version = VERSION;
+    memcpy(header, MAGIC, sizeof(MAGIC));
+    memcpy(&header[sizeof(MAGIC)], &version, sizeof(version));
+
+    if (!writeAll(fd, header, sizeof(header)))
+    {
+      close(fd);
+      return -1;
+    }
+
+    return fd;
+  }
+
+  bool Capture::save(const std::string &path)
+  {
+    int fd = create(path);
+    if (fd < 0)
+      return false;
+
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t pos = (head > m_mask + 1) ? head - (m_mask + 1) : 0;
+    uint64_t lost = 0;
+
+    bool ok = (write(fd, pos, lost) >= 0);
+
+    return (close(fd) == 0) && ok;
+  }
+
+  bool Capture::rotate()
+  {
+    if (m_maxSize == 0 || m_size < m_maxSize)
+      return true;
+
+    close(m_fd);
+    m_fd = -1;
+
+    for (unsigned int i = m_files; i > 1; i--)
+    {
+      char from[16];
+      char to[16];
+      snprintf(from, sizeof(from), ".%u", i - 1);
+      snprintf(to, sizeof(to), ".%u", i);
+      rename((m_path + from).c_str(), (m_path + to).c_str());
+    }
+
+    if (m_files)
+      rename(m_path.c_str(), (m_path + ".1").c_str());
+
+    m_fd = create(m_path);
+    m_size = HEADER_SIZE;
+
+    return m_fd >= 0;
+  }
+
+  bool Capture::start(const std::string &path, size_t maxSize, unsigned int files,
+      unsigned int period)
+  {
+    if (m_running)
+      return false;
+
+    m_fd = create(path);
+    if (m_fd < 0)
+      return false;
+
+    // The traffic already in the ring is written too
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    m_flushed = (head > m_mask + 1) ? head - (m_mask + 1) : 0;
+
+    m_path = path;
+    m_size = HEADER_SIZE;
+    m_maxSize = maxSize;
+    m_files = files;
+    m_period = (period) ? period : 1;
+    m_stop = false;
+    m_sync = false;
+    m_ok = true;
+
+    if (pthread_create(&m_flusher, NULL, flusherFunction, this))
+    {
+      close(m_fd);
+      m_fd = -1;
+      return false;
+    }
+
+    m_running = true;
+    return true;
+  }
+
+  bool Capture::sync()
+  {
+    pthread_mutex_lock(&m_lock);
+
+    if (!m_running || m_stop)
+    {
+      pthread_mutex_unlock(&m_lock);
+      return false;
+    }
+
+    m_sync = true;
+    pthread_cond_broadcast(&m_wake);
+    while (m_sync)
+    {
+      pthread_cond_wait(&m_wake, &m_lock);
+    }
+    bool ok = m_ok;
+
+    pthread_mutex_unlock(&m_lock);
+
+    return ok;
+  }
+
+  void Capture::stop()
+  {
+    pthread_mutex_lock(&m_lock);
+    bool running = m_running;
+    m_stop = true;
+    pthread_cond_broadcast(&m_wake);
+    pthread_mutex_unlock(&m_lock);
+
+    if (!running)
+      return;
+
+    pthread_join(m_flusher, NULL);
+    m_running = false;
+
+    if (m_fd >= 0)
+      close(m_fd);
+    m_fd = -1;
+  }
+
+  void* Capture::flusherFunction(void *arg)
+  {
+    Capture *c = (Capture *) arg;
+
+    pthread_mutex_lock(&c->m_lock);
+    while (true)
+    {
+      if (!c->m_stop && !c->m_sync)
+      {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t ns = ts.tv_nsec + (uint64_t) c->m_period * 1000000;
+        ts.tv_sec += ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+        pthread_cond_timedwait(&c->m_wake, &c->m_lock, &ts);
+      }
+
+      uint64_t lost = 0;
+      ssize_t n = (c->m_fd >= 0) ? c->write(c->m_fd, c->m_flushed, lost) : -1;
+      if (n > 0)
+        c->m_size += n;
+      c->m_lost.fetch_add(lost, std::memory_order_relaxed);
+      c->m_ok = (n >= 0) && c->rotate();
+
+      if (c->m_sync)
+      {
+        c->m_sync = false;
+        pthread_cond_broadcast(&c->m_wake);
+      }
+
+      if (c->m_stop)
+        break;
+    }
+    pthread_mutex_unlock(&c->m_lock);
+
+    return NULL;
+  }
+
+  bool Capture::checkHeader(const uint8_t *buffer, size_t size)
+  {
+    uint32_t version = 0;
+    if (size < HEADER_SIZE || memcmp(buffer, MAGIC, sizeof(MAGIC)) != 0)
+      return false;
+
+    memcpy(&version, &buffer[sizeof(MAGIC)], sizeof(version));
+    return version == VERSION;
+  }
+
+  size_t Capture::decode(const uint8_t *buffer, size_t size, Record &record)
+  {
+    if (size < RECORD_HEADER)
+      return 0;
+
+    uint16_t len = 0;
+    memcpy(&record.time, buffer, sizeof(record.time));
+    memcpy(&len, &buffer[8], sizeof(len));
+    record.dir = buffer[10];
+
+    if (size < RECORD_HEADER + len)
+      return 0;
+
+    record.data = &buffer[RECORD_HEADER];
+    record.size = len;
+
+    return RECORD_HEADER + len;
+  }
+
+} /* namespace lora */
@@ -0,0 +1,340 @@
+//============================================================================
+// Name        : capture.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : In-memory capture of the bytes of a serial device
+//============================================================================
+#ifndef _LORA_CAPTURE_H_
+#define _LORA_CAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <atomic>
+#include <string>
+
+namespace lora
+{
+  /**
+   * @brief The Capture class records the bytes sent and received on a serial
+   * device (see Serial::setCapture()) in a ring in memory.
+   *
+   * Every send or receive operation is a record: direction, time (monotonic
+   * clock, nanoseconds) and bytes. A record is stored in one or more slots
+   * of 64 bytes (SLOT_DATA bytes of data each). Recording is lock-free and
+   * can be done by several threads: a thread takes a slot with an atomic
+   * increment of the head and fills it; the sequence number of the slot is
+   * cleared while it is written and set to its position + 1 when it is
+   * complete (seqlock). When the ring is full the oldest slots are
+   * overwritten, so the ring always holds the last traffic.
+   *
+   * The ring is written in a capture file on demand (save(), the whole
+   * ring) or continuously by a flusher thread (start(), the new slots every
+   * period), rotating the file when it exceeds a size. Readers copy a slot
+   * and check its sequence number again: slots overwritten before they are
+   * written in the file are reported with a LOST record.
+   *
+   * A capture file starts with a header of HEADER_SIZE bytes (MAGIC, format
+   * version, reserved) followed by records: time (8 bytes), size (2 bytes),
+   * direction (1 byte), reserved (1 byte) and the bytes. Fields are in host
+   * byte order. The data of a LOST record is the number of slots lost (8
+   * bytes).
+   *
+   */
+  class Capture
+  {
+    public:
+      /**
+       * @brief Direction of a record.
+       */
+      enum Direction
+      {
+        /// Bytes written on the device
+        TX = 0,
+
+        /// Bytes read from the device
+        RX,
+
+        /// Slots overwritten before being saved
+        LOST,
+      };
+
+      /**
+       * @brief Record of a capture file.
+       */
+      struct Record
+      {
+          /// Time in nanoseconds (CLOCK_MONOTONIC).
+          uint64_t time;
+
+          /// Direction (Direction).
+          uint8_t dir;
+
+          /// Bytes (in the file).
+          const uint8_t *data;
+
+          /// Number of bytes.
+          size_t size;
+      };
+
+      /// Bytes of data of a slot.
+      static const size_t SLOT_DATA = 44;
+
+      /// Default number of slots (1 MB).
+      static const size_t DEFAULT_SLOTS = 16384;
+
+      /// Size of the file header.
+      static const size_t HEADER_SIZE = 16;
+
+      /// Size of the header of a record.
+      static const size_t RECORD_HEADER = 12;
+
+      /// Version of the file format.
+      static const uint32_t VERSION = 1;
+
+      /// First bytes of a capture file.
+      static const char MAGIC[8];
+
+      /**
+       * @brief Creates a capture.
+       *
+       * @param[in] slots minimum number of slots (rounded up to a power of two).
+       */
+      explicit Capture(size_t slots = DEFAULT_SLOTS);
+
+      /**
+       * @brief Destroys the capture (the flusher thread is stopped).
+       *
+       */
+      ~Capture();
+
+      /**
+       * @brief Records bytes (lock-free, any thread).
+       *
+       * @param[in] dir direction (TX or RX).
+       * @param[in] data bytes.
+       * @param[in] size number of bytes.
+       */
+      void record(Direction dir, const void *data, size_t size);
+
+      /**
+       * @brief Writes the whole ring in a new capture file.
+       *
+       * @param[in] path capture file (replaced).
+       *
+       * @returns false if the file can't be written.
+       */
+      bool save(const std::string &path);
+
+      /**
+       * @brief Starts the flusher thread.
+       *
+       * Every period the new slots are appended to the capture file. When the
+       * file exceeds maxSize bytes it is renamed path.1 (path.1 becomes
+       * path.2 and so on, at most files old files) and a new file is started.
+       *
+       * @param[in] path capture file (replaced).
+       * @param[in] maxSize size of a file in bytes (0 to never rotate).
+       * @param[in] files number of old files kept.
+       * @param[in] period flush period in milliseconds.
+       *
+       * @returns false if the file can't be created or the thread can't start.
+       */
+      bool start(const std::string &path, size_t maxSize, unsigned int files,
+          unsigned int period);
+
+      /**
+       * @brief Writes the new slots in the capture file now (flusher thread
+       * running).
+       *
+       * @returns false if the flusher thread isn't running or the file can't
+       * be written.
+       */
+      bool sync();
+
+      /**
+       * @brief Stops the flusher thread, after writing the last slots.
+       *
+       */
+      void stop();
+
+      /**
+       * @brief Returns true if the flusher thread is running.
+       *
+       */
+      bool running() const
+      {
+        return m_running;
+      }
+
+      /**
+       * @brief Gets the number of slots written.
+       *
+       */
+      uint64_t slots() const
+      {
+        return m_head.load(std::memory_order_relaxed);
+      }
+
+      /**
+       * @brief Gets the number of slots lost by the flusher thread.
+       *
+       */
+      uint64_t lost() const
+      {
+        return m_lost.load(std::memory_order_relaxed);
+      }
+
+      /**
+       * @brief Gets the capacity of the ring (slots).
+       *
+       */
+      size_t capacity() const
+      {
+        return m_mask + 1;
+      }
+
+      /**
+       * @brief Checks the header of a capture file.
+       *
+       * @param[in] buffer first bytes of the file.
+       * @param[in] size number of bytes.
+       *
+       * @returns true if the file is a capture file of this version.
+       */
+      static bool checkHeader(const uint8_t *buffer, size_t size);
+
+      /**
+       * @brief Decodes a record of a capture file.
+       *
+       * @param[in] buffer bytes of the file after the header.
+       * @param[in] size number of bytes.
+       * @param[out] record record (data points into buffer).
+       *
+       * @returns size of the record, 0 if the buffer ends before the record.
+       */
+      static size_t decode(const uint8_t *buffer, size_t size, Record &record);
+
+      /**
+       * @brief Gets the monotonic clock in nanoseconds.
+       *
+       */
+      static uint64_t now();
+
+    private:
+      /**
+       * @brief Slot of the ring (a cache line).
+       */
+      struct Slot
+      {
+          /// Position + 1 when complete, 0 while written.
+          std::atomic<uint64_t> seq;
+
+          /// Time in nanoseconds.
+          uint64_t time;
+
+          /// Number of bytes.
+          uint16_t size;
+
+          /// Direction.
+          uint8_t dir;
+
+          /// Reserved.
+          uint8_t reserved;
+
+          /// Bytes.
+          uint8_t data[SLOT_DATA];
+      };
+
+      /**
+       * @brief Writes the slots from a position to the head in a file.
+       *
+       * A slot still written by a thread stops the copy: it is written the
+       * next time.
+       *
+       * @param[in] fd file descriptor.
+       * @param[in,out] pos first slot, then the next slot to write.
+       * @param[in,out] lost slots overwritten before they were read.
+       *
+       * @returns number of bytes written, -1 if the file can't be written.
+       */
+      ssize_t write(int fd, uint64_t &pos, uint64_t &lost);
+
+      /**
+       * @brief Starts a new capture file if the current one is full.
+       *
+       * @returns false if the new file can't be created.
+       */
+      bool rotate();
+
+      /**
+       * @brief Creates a capture file and writes its header.
+       *
+       * @returns file descriptor, -1 in case of errors.
+       */
+      static int create(const std::string &path);
+
+      static void* flusherFunction(void *arg);
+
+      Capture(const Capture &);
+      Capture& operator=(const Capture &);
+
+      //! Slots
+      Slot *m_slots;
+
+      //! Capacity - 1
+      uint64_t m_mask;
+
+      //! Next slot to take (free-running)
+      alignas(64) std::atomic<uint64_t> m_head;
+
+      //! Readers (save(), flusher thread) one at a time
+      pthread_mutex_t m_lock;
+
+      //! Flusher thread wake up (sync(), stop())
+      pthread_cond_t m_wake;
+
+      //! Flusher thread
+      pthread_t m_flusher;
+
+      //! Flusher thread running
+      bool m_running;
+
+      //! Flusher thread must stop
+      bool m_stop;
+
+      //! Flush requested by sync()
+      bool m_sync;
+
+      //! Result of the last flush
+      bool m_ok;
+
+      //! Next slot of the flusher thread
+      uint64_t m_flushed;
+
+      //! Slots lost by the flusher thread
+      std::atomic<uint64_t> m_lost;
+
+      //! Capture file of the flusher thread
+      std::string m_path;
+
+      //! Descriptor of the capture file
+      int m_fd;
+
+      //! Bytes of the capture file
+      size_t m_size;
+
+      //! Size of a file before rotation (0 never)
+      size_t m_maxSize;
+
+      //! Old files kept
+      unsigned int m_files;
+
+      //! Flush period (ms)
+      unsigned int m_period;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_CAPTURE_H_ */
@@ -0,0 +1,110 @@
+//============================================================================
+// Name        : coalesce.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Several short Lo-Ra messages packed in one frame
+//============================================================================
+
+#include "coalesce.h"
+
+namespace lora
+{
+  /*************************************************************************
+   * class Coalescer
+   ************************************************************************/
+  Coalescer::Coalescer() :
+      m_limit(MAX_SIZE), m_size(0), m_count(0)
+  {
+  }
+
+  Coalescer::~Coalescer()
+  {
+  }
+
+  void Coalescer::begin(size_t limit)
+  {
+    m_limit = (limit < MAX_SIZE) ? limit : MAX_SIZE;
+    m_size = 0;
+    m_count = 0;
+  }
+
+  size_t Coalescer::encodedSize(const uint8_t *msg, size_t len)
+  {
+    size_t n = 1 + len;
+    for (size_t i = 0; i < len; i++)
+    {
+      if (msg[i] == MARK || msg[i] == ESCAPE)
+        n++;
+    }
+
+    return n;
+  }
+
+  bool Coalescer::add(const uint8_t *msg, size_t len)
+  {
+    if (len && msg == 0)
+      return false;
+
+    // The frame is left as it is if the message doesn't fit
+    if (1 + len > m_limit - m_size || encodedSize(msg, len) > m_limit - m_size)
+      return false;
+
+    m_frame[m_size++] = MARK;
+    for (size_t i = 0; i < len; i++)
+    {
+      if (msg[i] == MARK || msg[i] == ESCAPE)
+        m_frame[m_size++] = ESCAPE;
+      m_frame[m_size++] = msg[i];
+    }
+
+    m_count++;
+    return true;
+  }
+
+  /*************************************************************************
+   * class Splitter
+   ************************************************************************/
+  Splitter::Splitter() :
+      m_pos(0), m_end(0)
+  {
+  }
+
+  Splitter::~Splitter()
+  {
+  }
+
+  bool Splitter::begin(const uint8_t *data, size_t len)
+  {
+    m_message.clear();
+    m_pos = 0;
+    m_end = 0;
+
+    if (data == 0 || !coalesced(data, len))
+      return false;
+
+    m_pos = data;
+    m_end = data + len;
+    return true;
+  }
+
+  bool Splitter::next()
+  {
+    m_message.clear();
+
+    // Every message starts with the mark
+    if (m_pos >= m_end || *m_pos != Coalescer::MARK)
+      return false;
+
+    for (m_pos++; m_pos < m_end && *m_pos != Coalescer::MARK; m_pos++)
+    {
+      // An escape at the end of the frame is dropped
+      if (*m_pos == Coalescer::ESCAPE && ++m_pos >= m_end)
+        break;
+      m_message.push_back(*m_pos);
+    }
+
+    return true;
+  }
+
+} /* namespace lora */
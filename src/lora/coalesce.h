@@ -0,0 +1,217 @@
+//============================================================================
+// Name        : coalesce.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Several short Lo-Ra messages packed in one frame
+//============================================================================
+#ifndef _LORA_COALESCE_H_
+#define _LORA_COALESCE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "fragment.h"
+
+namespace lora
+{
+  /**
+   * @brief The Coalescer class packs several short messages for the same
+   * node in a single DATA frame.
+   *
+   * Every frame costs a preamble, a header and a CRC on air (and an answer of
+   * the module), so at high spreading factors ten readings of a few bytes
+   * take much more time on air than a frame with all of them. A coalesced
+   * frame is a sequence of messages, each one after the mark:
+   *
+   * | '|' | Message 1 | '|' | Message 2 | ... | '|' | Message N |
+   *
+   * The mark and the escape character in a message are written after an
+   * escape character ('\'), so the receiver splits the frame without
+   * ambiguity (see Splitter). A short message sent alone that starts with
+   * the mark is sent as a coalesced frame of one message.
+   *
+   * The coalesced frame is kept in the object: it must be valid until the
+   * frame is created.
+   *
+   */
+  class Coalescer
+  {
+    public:
+      /// First character of a coalesced frame and of every message.
+      static const uint8_t MARK = '|';
+
+      /// Character written before a mark or an escape of a message.
+      static const uint8_t ESCAPE = '\\';
+
+      /// Maximum length of a coalesced frame (a frame not fragmented).
+      static const size_t MAX_SIZE = Fragmenter::HEADER_SIZE + Fragmenter::FRAGMENT_SIZE;
+
+      /**
+       * @brief Creates an empty frame.
+       *
+       */
+      Coalescer();
+
+      /**
+       * @brief Destroys the object.
+       *
+       */
+      virtual ~Coalescer();
+
+      /**
+       * @brief Starts a new frame.
+       *
+       * @param[in] limit maximum length of the frame (at most MAX_SIZE).
+       */
+      void begin(size_t limit);
+
+      /**
+       * @brief Appends a message to the frame.
+       *
+       * @param[in] msg message.
+       * @param[in] len message length.
+       *
+       * @returns false if the message doesn't fit: the frame isn't changed.
+       */
+      bool add(const uint8_t *msg, size_t len);
+
+      /**
+       * @brief Gets the frame.
+       *
+       */
+      const uint8_t* data() const
+      {
+        return m_frame;
+      }
+
+      /**
+       * @brief Gets the length of the frame.
+       *
+       */
+      size_t size() const
+      {
+        return m_size;
+      }
+
+      /**
+       * @brief Gets the number of messages in the frame.
+       *
+       */
+      size_t count() const
+      {
+        return m_count;
+      }
+
+      /**
+       * @brief Gets the bytes taken by a message in a coalesced frame.
+       *
+       * @param[in] msg message.
+       * @param[in] len message length.
+       *
+       * @returns length of the message with its mark and escapes.
+       */
+      static size_t encodedSize(const uint8_t *msg, size_t len);
+
+    private:
+      //! Maximum length of the frame
+      size_t m_limit;
+
+      //! Length of the frame
+      size_t m_size;
+
+      //! Number of messages
+      size_t m_count;
+
+      //! Frame
+      uint8_t m_frame[MAX_SIZE];
+  };
+
+  /**
+   * @brief The Splitter class gives the messages of a coalesced frame.
+   *
+   * Example:
+   *
+   *    lora::Splitter splitter;
+   *    if (splitter.begin(data, len))
+   *    {
+   *      while (splitter.next())
+   *        use(splitter.message(), splitter.size());
+   *    }
+   *
+   */
+  class Splitter
+  {
+    public:
+      /**
+       * @brief Creates a splitter.
+       *
+       */
+      Splitter();
+
+      /**
+       * @brief Destroys the splitter.
+       *
+       */
+      virtual ~Splitter();
+
+      /**
+       * @brief Starts to split a received frame. The frame isn't copied.
+       *
+       * @param[in] data message of the DATA command.
+       * @param[in] len length of the message.
+       *
+       * @returns false if the frame isn't coalesced (no message to give).
+       */
+      bool begin(const uint8_t *data, size_t len);
+
+      /**
+       * @brief Moves to the next message of the frame.
+       *
+       * @returns false if there are no other messages.
+       */
+      bool next();
+
+      /**
+       * @brief Gets the current message.
+       *
+       */
+      const uint8_t* message() const
+      {
+        return m_message.data();
+      }
+
+      /**
+       * @brief Gets the length of the current message.
+       *
+       */
+      size_t size() const
+      {
+        return m_message.size();
+      }
+
+      /**
+       * @brief Returns true if a message starts with the mark of the
+       * coalesced frames.
+       *
+       * @param[in] data message of the DATA command.
+       * @param[in] len length of the message.
+       */
+      static bool coalesced(const uint8_t *data, size_t len)
+      {
+        return len && data[0] == Coalescer::MARK;
+      }
+
+    private:
+      //! Next byte of the frame
+      const uint8_t *m_pos;
+
+      //! End of the frame
+      const uint8_t *m_end;
+
+      //! Current message (escapes removed)
+      std::vector<uint8_t> m_message;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_COALESCE_H_ */
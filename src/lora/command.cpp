@@ -7,7 +7,9 @@
 //============================================================================
 #include "command.h"
 #include "utils.h"
+#include "framecache.h"
 #include <ctype.h>
+#include <string.h>
 #include <stdlib.h>
 #include <string>
 #include <locale>
@@ -16,6 +18,50 @@ namespace lora
 {
   namespace command
   {
+    namespace
+    {
+      /**
+       * @brief Appends bytes to a field in a buffer.
+       *
+       * Bytes that don't fit in the buffer are discarded.
+       *
+       * @returns index after the last byte written.
+       */
+      inline size_t appendBytes(uint8_t *buffer, size_t size, size_t index, const uint8_t *data,
+          size_t n)
+      {
+        if (index >= size)
+          return index;
+
+        if (n > size - index)
+          n = size - index;
+
+        memcpy(&buffer[index], data, n);
+
+        return index + n;
+      }
+
+      /**
+       * @brief Appends a string (without terminator) to a field in a buffer.
+       *
+       */
+      inline size_t appendString(uint8_t *buffer, size_t size, size_t index, const char *str)
+      {
+        return appendBytes(buffer, size, index, (const uint8_t *) str, strlen(str));
+      }
+
+      /**
+       * @brief Appends the decimal value of an integer to a field in a buffer.
+       *
+       */
+      inline size_t appendInt(uint8_t *buffer, size_t size, size_t index, int val)
+      {
+        uint8_t digits[12];
+        size_t n = convertIntToChars(val, digits, sizeof(digits));
+
+        return appendBytes(buffer, size, index, digits, n);
+      }
+    }
 
 ////////////////////////////////////// Read /////////////////////////////////////////////////
     Read::Read()
@@ -33,12 +79,12 @@ namespace lora
 
     }
 
-    uint8_t Read::createFieldType(uint8_t *buffer, uint8_t size)
+    size_t Read::createFieldType(uint8_t *buffer, size_t size)
     {
       if (buffer == 0 || size < SZ_CMD)
         return 0;
 
-      uint8_t index = 0;
+      size_t index = 0;
       buffer[index++] = 'R';
       buffer[index++] = 'E';
       buffer[index++] = 'A';
@@ -47,68 +93,19 @@ namespace lora
       return index;
     }
 
-    uint8_t Read::serialize(uint8_t *buffer, size_t size)
+    size_t Read::serialize(uint8_t *buffer, size_t size)
     {
-      uint8_t msg_size = SZ_START + SZ_CMD + SZ_SEPARATOR + SZ_CRC + SZ_END;
-
       m_size = 0;
 
-      if (buffer == 0 || size < msg_size)
-        return 0;
-
-      uint8_t index = 0;
-      uint8_t n = 0;
-
-// Create start field
-      if ((n = createFieldStart(&buffer[index], size - index)) == 0)
-        return 0;
-      else
-        index += n;
-
-// Create type field
-//    if ((n = createFieldType(&buffer[index], size - index)) == 0)
-      if ((n = createPayload(&buffer[index], size - index)) == 0)
-        return 0;
-      else
-        index += n;
-
-      m_crc = CRC16(&buffer[1], index - 1);
-
-// Create separator before CRC
-      if ((n = createFieldSeparator(&buffer[index], size - index)) == 0)
+      if (buffer == 0 || size < ReadFrame::size)
         return 0;
-      else
-        index += n;
 
-// create CRC field
-      if ((n = createFieldCRC(&buffer[index], size - index)) == 0)
-        return 0;
-      else
-        index += n;
+      // The READ frame never changes: it is built at compile time
+      memcpy(buffer, READ_FRAME.data, ReadFrame::size);
+      m_crc = READ_FRAME.crc;
+      m_size = ReadFrame::size;
 
-// Create end field
-      if ((n = createFieldEnd(&buffer[index], size - index)) == 0)
-        return 0;
-      else
-        index += n;
-
-// Create separator
-      if ((n = createFieldSeparator(&buffer[index], size - index)) == 0)
-        return 0;
-      else
-        index += n;
-      /*
-       for (uint8_t i = 0; i < index; i++)
-       {
-       int c = (buffer[i] & 0x0FF);
-       std::cout << "[";
-       std::cout << std::dec << (int) i << "]: ";
-       std::cout << std::hex << c << std::endl;
-       }
-       */
-      m_size = index;
-
-      return index;
+      return m_size;
     }
 
 ////////////////////////////////////// Info /////////////////////////////////////////////////
@@ -128,12 +125,12 @@ namespace lora
 
     }
 
-    uint8_t Info::createFieldType(uint8_t *buffer, uint8_t size)
+    size_t Info::createFieldType(uint8_t *buffer, size_t size)
     {
       if (buffer == 0 || size < SZ_CMD)
         return 0;
 
-      uint8_t index = 0;
+      size_t index = 0;
       buffer[index++] = 'I';
       buffer[index++] = 'N';
       buffer[index++] = 'F';
@@ -142,7 +139,7 @@ namespace lora
       return index;
     }
 
-    uint8_t Info::createFromBuffer(uint8_t *buffer, size_t size)
+    size_t Info::createFromBuffer(uint8_t *buffer, size_t size)
     {
       m_type = INFO;
       m_crc = 0;
@@ -441,7 +438,7 @@ namespace lora
                 setSpreadingFactor(SF_9);
               else if (value == "SF_10")
                 setSpreadingFactor(SF_10);
-              else if (value == "SF_8")
+              else if (value == "SF_11")
                 setSpreadingFactor(SF_11);
               else if (value == "SF_12")
                 setSpreadingFactor(SF_12);
@@ -515,12 +512,12 @@ namespace lora
 
     }
 
-    uint8_t Set::createFieldType(uint8_t *buffer, uint8_t size)
+    size_t Set::createFieldType(uint8_t *buffer, size_t size)
     {
       if (buffer == 0 || size < SZ_CMD)
         return 0;
 
-      uint8_t index = 0;
+      size_t index = 0;
       buffer[index++] = 'S';
       buffer[index++] = 'E';
       buffer[index++] = 'T';
@@ -528,10 +525,10 @@ namespace lora
       return index;
     }
 
-    uint8_t Set::createPayload(uint8_t *buffer, size_t size)
+    size_t Set::createPayload(uint8_t *buffer, size_t size)
     {
-      uint8_t index = 0;
-      uint8_t n = 0;
+      size_t index = 0;
+      size_t n = 0;
 
       // Create type field
       if ((n = createFieldType(&buffer[index], size - index)) == 0)
@@ -539,116 +536,110 @@ namespace lora
       else
         index += n;
 
-      std::string pl = "#";
-
-      // Frequency:
-      pl += "FREC:CH_";
-      std::string fld = "";
-      convertIntToSting(m_ch, fld);
-      pl += fld;
-      pl += "_";
+      int freq = 0;
       switch (m_freq)
       {
         case F_868:
-          convertIntToSting(868, fld);
+          freq = 868;
           break;
         case F_900:
-          convertIntToSting(900, fld);
+          freq = 900;
           break;
         default:
           return 0;
       }
-      pl += fld;
-      pl += ";";
-
-      // Address
-      pl += "ADDR:";
-      convertIntToSting(m_addr, fld);
-      pl += fld;
-      pl += ";";
 
-      // Bandwidth:
-      pl += "BW:BW_";
+      int bw = 0;
       switch (m_bw)
       {
         case BW_125:
-          convertIntToSting(125, fld);
+          bw = 125;
           break;
         case BW_250:
-          convertIntToSting(250, fld);
+          bw = 250;
           break;
         case BW_500:
-          convertIntToSting(500, fld);
+          bw = 500;
           break;
         default:
           return 0;
       }
-      pl += fld;
-      pl += ";";
 
-      // Coding Rate:
-      pl += "CR:CR_";
+      int cr = 0;
       switch (m_cr)
       {
         case CR_5:
-          convertIntToSting(5, fld);
+          cr = 5;
           break;
         case CR_6:
-          convertIntToSting(6, fld);
+          cr = 6;
           break;
         case CR_7:
-          convertIntToSting(7, fld);
+          cr = 7;
           break;
         case CR_8:
-          convertIntToSting(8, fld);
+          cr = 8;
           break;
         default:
           return 0;
       }
-      pl += fld;
-      pl += ";";
 
-      // Spreading factor:
-      pl += "SF:SF_";
+      int sf = 0;
       switch (m_sf)
       {
         case SF_6:
-          convertIntToSting(6, fld);
+          sf = 6;
           break;
         case SF_7:
-          convertIntToSting(7, fld);
+          sf = 7;
           break;
         case SF_8:
-          convertIntToSting(8, fld);
+          sf = 8;
           break;
         case SF_9:
-          convertIntToSting(9, fld);
+          sf = 9;
           break;
         case SF_10:
-          convertIntToSting(10, fld);
+          sf = 10;
           break;
         case SF_11:
-          convertIntToSting(11, fld);
+          sf = 11;
           break;
         case SF_12:
-          convertIntToSting(12, fld);
+          sf = 12;
           break;
         default:
           return 0;
       }
-      pl += fld;
 
-      for (size_t i = 0; index < size && i < pl.size(); index++, i++)
-      {
-        buffer[index] = pl[i];
-      }
+      // Frequency:
+      index = appendString(buffer, size, index, "#FREC:CH_");
+      index = appendInt(buffer, size, index, m_ch);
+      index = appendString(buffer, size, index, "_");
+      index = appendInt(buffer, size, index, freq);
+
+      // Address
+      index = appendString(buffer, size, index, ";ADDR:");
+      index = appendInt(buffer, size, index, m_addr);
+
+      // Bandwidth:
+      index = appendString(buffer, size, index, ";BW:BW_");
+      index = appendInt(buffer, size, index, bw);
+
+      // Coding Rate:
+      index = appendString(buffer, size, index, ";CR:CR_");
+      index = appendInt(buffer, size, index, cr);
+
+      // Spreading factor:
+      index = appendString(buffer, size, index, ";SF:SF_");
+      index = appendInt(buffer, size, index, sf);
 
       return index;
     }
 
-    uint8_t Set::serialize(uint8_t *buffer, size_t size)
+    size_t Set::serialize(uint8_t *buffer, size_t size)
     {
-      uint8_t msg_size = SZ_START + SZ_CMD + SZ_SEPARATOR + SZ_CRC + SZ_END;
+      size_t msg_size = SZ_START + SZ_CMD + SZ_SEPARATOR + SZ_CRC + SZ_END;
 
       m_size = 0;
 
@@ -658,8 +649,8 @@ namespace lora
       if (m_freq == F_UNKN || m_ch == CH_UNKN)
         return 0;
 
-      uint8_t index = 0;
-      uint8_t n = 0;
+      size_t index = 0;
+      size_t n = 0;
 
       // Create start field
       if ((n = createFieldStart(&buffer[index], size - index)) == 0)
@@ -715,12 +706,12 @@ namespace lora
 
     }
 
-    uint8_t Error::createFieldType(uint8_t *buffer, uint8_t size)
+    size_t Error::createFieldType(uint8_t *buffer, size_t size)
     {
       if (buffer == 0 || size < SZ_CMD)
         return 0;
 
-      uint8_t index = 0;
+      size_t index = 0;
       buffer[index++] = 'E';
       buffer[index++] = 'R';
       buffer[index++] = 'R';
@@ -730,7 +721,7 @@ namespace lora
       return index;
     }
 
-    uint8_t Error::createFromBuffer(uint8_t *buffer, size_t size)
+    size_t Error::createFromBuffer(uint8_t *buffer, size_t size)
     {
       m_type = ERROR;
       m_crc = 0;
@@ -747,7 +738,7 @@ namespace lora
       uint8_t state = LOOKFOR_START;
       std::string field = "";
 
-      for (uint8_t i = 0; i < size; i++)
+      for (size_t i = 0; i < size; i++)
       {
         switch (state)
         {
@@ -807,12 +798,12 @@ namespace lora
 
     }
 
-    uint8_t Data::createFieldType(uint8_t *buffer, uint8_t size)
+    size_t Data::createFieldType(uint8_t *buffer, size_t size)
     {
       if (buffer == 0 || size < SZ_CMD)
         return 0;
 
-      uint8_t index = 0;
+      size_t index = 0;
       buffer[index++] = 'D';
       buffer[index++] = 'A';
       buffer[index++] = 'T';
@@ -821,10 +812,10 @@ namespace lora
       return index;
     }
 
-    uint8_t Data::createPayload(uint8_t *buffer, size_t size)
+    size_t Data::createPayload(uint8_t *buffer, size_t size)
     {
-      uint8_t index = 0;
-      uint8_t n = 0;
+      size_t index = 0;
+      size_t n = 0;
 
       // Create type field
       if ((n = createFieldType(&buffer[index], size - index)) == 0)
@@ -832,29 +823,30 @@ namespace lora
       else
         index += n;
 
-      std::string addr = "";
-      convertIntToSting(m_dest, addr);
-      std::string pl = "#" + addr + "#ASCII#" + m_data;
+      index = appendString(buffer, size, index, "#");
+      index = appendInt(buffer, size, index, m_dest);
+      index = appendString(buffer, size, index, "#ASCII#");
 
-      for (size_t i = 0; index < size && i < pl.size(); index++, i++)
-      {
-        buffer[index] = pl[i];
-      }
+      // A message is never truncated: long messages must be fragmented
+      if (m_data.size() > size - index || index - n + m_data.size() > PAYLOAD_MAX_LENGTH)
+        return 0;
+
+      index = appendBytes(buffer, size, index, (const uint8_t *) m_data.data(), m_data.size());
 
       return index;
     }
 
-    uint8_t Data::serialize(uint8_t *buffer, size_t size)
+    size_t Data::serialize(uint8_t *buffer, size_t size)
     {
-      uint8_t msg_size = SZ_START + SZ_CMD + SZ_SEPARATOR + SZ_CRC + SZ_END;
+      size_t msg_size = SZ_START + SZ_CMD + SZ_SEPARATOR + SZ_CRC + SZ_END;
 
       m_size = 0;
 
       if (buffer == 0 || size < msg_size)
         return 0;
 
-      uint8_t index = 0;
-      uint8_t n = 0;
+      size_t index = 0;
+      size_t n = 0;
 
       // Create start field
       if ((n = createFieldStart(&buffer[index], size - index)) == 0)
@@ -895,6 +887,62 @@ namespace lora
 
     }
 
+    size_t Data::createFromBuffer(uint8_t *buffer, size_t size)
+    {
+      m_type = DATA;
+      m_crc = 0;
+      m_size = 0;
+
+      if (size == 0 || buffer == NULL || buffer[0] != '#')
+        return 0;
+
+      // Address
+      size_t i = 1;
+      long addr = 0;
+      for (; i < size && isdigit(buffer[i]); i++)
+      {
+        addr = addr * 10 + (buffer[i] - '0');
+      }
+
+      if (i == 1 || addr > 0xFF)
+        return 0;
+
+      // Message format
+      const char format[] = "#ASCII#";
+      const size_t sz_format = sizeof(format) - 1;
+      if (size - i < sz_format || memcmp(&buffer[i], format, sz_format) != 0)
+        return 0;
+
+      i += sz_format;
+
+      m_dest = addr;
+      m_data.assign((const char *) &buffer[i], size - i);
+
+      return size;
+    }
+
+    size_t Data::serialize(Data *cmds, size_t n, uint8_t *buffer, size_t size, size_t *offsets)
+    {
+      if (cmds == 0 || buffer == 0 || offsets == 0)
+        return 0;
+
+      size_t index = 0;
+      size_t i = 0;
+
+      offsets[0] = 0;
+      for (i = 0; i < n; i++)
+      {
+        size_t sz = cmds[i].serialize(&buffer[index], size - index);
+        if (sz == 0)
+          break;
+
+        index += sz;
+        offsets[i + 1] = index;
+      }
+
+      return i;
+    }
+
 ////////////////////////////////////// Ack ////////////////////////////////////////////////
     Ack::Ack()
     {
@@ -911,12 +959,12 @@ namespace lora
 
     }
 
-    uint8_t Ack::createFieldType(uint8_t *buffer, uint8_t size)
+    size_t Ack::createFieldType(uint8_t *buffer, size_t size)
     {
       if (buffer == 0 || size < SZ_CMD)
         return 0;
 
-      uint8_t index = 0;
+      size_t index = 0;
       buffer[index++] = 'A';
       buffer[index++] = 'C';
       buffer[index++] = 'K';
@@ -924,12 +972,12 @@ namespace lora
       return index;
     }
 
-    uint8_t Ack::createFromBuffer(uint8_t *buffer, size_t size)
+    size_t Ack::createFromBuffer(uint8_t *buffer, size_t size)
     {
       return 1;
     }
 
-    uint8_t Ack::createPayload(uint8_t *buffer, size_t size)
+    size_t Ack::createPayload(uint8_t *buffer, size_t size)
     {
       return 1;
     }
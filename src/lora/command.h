@@ -80,7 +80,7 @@ namespace lora
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t serialize(uint8_t *buffer, size_t size);
+        virtual size_t serialize(uint8_t *buffer, size_t size);
 
       protected:
         /**
@@ -94,7 +94,7 @@ namespace lora
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t createFieldType(uint8_t *buffer, uint8_t size);
+        virtual size_t createFieldType(uint8_t *buffer, size_t size);
 
     };
 
@@ -160,7 +160,7 @@ namespace lora
          *
          * @returns number of byte processed. 0 if there was an error.
          */
-        virtual uint8_t createFromBuffer(uint8_t *buffer, size_t size);
+        virtual size_t createFromBuffer(uint8_t *buffer, size_t size);
 
       protected:
         /**
@@ -174,7 +174,7 @@ namespace lora
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t createFieldType(uint8_t *buffer, uint8_t size);
+        virtual size_t createFieldType(uint8_t *buffer, size_t size);
 
     };
 
@@ -247,7 +247,7 @@ namespace lora
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t serialize(uint8_t *buffer, size_t size);
+        virtual size_t serialize(uint8_t *buffer, size_t size);
 
       protected:
         /**
@@ -261,7 +261,7 @@ namespace lora
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t createFieldType(uint8_t *buffer, uint8_t size);
+        virtual size_t createFieldType(uint8_t *buffer, size_t size);
 
         /**
          * @brief Creates the data field of the SET command.
@@ -274,7 +274,7 @@ namespace lora
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t createPayload(uint8_t *buffer, size_t size);
+        virtual size_t createPayload(uint8_t *buffer, size_t size);
 
     };
 
@@ -341,7 +341,7 @@ namespace lora
          *
          * @returns number of byte processed. 0 if there was an error.
          */
-        virtual uint8_t createFromBuffer(uint8_t *buffer, size_t size);
+        virtual size_t createFromBuffer(uint8_t *buffer, size_t size);
 
         /**
          * @brief Gets the error description.
@@ -368,7 +368,7 @@ namespace lora
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t createFieldType(uint8_t *buffer, uint8_t size);
+        virtual size_t createFieldType(uint8_t *buffer, size_t size);
 
         //! Error message
         std::string m_error;
@@ -402,7 +402,7 @@ namespace lora
      * 01 44 41 54 41 23 32 23 41 53 43 49 49 23 54 48 49 53 20 49 53 20 54 48 45 20 4d 45 53 53 41 47 45 0d 0a 39 44 44 35 04
      *
      */
-    class Data: public lora::Command, public OutputCommand
+    class Data: public lora::Command, public OutputCommand, public InputCommand
     {
       public:
 
@@ -436,13 +436,49 @@ namespace lora
          * @brief Creates the sequences of bytes for the DATA command.
          *
          * This function creates the output command and saves it on a buffer.
+         * The message is never truncated: if the payload is longer than
+         * PAYLOAD_MAX_LENGTH, the message must be split in fragments (see
+         * lora::Fragmenter).
          *
          * @param[out] buffer array where command is saved.
          * @param[in] size size of the buffer (number of bytes).
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t serialize(uint8_t *buffer, size_t size);
+        virtual size_t serialize(uint8_t *buffer, size_t size);
+
+        /**
+         * @brief Creates command from a byte array.
+         *
+         * This function reads the payload of a DATA command received from the
+         * module ("#<address>#ASCII#<message>"): the address is the node that
+         * sent the message.
+         *
+         * @param[out] buffer array of the received bytes.
+         * @param[in] size size of the buffer (number of bytes).
+         *
+         * @returns number of byte processed. 0 if there was an error.
+         */
+        virtual size_t createFromBuffer(uint8_t *buffer, size_t size);
+
+        /**
+         * @brief Creates the sequences of bytes for a batch of DATA commands.
+         *
+         * This function serializes the commands one after the other in a
+         * contiguous buffer. The frame of the i-th command starts at
+         * offsets[i] and ends at offsets[i + 1]. If the buffer is full or a
+         * command can't be serialized, the function stops.
+         *
+         * @param[in] cmds array of commands.
+         * @param[in] n number of commands.
+         * @param[out] buffer array where commands are saved.
+         * @param[in] size size of the buffer (number of bytes).
+         * @param[out] offsets array of (n + 1) offsets of the frames in the buffer.
+         *
+         * @returns number of commands serialized.
+         */
+        static size_t serialize(Data *cmds, size_t n, uint8_t *buffer, size_t size,
+            size_t *offsets);
 
         /**
          * @brief Sets the destination node address.
@@ -486,6 +522,22 @@ namespace lora
         }
         ;
 
+        /**
+         * @brief Sets the message to an array of ASCII characters.
+         *
+         * The memory of the previous message is reused, so setting messages
+         * of the same length doesn't allocate memory.
+         *
+         * @param[in] data ASCII characters to send.
+         * @param[in] size number of characters.
+         *
+         */
+        void setData(const uint8_t *data, size_t size)
+        {
+          m_data.assign((const char *) data, size);
+        }
+        ;
+
         /**
          * @brief Gets the message field.
          *
@@ -511,7 +563,7 @@ namespace lora
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t createFieldType(uint8_t *buffer, uint8_t size);
+        virtual size_t createFieldType(uint8_t *buffer, size_t size);
 
         /**
          * @brief Creates the data field of the DATA command.
@@ -522,9 +574,10 @@ namespace lora
          * @param[out] buffer array where field is added.
          * @param[in] size size of the buffer (number of bytes).
          *
-         * @returns number of byte written. 0 if there was an error.
+         * @returns number of byte written. 0 if there was an error (buffer too
+         * small or payload longer than PAYLOAD_MAX_LENGTH).
          */
-        virtual uint8_t createPayload(uint8_t *buffer, size_t size);
+        virtual size_t createPayload(uint8_t *buffer, size_t size);
 
         //! Destination address
         uint8_t m_dest;
@@ -594,7 +647,7 @@ namespace lora
          *
          * @returns number of byte processed. 0 if there was an error.
          */
-        virtual uint8_t createFromBuffer(uint8_t *buffer, size_t size);
+        virtual size_t createFromBuffer(uint8_t *buffer, size_t size);
 
       protected:
         /**
@@ -608,7 +661,7 @@ namespace lora
          *
          * @returns number of byte written. 0 if there was an error.
          */
-        virtual uint8_t createFieldType(uint8_t *buffer, uint8_t size);
+        virtual size_t createFieldType(uint8_t *buffer, size_t size);
 
         /**
          * Creates the payload of the message.
@@ -618,7 +671,7 @@ namespace lora
          *
          * \return number of byte processed from the buffer. 0 if there was an error.
          */
-        virtual uint8_t createPayload(uint8_t *buffer, size_t size);
+        virtual size_t createPayload(uint8_t *buffer, size_t size);
     };
 
   } /* namespace command */
@@ -0,0 +1,308 @@
+//============================================================================
+// Name        : crc16.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Modbus CRC16 engines
+//============================================================================
+
+#include "crc16.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRC16_PCLMUL 1
+#include <immintrin.h>
+#endif
+
+namespace lora
+{
+  namespace
+  {
+    /// Reflected polynomial
+    const uint16_t POLY_REFLECTED = 0xA001;
+
+    /// Polynomial (x^16 + x^15 + x^2 + 1), x^16 included
+    const uint32_t POLY = 0x18005;
+
+    /**
+     * @brief Lookup tables of the slice-by-8 engine. Table 0 is the byte by
+     * byte table.
+     */
+    struct Tables
+    {
+        uint16_t t[8][256];
+    };
+
+    constexpr Tables createTables()
+    {
+      Tables tables = { };
+
+      for (unsigned int b = 0; b < 256; b++)
+      {
+        uint16_t crc = b;
+        for (int i = 0; i < 8; i++)
+        {
+          crc = (crc & 0x0001) ? ((crc >> 1) ^ POLY_REFLECTED) : (crc >> 1);
+        }
+        tables.t[0][b] = crc;
+      }
+
+      for (unsigned int k = 1; k < 8; k++)
+      {
+        for (unsigned int b = 0; b < 256; b++)
+        {
+          uint16_t prev = tables.t[k - 1][b];
+          tables.t[k][b] = (prev >> 8) ^ tables.t[0][prev & 0xFF];
+        }
+      }
+
+      return tables;
+    }
+
+    constexpr Tables TABLES = createTables();
+
+    uint16_t crcBitwise(const uint8_t *buffer, size_t size, uint16_t crc)
+    {
+      for (size_t pos = 0; pos < size; pos++)
+      {
+        crc ^= (uint16_t) buffer[pos];
+
+        for (int i = 8; i != 0; i--)
+        {
+          if ((crc & 0x0001) != 0)
+          {
+            crc >>= 1;
+            crc ^= POLY_REFLECTED;
+          }
+          else
+            crc >>= 1;
+        }
+      }
+      return crc;
+    }
+
+    inline uint16_t crcTable(const uint8_t *buffer, size_t size, uint16_t crc)
+    {
+      const uint16_t *t0 = TABLES.t[0];
+
+      for (size_t pos = 0; pos < size; pos++)
+      {
+        crc = (crc >> 8) ^ t0[(crc ^ buffer[pos]) & 0xFF];
+      }
+      return crc;
+    }
+
+    uint16_t crcSliceBy8(const uint8_t *buffer, size_t size, uint16_t crc)
+    {
+      const uint16_t (*t)[256] = TABLES.t;
+
+      while (size >= 8)
+      {
+        // The CRC is XORed into the first two bytes of the block
+        uint8_t b0 = buffer[0] ^ (crc & 0xFF);
+        uint8_t b1 = buffer[1] ^ (crc >> 8);
+
+        crc = t[7][b0] ^ t[6][b1] ^ t[5][buffer[2]] ^ t[4][buffer[3]] ^ t[3][buffer[4]]
+            ^ t[2][buffer[5]] ^ t[1][buffer[6]] ^ t[0][buffer[7]];
+
+        buffer += 8;
+        size -= 8;
+      }
+
+      return crcTable(buffer, size, crc);
+    }
+
+#ifdef CRC16_PCLMUL
+    /**
+     * @brief Calculates x^n mod P.
+     */
+    constexpr uint16_t xPowMod(unsigned int n)
+    {
+      uint32_t r = 1;
+      for (unsigned int i = 0; i < n; i++)
+      {
+        r <<= 1;
+        if (r & 0x10000)
+          r ^= POLY;
+      }
+      return r;
+    }
+
+    /**
+     * @brief Converts a polynomial of degree < 16 to a reflected 64 bits
+     * operand (coefficient of x^i at bit 63 - i).
+     */
+    constexpr uint64_t reflect64(uint16_t p)
+    {
+      uint64_t r = 0;
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        if (p & (1 << i))
+          r |= (uint64_t) 1 << (63 - i);
+      }
+      return r;
+    }
+
+    /**
+     * @brief Folding constants for a distance of D bits.
+     *
+     * A 128 bits block R = H * x^64 + L is moved forward by D bits as
+     * H * (x^(D+64) mod P) + L * (x^D mod P). The carry-less product of two
+     * reflected operands is one bit short, so the constants are x^(D+63) and
+     * x^(D-1).
+     */
+    struct Fold
+    {
+        uint64_t high;
+        uint64_t low;
+    };
+
+    constexpr Fold createFold(unsigned int d)
+    {
+      return Fold { reflect64(xPowMod(d + 63)), reflect64(xPowMod(d - 1)) };
+    }
+
+    constexpr Fold FOLD_128 = createFold(128);
+    constexpr Fold FOLD_256 = createFold(256);
+    constexpr Fold FOLD_384 = createFold(384);
+    constexpr Fold FOLD_512 = createFold(512);
+
+    /// Minimum size processed with carry-less multiplication
+    const size_t PCLMUL_MIN_SIZE = 64;
+
+    __attribute__((target("pclmul,sse2")))
+    inline __m128i fold(__m128i x, const Fold &k)
+    {
+      __m128i c = _mm_set_epi64x((long long) k.low, (long long) k.high);
+      return _mm_xor_si128(_mm_clmulepi64_si128(x, c, 0x00), _mm_clmulepi64_si128(x, c, 0x11));
+    }
+
+    __attribute__((target("pclmul,sse2")))
+    uint16_t crcPclmul(const uint8_t *buffer, size_t size, uint16_t crc)
+    {
+      if (size < PCLMUL_MIN_SIZE)
+        return crcSliceBy8(buffer, size, crc);
+
+      const __m128i *p = (const __m128i *) buffer;
+
+      // The initial value is XORed into the first two bytes
+      __m128i x0 = _mm_xor_si128(_mm_loadu_si128(p), _mm_cvtsi32_si128(crc));
+      __m128i x1 = _mm_loadu_si128(p + 1);
+      __m128i x2 = _mm_loadu_si128(p + 2);
+      __m128i x3 = _mm_loadu_si128(p + 3);
+      p += 4;
+      size -= 64;
+
+      // Four independent lanes, 64 bytes for each iteration
+      while (size >= 64)
+      {
+        x0 = _mm_xor_si128(fold(x0, FOLD_512), _mm_loadu_si128(p));
+        x1 = _mm_xor_si128(fold(x1, FOLD_512), _mm_loadu_si128(p + 1));
+        x2 = _mm_xor_si128(fold(x2, FOLD_512), _mm_loadu_si128(p + 2));
+        x3 = _mm_xor_si128(fold(x3, FOLD_512), _mm_loadu_si128(p + 3));
+        p += 4;
+        size -= 64;
+      }
+
+      // Reduce the lanes to one block
+      __m128i x = _mm_xor_si128(_mm_xor_si128(fold(x0, FOLD_384), fold(x1, FOLD_256)),
+          _mm_xor_si128(fold(x2, FOLD_128), x3));
+
+      while (size >= 16)
+      {
+        x = _mm_xor_si128(fold(x, FOLD_128), _mm_loadu_si128(p));
+        p++;
+        size -= 16;
+      }
+
+      // The last block has the same remainder of the processed bytes
+      uint8_t block[16];
+      _mm_storeu_si128((__m128i *) block, x);
+
+      crc = crcSliceBy8(block, sizeof(block), 0);
+
+      return crcSliceBy8((const uint8_t *) p, size, crc);
+    }
+#endif
+
+    Crc16::Engine selectEngine()
+    {
+#ifdef CRC16_PCLMUL
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2"))
+        return Crc16::PCLMUL;
+#endif
+      return Crc16::SLICE_BY_8;
+    }
+
+    //! Engine used by compute()
+    const Crc16::Engine s_engine = selectEngine();
+  }
+
+  /*************************************************************************
+   * class Crc16
+   ************************************************************************/
+  uint16_t Crc16::compute(const uint8_t *buffer, size_t size, uint16_t crc)
+  {
+#ifdef CRC16_PCLMUL
+    if (s_engine == PCLMUL)
+      return crcPclmul(buffer, size, crc);
+#endif
+    return crcSliceBy8(buffer, size, crc);
+  }
+
+  uint16_t Crc16::compute(Engine engine, const uint8_t *buffer, size_t size, uint16_t crc)
+  {
+    switch (engine)
+    {
+      case BITWISE:
+        return crcBitwise(buffer, size, crc);
+
+      case TABLE:
+        return crcTable(buffer, size, crc);
+
+#ifdef CRC16_PCLMUL
+      case PCLMUL:
+        if (s_engine == PCLMUL)
+          return crcPclmul(buffer, size, crc);
+        break;
+#endif
+
+      default:
+        break;
+    }
+
+    return crcSliceBy8(buffer, size, crc);
+  }
+
+  bool Crc16::supported(Engine engine)
+  {
+    if (engine == PCLMUL)
+      return s_engine == PCLMUL;
+
+    return engine < N_ENGINES;
+  }
+
+  Crc16::Engine Crc16::engine()
+  {
+    return s_engine;
+  }
+
+  const char* Crc16::engineName(Engine engine)
+  {
+    switch (engine)
+    {
+      case BITWISE:
+        return "bitwise";
+      case TABLE:
+        return "table";
+      case SLICE_BY_8:
+        return "slice-by-8";
+      case PCLMUL:
+        return "pclmul";
+      default:
+        break;
+    }
+    return "unknown";
+  }
+
+} /* namespace lora */
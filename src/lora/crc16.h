@@ -0,0 +1,139 @@
+//============================================================================
+// Name        : crc16.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Modbus CRC16 engines
+//============================================================================
+#ifndef _LORA_CRC16_H_
+#define _LORA_CRC16_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace lora
+{
+  /**
+   * @brief The Crc16 class calculates the modbus CRC16 (reflected polynomial
+   * 0xA001, initial value 0xFFFF) used by LoRa frames.
+   *
+   * Several engines are available:
+   *    - BITWISE: reference implementation, one bit at a time.
+   *    - TABLE: one byte at a time with a 256 entries table.
+   *    - SLICE_BY_8: eight bytes at a time with 8 tables.
+   *    - PCLMUL: carry-less multiplication folding (x86 with PCLMULQDQ).
+   *
+   * Tables are built at compile time. The fastest engine supported by the
+   * CPU is selected at run time and used by compute().
+   *
+   * The CRC has no final XOR, so a CRC can be continued: the CRC of A + B is
+   * compute(B, compute(A)).
+   *
+   */
+  class Crc16
+  {
+    public:
+      /**
+       * @brief CRC engines.
+       */
+      enum Engine
+      {
+        /// Bit by bit (reference implementation)
+        BITWISE = 0,
+
+        /// Byte by byte, 256 entries table
+        TABLE,
+
+        /// Eight bytes at a time
+        SLICE_BY_8,
+
+        /// Carry-less multiplication (x86 only)
+        PCLMUL,
+
+        /// Number of engines
+        N_ENGINES,
+      };
+
+      /// Initial value of the CRC.
+      static const uint16_t INIT = 0xFFFF;
+
+      /**
+       * @brief Calculates the CRC with the fastest engine.
+       *
+       * @param[in] buffer bytes.
+       * @param[in] size number of bytes.
+       * @param[in] crc initial value or CRC of the previous bytes.
+       *
+       * @returns CRC16 value.
+       */
+      static uint16_t compute(const uint8_t *buffer, size_t size, uint16_t crc = INIT);
+
+      /**
+       * @brief Calculates the CRC with an engine.
+       *
+       * If the engine isn't supported by the CPU, the slice-by-8 engine is
+       * used.
+       *
+       * @param[in] engine engine.
+       * @param[in] buffer bytes.
+       * @param[in] size number of bytes.
+       * @param[in] crc initial value or CRC of the previous bytes.
+       *
+       * @returns CRC16 value.
+       */
+      static uint16_t compute(Engine engine, const uint8_t *buffer, size_t size, uint16_t crc =
+          INIT);
+
+      /**
+       * @brief Calculates the CRC at compile time.
+       *
+       * This function is the bitwise engine usable in constant expressions
+       * (e.g. frames built at compile time).
+       *
+       * @param[in] buffer characters.
+       * @param[in] size number of characters.
+       * @param[in] crc initial value or CRC of the previous bytes.
+       *
+       * @returns CRC16 value.
+       */
+      static constexpr uint16_t constant(const char *buffer, size_t size, uint16_t crc = INIT)
+      {
+        for (size_t pos = 0; pos < size; pos++)
+        {
+          crc ^= (uint8_t) buffer[pos];
+          for (int i = 0; i < 8; i++)
+          {
+            crc = (crc & 0x0001) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+          }
+        }
+        return crc;
+      }
+
+      /**
+       * @brief Returns true if an engine is supported by the CPU.
+       *
+       * @param[in] engine engine.
+       *
+       * @returns true if the engine can be used.
+       */
+      static bool supported(Engine engine);
+
+      /**
+       * @brief Gets the engine used by compute().
+       *
+       * @returns engine.
+       */
+      static Engine engine();
+
+      /**
+       * @brief Gets the name of an engine.
+       *
+       * @param[in] engine engine.
+       *
+       * @returns engine name.
+       */
+      static const char* engineName(Engine engine);
+  };
+
+} /* namespace lora */
+#endif /* _LORA_CRC16_H_ */
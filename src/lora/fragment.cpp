@@ -0,0 +1,347 @@
+//============================================================================
+// Name        : fragment.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Fragmentation and reassembly of long Lo-Ra messages
+//============================================================================
+
+#include "fragment.h"
+#include "utils.h"
+
+#include <string.h>
+
+namespace lora
+{
+  namespace
+  {
+    /**
+     * @brief Writes a number as hexadecimal digits.
+     *
+     */
+    inline void writeHex(uint8_t *buffer, size_t digits, size_t val)
+    {
+      for (size_t i = digits; i > 0; i--)
+      {
+        uint8_t low = 0;
+        uint8_t high = 0;
+        convertHexToChars(val & 0x0F, high, low);
+        buffer[i - 1] = low;
+        val >>= 4;
+      }
+    }
+
+    /**
+     * @brief Reads a number written as hexadecimal digits.
+     *
+     * @returns false if a character isn't an hexadecimal digit.
+     */
+    inline bool readHex(const uint8_t *buffer, size_t digits, size_t &val)
+    {
+      val = 0;
+      for (size_t i = 0; i < digits; i++)
+      {
+        uint8_t v = convertHexCharToInt(buffer[i]);
+        if (v == 0xFF)
+          return false;
+        val = (val << 4) | v;
+      }
+      return true;
+    }
+  }
+
+  /*************************************************************************
+   * class Fragmenter
+   ************************************************************************/
+  Fragmenter::Fragmenter(command::FrameCache &cache) :
+      m_cache(cache), m_dest(0), m_msg(0), m_len(0), m_header(false), m_id(0), m_count(0), m_index(0)
+  {
+  }
+
+  Fragmenter::~Fragmenter()
+  {
+  }
+
+  size_t Fragmenter::fragments(const uint8_t *msg, size_t len, bool header)
+  {
+    // A message that fits in a frame is sent as it is
+    if (len <= HEADER_SIZE + FRAGMENT_SIZE && (len == 0 || (msg[0] != MARK && !header)))
+      return 1;
+
+    return (len + FRAGMENT_SIZE - 1) / FRAGMENT_SIZE;
+  }
+
+  size_t Fragmenter::fragmentSize(const uint8_t *msg, size_t len, size_t index, bool header)
+  {
+    size_t count = fragments(msg, len, header);
+    if (index >= count)
+      return 0;
+
+    if (count == 1 && (len == 0 || (msg[0] != MARK && !header)))
+      return len;
+
+    size_t offset = index * FRAGMENT_SIZE;
+    return HEADER_SIZE + ((len - offset < FRAGMENT_SIZE) ? len - offset : FRAGMENT_SIZE);
+  }
+
+  bool Fragmenter::begin(uint8_t dest, const uint8_t *msg, size_t len, bool header)
+  {
+    m_count = 0;
+    m_index = 0;
+
+    if (len > MAX_MESSAGE_SIZE || (len && msg == 0))
+      return false;
+
+    m_dest = dest;
+    m_msg = msg;
+    m_len = len;
+    m_header = (len && (msg[0] == MARK || header));
+    m_count = fragments(msg, len, header);
+
+    // Every message sent with fragment headers has a new identifier
+    if (m_count > 1 || m_header)
+      m_id++;
+
+    return true;
+  }
+
+  size_t Fragmenter::next(uint8_t *buffer, size_t size)
+  {
+    if (done())
+      return 0;
+
+    size_t sz = 0;
+
+    if (m_count == 1 && !m_header)
+    {
+      sz = m_cache.data(m_dest, m_msg, m_len, buffer, size);
+    }
+    else
+    {
+      size_t offset = m_index * FRAGMENT_SIZE;
+      size_t len = (m_len - offset < FRAGMENT_SIZE) ? m_len - offset : FRAGMENT_SIZE;
+
+      m_fragment[0] = MARK;
+      writeHex(&m_fragment[1], 2, m_id);
+      writeHex(&m_fragment[3], 3, m_index);
+      writeHex(&m_fragment[6], 3, m_count);
+      memcpy(&m_fragment[HEADER_SIZE], &m_msg[offset], len);
+
+      sz = m_cache.data(m_dest, m_fragment, HEADER_SIZE + len, buffer, size);
+    }
+
+    if (sz)
+      m_index++;
+
+    return sz;
+  }
+
+  /*************************************************************************
+   * class Reassembler
+   ************************************************************************/
+  Reassembler::Reassembler(size_t memory, size_t slots, uint64_t timeout) :
+      m_maxMemory(memory), m_timeout(timeout), m_slots(slots), m_message(0), m_size(0), m_source(
+          0), m_memory(0), m_peak(0), m_completed(0), m_expired(0), m_dropped(0), m_duplicates(0), m_invalid(
+          0)
+  {
+    for (size_t i = 0; i < m_slots.size(); i++)
+    {
+      m_slots[i].used = false;
+    }
+  }
+
+  Reassembler::~Reassembler()
+  {
+  }
+
+  size_t Reassembler::pending() const
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < m_slots.size(); i++)
+    {
+      if (m_slots[i].used)
+        n++;
+    }
+    return n;
+  }
+
+  void Reassembler::release(Slot &slot)
+  {
+    m_memory -= slot.data.capacity();
+    std::vector<uint8_t>().swap(slot.data);
+    slot.map.clear();
+    slot.used = false;
+  }
+
+  Reassembler::Slot* Reassembler::allocate(size_t count)
+  {
+    size_t need = count * Fragmenter::FRAGMENT_SIZE;
+    if (need > m_maxMemory || m_slots.empty())
+      return 0;
+
+    // Drop the oldest messages until there is a free slot and enough memory
+    while (true)
+    {
+      Slot *free = 0;
+      Slot *oldest = 0;
+      for (size_t i = 0; i < m_slots.size(); i++)
+      {
+        Slot &s = m_slots[i];
+        if (!s.used)
+        {
+          if (free == 0)
+            free = &s;
+        }
+        else if (oldest == 0 || s.time < oldest->time)
+        {
+          oldest = &s;
+        }
+      }
+
+      if (free && m_memory + need <= m_maxMemory)
+      {
+        free->data.reserve(need);
+        m_memory += free->data.capacity();
+        if (m_memory > m_peak)
+          m_peak = m_memory;
+        free->map.assign(count, false);
+        return free;
+      }
+
+      release(*oldest);
+      m_dropped++;
+    }
+  }
+
+  size_t Reassembler::expire(uint64_t now)
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < m_slots.size(); i++)
+    {
+      Slot &s = m_slots[i];
+      if (s.used && now > s.time && now - s.time > m_timeout)
+      {
+        release(s);
+        m_expired++;
+        n++;
+      }
+    }
+    return n;
+  }
+
+  bool Reassembler::add(uint8_t src, const uint8_t *data, size_t len, uint64_t now)
+  {
+    m_message = 0;
+    m_size = 0;
+
+    expire(now);
+
+    if (len && data == 0)
+      return false;
+
+    // Message not fragmented
+    if (len == 0 || data[0] != Fragmenter::MARK)
+    {
+      m_message = data;
+      m_size = len;
+      m_source = src;
+      return true;
+    }
+
+    size_t id = 0;
+    size_t index = 0;
+    size_t count = 0;
+    if (len <= Fragmenter::HEADER_SIZE || !readHex(&data[1], 2, id) || !readHex(&data[3], 3, index)
+        || !readHex(&data[6], 3, count) || index >= count)
+    {
+      m_invalid++;
+      return false;
+    }
+
+    const uint8_t *payload = &data[Fragmenter::HEADER_SIZE];
+    size_t p_size = len - Fragmenter::HEADER_SIZE;
+
+    // Only the last fragment can be shorter
+    if (p_size > Fragmenter::FRAGMENT_SIZE
+        || (index < count - 1 && p_size != Fragmenter::FRAGMENT_SIZE))
+    {
+      m_invalid++;
+      return false;
+    }
+
+    if (count == 1)
+    {
+      m_message = payload;
+      m_size = p_size;
+      m_source = src;
+      return true;
+    }
+
+    Slot *slot = 0;
+    for (size_t i = 0; i < m_slots.size() && slot == 0; i++)
+    {
+      Slot &s = m_slots[i];
+      if (s.used && s.src == src && s.id == id)
+        slot = &s;
+    }
+
+    if (slot && slot->count != count)
+    {
+      // Same identifier, different message: the old one can't be completed
+      release(*slot);
+      m_dropped++;
+      slot = 0;
+    }
+
+    if (slot == 0)
+    {
+      slot = allocate(count);
+      if (slot == 0)
+      {
+        m_dropped++;
+        return false;
+      }
+
+      slot->used = true;
+      slot->src = src;
+      slot->id = id;
+      slot->count = count;
+      slot->received = 0;
+      slot->last = 0;
+      slot->data.resize(count * Fragmenter::FRAGMENT_SIZE);
+    }
+
+    slot->time = now;
+
+    if (slot->map[index])
+    {
+      m_duplicates++;
+      return false;
+    }
+
+    memcpy(&slot->data[index * Fragmenter::FRAGMENT_SIZE], payload, p_size);
+    slot->map[index] = true;
+    slot->received++;
+    if (index == count - 1)
+      slot->last = p_size;
+
+    if (slot->received < count)
+      return false;
+
+    // The buffer of the message is moved to the output
+    m_output.swap(slot->data);
+    m_output.resize((count - 1) * Fragmenter::FRAGMENT_SIZE + slot->last);
+    m_memory -= m_output.capacity();
+    std::vector<uint8_t>().swap(slot->data);
+    slot->map.clear();
+    slot->used = false;
+
+    m_message = &m_output[0];
+    m_size = m_output.size();
+    m_source = src;
+    m_completed++;
+
+    return true;
+  }
+
+} /* namespace lora */
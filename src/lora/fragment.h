@@ -0,0 +1,421 @@
+//============================================================================
+// Name        : fragment.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Fragmentation and reassembly of long Lo-Ra messages
+//============================================================================
+#ifndef _LORA_FRAGMENT_H_
+#define _LORA_FRAGMENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "framecache.h"
+
+namespace lora
+{
+  /**
+   * @brief The Fragmenter class splits a long message in several DATA
+   * commands.
+   *
+   * The payload of a DATA command is limited (Command::PAYLOAD_MAX_LENGTH)
+   * and the frame must fit in the buffers of the module, so a long message
+   * is sent as a sequence of fragments. Every fragment starts with a header
+   * of ASCII characters:
+   *
+   * | '^' | ID (2 hex) | Index (3 hex) | Count (3 hex) | Data |
+   *
+   * where:
+   *    - ID : identifier of the message (it changes for every fragmented message).
+   *    - Index : index of the fragment (0 to Count - 1).
+   *    - Count : number of fragments of the message.
+   *    - Data : FRAGMENT_SIZE bytes of the message (less in the last fragment).
+   *
+   * For example, the second fragment of a message of 3 fragments:
+   * [SOH]DATA#2#ASCII#^1F001003...[CR+LF]9DD5[EOT]
+   *
+   * A message that fits in a single frame is sent without header, as
+   * before, unless it starts with the header mark or the header is forced
+   * (e.g. a message that the receiver would take for a coalesced frame).
+   *
+   */
+  class Fragmenter
+  {
+    public:
+      /// First character of a fragment header.
+      static const uint8_t MARK = '^';
+
+      /// Size of the fragment header in bytes.
+      static const size_t HEADER_SIZE = 9;
+
+      /// Message bytes in a fragment (except the last one).
+      static const size_t FRAGMENT_SIZE = 223;
+
+      /// Maximum number of fragments of a message (3 hexadecimal digits).
+      static const size_t MAX_FRAGMENTS = 0xFFF;
+
+      /// Maximum length of a message.
+      static const size_t MAX_MESSAGE_SIZE = FRAGMENT_SIZE * MAX_FRAGMENTS;
+
+      /**
+       * @brief Creates a fragmenter.
+       *
+       * @param[in,out] cache templates used to build the DATA frames.
+       */
+      Fragmenter(command::FrameCache &cache);
+
+      /**
+       * @brief Destroys the fragmenter.
+       *
+       */
+      virtual ~Fragmenter();
+
+      /**
+       * @brief Starts to send a message.
+       *
+       * The message isn't copied: it must be valid until the last fragment
+       * is created.
+       *
+       * @param[in] dest destination address.
+       * @param[in] msg message.
+       * @param[in] len message length.
+       * @param[in] header true to send the fragment header even if the
+       * message fits in a frame.
+       *
+       * @returns false if the message is longer than MAX_MESSAGE_SIZE.
+       */
+      bool begin(uint8_t dest, const uint8_t *msg, size_t len, bool header = false);
+
+      /**
+       * @brief Creates the DATA frame of the next fragment.
+       *
+       * @param[out] buffer array where the frame is saved.
+       * @param[in] size size of the buffer (number of bytes).
+       *
+       * @returns number of bytes written. 0 if all fragments are created or
+       * the buffer is too small.
+       */
+      size_t next(uint8_t *buffer, size_t size);
+
+      /**
+       * @brief Stops the message: the other fragments are not created.
+       *
+       */
+      void cancel()
+      {
+        m_count = 0;
+        m_index = 0;
+      }
+
+      /**
+       * @brief Returns true if all fragments of the message are created.
+       *
+       */
+      bool done() const
+      {
+        return m_index >= m_count;
+      }
+
+      /**
+       * @brief Gets the number of fragments of the message.
+       *
+       * @returns number of fragments (1 if the message isn't fragmented).
+       */
+      size_t count() const
+      {
+        return m_count;
+      }
+
+      /**
+       * @brief Gets the number of fragments already created.
+       *
+       * @returns index of the next fragment.
+       */
+      size_t index() const
+      {
+        return m_index;
+      }
+
+      /**
+       * @brief Gets the number of fragments needed by a message.
+       *
+       * @param[in] msg message.
+       * @param[in] len message length.
+       * @param[in] header true if the fragment header is forced.
+       *
+       * @returns number of DATA frames.
+       */
+      static size_t fragments(const uint8_t *msg, size_t len, bool header = false);
+
+      /**
+       * @brief Gets the length of a fragment (header included).
+       *
+       * @param[in] msg message.
+       * @param[in] len message length.
+       * @param[in] index fragment index.
+       * @param[in] header true if the fragment header is forced.
+       *
+       * @returns bytes of the DATA message field, 0 if the index isn't valid.
+       */
+      static size_t fragmentSize(const uint8_t *msg, size_t len, size_t index, bool header = false);
+
+    private:
+      //! Templates of the DATA frames
+      command::FrameCache &m_cache;
+
+      //! Destination address
+      uint8_t m_dest;
+
+      //! Message to send
+      const uint8_t *m_msg;
+
+      //! Message length
+      size_t m_len;
+
+      //! Fragment header forced
+      bool m_header;
+
+      //! Identifier of the last fragmented message
+      uint8_t m_id;
+
+      //! Number of fragments (0 if no fragment has to be sent)
+      size_t m_count;
+
+      //! Index of the next fragment
+      size_t m_index;
+
+      //! Header and data of the current fragment
+      uint8_t m_fragment[HEADER_SIZE + FRAGMENT_SIZE];
+  };
+
+  /**
+   * @brief The Reassembler class rebuilds the messages sent in fragments.
+   *
+   * Fragments can be received in any order. Every message being rebuilt uses
+   * a slot with a buffer of (Count * FRAGMENT_SIZE) bytes; the number of
+   * slots and the total memory are bounded: when a new message doesn't fit,
+   * the message not updated for the longest time is dropped. Messages not
+   * completed within the timeout are dropped too.
+   *
+   * Messages without fragment header are returned as they are. The last
+   * complete message is kept until the next call of add(), so the memory
+   * used is at most the limit plus the longest message.
+   *
+   */
+  class Reassembler
+  {
+    public:
+      /// Default memory for the messages being rebuilt (bytes).
+      static const size_t DEFAULT_MEMORY = 256 * 1024;
+
+      /// Default maximum number of messages being rebuilt.
+      static const size_t DEFAULT_SLOTS = 8;
+
+      /// Default time to receive all fragments of a message (usec).
+      static const uint64_t DEFAULT_TIMEOUT = 30000000;
+
+      /**
+       * @brief Creates a reassembler.
+       *
+       * @param[in] memory maximum memory for the messages being rebuilt.
+       * @param[in] slots maximum number of messages being rebuilt.
+       * @param[in] timeout time to receive all fragments of a message (usec).
+       */
+      Reassembler(size_t memory = DEFAULT_MEMORY, size_t slots = DEFAULT_SLOTS, uint64_t timeout =
+          DEFAULT_TIMEOUT);
+
+      /**
+       * @brief Destroys the reassembler.
+       *
+       */
+      virtual ~Reassembler();
+
+      /**
+       * @brief Adds the message of a received DATA command.
+       *
+       * @param[in] src address of the node that sent the message.
+       * @param[in] data message or fragment received.
+       * @param[in] len length of the message.
+       * @param[in] now current time (usec, monotonic clock).
+       *
+       * @returns true if a message is complete: it is available with
+       * message() and size() until the next call.
+       */
+      bool add(uint8_t src, const uint8_t *data, size_t len, uint64_t now);
+
+      /**
+       * @brief Drops the messages not completed within the timeout.
+       *
+       * @param[in] now current time (usec, monotonic clock).
+       *
+       * @returns number of messages dropped.
+       */
+      size_t expire(uint64_t now);
+
+      /**
+       * @brief Gets the last complete message.
+       *
+       */
+      const uint8_t* message() const
+      {
+        return m_message;
+      }
+
+      /**
+       * @brief Gets the length of the last complete message.
+       *
+       */
+      size_t size() const
+      {
+        return m_size;
+      }
+
+      /**
+       * @brief Gets the address of the node that sent the last complete message.
+       *
+       */
+      uint8_t source() const
+      {
+        return m_source;
+      }
+
+      /**
+       * @brief Gets the number of messages being rebuilt.
+       *
+       */
+      size_t pending() const;
+
+      /**
+       * @brief Gets the memory used by the messages being rebuilt (bytes).
+       *
+       */
+      size_t memory() const
+      {
+        return m_memory;
+      }
+
+      /**
+       * @brief Gets the maximum memory used by the messages being rebuilt (bytes).
+       *
+       */
+      size_t peakMemory() const
+      {
+        return m_peak;
+      }
+
+      /// Number of messages rebuilt from fragments.
+      unsigned long completed() const
+      {
+        return m_completed;
+      }
+
+      /// Number of messages dropped because of the timeout.
+      unsigned long expired() const
+      {
+        return m_expired;
+      }
+
+      /// Number of messages dropped because of the memory or slot limits
+      /// (every fragment refused is counted).
+      unsigned long dropped() const
+      {
+        return m_dropped;
+      }
+
+      /// Number of fragments received twice.
+      unsigned long duplicates() const
+      {
+        return m_duplicates;
+      }
+
+      /// Number of fragments with an invalid header.
+      unsigned long invalid() const
+      {
+        return m_invalid;
+      }
+
+    private:
+      /**
+       * @brief Message being rebuilt.
+       */
+      struct Slot
+      {
+          /// True if the slot is in use.
+          bool used;
+
+          /// Address of the sender.
+          uint8_t src;
+
+          /// Message identifier.
+          uint8_t id;
+
+          /// Number of fragments.
+          size_t count;
+
+          /// Number of fragments received.
+          size_t received;
+
+          /// Length of the last fragment (0 if not received yet).
+          size_t last;
+
+          /// Time of the last fragment received (usec).
+          uint64_t time;
+
+          /// Message bytes.
+          std::vector<uint8_t> data;
+
+          /// Fragments received.
+          std::vector<bool> map;
+      };
+
+      /**
+       * @brief Releases a slot.
+       *
+       */
+      void release(Slot &slot);
+
+      /**
+       * @brief Gets a free slot for a message of count fragments.
+       *
+       * @returns slot, 0 if the message can't be rebuilt.
+       */
+      Slot* allocate(size_t count);
+
+      //! Maximum memory
+      size_t m_maxMemory;
+
+      //! Time to receive all fragments of a message (usec)
+      uint64_t m_timeout;
+
+      //! Messages being rebuilt
+      std::vector<Slot> m_slots;
+
+      //! Last complete message
+      std::vector<uint8_t> m_output;
+
+      //! Pointer to the last complete message
+      const uint8_t *m_message;
+
+      //! Length of the last complete message
+      size_t m_size;
+
+      //! Sender of the last complete message
+      uint8_t m_source;
+
+      //! Memory used
+      size_t m_memory;
+
+      //! Maximum memory used
+      size_t m_peak;
+
+      //! Statistics
+      unsigned long m_completed;
+      unsigned long m_expired;
+      unsigned long m_dropped;
+      unsigned long m_duplicates;
+      unsigned long m_invalid;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_FRAGMENT_H_ */
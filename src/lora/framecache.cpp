@@ -0,0 +1,96 @@
+//============================================================================
+// Name        : framecache.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Cache of pre-serialized Lo-Ra frames
+//============================================================================
+
+#include "framecache.h"
+#include "utils.h"
+
+#include <string.h>
+
+namespace lora
+{
+  namespace command
+  {
+    /*************************************************************************
+     * class FrameCache
+     ************************************************************************/
+    FrameCache::FrameCache()
+    {
+      clear();
+    }
+
+    FrameCache::~FrameCache()
+    {
+    }
+
+    void FrameCache::clear()
+    {
+      memset(m_headers, 0, sizeof(m_headers));
+      m_hits = 0;
+      m_misses = 0;
+    }
+
+    size_t FrameCache::read(uint8_t *buffer, size_t size)
+    {
+      if (buffer == 0 || size < ReadFrame::size)
+        return 0;
+
+      memcpy(buffer, READ_FRAME.data, ReadFrame::size);
+      m_hits++;
+
+      return ReadFrame::size;
+    }
+
+    size_t FrameCache::data(uint8_t dest, const uint8_t *msg, size_t len, uint8_t *buffer,
+        size_t size)
+    {
+      Header &h = m_headers[dest];
+      bool miss = (h.size == 0);
+
+      if (miss)
+      {
+        // Create the template: SOH + "DATA#<dest>#ASCII#"
+        uint8_t index = 0;
+        h.data[index++] = Command::SOH;
+        memcpy(&h.data[index], "DATA#", 5);
+        index += 5;
+        index += convertIntToChars(dest, &h.data[index], MAX_HEADER_SIZE - index);
+        memcpy(&h.data[index], "#ASCII#", 7);
+        index += 7;
+
+        h.size = index;
+        h.crc = Crc16::compute(&h.data[1], index - 1);
+      }
+
+      size_t total = h.size + len + Command::SZ_SEPARATOR + Command::SZ_CRC + Command::SZ_END;
+      if (buffer == 0 || (len && msg == 0) || total > size)
+        return 0;
+
+      // Only the message bytes are copied and hashed
+      memcpy(buffer, h.data, h.size);
+      memcpy(&buffer[h.size], msg, len);
+      uint16_t crc = Crc16::compute(msg, len, h.crc);
+
+      size_t index = h.size + len;
+      buffer[index++] = Command::CR;
+      buffer[index++] = Command::LF;
+      convertHexToChars(crc >> 8, buffer[index], buffer[index + 1]);
+      convertHexToChars(crc & 0xFF, buffer[index + 2], buffer[index + 3]);
+      index += Command::SZ_CRC;
+      buffer[index++] = Command::EOT;
+
+      // Only the frames built are counted
+      if (miss)
+        m_misses++;
+      else
+        m_hits++;
+
+      return index;
+    }
+
+  } /* namespace command */
+} /* namespace lora */
@@ -0,0 +1,201 @@
+//============================================================================
+// Name        : framecache.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Cache of pre-serialized Lo-Ra frames
+//============================================================================
+#ifndef _LORA_FRAMECACHE_H_
+#define _LORA_FRAMECACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "interfaces.h"
+#include "crc16.h"
+
+namespace lora
+{
+  namespace command
+  {
+    /**
+     * @brief Frame built at compile time.
+     *
+     */
+    template<size_t N>
+    struct ConstFrame
+    {
+        /// Frame bytes.
+        uint8_t data[N];
+
+        /// CRC of the frame.
+        uint16_t crc;
+
+        /// Frame size.
+        static const size_t size = N;
+    };
+
+    /**
+     * @brief Converts a nibble into an hexadecimal digit at compile time.
+     *
+     */
+    constexpr uint8_t constHexChar(uint8_t val)
+    {
+      return (val < 10) ? ('0' + val) : ('A' + (val - 10));
+    }
+
+    /**
+     * @brief Builds the frame of a command without payload at compile time.
+     *
+     * The frame has the same bytes written by Read::serialize(): SOH, command,
+     * CR + LF, CRC, EOT, CR + LF.
+     *
+     * @param[in] cmd command type (ASCII string of N - 10 characters).
+     *
+     * @returns the frame.
+     */
+    template<size_t N>
+    constexpr ConstFrame<N> createConstFrame(const char *cmd)
+    {
+      ConstFrame<N> frame = { { 0 }, 0 };
+      const size_t len = N - 10;
+
+      frame.crc = Crc16::constant(cmd, len);
+
+      size_t index = 0;
+      frame.data[index++] = Command::SOH;
+      for (size_t i = 0; i < len; i++)
+      {
+        frame.data[index++] = cmd[i];
+      }
+      frame.data[index++] = Command::CR;
+      frame.data[index++] = Command::LF;
+      frame.data[index++] = constHexChar((frame.crc >> 12) & 0x0F);
+      frame.data[index++] = constHexChar((frame.crc >> 8) & 0x0F);
+      frame.data[index++] = constHexChar((frame.crc >> 4) & 0x0F);
+      frame.data[index++] = constHexChar(frame.crc & 0x0F);
+      frame.data[index++] = Command::EOT;
+      frame.data[index++] = Command::CR;
+      frame.data[index++] = Command::LF;
+
+      return frame;
+    }
+
+    /// Type of the READ frame: 4 command bytes and 10 bytes of the other fields.
+    typedef ConstFrame<14> ReadFrame;
+
+    /// READ frame, built at compile time.
+    constexpr ReadFrame READ_FRAME = createConstFrame<14>("READ");
+
+    /**
+     * @brief The FrameCache class builds frames from pre-serialized templates.
+     *
+     * Constant frames (READ) are built at compile time and they are only
+     * copied. DATA frames for a destination always start with the same
+     * header (SOH + "DATA#<dest>#ASCII#"): the first frame for a destination
+     * (miss) serializes the header and stores it with its CRC; the next
+     * frames (hits) copy the header and continue the CRC over the message
+     * bytes only.
+     *
+     * Frames are the same produced by the serialize() functions of the
+     * commands. A cache is not thread safe: every thread must use its own.
+     *
+     */
+    class FrameCache
+    {
+      public:
+        /// Maximum size of a DATA header: SOH + "DATA#255#ASCII#".
+        static const size_t MAX_HEADER_SIZE = 16;
+
+        /**
+         * @brief Creates an empty cache.
+         *
+         */
+        FrameCache();
+
+        /**
+         * @brief Destroys the cache.
+         *
+         */
+        virtual ~FrameCache();
+
+        /**
+         * @brief Creates the frame of a READ command.
+         *
+         * @param[out] buffer array where the frame is saved.
+         * @param[in] size size of the buffer (number of bytes).
+         *
+         * @returns number of bytes written. 0 if the buffer is too small.
+         */
+        size_t read(uint8_t *buffer, size_t size);
+
+        /**
+         * @brief Creates the frame of a DATA command.
+         *
+         * @param[in] dest destination address.
+         * @param[in] msg message.
+         * @param[in] len message length.
+         * @param[out] buffer array where the frame is saved.
+         * @param[in] size size of the buffer (number of bytes).
+         *
+         * @returns number of bytes written. 0 if the buffer is too small.
+         */
+        size_t data(uint8_t dest, const uint8_t *msg, size_t len, uint8_t *buffer, size_t size);
+
+        /**
+         * @brief Removes all templates and resets the statistics.
+         *
+         */
+        void clear();
+
+        /**
+         * @brief Gets the number of frames built from a stored template.
+         *
+         * @returns number of hits.
+         */
+        unsigned long hits() const
+        {
+          return m_hits;
+        }
+
+        /**
+         * @brief Gets the number of templates created.
+         *
+         * @returns number of misses.
+         */
+        unsigned long misses() const
+        {
+          return m_misses;
+        }
+
+      private:
+        /**
+         * @brief Template of a DATA frame header.
+         */
+        struct Header
+        {
+            /// Header bytes (SOH included).
+            uint8_t data[MAX_HEADER_SIZE];
+
+            /// Header size, 0 if the template isn't created yet.
+            uint8_t size;
+
+            /// CRC of the header bytes after SOH.
+            uint16_t crc;
+        };
+
+        /// Number of destinations.
+        static const size_t N_DEST = 256;
+
+        //! Templates of the DATA headers, indexed by destination
+        Header m_headers[N_DEST];
+
+        //! Number of hits
+        unsigned long m_hits;
+
+        //! Number of misses
+        unsigned long m_misses;
+    };
+
+  } /* namespace command */
+} /* namespace lora */
+#endif /* _LORA_FRAMECACHE_H_ */
@@ -0,0 +1,328 @@
+//============================================================================
+// Name        : gwsim.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Simulated Libelium Lo-Ra gateway on a pseudo terminal
+//============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include "gwsim.h"
+#include "airtime.h"
+#include "crc16.h"
+
+namespace lora
+{
+  GatewaySim::GatewaySim() :
+      m_master(-1), m_slave(-1), m_reactor(0), m_timer(-1), m_size(0), m_busy(0), m_loss(0),
+          m_corruption(0), m_comError(0), m_scale(1), m_seed(1), m_observer(0)
+  {
+    m_config.setFrequency(ConfigCommand::F_868);
+    m_config.setChannel(ConfigCommand::CH_10);
+    m_config.setAddress(1);
+    m_config.setBandwidth(ConfigCommand::BW_125);
+    m_config.setCodingRate(ConfigCommand::CR_5);
+    m_config.setSpreadingFactor(ConfigCommand::SF_12);
+
+    memset(&m_stats, 0, sizeof(m_stats));
+  }
+
+  GatewaySim::~GatewaySim()
+  {
+    close();
+  }
+
+  bool GatewaySim::open(const std::string &link)
+  {
+    close();
+
+    m_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (m_master < 0 || grantpt(m_master) < 0 || unlockpt(m_master) < 0)
+    {
+      close();
+      return false;
+    }
+
+    m_device = ptsname(m_master);
+    fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+    fcntl(m_master, F_SETFD, FD_CLOEXEC);
+
+    // The slave side stays open: the master never gets a hang up when a
+    // tool closes the device. Raw until a tool sets its own mode.
+    m_slave = ::open(m_device.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (m_slave < 0)
+    {
+      close();
+      return false;
+    }
+
+    struct termios tio;
+    if (tcgetattr(m_slave, &tio) == 0)
+    {
+      cfmakeraw(&tio);
+      tcsetattr(m_slave, TCSANOW, &tio);
+    }
+
+    if (!link.empty())
+    {
+      struct stat st;
+      if (lstat(link.c_str(), &st) == 0 && S_ISLNK(st.st_mode))
+        unlink(link.c_str());
+
+      if (symlink(m_device.c_str(), link.c_str()) < 0)
+      {
+        close();
+        return false;
+      }
+      m_link = link;
+    }
+
+    m_parser.reset();
+    m_size = 0;
+
+    return true;
+  }
+
+  void GatewaySim::close()
+  {
+    if (m_reactor)
+    {
+      if (m_master >= 0)
+        m_reactor->remove(m_master);
+      if (m_timer >= 0)
+        m_reactor->removeTimer(m_timer);
+      m_reactor = 0;
+      m_timer = -1;
+    }
+
+    if (!m_link.empty())
+    {
+      unlink(m_link.c_str());
+      m_link.clear();
+    }
+
+    if (m_slave >= 0)
+      ::close(m_slave);
+    if (m_master >= 0)
+      ::close(m_master);
+
+    m_slave = -1;
+    m_master = -1;
+    m_device.clear();
+    m_answers.clear();
+  }
+
+  void GatewaySim::attach(Reactor &reactor)
+  {
+    m_reactor = &reactor;
+    m_reactor->add(m_master, this);
+    m_timer = m_reactor->addTimer(this);
+  }
+
+  void GatewaySim::setFaults(double loss, double corruption, double comError)
+  {
+    m_loss = loss;
+    m_corruption = corruption;
+    m_comError = comError;
+  }
+
+  void GatewaySim::handleEvent(int fd, uint32_t events)
+  {
+    if (fd == m_timer)
+    {
+      flush();
+      return;
+    }
+
+    ssize_t n = read(m_master, &m_window[m_size], WINDOW_SIZE - m_size);
+    if (n <= 0)
+      return;
+
+    m_size += n;
+
+    // Frames longer than the parser limit are skipped, so the window
+    // never fills up
+    size_t consumed = m_parser.parse(m_window, m_size, *this);
+    if (consumed)
+    {
+      m_size -= consumed;
+      memmove(m_window, &m_window[consumed], m_size);
+    }
+  }
+
+  void GatewaySim::onFrame(const Frame &frame)
+  {
+    if (frame.type < sizeof(m_stats.commands) / sizeof(m_stats.commands[0]))
+      m_stats.commands[frame.type]++;
+
+    switch (frame.type)
+    {
+      case Command::READ:
+        answer("INFO", info());
+        break;
+
+      case Command::SET:
+      {
+        // The SET payload is an INFO payload without RSSI and SNR
+        uint8_t payload[FrameParser::MAX_FRAME_SIZE + 1];
+        memcpy(payload, frame.payload, frame.p_size);
+        payload[frame.p_size] = ';';
+
+        command::Info cfg;
+        if (cfg.createFromBuffer(payload, frame.p_size + 1) == 0
+            || cfg.frequency() == ConfigCommand::F_UNKN || cfg.channel() == ConfigCommand::CH_UNKN
+            || cfg.bandwidth() == ConfigCommand::BW_UNKN
+            || cfg.codingRate() == ConfigCommand::CR_UNKN
+            || cfg.spreadingFactor() == ConfigCommand::SF_UNKN || cfg.address() == 0)
+        {
+          answer("ERROR", "#BAD SETUP");
+          break;
+        }
+
+        m_config.setFrequency(cfg.frequency());
+        m_config.setChannel(cfg.channel());
+        m_config.setAddress(cfg.address());
+        m_config.setBandwidth(cfg.bandwidth());
+        m_config.setCodingRate(cfg.codingRate());
+        m_config.setSpreadingFactor(cfg.spreadingFactor());
+
+        answer("INFO", info());
+      }
+        break;
+
+      case Command::DATA:
+      {
+        command::Data data;
+        if (data.createFromBuffer((uint8_t *) frame.payload, frame.p_size) == 0)
+        {
+          answer("ERROR", "#BAD DATA");
+          break;
+        }
+
+        uint64_t airtime = Airtime::compute(m_config, data.data().size());
+        m_stats.airtime += airtime;
+
+        if (happens(m_comError))
+        {
+          m_stats.comErrors++;
+          answer("ERROR", "#COM_ERROR", airtime);
+        }
+        else
+        {
+          answer("ACK", "", airtime, &data.data());
+        }
+      }
+        break;
+
+      default:
+        answer("ERROR", "#BAD COMMAND");
+        break;
+    }
+  }
+
+  void GatewaySim::onError(uint8_t code, const uint8_t *data, size_t size)
+  {
+    m_stats.badFrames++;
+
+    if (code == Command::INVALID_CRC)
+      answer("ERROR", "#BAD CRC");
+  }
+
+  void GatewaySim::answer(const char *cmd, const std::string &payload, uint64_t delay,
+      const std::string *message)
+  {
+    uint64_t now = Reactor::now();
+
+    // Commands are handled in order: the answer follows the previous ones
+    Answer a;
+    a.due = ((m_busy > now) ? m_busy : now) + (uint64_t) (delay * m_scale);
+    m_busy = a.due;
+
+    if (happens(m_loss))
+    {
+      m_stats.lost++;
+      return;
+    }
+
+    std::string body = cmd;
+    body += payload;
+
+    char crc[8];
+    snprintf(crc, sizeof(crc), "%04X",
+        Crc16::compute((const uint8_t *) body.data(), body.size()));
+
+    a.frame.reserve(body.size() + 8);
+    a.frame += (char) Command::SOH;
+    a.frame += body;
+    a.frame += (char) Command::CR;
+    a.frame += (char) Command::LF;
+    a.frame += crc;
+    a.frame += (char) Command::EOT;
+
+    bool corrupted = happens(m_corruption);
+    if (corrupted)
+    {
+      // A bit of the command, the payload or the CRC
+      size_t i = 1 + rand_r(&m_seed) % (a.frame.size() - 2);
+      a.frame[i] ^= (char) (1 << (rand_r(&m_seed) % 7));
+      m_stats.corrupted++;
+    }
+
+    // The host doesn't see a corrupted ACK
+    if (m_observer && message && !corrupted)
+      a.message = *message;
+
+    bool idle = m_answers.empty();
+    m_answers.push_back(a);
+    if (idle)
+      flush();
+  }
+
+  void GatewaySim::flush()
+  {
+    uint64_t now = Reactor::now();
+
+    while (!m_answers.empty() && m_answers.front().due <= now)
+    {
+      const Answer &a = m_answers.front();
+      if (write(m_master, a.frame.data(), a.frame.size()) == (ssize_t) a.frame.size())
+      {
+        m_stats.answers++;
+        if (m_observer && !a.message.empty())
+          m_observer->onAck((const uint8_t *) a.message.data(), a.message.size());
+      }
+      else
+      {
+        m_stats.overflows++;
+      }
+
+      m_answers.pop_front();
+    }
+
+    if (!m_answers.empty() && m_reactor)
+      m_reactor->armTimer(m_timer, m_answers.front().due - now);
+  }
+
+  std::string GatewaySim::info()
+  {
+    char payload[96];
+    snprintf(payload, sizeof(payload), "#FREC:CH_%d_%d;ADDR:%d;BW:BW_%d;CR:CR_%d;SF:SF_%d;RSSI:%d;SNR:%d",
+        m_config.channel(false), m_config.frequency(false), m_config.address(),
+        m_config.bandwidth(false), m_config.codingRate(false), m_config.spreadingFactor(false),
+        RSSI, SNR);
+
+    return payload;
+  }
+
+  bool GatewaySim::happens(double rate)
+  {
+    return rate > 0 && rand_r(&m_seed) < rate * ((double) RAND_MAX + 1.0);
+  }
+
+} /* namespace lora */
@@ -0,0 +1,360 @@
+//============================================================================
+// Name        : gwsim.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Simulated Libelium Lo-Ra gateway on a pseudo terminal
+//============================================================================
+#ifndef _LORA_GWSIM_H_
+#define _LORA_GWSIM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <deque>
+#include "command.h"
+#include "parser.h"
+#include "reactor.h"
+
+namespace lora
+{
+  /**
+   * @brief The GatewaySim class simulates the Libelium SX1272 gateway on a
+   * pseudo terminal, so the tools can run without hardware.
+   *
+   * The tools open the slave side (device()) as the serial device of the
+   * gateway; the simulator reads the commands from the master side and
+   * answers as the module does:
+   *
+   *    - READ : INFO with the current setup;
+   *    - SET  : INFO with the new setup, ERROR if the setup isn't valid;
+   *    - DATA : ACK when the frame has been on air (lora::Airtime with the
+   *      current setup), ERROR if the command isn't valid;
+   *    - a frame with a bad CRC: ERROR#BAD CRC.
+   *
+   * The module handles a command at a time, so an answer is never sent
+   * before the frames sent before it are on air. The time on air can be
+   * scaled (0 answers at once). Faults are injected at random with fixed
+   * rates: an answer can be lost (the host gets nothing), corrupted (a bit
+   * flipped, the host gets a bad CRC) or a DATA command can fail with
+   * ERROR#COM_ERROR.
+   *
+   * The simulator keeps the slave side open, so the tools can close and
+   * open the device again (i.e. lora_setup then lora_sender) while it runs.
+   *
+   * Example:
+   *
+   *    lora::Reactor reactor;
+   *    lora::GatewaySim gw;
+   *    if (gw.open("/tmp/ttyLORA"))
+   *    {
+   *      gw.attach(reactor);
+   *      reactor.run();
+   *    }
+   *
+   */
+  class GatewaySim: public Reactor::Handler, public FrameParser::Listener
+  {
+    public:
+      /// Size of the receive window (bytes).
+      static const size_t WINDOW_SIZE = 4096;
+
+      /// RSSI reported in the INFO command (dBm).
+      static const int RSSI = -80;
+
+      /// SNR reported in the INFO command (dB).
+      static const int SNR = 7;
+
+      /**
+       * @brief Interface for an object notified of the messages acknowledged
+       * (i.e. a load generator that measures the latency).
+       *
+       */
+      class Observer
+      {
+        public:
+          /**
+           * @brief Destroys the observer.
+           *
+           */
+          virtual ~Observer()
+          {
+          }
+          ;
+
+          /**
+           * @brief Called when the ACK of a DATA command is written.
+           *
+           * @param[in] msg message of the DATA command (a frame as sent by
+           * the host: it can be a fragment or a coalesced frame).
+           * @param[in] len message length.
+           */
+          virtual void onAck(const uint8_t *msg, size_t len) = 0;
+      };
+
+      /**
+       * @brief Counters of the simulator.
+       */
+      struct Stats
+      {
+          /// Commands received, according to lora::Command::CMD_TYPE enum.
+          unsigned long commands[Command::ACK + 1];
+
+          /// Frames with a bad CRC or not valid.
+          unsigned long badFrames;
+
+          /// Answers sent.
+          unsigned long answers;
+
+          /// Answers lost on purpose.
+          unsigned long lost;
+
+          /// Answers corrupted on purpose.
+          unsigned long corrupted;
+
+          /// COM_ERROR notified on purpose.
+          unsigned long comErrors;
+
+          /// Answers not written (the host doesn't read the device).
+          unsigned long overflows;
+
+          /// Time on air of the DATA frames (usec, not scaled).
+          uint64_t airtime;
+      };
+
+      /**
+       * @brief Creates a simulator: channel 10 (868 MHz), address 1, BW 125 KHz,
+       * CR 4/5 and SF 12.
+       *
+       */
+      GatewaySim();
+
+      /**
+       * @brief Destroys the simulator (the pseudo terminal is closed).
+       *
+       */
+      virtual ~GatewaySim();
+
+      /**
+       * @brief Opens the pseudo terminal.
+       *
+       * @param[in] link path of a symbolic link to the slave device (i.e. a
+       * fixed name for the tools), empty for none. An old link is replaced.
+       *
+       * @returns false if the pseudo terminal or the link can't be created.
+       */
+      bool open(const std::string &link = "");
+
+      /**
+       * @brief Closes the pseudo terminal and removes the link.
+       *
+       */
+      void close();
+
+      /**
+       * @brief Registers the master side and the answer timer in a reactor.
+       *
+       * @param[in] reactor event loop.
+       */
+      void attach(Reactor &reactor);
+
+      /**
+       * @brief Gets the slave device (the serial device of the tools).
+       *
+       */
+      const std::string& device() const
+      {
+        return m_device;
+      }
+
+      /**
+       * @brief Gets the setup of the module (it can be changed before the
+       * simulator starts).
+       *
+       */
+      command::Info& config()
+      {
+        return m_config;
+      }
+
+      /**
+       * @brief Sets the rates of the injected faults.
+       *
+       * @param[in] loss answers lost (0 to 1).
+       * @param[in] corruption answers corrupted (0 to 1).
+       * @param[in] comError DATA commands failed with COM_ERROR (0 to 1).
+       */
+      void setFaults(double loss, double corruption, double comError);
+
+      /**
+       * @brief Sets the scale of the time on air (1 real time, 0 no delay).
+       *
+       */
+      void setTimeScale(double scale)
+      {
+        m_scale = (scale > 0) ? scale : 0;
+      }
+
+      /**
+       * @brief Sets the seed of the fault generator.
+       *
+       */
+      void setSeed(unsigned int seed)
+      {
+        m_seed = seed;
+      }
+
+      /**
+       * @brief Sets the observer of the messages acknowledged (0 for none).
+       *
+       */
+      void setObserver(Observer *observer)
+      {
+        m_observer = observer;
+      }
+
+      /**
+       * @brief Gets the counters.
+       *
+       */
+      const Stats& stats() const
+      {
+        return m_stats;
+      }
+
+      /**
+       * @brief Handles the bytes of the host and the answer timer.
+       *
+       * @param[in] fd file descriptor ready.
+       * @param[in] events epoll events.
+       */
+      virtual void handleEvent(int fd, uint32_t events);
+
+      /**
+       * @brief Answers a command of the host.
+       *
+       * @param[in] frame view of the command.
+       */
+      virtual void onFrame(const Frame &frame);
+
+      /**
+       * @brief Answers a corrupted frame of the host.
+       *
+       * @param[in] code error code, according to lora::Command::_ERROR_CODE enum.
+       * @param[in] data first byte of the bad frame (SOH).
+       * @param[in] size number of bytes of the bad frame examined.
+       */
+      virtual void onError(uint8_t code, const uint8_t *data, size_t size);
+
+    private:
+      /**
+       * @brief Answer waiting for its time.
+       */
+      struct Answer
+      {
+          /// Time of the answer (usec).
+          uint64_t due;
+
+          /// Frame.
+          std::string frame;
+
+          /// Message acknowledged (only with an observer).
+          std::string message;
+      };
+
+      /// Copy is not allowed
+      GatewaySim(const GatewaySim &g);
+
+      /// Assignment is not allowed
+      GatewaySim & operator=(const GatewaySim &g);
+
+      /**
+       * @brief Queues an answer after the commands already handled.
+       *
+       * @param[in] cmd command field (i.e. "ACK").
+       * @param[in] payload data after the command field (with '#'), can be empty.
+       * @param[in] delay time of the command (usec, not scaled).
+       * @param[in] message message acknowledged (ACK only).
+       */
+      void answer(const char *cmd, const std::string &payload, uint64_t delay = 0,
+          const std::string *message = 0);
+
+      /**
+       * @brief Writes the answers whose time has come and arms the timer for
+       * the next one.
+       *
+       */
+      void flush();
+
+      /**
+       * @brief Creates the INFO payload of the current setup.
+       *
+       */
+      std::string info();
+
+      /**
+       * @brief Returns true with the given probability.
+       *
+       */
+      bool happens(double rate);
+
+      //! Slave device
+      std::string m_device;
+
+      //! Symbolic link to the slave device
+      std::string m_link;
+
+      //! Master side
+      int m_master;
+
+      //! Slave side kept open
+      int m_slave;
+
+      //! Event loop
+      Reactor *m_reactor;
+
+      //! Answer timer
+      int m_timer;
+
+      //! Setup of the module
+      command::Info m_config;
+
+      //! Frame parser
+      FrameParser m_parser;
+
+      //! Receive window
+      uint8_t m_window[WINDOW_SIZE];
+
+      //! Bytes in the window
+      size_t m_size;
+
+      //! Answers not sent yet (in order of time)
+      std::deque<Answer> m_answers;
+
+      //! The module is busy until this time (usec)
+      uint64_t m_busy;
+
+      //! Rate of the lost answers
+      double m_loss;
+
+      //! Rate of the corrupted answers
+      double m_corruption;
+
+      //! Rate of the COM_ERROR
+      double m_comError;
+
+      //! Scale of the time on air
+      double m_scale;
+
+      //! State of the fault generator
+      unsigned int m_seed;
+
+      //! Observer of the messages acknowledged
+      Observer *m_observer;
+
+      //! Counters
+      Stats m_stats;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_GWSIM_H_ */
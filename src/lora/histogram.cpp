@@ -0,0 +1,85 @@
+//============================================================================
+// Name        : histogram.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Histogram of durations with logarithmic buckets
+//============================================================================
+
+#include "histogram.h"
+
+namespace lora
+{
+  Histogram::Histogram()
+  {
+    clear();
+  }
+
+  Histogram::~Histogram()
+  {
+  }
+
+  void Histogram::clear()
+  {
+    for (unsigned int i = 0; i < BUCKETS; i++)
+    {
+      m_buckets[i] = 0;
+    }
+
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+  }
+
+  unsigned int Histogram::bucket(uint64_t value)
+  {
+    // Number of significant bits of the value
+    unsigned int b = 0;
+    while (value && b < BUCKETS - 1)
+    {
+      value >>= 1;
+      b++;
+    }
+
+    return b;
+  }
+
+  void Histogram::add(uint64_t value)
+  {
+    m_buckets[bucket(value)]++;
+
+    if (m_count == 0 || value < m_min)
+      m_min = value;
+    if (value > m_max)
+      m_max = value;
+
+    m_count++;
+    m_sum += value;
+  }
+
+  uint64_t Histogram::percentile(double percent) const
+  {
+    if (m_count == 0)
+      return 0;
+
+    uint64_t target = (uint64_t) (percent * m_count / 100.0 + 0.5);
+    if (target == 0)
+      target = 1;
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < BUCKETS - 1; i++)
+    {
+      seen += m_buckets[i];
+      if (seen >= target)
+      {
+        // Largest value of the bucket, not more than the maximum
+        uint64_t upper = (i) ? lower(i + 1) - 1 : 0;
+        return (upper < m_max) ? upper : m_max;
+      }
+    }
+
+    return m_max;
+  }
+
+} /* namespace lora */
@@ -0,0 +1,133 @@
+//============================================================================
+// Name        : histogram.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Histogram of durations with logarithmic buckets
+//============================================================================
+#ifndef _LORA_HISTOGRAM_H_
+#define _LORA_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace lora
+{
+  /**
+   * @brief The Histogram class counts durations (i.e. the round trip time
+   * of the frames) in buckets of powers of two.
+   *
+   * Bucket 0 counts the value 0 and bucket i (1 to BUCKETS - 1) the values
+   * from 2^(i-1) to 2^i - 1; longer durations are counted in the last
+   * bucket. A value costs a few instructions and no memory, so histograms
+   * can be kept for every destination.
+   *
+   */
+  class Histogram
+  {
+    public:
+      /// Number of buckets (the last one counts up to 2^31 - 1 usec, 35 minutes).
+      static const unsigned int BUCKETS = 32;
+
+      /**
+       * @brief Creates an empty histogram.
+       *
+       */
+      Histogram();
+
+      /**
+       * @brief Destroys the histogram.
+       *
+       */
+      virtual ~Histogram();
+
+      /**
+       * @brief Counts a value.
+       *
+       * @param[in] value value (i.e. usec).
+       */
+      void add(uint64_t value);
+
+      /**
+       * @brief Removes all values.
+       *
+       */
+      void clear();
+
+      /**
+       * @brief Gets the bucket of a value.
+       *
+       */
+      static unsigned int bucket(uint64_t value);
+
+      /**
+       * @brief Gets the smallest value of a bucket.
+       *
+       */
+      static uint64_t lower(unsigned int bucket)
+      {
+        return (bucket) ? (uint64_t) 1 << (bucket - 1) : 0;
+      }
+
+      /**
+       * @brief Gets the values counted in a bucket.
+       *
+       */
+      uint64_t count(unsigned int bucket) const
+      {
+        return (bucket < BUCKETS) ? m_buckets[bucket] : 0;
+      }
+
+      /**
+       * @brief Gets an upper bound of a percentile: the values below are at
+       * least the given part of all values.
+       *
+       * @param[in] percent percentile (0 to 100).
+       *
+       * @returns the bound (the maximum for the last bucket), 0 if empty.
+       */
+      uint64_t percentile(double percent) const;
+
+      /// Number of values.
+      uint64_t count() const
+      {
+        return m_count;
+      }
+
+      /// Smallest value (0 if empty).
+      uint64_t min() const
+      {
+        return m_min;
+      }
+
+      /// Largest value.
+      uint64_t max() const
+      {
+        return m_max;
+      }
+
+      /// Mean of the values (0 if empty).
+      uint64_t mean() const
+      {
+        return (m_count) ? m_sum / m_count : 0;
+      }
+
+    private:
+      //! Values of each bucket
+      uint64_t m_buckets[BUCKETS];
+
+      //! Number of values
+      uint64_t m_count;
+
+      //! Sum of the values
+      uint64_t m_sum;
+
+      //! Smallest value
+      uint64_t m_min;
+
+      //! Largest value
+      uint64_t m_max;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_HISTOGRAM_H_ */
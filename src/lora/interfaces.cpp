@@ -7,6 +7,8 @@
 //============================================================================
 #include "interfaces.h"
 #include "utils.h"
+#include "crc16.h"
+#include "scanner.h"
 #include <stdlib.h>
 #include <iostream>
 
@@ -17,46 +19,28 @@ namespace lora
    *******************************************************************************************************************/
   uint16_t Command::CRC16(uint8_t *buf, size_t len)
   {
-    uint16_t crc = 0xFFFF;
-
-    for (size_t pos = 0; pos < len; pos++)
-    {
-      crc ^= (uint16_t) buf[pos];       // XOR byte into least sig. byte of crc
-
-      for (int i = 8; i != 0; i--)
-      {    // Loop over each bit
-        if ((crc & 0x0001) != 0)
-        {      // If the LSB is set
-          crc >>= 1;                    // Shift right and XOR 0xA001
-          crc ^= 0xA001;
-        }
-        else
-          // Else LSB is not set
-          crc >>= 1;                    // Just shift right
-      }
-    }
     // Note, this number has low and high bytes swapped, so use it accordingly (or swap bytes)
-    return crc;
+    return Crc16::compute(buf, len);
   }
 
-  uint8_t Command::createFieldStart(uint8_t *buffer, uint8_t size)
+  size_t Command::createFieldStart(uint8_t *buffer, size_t size)
   {
     if (buffer == 0 || size < SZ_START)
       return 0;
 
-    uint8_t index = 0;
+    size_t index = 0;
     buffer[index++] = SOH;
 
     return index;
 
   }
 
-  uint8_t Command::createFieldCRC(uint8_t *buffer, uint8_t size)
+  size_t Command::createFieldCRC(uint8_t *buffer, size_t size)
   {
     if (buffer == 0 || size < SZ_CRC /* sizeof(m_crc) */)
       return 0;
 
-    uint8_t index = 0;
+    size_t index = 0;
 
     for (uint8_t i = 0; i < SZ_CRC_BINARY/* ( sizeof(m_crc) * 2 ) */; i++)
     {
@@ -78,12 +62,12 @@ namespace lora
 
   }
 
-  uint8_t Command::createFieldSeparator(uint8_t *buffer, uint8_t size)
+  size_t Command::createFieldSeparator(uint8_t *buffer, size_t size)
   {
     if (buffer == 0 || size < SZ_SEPARATOR)
       return 0;
 
-    uint8_t index = 0;
+    size_t index = 0;
     buffer[index++] = CR;
     buffer[index++] = LF;
 
@@ -91,12 +75,12 @@ namespace lora
 
   }
 
-  uint8_t Command::createFieldEnd(uint8_t *buffer, uint8_t size)
+  size_t Command::createFieldEnd(uint8_t *buffer, size_t size)
   {
     if (buffer == 0 || size < SZ_END)
       return 0;
 
-    uint8_t index = 0;
+    size_t index = 0;
     buffer[index++] = EOT;
 
     return index;
@@ -176,6 +160,10 @@ namespace lora
     size_t index = 0;
     size_t i = 0;
 
+    // Offsets of SOH and CR, the CRC is calculated on the bytes between them
+    size_t start = 0;
+    size_t end = 0;
+
     crc = 0;
 
     std::string cmd = "";
@@ -193,6 +181,9 @@ namespace lora
     bool msg_found = false;
     uint8_t state = LOOKFOR_SOH;
 
+    // Skip the bytes before the first SOH
+    index = Scanner::find(buffer, sz, SOH);
+
     while (index < sz && !msg_found)
     {
 
@@ -211,6 +202,7 @@ namespace lora
           if (buffer[index] == SOH)
           {
             i = 0;
+            start = index;
             state = LOOKFOR_CMD;
           }
         }
@@ -284,6 +276,7 @@ namespace lora
                 payload[i] = 0;
                 p_size = i;
                 i = 0;
+                end = index - 1;
                 state = LOOKFOR_CRC;
               }
               else
@@ -345,6 +338,12 @@ namespace lora
           {
             i = 0;
             state = MSG_FOUND;
+
+            if (Crc16::compute(&buffer[start + 1], end - start - 1) != crc)
+            {
+              ret = INVALID_CRC;
+              state = MSG_NOT_FOUND;
+            }
           }
           else
           {
@@ -374,7 +373,14 @@ namespace lora
         index++;
     }
 
-    if (state != MSG_FOUND)
+    if (state == MSG_NOT_FOUND)
+    {
+      // Error found on the last byte
+      type = UNKNOWN;
+      p_size = 0;
+      crc = 0;
+    }
+    else if (state != MSG_FOUND)
     {
       ret = CMD_NOT_FOUND;
     }
@@ -386,10 +392,10 @@ namespace lora
     return ret;
   }
 
-  uint8_t Command::createPayload(uint8_t *buffer, size_t size)
+  size_t Command::createPayload(uint8_t *buffer, size_t size)
   {
-    uint8_t index = 0;
-    uint8_t n = 0;
+    size_t index = 0;
+    size_t n = 0;
 
     // Create type field
     if ((n = createFieldType(&buffer[index], size - index)) == 0)
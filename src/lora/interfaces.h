@@ -155,7 +155,7 @@ namespace lora
         /// Error while searching the payload, not found CR + LF.
         INVALID_PAYLOAD_2 = 0x05,
 
-        /// Invalid CRC field.
+        /// Invalid CRC field, or CRC different from the one of the received bytes.
         INVALID_CRC = 0x07,
 
         /// EOT not found.
@@ -242,7 +242,7 @@ namespace lora
        *
        * @returns message length.
        */
-      virtual uint8_t size()
+      virtual size_t size()
       {
         return m_size;
       }
@@ -253,6 +253,8 @@ namespace lora
        *
        * This function processes a buffer of size "sz" bytes and extract command
        * type, payload (<Data_Separator> + <Data>), payload length and CRC value.
+       * A command whose CRC doesn't match the received bytes is rejected with
+       * lora::Command::INVALID_CRC.
        *
        * @param[in] buffer buffer to process
        * @param[in] sz size of the buffer to process
@@ -309,7 +311,7 @@ namespace lora
        *
        * @returns number of byte written. 0 if there was an error.
        */
-      virtual uint8_t createFieldStart(uint8_t *buffer, uint8_t size);
+      virtual size_t createFieldStart(uint8_t *buffer, size_t size);
 
       /**
        * @brief Creates payload of the command (<Data_Separator> + <Data>).
@@ -322,7 +324,7 @@ namespace lora
        *
        * @returns number of byte written. 0 if there was an error.
        */
-      virtual uint8_t createPayload(uint8_t *buffer, size_t size);
+      virtual size_t createPayload(uint8_t *buffer, size_t size);
 
       /**
        * @brief Creates field separator before the CRC.
@@ -335,7 +337,7 @@ namespace lora
        *
        * @returns number of byte written. 0 if there was an error.
        */
-      virtual uint8_t createFieldSeparator(uint8_t *buffer, uint8_t size);
+      virtual size_t createFieldSeparator(uint8_t *buffer, size_t size);
 
       /**
        * @brief Creates the CRC field of the command.
@@ -348,7 +350,7 @@ namespace lora
        *
        * @returns number of byte written. 0 if there was an error.
        */
-      virtual uint8_t createFieldCRC(uint8_t *buffer, uint8_t size);
+      virtual size_t createFieldCRC(uint8_t *buffer, size_t size);
 
       /**
        * @brief Creates the stop sequence of the command.
@@ -360,7 +362,7 @@ namespace lora
        *
        * @returns number of byte written. 0 if there was an error.
        */
-      virtual uint8_t createFieldEnd(uint8_t *buffer, uint8_t size);
+      virtual size_t createFieldEnd(uint8_t *buffer, size_t size);
 
       /**
        * @brief Creates the type field of the command.
@@ -373,7 +375,7 @@ namespace lora
        *
        * @returns number of byte written. 0 if there was an error.
        */
-      virtual uint8_t createFieldType(uint8_t *buffer, uint8_t size) = 0;
+      virtual size_t createFieldType(uint8_t *buffer, size_t size) = 0;
 
       //! Code of the message type
       uint8_t m_type;
@@ -382,7 +384,7 @@ namespace lora
       uint16_t m_crc;
 
       //! Message size
-      uint8_t m_size;
+      size_t m_size;
   };
 
   /**
@@ -437,7 +439,7 @@ namespace lora
        *
        * @returns number of byte written. 0 if there was an error.
        */
-      virtual uint8_t serialize(uint8_t *buffer, size_t size) = 0;
+      virtual size_t serialize(uint8_t *buffer, size_t size) = 0;
   };
 
   /**
@@ -493,7 +495,7 @@ namespace lora
        *
        * @returns number of byte processed. 0 if there was an error.
        */
-      virtual uint8_t createFromBuffer(uint8_t *buffer, size_t size) = 0;
+      virtual size_t createFromBuffer(uint8_t *buffer, size_t size) = 0;
   };
 
   /**
@@ -0,0 +1,352 @@
+//============================================================================
+// Name        : outbox.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Queue of the messages waiting to be sent
+//============================================================================
+
+#include "outbox.h"
+#include "submit.h"
+#include "fragment.h"
+
+#include <string.h>
+
+namespace lora
+{
+  Outbox::Outbox() :
+      m_free(false), m_maxWait(0), m_id(0), m_submitted(0)
+  {
+    for (unsigned int i = 0; i < CAPACITY; i++)
+    {
+      m_used[i] = false;
+      m_free.push(&m_slots[i]);
+    }
+
+    memset(m_dests, 0, sizeof(m_dests));
+
+    for (unsigned int i = 0; i < LANES; i++)
+    {
+      m_active[i].setOverWrite(false);
+      m_oldest[i] = 0;
+      m_newest[i] = 0;
+      m_depth[i] = 0;
+      m_weight[i] = 1;
+      m_credit[i] = 1;
+      memset(&m_stats[i], 0, sizeof(m_stats[i]));
+    }
+  }
+
+  Outbox::~Outbox()
+  {
+  }
+
+  Outbox::Message* Outbox::create(uint64_t now)
+  {
+    Message *msg = 0;
+    if (!m_free.pop(msg))
+      return 0;
+
+    m_used[msg - m_slots] = true;
+
+    // Identifiers are never 0
+    if (++m_id == 0)
+      m_id = 1;
+
+    msg->id = m_id;
+    msg->dest = 0;
+    msg->priority = 0;
+    msg->client = -1;
+    msg->status = submit::QUEUED;
+    msg->done = false;
+    msg->outstanding = 0;
+    msg->time = now;
+    msg->deadline = 0;
+    msg->data = 0;
+    msg->size = 0;
+    msg->owner = 0;
+    msg->ref = 0;
+    msg->frames = 0;
+    msg->next = 0;
+    msg->older = 0;
+    msg->newer = 0;
+
+    return msg;
+  }
+
+  void Outbox::submit(Message *msg)
+  {
+    unsigned int l = lane(msg->priority);
+    Destination &dst = m_dests[msg->dest];
+    msg->frames = Fragmenter::fragments(msg->data, msg->size);
+
+    // Queue of the destination
+    msg->next = 0;
+    if (dst.tail[l])
+      dst.tail[l]->next = msg;
+    else
+      dst.head[l] = msg;
+    dst.tail[l] = msg;
+    dst.queued++;
+    dst.size += msg->size;
+
+    if (!dst.active[l])
+    {
+      dst.active[l] = true;
+      dst.deficit[l] = 0;
+      m_active[l].push(msg->dest);
+    }
+
+    // Submission order of the lane
+    msg->older = m_newest[l];
+    msg->newer = 0;
+    if (m_newest[l])
+      m_newest[l]->newer = msg;
+    else
+      m_oldest[l] = msg;
+    m_newest[l] = msg;
+
+    m_depth[l]++;
+    m_submitted++;
+
+    if (m_depth[l] > m_stats[l].maxDepth)
+      m_stats[l].maxDepth = m_depth[l];
+  }
+
+  Outbox::Message* Outbox::next(uint64_t now, Selector &selector, uint64_t &wake)
+  {
+    Message *aged = 0;
+    int weighted = -1;
+    int ready = -1;
+    Message *heads[LANES];
+    wake = 0;
+
+    // Heads that can be sent now, most urgent lane first
+    for (int l = LANES - 1; l >= 0; l--)
+    {
+      heads[l] = 0;
+
+      // The oldest message of the lane goes first if it waited too long
+      Message *oldest = m_oldest[l];
+      if (m_maxWait && oldest && now - oldest->time >= m_maxWait
+          && (aged == 0 || oldest->time < aged->time) && selector.release(*oldest, now) <= now)
+        aged = oldest;
+
+      Message *head = candidate(l);
+      if (head == 0)
+        continue;
+
+      uint64_t t = selector.release(*head, now);
+      if (t > now)
+      {
+        if (wake == 0 || t < wake)
+          wake = t;
+        continue;
+      }
+
+      heads[l] = head;
+
+      if (weighted < 0 && m_credit[l] > 0)
+        weighted = l;
+
+      if (ready < 0)
+        ready = l;
+    }
+
+    if (aged)
+    {
+      m_stats[lane(aged->priority)].aged++;
+      return take(aged, now, false);
+    }
+
+    if (weighted < 0 && ready >= 0)
+    {
+      // Round over: every lane gets its weight again
+      for (unsigned int l = 0; l < LANES; l++)
+      {
+        m_credit[l] = m_weight[l];
+      }
+      weighted = ready;
+    }
+
+    if (weighted < 0)
+      return 0;
+
+    m_credit[weighted]--;
+    return take(heads[weighted], now, true);
+  }
+
+  Outbox::Message* Outbox::candidate(unsigned int lane)
+  {
+    CircularBuffer<uint8_t, DESTINATIONS> &active = m_active[lane];
+    unsigned int visited = 0;
+
+    while (!active.empty())
+    {
+      uint8_t d = active[0];
+      Destination &dst = m_dests[d];
+      Message *head = dst.head[lane];
+
+      if (head == 0)
+      {
+        // Queue emptied out of turn: the destination leaves the round
+        active.pop(d);
+        dst.active[lane] = false;
+        dst.deficit[lane] = 0;
+        continue;
+      }
+
+      if (dst.deficit[lane] >= head->frames)
+        return head;
+
+      if (visited >= active.size())
+      {
+        skipRounds(lane);
+        visited = 0;
+      }
+
+      // Turn over: credit for the next round
+      dst.deficit[lane] += QUANTUM;
+      active.pop(d);
+      active.push(d);
+      visited++;
+    }
+
+    return 0;
+  }
+
+  void Outbox::skipRounds(unsigned int lane)
+  {
+    CircularBuffer<uint8_t, DESTINATIONS> &active = m_active[lane];
+
+    // Rounds needed by the destination nearest to its message
+    uint32_t rounds = 0;
+    for (unsigned int i = 0; i < active.size(); i++)
+    {
+      const Destination &dst = m_dests[active[i]];
+      if (dst.head[lane] == 0)
+        continue;
+
+      uint32_t missing = dst.head[lane]->frames - dst.deficit[lane];
+      uint32_t r = (missing + QUANTUM - 1) / QUANTUM;
+      if (rounds == 0 || r < rounds)
+        rounds = r;
+    }
+
+    // The last round is done one destination at a time, in order
+    if (rounds <= 1)
+      return;
+
+    for (unsigned int i = 0; i < active.size(); i++)
+    {
+      m_dests[active[i]].deficit[lane] += (rounds - 1) * QUANTUM;
+    }
+  }
+
+  Outbox::Message* Outbox::head(uint8_t dest) const
+  {
+    const Destination &dst = m_dests[dest];
+    for (unsigned int l = LANES; l > 0; l--)
+    {
+      if (dst.head[l - 1])
+        return dst.head[l - 1];
+    }
+
+    return 0;
+  }
+
+  Outbox::Message* Outbox::take(Message *msg, uint64_t now, bool turn)
+  {
+    unsigned int l = lane(msg->priority);
+    Destination &dst = m_dests[msg->dest];
+
+    // The message is the head of its destination queue
+    dst.head[l] = msg->next;
+    if (dst.head[l] == 0)
+      dst.tail[l] = 0;
+    dst.queued--;
+    dst.size -= msg->size;
+    dst.messages++;
+    dst.bytes += msg->size;
+
+    if (turn)
+    {
+      // Taken in turn: the destination is the first of the round
+      dst.deficit[l] -= msg->frames;
+      if (dst.head[l] == 0)
+      {
+        uint8_t d = 0;
+        m_active[l].pop(d);
+        dst.active[l] = false;
+        dst.deficit[l] = 0;
+      }
+    }
+
+    if (msg->older)
+      msg->older->newer = msg->newer;
+    else
+      m_oldest[l] = msg->newer;
+    if (msg->newer)
+      msg->newer->older = msg->older;
+    else
+      m_newest[l] = msg->older;
+    msg->next = 0;
+    msg->older = 0;
+    msg->newer = 0;
+    m_depth[l]--;
+
+    Lane &st = m_stats[l];
+    uint64_t wait = (now > msg->time) ? now - msg->time : 0;
+    st.messages++;
+    st.wait += wait;
+    if (wait > st.maxWait)
+      st.maxWait = wait;
+
+    return msg;
+  }
+
+  void Outbox::setWeight(unsigned int lane, unsigned int weight)
+  {
+    if (lane >= LANES)
+      return;
+
+    m_weight[lane] = (weight) ? weight : 1;
+    m_credit[lane] = m_weight[lane];
+  }
+
+  size_t Outbox::queued() const
+  {
+    size_t n = 0;
+    for (unsigned int l = 0; l < LANES; l++)
+    {
+      n += m_depth[l];
+    }
+
+    return n;
+  }
+
+  void Outbox::release(Message *msg)
+  {
+    m_used[msg - m_slots] = false;
+    m_free.push(msg);
+
+    if (msg->owner)
+      msg->owner->released(*msg);
+  }
+
+  size_t Outbox::detach(int client)
+  {
+    size_t n = 0;
+    for (unsigned int i = 0; i < CAPACITY; i++)
+    {
+      if (m_used[i] && m_slots[i].client == client)
+      {
+        m_slots[i].client = -1;
+        n++;
+      }
+    }
+
+    return n;
+  }
+
+} /* namespace lora */
@@ -0,0 +1,533 @@
+//============================================================================
+// Name        : outbox.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Queue of the messages waiting to be sent
+//============================================================================
+#ifndef _LORA_OUTBOX_H_
+#define _LORA_OUTBOX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "circularbuffer.h"
+
+namespace lora
+{
+  /**
+   * @brief The Outbox class stores the messages submitted to the daemon
+   * from their submission to their final status.
+   *
+   * The messages are kept in a fixed pool of CAPACITY slots. A slot is taken
+   * with create(), filled by the front end (pipe, socket, ...) and queued
+   * with submit(); the sender takes the queued messages in order with next()
+   * and gives the slot back with release() when the final status of the
+   * message is known (frames acknowledged, expired, ...).
+   *
+   * A message is either copied in the buffer of its slot (Message::assign())
+   * or left where the front end received it (a shared ring): in this case
+   * the front end is the owner of the message and it is notified when the
+   * slot is released. The buffer of a slot keeps its memory, so a slot used
+   * again doesn't allocate memory unless the message is longer than the
+   * previous ones.
+   *
+   * When all slots are taken (full()) the front ends stop reading, so the
+   * producers are blocked by the pipe or the socket.
+   *
+   * The queued messages wait in LANES priority lanes (the priority of a
+   * message selects its lane, higher is more urgent). next() serves the
+   * lanes by weighted round robin: in a round a lane gives at most its
+   * weight of messages, the most urgent lane first. In a lane every
+   * destination has its own queue (a flat table indexed by the node
+   * address) and the destinations with messages are served by deficit
+   * round robin on the frames (a long message costs one frame per
+   * fragment): each turn a destination gets QUANTUM frames of credit, so a
+   * node with long messages doesn't take the channel from the others. Only the messages that
+   * can be sent now (asked to a Selector, i.e. the duty cycle scheduler)
+   * are taken, so a short alarm goes before a long frame waiting for the
+   * duty cycle budget. A message that has waited more than the maximum wait
+   * goes first whatever its lane (anti-starvation). The sender can also
+   * take out of turn, with head() and remove(), the messages that it packs
+   * in the frame of the message being sent (see Coalescer).
+   *
+   */
+  class Outbox
+  {
+    public:
+      /// Maximum number of messages in the outbox (a power of two).
+      static const unsigned int CAPACITY = 256;
+
+      /// Number of priority lanes.
+      static const unsigned int LANES = 4;
+
+      /// Number of destinations (node addresses).
+      static const unsigned int DESTINATIONS = 256;
+
+      /// Credit of a destination in a round of a lane (frames).
+      static const uint32_t QUANTUM = 1;
+
+      struct Message;
+
+      /**
+       * @brief Interface for a front end that keeps the bytes of its
+       * messages.
+       *
+       */
+      class Owner
+      {
+        public:
+          /**
+           * @brief Destroys the owner.
+           *
+           */
+          virtual ~Owner()
+          {
+          }
+          ;
+
+          /**
+           * @brief Called when the slot of a message is released: its bytes
+           * are not used any more.
+           *
+           * @param[in] msg message released.
+           */
+          virtual void released(const Message &msg) = 0;
+      };
+
+      /**
+       * @brief Message submitted to the daemon.
+       */
+      struct Message
+      {
+          /// Identifier (never 0).
+          uint32_t id;
+
+          /// Address of the destination node.
+          uint8_t dest;
+
+          /// Priority (0 is the lowest).
+          uint8_t priority;
+
+          /// Socket of the client to notify (-1 if none).
+          int client;
+
+          /// Current status (lora::submit::_STATUS).
+          uint8_t status;
+
+          /// True when no other frame of the message will be sent.
+          bool done;
+
+          /// Frames sent and not acknowledged yet.
+          unsigned int outstanding;
+
+          /// Submission time (usec).
+          uint64_t time;
+
+          /// Expiration time of the message not sent (usec, 0 if never).
+          uint64_t deadline;
+
+          /// First byte of the message.
+          const uint8_t *data;
+
+          /// Length of the message.
+          size_t size;
+
+          /// Copy of the message (if it has no owner).
+          std::vector<uint8_t> buffer;
+
+          /// Front end that keeps the bytes of the message (0 if copied).
+          Owner *owner;
+
+          /// Reference of the message for its owner.
+          uint64_t ref;
+
+          /// Frames of the message (set by submit()).
+          uint32_t frames;
+
+          /// Next message of the same destination and lane (queued), or of
+          /// the same frame (coalesced).
+          Message *next;
+
+          /// Previous and next message of the lane, in submission order.
+          Message *older;
+          Message *newer;
+
+          /**
+           * @brief Copies the bytes of the message in the buffer of the slot.
+           *
+           * @param[in] bytes message.
+           * @param[in] len length of the message.
+           */
+          void assign(const uint8_t *bytes, size_t len)
+          {
+            buffer.assign(bytes, bytes + len);
+            data = buffer.data();
+            size = len;
+          }
+      };
+
+      /**
+       * @brief Interface that tells when a message can be sent.
+       *
+       */
+      class Selector
+      {
+        public:
+          /**
+           * @brief Destroys the selector.
+           *
+           */
+          virtual ~Selector()
+          {
+          }
+          ;
+
+          /**
+           * @brief Gets the time when a message can be sent.
+           *
+           * @param[in] msg message at the head of a lane.
+           * @param[in] now current time (usec).
+           *
+           * @returns the time (usec), now or less if the message must be
+           * taken now (also to be dropped).
+           */
+          virtual uint64_t release(const Message &msg, uint64_t now) = 0;
+      };
+
+      /**
+       * @brief Statistics of a priority lane.
+       */
+      struct Lane
+      {
+          /// Messages taken from the lane.
+          unsigned long messages;
+
+          /// Messages taken because they waited too long.
+          unsigned long aged;
+
+          /// Total wait of the messages taken (usec).
+          uint64_t wait;
+
+          /// Longest wait of a message (usec).
+          uint64_t maxWait;
+
+          /// Most messages queued at once.
+          size_t maxDepth;
+      };
+
+      /**
+       * @brief Creates an empty outbox. All lanes have weight 1 and the
+       * messages never age.
+       *
+       */
+      Outbox();
+
+      /**
+       * @brief Destroys the outbox.
+       *
+       */
+      virtual ~Outbox();
+
+      /**
+       * @brief Takes a free slot.
+       *
+       * The message gets a new identifier, no client and no deadline.
+       *
+       * @param[in] now current time (usec).
+       *
+       * @returns the message, 0 if the outbox is full.
+       */
+      Message* create(uint64_t now);
+
+      /**
+       * @brief Queues a message taken with create().
+       *
+       * @param[in] msg message.
+       */
+      void submit(Message *msg);
+
+      /**
+       * @brief Gets and removes from the queue the next message to send.
+       *
+       * @param[in] now current time (usec).
+       * @param[in] selector tells when the head of a lane can be sent.
+       * @param[out] wake earliest time a message can be sent if none can be
+       * sent now (0 if the queue is empty).
+       *
+       * @returns the message, 0 if no message can be sent now.
+       */
+      Message* next(uint64_t now, Selector &selector, uint64_t &wake);
+
+      /**
+       * @brief Gets the first queued message of a destination, the most
+       * urgent lane first (to coalesce it with a message being sent).
+       *
+       * @param[in] dest address of the node.
+       *
+       * @returns the message, 0 if the destination has no queued messages.
+       */
+      Message* head(uint8_t dest) const;
+
+      /**
+       * @brief Removes out of turn a message returned by head(). The
+       * destination isn't charged: the message shares a frame already paid.
+       *
+       * @param[in] msg message.
+       * @param[in] now current time (usec).
+       */
+      void remove(Message *msg, uint64_t now)
+      {
+        take(msg, now, false);
+      }
+
+      /**
+       * @brief Sets the weight of a lane: messages of the lane taken in a
+       * round when all lanes are busy.
+       *
+       * @param[in] lane lane (0 to LANES - 1).
+       * @param[in] weight weight (at least 1).
+       */
+      void setWeight(unsigned int lane, unsigned int weight);
+
+      /**
+       * @brief Sets the maximum wait: a message queued for longer goes first.
+       *
+       * @param[in] usec maximum wait (usec, 0 disables the aging).
+       */
+      void setMaxWait(uint64_t usec)
+      {
+        m_maxWait = usec;
+      }
+
+      /**
+       * @brief Gets the lane of a priority.
+       *
+       */
+      static unsigned int lane(uint8_t priority)
+      {
+        return (priority < LANES) ? priority : LANES - 1;
+      }
+
+      /**
+       * @brief Gives back the slot of a message. The owner of the message, if
+       * any, is notified.
+       *
+       * @param[in] msg message (not queued).
+       */
+      void release(Message *msg);
+
+      /**
+       * @brief Forgets a client: its messages are not notified any more.
+       *
+       * @param[in] client socket of the client.
+       *
+       * @returns number of messages of the client.
+       */
+      size_t detach(int client);
+
+      /**
+       * @brief Returns true if all slots are taken.
+       *
+       */
+      bool full() const
+      {
+        return m_free.empty();
+      }
+
+      /**
+       * @brief Gets the number of messages (queued or being sent).
+       *
+       */
+      size_t size() const
+      {
+        return CAPACITY - m_free.size();
+      }
+
+      /**
+       * @brief Gets the number of queued messages.
+       *
+       */
+      size_t queued() const;
+
+      /**
+       * @brief Gets the number of queued messages of a lane.
+       *
+       * @param[in] lane lane (0 to LANES - 1).
+       */
+      size_t depth(unsigned int lane) const
+      {
+        return m_depth[lane];
+      }
+
+      /**
+       * @brief Gets the number of queued messages of a destination.
+       *
+       * @param[in] dest address of the node.
+       */
+      size_t pending(uint8_t dest) const
+      {
+        return m_dests[dest].queued;
+      }
+
+      /**
+       * @brief Gets the bytes of the queued messages of a destination.
+       *
+       * @param[in] dest address of the node.
+       */
+      size_t pendingBytes(uint8_t dest) const
+      {
+        return m_dests[dest].size;
+      }
+
+      /**
+       * @brief Gets the number of messages of a destination taken from the
+       * queues.
+       *
+       * @param[in] dest address of the node.
+       */
+      unsigned long taken(uint8_t dest) const
+      {
+        return m_dests[dest].messages;
+      }
+
+      /**
+       * @brief Gets the bytes of the messages of a destination taken from
+       * the queues.
+       *
+       * @param[in] dest address of the node.
+       */
+      uint64_t bytes(uint8_t dest) const
+      {
+        return m_dests[dest].bytes;
+      }
+
+      /**
+       * @brief Gets the statistics of a lane.
+       *
+       * @param[in] lane lane (0 to LANES - 1).
+       */
+      const Lane& stats(unsigned int lane) const
+      {
+        return m_stats[lane];
+      }
+
+      /**
+       * @brief Gets the weight of a lane.
+       *
+       * @param[in] lane lane (0 to LANES - 1).
+       */
+      unsigned int weight(unsigned int lane) const
+      {
+        return m_weight[lane];
+      }
+
+      /// Number of messages submitted.
+      unsigned long submitted() const
+      {
+        return m_submitted;
+      }
+
+    private:
+      /// Copy is not allowed
+      Outbox(const Outbox &o);
+
+      /// Assignment is not allowed
+      Outbox & operator=(const Outbox &o);
+
+      //! Slots
+      Message m_slots[CAPACITY];
+
+      //! True if the slot is taken
+      bool m_used[CAPACITY];
+
+      //! Free slots
+      CircularBuffer<Message*, CAPACITY> m_free;
+
+      /**
+       * @brief Queues of a destination.
+       */
+      struct Destination
+      {
+          /// First and last message of each lane
+          Message *head[LANES];
+          Message *tail[LANES];
+
+          /// Credit of each lane (frames)
+          uint32_t deficit[LANES];
+
+          /// True if the destination is in the round of the lane
+          bool active[LANES];
+
+          /// Queued messages
+          size_t queued;
+
+          /// Bytes of the queued messages
+          size_t size;
+
+          /// Messages taken
+          unsigned long messages;
+
+          /// Bytes of the messages taken
+          uint64_t bytes;
+      };
+
+      /**
+       * @brief Gets the message of a lane that the deficit round robin sends
+       * next (the destinations without credit go to the end of the round).
+       *
+       * @returns the message, 0 if the lane is empty.
+       */
+      Message* candidate(unsigned int lane);
+
+      /**
+       * @brief Skips the rounds of a lane in which no destination has enough
+       * credit for its message.
+       *
+       */
+      void skipRounds(unsigned int lane);
+
+      /**
+       * @brief Takes the first message of a destination and updates the
+       * statistics.
+       *
+       * @param[in] msg message at the head of its destination queue.
+       * @param[in] turn true if taken in the turn of the destination (false
+       * if it waited too long or it is coalesced).
+       */
+      Message* take(Message *msg, uint64_t now, bool turn);
+
+      //! Queues of the destinations
+      Destination m_dests[DESTINATIONS];
+
+      //! Destinations with messages in each lane, in round order
+      CircularBuffer<uint8_t, DESTINATIONS> m_active[LANES];
+
+      //! Oldest and newest message of each lane
+      Message *m_oldest[LANES];
+      Message *m_newest[LANES];
+
+      //! Queued messages of each lane
+      size_t m_depth[LANES];
+
+      //! Weight of each lane
+      unsigned int m_weight[LANES];
+
+      //! Messages that each lane can still give in the current round
+      unsigned int m_credit[LANES];
+
+      //! Maximum wait before a message goes first (usec, 0 if never)
+      uint64_t m_maxWait;
+
+      //! Statistics of each lane
+      Lane m_stats[LANES];
+
+      //! Identifier of the next message
+      uint32_t m_id;
+
+      //! Statistics
+      unsigned long m_submitted;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_OUTBOX_H_ */
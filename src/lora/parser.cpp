@@ -0,0 +1,241 @@
+//============================================================================
+// Name        : parser.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Incremental parser of Lo-Ra frames
+//============================================================================
+
+#include "parser.h"
+#include "interfaces.h"
+#include "utils.h"
+#include "crc16.h"
+#include "scanner.h"
+
+#include <string.h>
+#include <ctype.h>
+
+namespace lora
+{
+  /*************************************************************************
+   * class FrameParser
+   ************************************************************************/
+  FrameParser::FrameParser(size_t maxFrame) :
+      m_maxFrame(maxFrame), m_frames(0), m_bytesSkipped(0)
+  {
+    memset(m_errors, 0, sizeof(m_errors));
+    reset();
+  }
+
+  FrameParser::~FrameParser()
+  {
+  }
+
+  void FrameParser::reset()
+  {
+    m_state = LOOKFOR_SOH;
+    m_pos = 0;
+    m_start = 0;
+    m_payload = 0;
+    m_type = Command::UNKNOWN;
+    m_cmdSize = 0;
+    m_crc = 0;
+    m_digits = 0;
+    m_skipped = 0;
+  }
+
+  void FrameParser::resync(const uint8_t *buffer, uint8_t code, Listener &listener)
+  {
+    if (code < N_ERRORS)
+      m_errors[code]++;
+
+    listener.onError(code, &buffer[m_start], m_pos - m_start + 1);
+
+    // Bytes after SOH are examined again: a new frame can start among them
+    m_pos = m_start + 1;
+    m_skipped++;
+    m_state = LOOKFOR_SOH;
+  }
+
+  size_t FrameParser::parse(const uint8_t *buffer, size_t size, Listener &listener)
+  {
+    size_t consumed = 0;
+
+    m_skipped = 0;
+
+    if (buffer == 0)
+      return 0;
+
+    while (m_pos < size)
+    {
+      uint8_t c = buffer[m_pos];
+
+      switch (m_state)
+      {
+        case LOOKFOR_SOH:
+        {
+          // Noise is skipped without running the state machine
+          size_t n = Scanner::find(&buffer[m_pos], size - m_pos, Command::SOH);
+          m_skipped += n;
+          m_pos += n;
+
+          if (m_pos < size)
+          {
+            m_start = m_pos;
+            m_cmdSize = 0;
+            m_state = LOOKFOR_CMD;
+            m_pos++;
+          }
+        }
+          break;
+
+        case LOOKFOR_CMD:
+        {
+          if (c == Command::FS || c == Command::CR)
+          {
+            m_cmd[m_cmdSize] = 0;
+
+            if (strcmp(m_cmd, "ACK") == 0)
+              m_type = Command::ACK;
+            else if (strcmp(m_cmd, "DATA") == 0)
+              m_type = Command::DATA;
+            else if (strcmp(m_cmd, "ERROR") == 0)
+              m_type = Command::ERROR;
+            else if (strcmp(m_cmd, "INFO") == 0)
+              m_type = Command::INFO;
+            else if (strcmp(m_cmd, "READ") == 0)
+              m_type = Command::READ;
+            else if (strcmp(m_cmd, "SET") == 0)
+              m_type = Command::SET;
+            else
+            {
+              resync(buffer, Command::INVALID_CMD, listener);
+              break;
+            }
+
+            // The payload starts with the separator (or CR if there is no data)
+            m_payload = m_pos;
+            m_state = LOOKFOR_PAYLOAD;
+            m_pos++;
+          }
+          else if (m_cmdSize < MAX_CMD_SIZE && isalpha(c))
+          {
+            m_cmd[m_cmdSize++] = toupper(c);
+            m_pos++;
+          }
+          else
+          {
+            resync(buffer, Command::INVALID_CMD, listener);
+          }
+        }
+          break;
+
+        case LOOKFOR_PAYLOAD:
+        {
+          // Payload bytes are skipped up to the next delimiter
+          size_t limit = m_start + m_maxFrame;
+          size_t end = (limit < size) ? limit : size;
+
+          m_pos += Scanner::findAny(&buffer[m_pos], end - m_pos, Command::LF, Command::SOH,
+              Command::EOT);
+
+          if (m_pos == end)
+          {
+            if (end == limit)
+            {
+              m_pos = limit - 1;
+              resync(buffer, Command::INVALID_PAYLOAD_1, listener);
+            }
+            break;
+          }
+
+          c = buffer[m_pos];
+          if (c == Command::LF && buffer[m_pos - 1] == Command::CR)
+          {
+            m_crc = 0;
+            m_digits = 0;
+            m_state = LOOKFOR_CRC;
+            m_pos++;
+          }
+          else if (c == Command::SOH || c == Command::EOT)
+          {
+            // Truncated frame
+            resync(buffer, Command::INVALID_PAYLOAD_2, listener);
+          }
+          else
+          {
+            m_pos++;
+          }
+        }
+          break;
+
+        case LOOKFOR_CRC:
+        {
+          if (!isxdigit(c))
+          {
+            resync(buffer, Command::INVALID_CRC, listener);
+            break;
+          }
+
+          m_crc <<= 4;
+          m_crc |= (convertHexCharToInt(c) & 0x0F);
+          m_pos++;
+
+          if (++m_digits == Command::SZ_CRC)
+            m_state = LOOKFOR_EOT;
+        }
+          break;
+
+        case LOOKFOR_EOT:
+        {
+          if (c != Command::EOT)
+          {
+            resync(buffer, Command::INVALID_EOT, listener);
+            break;
+          }
+
+          // CRC of the bytes between SOH and CR + LF
+          size_t end = m_pos - Command::SZ_CRC - Command::SZ_SEPARATOR;
+          if (Crc16::compute(&buffer[m_start + 1], end - m_start - 1) != m_crc)
+          {
+            resync(buffer, Command::INVALID_CRC, listener);
+            break;
+          }
+
+          Frame frame;
+          frame.type = m_type;
+          frame.data = &buffer[m_start];
+          frame.size = m_pos - m_start + 1;
+          frame.payload = &buffer[m_payload];
+          // Payload ends before CR + LF
+          frame.p_size = end - m_payload;
+          frame.crc = m_crc;
+
+          m_frames++;
+          m_pos++;
+          m_state = LOOKFOR_SOH;
+
+          listener.onFrame(frame);
+        }
+          break;
+      }
+
+      // Everything before a new frame can be consumed
+      if (m_state == LOOKFOR_SOH)
+        consumed = m_pos;
+    }
+
+    if (m_state != LOOKFOR_SOH)
+      consumed = m_start;
+
+    // Offsets are relative to the window: the consumed bytes are removed
+    m_pos -= consumed;
+    m_start = (m_start > consumed) ? (m_start - consumed) : 0;
+    m_payload = (m_payload > consumed) ? (m_payload - consumed) : 0;
+
+    m_bytesSkipped += m_skipped;
+
+    return consumed;
+  }
+
+} /* namespace lora */
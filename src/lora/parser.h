@@ -0,0 +1,253 @@
+//============================================================================
+// Name        : parser.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Incremental parser of Lo-Ra frames
+//============================================================================
+#ifndef _LORA_PARSER_H_
+#define _LORA_PARSER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace lora
+{
+  /**
+   * @brief View of a LoRa frame found in a receive buffer.
+   *
+   * A frame doesn't own any byte: all pointers refer to the buffer passed to
+   * the parser and they are valid until the bytes are consumed.
+   *
+   */
+  struct Frame
+  {
+    /// Command type, according to lora::Command::CMD_TYPE enum.
+    uint8_t type;
+
+    /// First byte of the frame (SOH).
+    const uint8_t *data;
+
+    /// Frame size in bytes, from SOH to EOT (included).
+    size_t size;
+
+    /// First byte of the payload (<Data_Separator> + <Data>).
+    const uint8_t *payload;
+
+    /// Payload size in bytes. 0 if the command has no payload.
+    size_t p_size;
+
+    /// Value of the CRC field.
+    uint16_t crc;
+  };
+
+  /**
+   * @brief Incremental (resumable) parser of LoRa frames.
+   *
+   * The parser looks for frames in a byte stream received in chunks of any
+   * size. It keeps its state between two calls, so a frame can be split
+   * across any number of chunks and a chunk can contain any number of
+   * frames.
+   *
+   * The caller keeps the received bytes in a window: at each call of parse()
+   * the window must start with the bytes not consumed by the previous call,
+   * followed by the new bytes. parse() returns the number of bytes consumed
+   * (complete frames and skipped bytes) that the caller must remove from
+   * the beginning of the window. Bytes already examined are never scanned
+   * again.
+   *
+   * The CRC of every frame is verified. When a corrupted frame is found, the
+   * parser notifies the error (lora::Command::INVALID_CRC for a CRC mismatch)
+   * and resynchronizes on the next SOH after the start of the bad frame.
+   *
+   */
+  class FrameParser
+  {
+    public:
+
+      /**
+       * @brief Interface for an object that receives the parser results.
+       *
+       */
+      class Listener
+      {
+        public:
+          /**
+           * @brief Destroys the listener.
+           *
+           */
+          virtual ~Listener()
+          {
+          }
+          ;
+
+          /**
+           * @brief Called for each complete frame.
+           *
+           * @param[in] frame view of the frame into the parser window.
+           */
+          virtual void onFrame(const Frame &frame) = 0;
+
+          /**
+           * @brief Called for each corrupted frame.
+           *
+           * @param[in] code error code, according to lora::Command::_ERROR_CODE enum.
+           * @param[in] data first byte of the bad frame (SOH).
+           * @param[in] size number of bytes of the bad frame examined.
+           */
+          virtual void onError(uint8_t code, const uint8_t *data, size_t size)
+          {
+          }
+          ;
+      };
+
+      /// Default maximum frame size in bytes: SOH + command + payload + CR/LF + CRC + EOT.
+      static const size_t MAX_FRAME_SIZE = 268;
+
+      /// Maximum size of the command field in bytes.
+      static const size_t MAX_CMD_SIZE = 5;
+
+      /**
+       * @brief Creates a parser.
+       *
+       * @param[in] maxFrame maximum frame size. Longer frames are discarded.
+       */
+      FrameParser(size_t maxFrame = MAX_FRAME_SIZE);
+
+      /**
+       * @brief Destroys the parser.
+       *
+       */
+      virtual ~FrameParser();
+
+      /**
+       * @brief Resets the parser state.
+       *
+       * The next call of parse() starts with an empty window.
+       *
+       */
+      void reset();
+
+      /**
+       * @brief Parses a window of received bytes.
+       *
+       * @param[in] buffer window: unconsumed bytes followed by the new ones.
+       * @param[in] size window size.
+       * @param[in] listener object notified of frames and errors.
+       *
+       * @returns number of bytes consumed from the beginning of the window.
+       */
+      size_t parse(const uint8_t *buffer, size_t size, Listener &listener);
+
+      /**
+       * @brief Gets the number of bytes skipped by the last call of parse().
+       *
+       * Skipped bytes are the ones outside a valid frame (noise and
+       * corrupted frames).
+       *
+       * @returns number of bytes skipped.
+       */
+      size_t skipped() const
+      {
+        return m_skipped;
+      }
+
+      /**
+       * @brief Gets the number of frames found.
+       *
+       * @returns number of frames.
+       */
+      unsigned long frames() const
+      {
+        return m_frames;
+      }
+
+      /**
+       * @brief Gets the number of errors of a type.
+       *
+       * @param[in] code error code, according to lora::Command::_ERROR_CODE enum.
+       *
+       * @returns number of errors.
+       */
+      unsigned long errors(uint8_t code) const
+      {
+        return (code < N_ERRORS) ? m_errors[code] : 0;
+      }
+
+      /**
+       * @brief Gets the total number of bytes skipped.
+       *
+       * @returns number of bytes.
+       */
+      unsigned long long bytesSkipped() const
+      {
+        return m_bytesSkipped;
+      }
+
+    private:
+      /// Size of the error counter array
+      static const uint8_t N_ERRORS = 16;
+
+      /**
+       * @brief Parser states.
+       */
+      enum _state
+      {
+        LOOKFOR_SOH,
+        LOOKFOR_CMD,
+        LOOKFOR_PAYLOAD,
+        LOOKFOR_CRC,
+        LOOKFOR_EOT,
+      };
+
+      /**
+       * @brief Notifies an error and restarts from the byte after SOH.
+       *
+       */
+      void resync(const uint8_t *buffer, uint8_t code, Listener &listener);
+
+      //! Maximum frame size
+      size_t m_maxFrame;
+
+      //! Current state
+      uint8_t m_state;
+
+      //! Offset (in the window) of the next byte to examine
+      size_t m_pos;
+
+      //! Offset of the current frame (SOH)
+      size_t m_start;
+
+      //! Offset of the payload of the current frame
+      size_t m_payload;
+
+      //! Command type of the current frame
+      uint8_t m_type;
+
+      //! Command field of the current frame
+      char m_cmd[MAX_CMD_SIZE + 1];
+
+      //! Size of the command field
+      size_t m_cmdSize;
+
+      //! CRC field of the current frame
+      uint16_t m_crc;
+
+      //! Number of CRC digits read
+      uint8_t m_digits;
+
+      //! Bytes skipped by the last call
+      size_t m_skipped;
+
+      //! Number of frames found
+      unsigned long m_frames;
+
+      //! Error counters
+      unsigned long m_errors[N_ERRORS];
+
+      //! Total number of bytes skipped
+      unsigned long long m_bytesSkipped;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_PARSER_H_ */
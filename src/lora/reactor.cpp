@@ -0,0 +1,269 @@
+//============================================================================
+// Name        : reactor.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Event loop based on epoll and timerfd
+//============================================================================
+
+#include "reactor.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+namespace lora
+{
+  /*************************************************************************
+   * class Reactor::Exception
+   ************************************************************************/
+  Reactor::Exception::~Exception() throw ()
+  {
+  }
+
+  const char* Reactor::Exception::what() const throw ()
+  {
+    switch (m_value)
+    {
+      case CREATE_FAILURE:
+        return "Error: can't create the event loop";
+        break;
+
+      case REGISTER_FAILURE:
+        return "Error: can't register the file descriptor";
+        break;
+
+      case TIMER_FAILURE:
+        return "Error: can't setup the timer";
+        break;
+
+      default:
+        break;
+    }
+    return "General exception";
+  }
+
+  /*************************************************************************
+   * class Reactor
+   ************************************************************************/
+  Reactor::Reactor() throw (Exception) :
+      m_epfd(-1), m_wakefd(-1), m_running(true)
+  {
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epfd < 0)
+    {
+      throw Exception(Exception::CREATE_FAILURE);
+    }
+
+    m_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakefd < 0)
+    {
+      close(m_epfd);
+      throw Exception(Exception::CREATE_FAILURE);
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakefd;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_wakefd, &ev) < 0)
+    {
+      close(m_wakefd);
+      close(m_epfd);
+      throw Exception(Exception::CREATE_FAILURE);
+    }
+  }
+
+  Reactor::~Reactor()
+  {
+    for (size_t fd = 0; fd < m_timers.size(); fd++)
+    {
+      if (m_timers[fd])
+      {
+        close(fd);
+      }
+    }
+
+    close(m_wakefd);
+    close(m_epfd);
+  }
+
+  void Reactor::add(int fd, Handler *handler, uint32_t events) throw (Exception)
+  {
+    if (fd < 0 || handler == 0)
+    {
+      throw Exception(Exception::REGISTER_FAILURE);
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+      throw Exception(Exception::REGISTER_FAILURE);
+    }
+
+    if ((size_t) fd >= m_handlers.size())
+    {
+      m_handlers.resize(fd + 1, 0);
+      m_timers.resize(fd + 1, false);
+    }
+    m_handlers[fd] = handler;
+    m_timers[fd] = false;
+  }
+
+  void Reactor::modify(int fd, uint32_t events) throw (Exception)
+  {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &ev) < 0)
+    {
+      throw Exception(Exception::REGISTER_FAILURE);
+    }
+  }
+
+  void Reactor::remove(int fd)
+  {
+    if (fd < 0 || (size_t) fd >= m_handlers.size())
+      return;
+
+    epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, NULL);
+    m_handlers[fd] = 0;
+    m_timers[fd] = false;
+  }
+
+  int Reactor::addTimer(Handler *handler) throw (Exception)
+  {
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0)
+    {
+      throw Exception(Exception::TIMER_FAILURE);
+    }
+
+    try
+    {
+      add(tfd, handler, EPOLLIN);
+    }
+    catch (Exception &e)
+    {
+      close(tfd);
+      throw;
+    }
+    m_timers[tfd] = true;
+
+    return tfd;
+  }
+
+  void Reactor::armTimer(int tfd, uint64_t usec, bool periodic) throw (Exception)
+  {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+
+    // A zero value disarms a timerfd: expire as soon as possible instead
+    if (usec == 0)
+      usec = 1;
+
+    its.it_value.tv_sec = usec / 1000000;
+    its.it_value.tv_nsec = (usec % 1000000) * 1000;
+    if (periodic)
+    {
+      its.it_interval = its.it_value;
+    }
+
+    if (timerfd_settime(tfd, 0, &its, NULL) < 0)
+    {
+      throw Exception(Exception::TIMER_FAILURE);
+    }
+  }
+
+  void Reactor::disarmTimer(int tfd)
+  {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(tfd, 0, &its, NULL);
+  }
+
+  void Reactor::removeTimer(int tfd)
+  {
+    if (tfd < 0 || (size_t) tfd >= m_timers.size() || !m_timers[tfd])
+      return;
+
+    remove(tfd);
+    close(tfd);
+  }
+
+  int Reactor::runOnce(int timeout)
+  {
+    struct epoll_event events[MAX_EVENTS];
+
+    int n = epoll_wait(m_epfd, events, MAX_EVENTS, timeout);
+    if (n < 0)
+    {
+      return (errno == EINTR) ? 0 : -1;
+    }
+
+    int dispatched = 0;
+    for (int i = 0; i < n; i++)
+    {
+      int fd = events[i].data.fd;
+
+      if (fd == m_wakefd)
+      {
+        uint64_t v = 0;
+        ssize_t r = read(m_wakefd, &v, sizeof(v));
+        (void) r;
+        continue;
+      }
+
+      // A previous handler may have removed this descriptor
+      if ((size_t) fd >= m_handlers.size() || m_handlers[fd] == 0)
+        continue;
+
+      if (m_timers[fd])
+      {
+        // Read the expiration counter, otherwise the timer stays ready
+        uint64_t expirations = 0;
+        if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+          continue;
+      }
+
+      m_handlers[fd]->handleEvent(fd, events[i].events);
+      dispatched++;
+    }
+
+    return dispatched;
+  }
+
+  void Reactor::run()
+  {
+    while (m_running)
+    {
+      if (runOnce(-1) < 0)
+        break;
+    }
+  }
+
+  void Reactor::stop()
+  {
+    m_running = false;
+
+    uint64_t v = 1;
+    ssize_t r = write(m_wakefd, &v, sizeof(v));
+    (void) r;
+  }
+
+  uint64_t Reactor::now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+
+} /* namespace lora */
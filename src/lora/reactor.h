@@ -0,0 +1,276 @@
+//============================================================================
+// Name        : reactor.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Event loop based on epoll and timerfd
+//============================================================================
+#ifndef _LORA_REACTOR_H_
+#define _LORA_REACTOR_H_
+
+#include <stdint.h>
+#include <vector>
+#include <exception>    // using standard exceptions
+
+#include <sys/epoll.h>  // epoll interface
+
+namespace lora
+{
+  /**
+   * @brief The Reactor class provides an event loop for file descriptors and
+   * timers.
+   *
+   * A reactor waits (epoll) on a set of file descriptors (serial device,
+   * pipes, sockets) and timers (timerfd) and calls the handler registered for
+   * each descriptor when it becomes ready. The calling thread sleeps in the
+   * kernel until bytes arrive or a deadline fires, so no polling loop is
+   * needed.
+   *
+   * Timers are file descriptors too: a timer created with addTimer() is
+   * armed with armTimer() and its handler is called when it expires. The
+   * expiration counter is read by the reactor before calling the handler.
+   *
+   * A reactor can be stopped from any thread (or from a signal handler)
+   * calling stop().
+   *
+   */
+  class Reactor
+  {
+    public:
+
+      /**
+       * @brief Interface for an object that handles reactor events.
+       *
+       */
+      class Handler
+      {
+        public:
+          /**
+           * @brief Destroys the handler.
+           *
+           */
+          virtual ~Handler()
+          {
+          }
+          ;
+
+          /**
+           * @brief Handles an event on a file descriptor.
+           *
+           * This function is called by the reactor when the file descriptor
+           * is ready (data to read, space to write, timer expired).
+           *
+           * @param[in] fd file descriptor ready.
+           * @param[in] events epoll events (EPOLLIN, EPOLLOUT, EPOLLHUP, ...).
+           */
+          virtual void handleEvent(int fd, uint32_t events) = 0;
+      };
+
+      /**
+       * @brief Custom class to handles exception for the Reactor class.
+       *
+       */
+      class Exception: public std::exception
+      {
+          //! Exception value
+          unsigned int m_value;
+
+        public:
+          /**
+           * @brief Exception codes for the reactor class.
+           */
+          enum ExceptionCode
+          {
+            /// Generic exception
+            UNKNOWN_EXCEPTION = 0,
+
+            /// epoll or eventfd creation error
+            CREATE_FAILURE,
+
+            /// File descriptor registration error
+            REGISTER_FAILURE,
+
+            /// Timer creation or setup error
+            TIMER_FAILURE,
+          };
+
+          /**
+           * @brief Constructs an exception.
+           *
+           */
+          Exception()
+          {
+            m_value = 0;
+          }
+          ;
+
+          /**
+           * @brief Constructor, it sets exception code.
+           *
+           * @param[in] code exception code.
+           */
+          Exception(int code)
+          {
+            m_value = code;
+          }
+          ;
+
+          /**
+           * @brief Destroy the exception object.
+           *
+           */
+          virtual ~Exception() throw ();
+
+          /**
+           * @brief Returns an explanatory string.
+           *
+           * @returns explanatory string.
+           */
+          virtual const char* what() const throw ();
+      };
+
+      /// Maximum number of events dispatched by a single wait.
+      static const int MAX_EVENTS = 16;
+
+      /**
+       * @brief Creates a reactor.
+       *
+       * If the epoll instance can't be created an exception is thrown.
+       *
+       */
+      Reactor() throw (Exception);
+
+      /**
+       * @brief Destroys the reactor and closes all its timers.
+       *
+       */
+      virtual ~Reactor();
+
+      /**
+       * @brief Registers a file descriptor.
+       *
+       * @param[in] fd file descriptor to watch.
+       * @param[in] handler object called when the descriptor is ready.
+       * @param[in] events epoll events to watch. Default is EPOLLIN.
+       */
+      void add(int fd, Handler *handler, uint32_t events = EPOLLIN) throw (Exception);
+
+      /**
+       * @brief Changes the events watched on a registered file descriptor.
+       *
+       * Using 0 as events the descriptor stays registered but it is not
+       * watched.
+       *
+       * @param[in] fd file descriptor.
+       * @param[in] events epoll events to watch.
+       */
+      void modify(int fd, uint32_t events) throw (Exception);
+
+      /**
+       * @brief Unregisters a file descriptor.
+       *
+       * @param[in] fd file descriptor.
+       */
+      void remove(int fd);
+
+      /**
+       * @brief Creates a timer.
+       *
+       * This function creates a disarmed timer (timerfd on the monotonic
+       * clock) and registers it.
+       *
+       * @param[in] handler object called when the timer expires.
+       *
+       * @returns timer file descriptor.
+       */
+      int addTimer(Handler *handler) throw (Exception);
+
+      /**
+       * @brief Arms a timer.
+       *
+       * @param[in] tfd timer file descriptor returned by addTimer().
+       * @param[in] usec expiration time from now, in microseconds.
+       * @param[in] periodic if true the timer expires every \a usec microseconds.
+       */
+      void armTimer(int tfd, uint64_t usec, bool periodic = false) throw (Exception);
+
+      /**
+       * @brief Disarms a timer.
+       *
+       * @param[in] tfd timer file descriptor returned by addTimer().
+       */
+      void disarmTimer(int tfd);
+
+      /**
+       * @brief Unregisters and closes a timer.
+       *
+       * @param[in] tfd timer file descriptor returned by addTimer().
+       */
+      void removeTimer(int tfd);
+
+      /**
+       * @brief Waits for events and dispatches them.
+       *
+       * @param[in] timeout maximum wait in milliseconds, -1 waits forever.
+       *
+       * @returns number of events dispatched, -1 on error.
+       */
+      int runOnce(int timeout = -1);
+
+      /**
+       * @brief Runs the event loop until stop() is called.
+       *
+       */
+      void run();
+
+      /**
+       * @brief Stops the event loop.
+       *
+       * This function can be called from another thread or from a signal
+       * handler.
+       *
+       */
+      void stop();
+
+      /**
+       * @brief Returns true if the loop is running (stop() not called).
+       *
+       * @returns true if the loop is running.
+       */
+      bool running() const
+      {
+        return m_running;
+      }
+
+      /**
+       * @brief Gets the monotonic clock.
+       *
+       * @returns current time of the monotonic clock in microseconds.
+       */
+      static uint64_t now();
+
+    private:
+      /// Copy is not allowed
+      Reactor(const Reactor &r);
+
+      /// Assignment is not allowed
+      Reactor & operator=(const Reactor &r);
+
+      //! epoll file descriptor
+      int m_epfd;
+
+      //! eventfd used to wake up the loop
+      int m_wakefd;
+
+      //! Running flag
+      volatile bool m_running;
+
+      //! Handlers indexed by file descriptor
+      std::vector<Handler *> m_handlers;
+
+      //! Timer flags indexed by file descriptor
+      std::vector<bool> m_timers;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_REACTOR_H_ */
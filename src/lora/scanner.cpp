@@ -0,0 +1,222 @@
+//============================================================================
+// Name        : scanner.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Vectorized search of frame delimiters
+//============================================================================
+
+#include "scanner.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCANNER_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace lora
+{
+  namespace
+  {
+    size_t findScalar(const uint8_t *buffer, size_t size, uint8_t c)
+    {
+      const void *p = memchr(buffer, c, size);
+
+      return (p) ? (const uint8_t *) p - buffer : size;
+    }
+
+    size_t findAnyScalar(const uint8_t *buffer, size_t size, uint8_t c1, uint8_t c2, uint8_t c3)
+    {
+      for (size_t i = 0; i < size; i++)
+      {
+        uint8_t c = buffer[i];
+        if (c == c1 || c == c2 || c == c3)
+          return i;
+      }
+      return size;
+    }
+
+#ifdef SCANNER_SIMD
+    __attribute__((target("sse2")))
+    size_t findSse2(const uint8_t *buffer, size_t size, uint8_t c)
+    {
+      const __m128i v = _mm_set1_epi8((char) c);
+      size_t i = 0;
+
+      for (; i + 16 <= size; i += 16)
+      {
+        __m128i x = _mm_loadu_si128((const __m128i *) &buffer[i]);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, v));
+        if (mask)
+          return i + __builtin_ctz(mask);
+      }
+
+      return i + findScalar(&buffer[i], size - i, c);
+    }
+
+    __attribute__((target("sse2")))
+    size_t findAnySse2(const uint8_t *buffer, size_t size, uint8_t c1, uint8_t c2, uint8_t c3)
+    {
+      const __m128i v1 = _mm_set1_epi8((char) c1);
+      const __m128i v2 = _mm_set1_epi8((char) c2);
+      const __m128i v3 = _mm_set1_epi8((char) c3);
+      size_t i = 0;
+
+      for (; i + 16 <= size; i += 16)
+      {
+        __m128i x = _mm_loadu_si128((const __m128i *) &buffer[i]);
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, v1), _mm_cmpeq_epi8(x, v2)),
+            _mm_cmpeq_epi8(x, v3));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+          return i + __builtin_ctz(mask);
+      }
+
+      return i + findAnyScalar(&buffer[i], size - i, c1, c2, c3);
+    }
+
+    __attribute__((target("avx2")))
+    size_t findAvx2(const uint8_t *buffer, size_t size, uint8_t c)
+    {
+      const __m256i v = _mm256_set1_epi8((char) c);
+      size_t i = 0;
+
+      for (; i + 32 <= size; i += 32)
+      {
+        __m256i x = _mm256_loadu_si256((const __m256i *) &buffer[i]);
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, v));
+        if (mask)
+        {
+          _mm256_zeroupper();
+          return i + __builtin_ctz(mask);
+        }
+      }
+
+      // Legacy SSE code after AVX code is slow if the upper state is dirty
+      _mm256_zeroupper();
+      return i + findScalar(&buffer[i], size - i, c);
+    }
+
+    __attribute__((target("avx2")))
+    size_t findAnyAvx2(const uint8_t *buffer, size_t size, uint8_t c1, uint8_t c2, uint8_t c3)
+    {
+      const __m256i v1 = _mm256_set1_epi8((char) c1);
+      const __m256i v2 = _mm256_set1_epi8((char) c2);
+      const __m256i v3 = _mm256_set1_epi8((char) c3);
+      size_t i = 0;
+
+      for (; i + 32 <= size; i += 32)
+      {
+        __m256i x = _mm256_loadu_si256((const __m256i *) &buffer[i]);
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, v1), _mm256_cmpeq_epi8(x, v2)),
+            _mm256_cmpeq_epi8(x, v3));
+        unsigned int mask = _mm256_movemask_epi8(m);
+        if (mask)
+        {
+          _mm256_zeroupper();
+          return i + __builtin_ctz(mask);
+        }
+      }
+
+      _mm256_zeroupper();
+      return i + findAnyScalar(&buffer[i], size - i, c1, c2, c3);
+    }
+#endif
+
+    //! Engine in use
+    Scanner::Engine s_engine = Scanner::SCALAR;
+
+    /**
+     * @brief Selects the fastest engine at start-up.
+     */
+    bool selectBest()
+    {
+#ifdef SCANNER_SIMD
+      __builtin_cpu_init();
+#endif
+      return Scanner::select(Scanner::AVX2) || Scanner::select(Scanner::SSE2);
+    }
+
+    const bool s_selected __attribute__((unused)) = selectBest();
+  }
+
+  /*************************************************************************
+   * class Scanner
+   ************************************************************************/
+  Scanner::FindFunction Scanner::s_find = findScalar;
+  Scanner::FindAnyFunction Scanner::s_findAny = findAnyScalar;
+
+  bool Scanner::select(Engine engine)
+  {
+    if (!supported(engine))
+      return false;
+
+    switch (engine)
+    {
+#ifdef SCANNER_SIMD
+      case SSE2:
+        s_find = findSse2;
+        s_findAny = findAnySse2;
+        break;
+
+      case AVX2:
+        s_find = findAvx2;
+        s_findAny = findAnyAvx2;
+        break;
+#endif
+
+      default:
+        s_find = findScalar;
+        s_findAny = findAnyScalar;
+        break;
+    }
+
+    s_engine = engine;
+    return true;
+  }
+
+  bool Scanner::supported(Engine engine)
+  {
+    switch (engine)
+    {
+      case SCALAR:
+        return true;
+
+#ifdef SCANNER_SIMD
+      case SSE2:
+        return __builtin_cpu_supports("sse2");
+
+      case AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+
+      default:
+        break;
+    }
+    return false;
+  }
+
+  Scanner::Engine Scanner::engine()
+  {
+    return s_engine;
+  }
+
+  const char* Scanner::engineName(Engine engine)
+  {
+    switch (engine)
+    {
+      case SCALAR:
+        return "scalar";
+      case SSE2:
+        return "sse2";
+      case AVX2:
+        return "avx2";
+      default:
+        break;
+    }
+    return "unknown";
+  }
+
+} /* namespace lora */
@@ -0,0 +1,133 @@
+//============================================================================
+// Name        : scanner.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Vectorized search of frame delimiters
+//============================================================================
+#ifndef _LORA_SCANNER_H_
+#define _LORA_SCANNER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace lora
+{
+  /**
+   * @brief The Scanner class looks for frame delimiters (SOH, CR/LF, EOT) in
+   * a byte stream.
+   *
+   * The frame parser uses it to jump over noise and payload bytes: only the
+   * candidate bytes found by the scanner go through the parser state
+   * machine.
+   *
+   * Several engines are available:
+   *    - SCALAR: one byte at a time (memchr() for a single byte).
+   *    - SSE2: 16 bytes at a time (x86 only).
+   *    - AVX2: 32 bytes at a time (x86 only).
+   *
+   * The fastest engine supported by the CPU is selected at run time.
+   *
+   */
+  class Scanner
+  {
+    public:
+      /**
+       * @brief Scanner engines.
+       */
+      enum Engine
+      {
+        /// One byte at a time
+        SCALAR = 0,
+
+        /// 16 bytes at a time
+        SSE2,
+
+        /// 32 bytes at a time
+        AVX2,
+
+        /// Number of engines
+        N_ENGINES,
+      };
+
+      /**
+       * @brief Finds the first occurrence of a byte.
+       *
+       * @param[in] buffer bytes.
+       * @param[in] size number of bytes.
+       * @param[in] c byte to find.
+       *
+       * @returns offset of the byte, \a size if it isn't found.
+       */
+      static size_t find(const uint8_t *buffer, size_t size, uint8_t c)
+      {
+        return s_find(buffer, size, c);
+      }
+
+      /**
+       * @brief Finds the first occurrence of any of three bytes.
+       *
+       * @param[in] buffer bytes.
+       * @param[in] size number of bytes.
+       * @param[in] c1 first byte to find.
+       * @param[in] c2 second byte to find.
+       * @param[in] c3 third byte to find.
+       *
+       * @returns offset of the first byte found, \a size if none is found.
+       */
+      static size_t findAny(const uint8_t *buffer, size_t size, uint8_t c1, uint8_t c2,
+          uint8_t c3)
+      {
+        return s_findAny(buffer, size, c1, c2, c3);
+      }
+
+      /**
+       * @brief Selects the engine used by find() and findAny().
+       *
+       * @param[in] engine engine.
+       *
+       * @returns false if the engine isn't supported by the CPU.
+       */
+      static bool select(Engine engine);
+
+      /**
+       * @brief Returns true if an engine is supported by the CPU.
+       *
+       * @param[in] engine engine.
+       *
+       * @returns true if the engine can be used.
+       */
+      static bool supported(Engine engine);
+
+      /**
+       * @brief Gets the engine in use.
+       *
+       * @returns engine.
+       */
+      static Engine engine();
+
+      /**
+       * @brief Gets the name of an engine.
+       *
+       * @param[in] engine engine.
+       *
+       * @returns engine name.
+       */
+      static const char* engineName(Engine engine);
+
+    private:
+      /// Type of the find() implementations
+      typedef size_t (*FindFunction)(const uint8_t *, size_t, uint8_t);
+
+      /// Type of the findAny() implementations
+      typedef size_t (*FindAnyFunction)(const uint8_t *, size_t, uint8_t, uint8_t, uint8_t);
+
+      //! find() implementation in use
+      static FindFunction s_find;
+
+      //! findAny() implementation in use
+      static FindAnyFunction s_findAny;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_SCANNER_H_ */
@@ -0,0 +1,174 @@
+//============================================================================
+// Name        : scheduler.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Duty cycle aware transmit scheduler
+//============================================================================
+
+#include "scheduler.h"
+
+#include <math.h>
+
+namespace lora
+{
+  Scheduler::Scheduler(const Region &region, uint64_t burst) :
+      m_region(region), m_burst(burst), m_bucket(0), m_sf(0), m_bw(0), m_cr(0), m_maxMessage(0), m_busy(0), m_frames(
+          0), m_delayed(0), m_airtime(0), m_maxDelay(0)
+  {
+    for (size_t i = 0; i < MAX_SUBBANDS; i++)
+    {
+      m_buckets[i].duty = 0;
+      m_buckets[i].tokens = 0;
+      m_buckets[i].capacity = 0;
+      m_buckets[i].rate = 0;
+      m_buckets[i].time = 0;
+    }
+  }
+
+  Scheduler::~Scheduler()
+  {
+  }
+
+  bool Scheduler::configure(uint8_t channel, uint8_t sf, uint16_t bw, uint8_t cr, uint64_t now)
+  {
+    const Channel *c = m_region.channel(channel);
+    if (c == 0 || c->subBand >= MAX_SUBBANDS || Airtime::compute(sf, bw, cr, 0) == 0)
+      return false;
+
+    bool first = (m_bucket == 0);
+
+    m_sf = sf;
+    m_bw = bw;
+    m_cr = cr;
+
+    // The capacity depends on the longest frame: all buckets are updated
+    double longest = (double) airtime(MAX_MESSAGE);
+    for (size_t i = 0; i < m_region.n_subBands && i < MAX_SUBBANDS; i++)
+    {
+      Bucket &b = m_buckets[i];
+      if (!first)
+        refill(b, now);
+
+      b.duty = m_region.subBands[i].duty;
+
+      double hourly = (double) b.duty * PERIOD / 1000;
+      double capacity = (double) b.duty * m_burst / 1000;
+      if (capacity < longest)
+        capacity = longest;
+
+      // At least half of the budget is left to the refill
+      if (capacity > hourly / 2)
+        capacity = hourly / 2;
+
+      b.capacity = capacity;
+      b.rate = (hourly - capacity) / PERIOD;
+      b.time = now;
+
+      if (first || b.tokens > capacity)
+        b.tokens = capacity;
+    }
+
+    m_bucket = &m_buckets[c->subBand];
+
+    // Longest message of the region that the dwell time and the bucket allow
+    m_maxMessage = (m_region.payload(sf) < MAX_MESSAGE) ? m_region.payload(sf) : MAX_MESSAGE;
+    while (m_maxMessage > 0 && !allowed(m_maxMessage))
+      m_maxMessage--;
+
+    return true;
+  }
+
+  bool Scheduler::configure(ConfigCommand &cfg, uint64_t now)
+  {
+    if (cfg.frequency() != m_region.band)
+      return false;
+
+    return configure(cfg.channel(), cfg.spreadingFactor(false), cfg.bandwidth(false),
+        cfg.codingRate(false), now);
+  }
+
+  void Scheduler::refill(Bucket &bucket, uint64_t now)
+  {
+    if (now <= bucket.time)
+      return;
+
+    bucket.tokens += bucket.rate * (double) (now - bucket.time);
+    if (bucket.tokens > bucket.capacity)
+      bucket.tokens = bucket.capacity;
+
+    bucket.time = now;
+  }
+
+  bool Scheduler::allowed(size_t len) const
+  {
+    if (m_bucket == 0 || len > MAX_MESSAGE)
+      return false;
+
+    uint64_t t = airtime(len);
+
+    if (m_region.dwell && t > m_region.dwell)
+      return false;
+
+    return (m_bucket->duty >= 1000 || (double) t <= m_bucket->capacity);
+  }
+
+  uint64_t Scheduler::release(size_t len, uint64_t now)
+  {
+    if (!allowed(len))
+      return NEVER;
+
+    // The previous frame must be on air until the end
+    uint64_t t = (m_busy > now) ? m_busy : now;
+
+    if (m_bucket->duty >= 1000)
+      return t;
+
+    refill(*m_bucket, now);
+
+    double need = (double) airtime(len) - m_bucket->tokens;
+    if (need <= 0)
+      return t;
+
+    uint64_t wait = (uint64_t) ceil(need / m_bucket->rate);
+    if (now + wait <= t)
+      return t;
+
+    m_delayed++;
+    if (wait > m_maxDelay)
+      m_maxDelay = wait;
+
+    return now + wait;
+  }
+
+  uint64_t Scheduler::commit(size_t len, uint64_t now)
+  {
+    uint64_t t = airtime(len);
+
+    if (m_bucket && m_bucket->duty < 1000)
+    {
+      refill(*m_bucket, now);
+      m_bucket->tokens -= (double) t;
+    }
+
+    m_busy = now + t;
+    m_frames++;
+    m_airtime += t;
+
+    return t;
+  }
+
+  uint64_t Scheduler::budget(uint64_t now)
+  {
+    if (m_bucket == 0)
+      return 0;
+
+    if (m_bucket->duty >= 1000)
+      return PERIOD;
+
+    refill(*m_bucket, now);
+
+    return (m_bucket->tokens > 0) ? (uint64_t) m_bucket->tokens : 0;
+  }
+
+} /* namespace lora */
@@ -0,0 +1,255 @@
+//============================================================================
+// Name        : scheduler.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Duty cycle aware transmit scheduler
+//============================================================================
+#ifndef _LORA_SCHEDULER_H_
+#define _LORA_SCHEDULER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "airtime.h"
+
+namespace lora
+{
+  /**
+   * @brief The Scheduler class decides when a frame can be sent without
+   * exceeding the duty cycle of the sub-band.
+   *
+   * Every sub-band of the region has a token bucket of time on air: a frame
+   * consumes its time on air (lora::Airtime) and the bucket refills
+   * continuously. The duty cycle is measured over one hour (ETSI EN 300 220),
+   * so with a bucket of capacity C and refill rate R the time on air of any
+   * hour is at most C + R * PERIOD. The rate is chosen to make this bound
+   * equal to the hourly budget (duty * PERIOD):
+   *
+   *    C = max(duty * burst, time on air of the largest frame)
+   *    R = (duty * PERIOD - C) / PERIOD
+   *
+   * The bucket starts full, so the first burst window of frames is sent
+   * without delay. A frame is never released while the previous one is
+   * still on air, and frames longer than the dwell time of the region are
+   * refused.
+   *
+   * Times are in microseconds of the monotonic clock (lora::Reactor::now()).
+   *
+   */
+  class Scheduler
+  {
+    public:
+      /// Duty cycle observation period (usec).
+      static const uint64_t PERIOD = 3600000000ULL;
+
+      /// Default burst window: time of full duty cycle available at once (usec).
+      static const uint64_t DEFAULT_BURST = 60000000;
+
+      /// Longest message the radio can send (bytes).
+      static const size_t MAX_MESSAGE = 255 - Airtime::FRAME_OVERHEAD;
+
+      /// Maximum number of sub-bands of a region.
+      static const size_t MAX_SUBBANDS = 8;
+
+      /// Value returned by release() for a frame that can't be sent.
+      static const uint64_t NEVER = ~0ULL;
+
+      /**
+       * @brief Creates a scheduler.
+       *
+       * @param[in] region regional parameters (sub-bands and dwell time).
+       * @param[in] burst burst window (usec).
+       */
+      Scheduler(const Region &region, uint64_t burst = DEFAULT_BURST);
+
+      /**
+       * @brief Destroys the scheduler.
+       *
+       */
+      virtual ~Scheduler();
+
+      /**
+       * @brief Sets the radio settings of the frames.
+       *
+       * The budget already used in every sub-band is kept.
+       *
+       * @param[in] channel channel code (lora::ConfigCommand::_FREQUENCY_CHANNEL).
+       * @param[in] sf spreading factor (6 to 12).
+       * @param[in] bw bandwidth in kHz (125, 250 or 500).
+       * @param[in] cr coding rate (5 to 8, the rate is 4/cr).
+       * @param[in] now current time (usec).
+       *
+       * @returns false if the channel isn't in the region or the settings
+       * are not valid.
+       */
+      bool configure(uint8_t channel, uint8_t sf, uint16_t bw, uint8_t cr, uint64_t now);
+
+      /**
+       * @brief Sets the radio settings of a configuration command.
+       *
+       * @param[in] cfg configuration (INFO or SET command).
+       * @param[in] now current time (usec).
+       *
+       * @returns false if the settings are not valid for the region.
+       */
+      bool configure(ConfigCommand &cfg, uint64_t now);
+
+      /**
+       * @brief Calculates the time on air of a message.
+       *
+       * @param[in] len message length (DATA message field).
+       *
+       * @returns time on air in usec (bytes added by the module included).
+       */
+      uint64_t airtime(size_t len) const
+      {
+        return Airtime::compute(m_sf, m_bw, m_cr, len + Airtime::FRAME_OVERHEAD);
+      }
+
+      /**
+       * @brief Returns true if a message can ever be sent with the current
+       * settings (dwell time and bucket capacity).
+       *
+       * @param[in] len message length.
+       */
+      bool allowed(size_t len) const;
+
+      /**
+       * @brief Gets the longest message allowed with the current settings
+       * (maximum length of the region for the spreading factor, dwell time
+       * and bucket capacity).
+       *
+       * @returns message length, 0 if the scheduler isn't configured.
+       */
+      size_t maxMessage() const
+      {
+        return m_maxMessage;
+      }
+
+      /**
+       * @brief Calculates when a message can be sent.
+       *
+       * @param[in] len message length.
+       * @param[in] now current time (usec).
+       *
+       * @returns earliest send time (usec, not before now), NEVER if the
+       * message isn't allowed or the scheduler isn't configured.
+       */
+      uint64_t release(size_t len, uint64_t now);
+
+      /**
+       * @brief Records that a message has been sent.
+       *
+       * The time on air is taken from the budget of the sub-band, even if it
+       * isn't available (the budget becomes negative).
+       *
+       * @param[in] len message length.
+       * @param[in] now send time (usec).
+       *
+       * @returns time on air of the message (usec).
+       */
+      uint64_t commit(size_t len, uint64_t now);
+
+      /**
+       * @brief Gets the time on air available at once in the current
+       * sub-band (usec).
+       *
+       * @param[in] now current time (usec).
+       *
+       * @returns available time on air, PERIOD if the sub-band has no limit.
+       */
+      uint64_t budget(uint64_t now);
+
+      /**
+       * @brief Gets the duty cycle of the current sub-band (per mille).
+       *
+       */
+      uint16_t duty() const
+      {
+        return (m_bucket) ? m_bucket->duty : 0;
+      }
+
+      /// Number of frames sent.
+      unsigned long frames() const
+      {
+        return m_frames;
+      }
+
+      /// Number of times a frame has been delayed by the duty cycle.
+      unsigned long delayed() const
+      {
+        return m_delayed;
+      }
+
+      /// Total time on air (usec).
+      uint64_t totalAirtime() const
+      {
+        return m_airtime;
+      }
+
+      /// Longest delay imposed by the duty cycle (usec).
+      uint64_t maxDelay() const
+      {
+        return m_maxDelay;
+      }
+
+    private:
+      /**
+       * @brief Token bucket of a sub-band.
+       */
+      struct Bucket
+      {
+          /// Duty cycle (per mille, 1000 if there is no limit).
+          uint16_t duty;
+
+          /// Time on air available (usec, negative after an overrun).
+          double tokens;
+
+          /// Maximum time on air available (usec).
+          double capacity;
+
+          /// Refill rate (usec of time on air per usec).
+          double rate;
+
+          /// Time of the last refill (usec).
+          uint64_t time;
+      };
+
+      /**
+       * @brief Adds the tokens accumulated since the last refill.
+       *
+       */
+      void refill(Bucket &bucket, uint64_t now);
+
+      //! Regional parameters
+      const Region &m_region;
+
+      //! Burst window (usec)
+      uint64_t m_burst;
+
+      //! Buckets of the sub-bands
+      Bucket m_buckets[MAX_SUBBANDS];
+
+      //! Bucket of the current channel (0 if not configured)
+      Bucket *m_bucket;
+
+      //! Radio settings
+      uint8_t m_sf;
+      uint16_t m_bw;
+      uint8_t m_cr;
+
+      //! Longest message allowed with the radio settings
+      size_t m_maxMessage;
+
+      //! End of the time on air of the last frame (usec)
+      uint64_t m_busy;
+
+      //! Statistics
+      unsigned long m_frames;
+      unsigned long m_delayed;
+      uint64_t m_airtime;
+      uint64_t m_maxDelay;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_SCHEDULER_H_ */
@@ -7,6 +7,7 @@
 //============================================================================
 
 #include "serial.h"
+#include "reactor.h"
 
 #include <iomanip>
 #include <sstream>
@@ -44,6 +45,10 @@ namespace lora
         return "Error: can't close device";
         break;
 
+      case WRITER_FAILURE:
+        return "Error: can't start the writer thread";
+        break;
+
       default:
         break;
     }
@@ -56,18 +61,29 @@ namespace lora
   const std::string Serial::DEFAULT_DEVICE = "/dev/USB0";
   const unsigned int Serial::DEFAULT_BITRATE = 9600;
 
+  /// Size of the header of a frame in the transmission queue: size + time
+  static const size_t TX_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint64_t);
+
   Serial::Serial() :
-      m_fd(-1)
+      m_fd(-1), m_fullDuplex(false), m_txFrames(0), m_txLatencySum(0), m_txLatencyMax(0),
+          m_capture(0)
   {
     m_device = DEFAULT_DEVICE;
     m_bitrate = DEFAULT_BITRATE;
+
+    sem_init(&m_txReady, 0, 0);
+    sem_init(&m_txSpace, 0, 0);
   }
 
   Serial::Serial(std::string device, unsigned int bitrate) throw (Exception) :
-      m_fd(-1)
+      m_fd(-1), m_fullDuplex(false), m_txFrames(0), m_txLatencySum(0), m_txLatencyMax(0),
+          m_capture(0)
   {
     m_device = device;
     setBitrate(bitrate);
+
+    sem_init(&m_txReady, 0, 0);
+    sem_init(&m_txSpace, 0, 0);
   }
 
   Serial::~Serial()
@@ -76,6 +92,9 @@ namespace lora
     {
       closeDev();
     }
+
+    sem_destroy(&m_txSpace);
+    sem_destroy(&m_txReady);
   }
 
   void Serial::setBitrate(std::string bitrate) throw (Exception)
@@ -269,9 +288,13 @@ namespace lora
 
   void Serial::closeDev() throw (Exception)
   {
+    // Write all queued bytes and stop the writer thread
+    setFullDuplex(false);
+
     /* restore the old port settings */
     tcsetattr(m_fd, TCSANOW, &m_oldtio);
     close(m_fd);
+    m_fd = -1;
   }
 
   int Serial::setInterfaceAttribs(int parity)
@@ -324,18 +347,159 @@ namespace lora
     return 0;
   }
 
+  void Serial::setFullDuplex(bool enable) throw (Exception)
+  {
+    if (enable == m_fullDuplex)
+      return;
+
+    if (enable)
+    {
+      if (m_fd < 0)
+        throw Exception(Exception::WRITER_FAILURE);
+
+      // Reads are driven by the device readiness: they must never wait
+      m_newtio.c_cc[VTIME] = 0;
+      tcsetattr(m_fd, TCSANOW, &m_newtio);
+
+      m_txQueue.resize(TX_QUEUE_SIZE);
+      m_fullDuplex = true;
+
+      if (pthread_create(&m_writer, NULL, writerFunction, (void *) this))
+      {
+        m_fullDuplex = false;
+        throw Exception(Exception::WRITER_FAILURE);
+      }
+    }
+    else
+    {
+      // The writer thread stops when it finds the queue empty
+      m_fullDuplex = false;
+      sem_post(&m_txReady);
+
+      pthread_join(m_writer, NULL);
+
+      m_newtio.c_cc[VTIME] = 5;
+      tcsetattr(m_fd, TCSANOW, &m_newtio);
+    }
+  }
+
+  void Serial::txLatency(unsigned long &frames, uint64_t &avg, uint64_t &max)
+  {
+    frames = m_txFrames.load(std::memory_order_relaxed);
+    uint64_t sum = m_txLatencySum.load(std::memory_order_relaxed);
+    avg = (frames) ? (sum / frames) : 0;
+    max = m_txLatencyMax.load(std::memory_order_relaxed);
+  }
+
+  ssize_t Serial::writeAll(const char* buffer, ssize_t size)
+  {
+    ssize_t t = 0;
+    while (t < size)
+    {
+      ssize_t n = write(m_fd, &buffer[t], size - t);
+      if (n < 0)
+      {
+        if (errno == EINTR || errno == EAGAIN)
+          continue;
+        return (t) ? t : n;
+      }
+      t += n;
+    }
+    return t;
+  }
+
+  void* Serial::writerFunction(void *arg)
+  {
+    Serial *s = (Serial *) arg;
+    uint8_t buffer[TX_QUEUE_SIZE];
+
+    while (true)
+    {
+      // One token for every frame queued
+      while (sem_wait(&s->m_txReady) < 0 && errno == EINTR)
+        ;
+
+      if (s->m_txQueue.empty())
+        break;
+
+      // Get a frame: it is complete, the token is posted after it
+      uint32_t size = 0;
+      uint64_t t0 = 0;
+      uint8_t header[TX_HEADER_SIZE];
+      s->m_txQueue.read(header, TX_HEADER_SIZE);
+      memcpy(&size, header, sizeof(size));
+      memcpy(&t0, &header[sizeof(size)], sizeof(t0));
+      s->m_txQueue.read(buffer, size);
+
+      // Wake up the sender if it waits for space (only one token is needed)
+      int waiting = 0;
+      sem_getvalue(&s->m_txSpace, &waiting);
+      if (waiting <= 0)
+        sem_post(&s->m_txSpace);
+
+      ssize_t n = s->writeAll((const char *) buffer, size);
+      if (n > 0 && s->m_capture)
+        s->m_capture->record(Capture::TX, buffer, n);
+      uint64_t latency = Reactor::now() - t0;
+
+      // Statistics are written only by this thread
+      s->m_txFrames.fetch_add(1, std::memory_order_relaxed);
+      s->m_txLatencySum.fetch_add(latency, std::memory_order_relaxed);
+      if (latency > s->m_txLatencyMax.load(std::memory_order_relaxed))
+        s->m_txLatencyMax.store(latency, std::memory_order_relaxed);
+    }
+
+    return NULL;
+  }
+
   ssize_t Serial::receive(const char* buffer, ssize_t size)
   {
     int n = read(m_fd, (char*) buffer, size);
+    if (n > 0 && m_capture)
+      m_capture->record(Capture::RX, buffer, n);
 
     return n;
   }
 
   ssize_t Serial::send(const char* buffer, ssize_t size)
   {
-    int n = write(m_fd, (char*) buffer, size);
+    if (!m_fullDuplex)
+    {
+      int n = write(m_fd, (char*) buffer, size);
+      if (n > 0 && m_capture)
+        m_capture->record(Capture::TX, buffer, n);
 
-    return n;
+      return n;
+    }
+
+    const uint8_t *data = (const uint8_t *) buffer;
+    ssize_t t = 0;
+
+    while (t < size)
+    {
+      // Frames longer than the queue are split
+      uint32_t n = size - t;
+      if (n > TX_QUEUE_SIZE - TX_HEADER_SIZE)
+        n = TX_QUEUE_SIZE - TX_HEADER_SIZE;
+
+      while (m_txQueue.space() < n + TX_HEADER_SIZE)
+      {
+        while (sem_wait(&m_txSpace) < 0 && errno == EINTR)
+          ;
+      }
+
+      uint64_t t0 = Reactor::now();
+      uint8_t header[TX_HEADER_SIZE];
+      memcpy(header, &n, sizeof(n));
+      memcpy(&header[sizeof(n)], &t0, sizeof(t0));
+      m_txQueue.write(header, TX_HEADER_SIZE);
+      m_txQueue.write(&data[t], n);
+      t += n;
+
+      sem_post(&m_txReady);
+    }
+
+    return t;
   }
 
   void Serial::dump()
@@ -344,6 +508,19 @@ namespace lora
         << m_device << std::endl;
     std::cerr << "\t" << std::left << std::setw(10) << std::setfill(' ') << "Bitrate" << ": "
         << (unsigned long) bitrate() << std::endl;
+
+    if (m_fullDuplex)
+    {
+      unsigned long frames = 0;
+      uint64_t avg = 0;
+      uint64_t max = 0;
+      txLatency(frames, avg, max);
+
+      std::cerr << "\t" << std::left << std::setw(10) << std::setfill(' ') << "TX frames" << ": "
+          << frames << std::endl;
+      std::cerr << "\t" << std::left << std::setw(10) << std::setfill(' ') << "TX latency" << ": "
+          << avg << " us (max " << max << " us)" << std::endl;
+    }
   }
 
 } /* namespace t2 */
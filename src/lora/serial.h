@@ -9,12 +9,20 @@
 #define _LORA_SERIAL_H_
 
 #include <iostream>
+#include <vector>
 #include <exception>    // using standard exceptions
+#include <stdint.h>
 
 #include <unistd.h>     // UNIX standard function definitions
 #include <fcntl.h>      // File control definitions
 #include <errno.h>      // Error number definitions
 #include <termios.h>    // POSIX terminal control definitions
+#include <pthread.h>    // POSIX threads
+#include <semaphore.h>  // POSIX semaphores
+#include <atomic>
+
+#include "spscbuffer.h"
+#include "capture.h"
 
 namespace lora
 {
@@ -27,6 +35,17 @@ namespace lora
    * (bps). The operative system sees a device as a file in the '/dev'
    * directory.
    *
+   * In full-duplex mode (see setFullDuplex()) send() doesn't write on the
+   * device: it copies the bytes in a transmission queue and returns. A
+   * dedicated writer thread empties the queue, so a thread can send while
+   * another one is receiving, without any lock between them. The queue is
+   * a lock-free ring (lora::SpscBuffer) between the sending thread and the
+   * writer thread: semaphores are used only to sleep when the queue is
+   * empty (writer) or full (sender).
+   *
+   * With a capture (see setCapture()) the bytes read and written on the
+   * device are recorded in a lora::Capture ring, without locks.
+   *
    */
   class Serial
   {
@@ -45,8 +64,39 @@ namespace lora
       //! New serial settings (after having opened the serial device)
       struct termios m_newtio;
 
+      //! Full-duplex mode flag
+      bool m_fullDuplex;
+
+      //! Writer thread (full-duplex mode)
+      pthread_t m_writer;
+
+      //! Posted for every frame queued (and to stop the writer thread)
+      sem_t m_txReady;
+
+      //! Posted when the writer thread frees space in a full queue
+      sem_t m_txSpace;
+
+      //! Transmission queue: a ring of [frame header][frame bytes]
+      SpscBuffer<uint8_t> m_txQueue;
+
+      //! Number of frames written by the writer thread
+      std::atomic<unsigned long> m_txFrames;
+
+      //! Sum of the queuing latencies (usec)
+      std::atomic<uint64_t> m_txLatencySum;
+
+      //! Maximum queuing latency (usec)
+      std::atomic<uint64_t> m_txLatencyMax;
+
+      //! Capture of the traffic (NULL if disabled)
+      Capture *m_capture;
+
       int setInterfaceAttribs(int parity);
 
+      ssize_t writeAll(const char* buffer, ssize_t size);
+
+      static void* writerFunction(void *arg);
+
     public:
 
       /**
@@ -78,6 +128,9 @@ namespace lora
 
             /// Close device error
             CLOSE_DEVICE_FAILURE,
+
+            /// Writer thread error
+            WRITER_FAILURE,
           };
 
           /**
@@ -121,6 +174,9 @@ namespace lora
       /// Default bitrate
       static const unsigned int DEFAULT_BITRATE;
 
+      /// Default size of the transmission queue in full-duplex mode (bytes)
+      static const size_t TX_QUEUE_SIZE = 4096;
+
       /**
        * @brief Creates a serial device object.
        *
@@ -155,6 +211,16 @@ namespace lora
         return m_device;
       }
 
+      /**
+       * @brief Returns the file descriptor of the serial device.
+       *
+       * @returns file descriptor, -1 if device is not open.
+       */
+      int fd() const
+      {
+        return m_fd;
+      }
+
       /**
        * @brief Returns the bit-rate code: enum B1200, B2400, ..., B115200.
        *
@@ -224,6 +290,65 @@ namespace lora
        */
       void closeDev() throw (Exception);
 
+      /**
+       * @brief Enables or disables the full-duplex mode.
+       *
+       * In full-duplex mode a writer thread is started and send() only
+       * queues the bytes. The read timeout is disabled, so receive() returns
+       * immediately and it must be called when the device is readable (see
+       * lora::Reactor). Disabling the mode, the queue is emptied before the
+       * writer thread is stopped. The device must be open.
+       *
+       * @param[in] enable true to enable the full-duplex mode.
+       */
+      void setFullDuplex(bool enable) throw (Exception);
+
+      /**
+       * @brief Returns true if the full-duplex mode is enabled.
+       *
+       * @returns true in full-duplex mode.
+       */
+      bool fullDuplex() const
+      {
+        return m_fullDuplex;
+      }
+
+      /**
+       * @brief Gets the queuing latency statistics of the full-duplex mode.
+       *
+       * The queuing latency is the time between the send() call and the end
+       * of the write operation on the device.
+       *
+       * @param[out] frames number of frames written.
+       * @param[out] avg average latency in microseconds.
+       * @param[out] max maximum latency in microseconds.
+       */
+      void txLatency(unsigned long &frames, uint64_t &avg, uint64_t &max);
+
+      /**
+       * @brief Sets the capture of the traffic.
+       *
+       * The bytes are recorded when they are read (receive()) and when they
+       * are written on the device (send(), the writer thread in full-duplex
+       * mode). The capture must exist while the device is used.
+       *
+       * @param[in] capture capture, NULL to disable it.
+       */
+      void setCapture(Capture *capture)
+      {
+        m_capture = capture;
+      }
+
+      /**
+       * @brief Gets the capture of the traffic.
+       *
+       * @returns capture, NULL if disabled.
+       */
+      Capture* capture() const
+      {
+        return m_capture;
+      }
+
       /**
        * @brief Receives bytes from a serial device.
        *
@@ -242,7 +367,9 @@ namespace lora
        * @brief Sends bytes to a serial device.
        *
        * This function writes bytes to a serial device and returns the number
-       * of byte written.
+       * of byte written. In full-duplex mode the bytes are queued (the
+       * caller waits only if the queue is full) and they are written by the
+       * writer thread.
        *
        * @param[in] buffer buffer with bytes to send.
        * @param[in] size buffer size.
@@ -0,0 +1,113 @@
+//============================================================================
+// Name        : shmclient.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Client of the lora_daemon shared memory submission ring
+//============================================================================
+
+#include "shmclient.h"
+#include "submit.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace lora
+{
+  ShmClient::ShmClient() :
+      m_fd(-1)
+  {
+  }
+
+  ShmClient::~ShmClient()
+  {
+    close();
+  }
+
+  bool ShmClient::connect(const std::string &path, size_t size)
+  {
+    close();
+
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path))
+      return false;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    m_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (m_fd < 0)
+      return false;
+
+    if (::connect(m_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || !m_ring.create(size))
+    {
+      close();
+      return false;
+    }
+
+    // Request with the descriptors of the ring
+    submit::Request req;
+    memset(&req, 0, sizeof(req));
+    req.version = submit::VERSION;
+    req.flags = submit::ATTACH;
+
+    int fds[submit::ATTACH_FDS] = { m_ring.memfd(), m_ring.doorbell(), m_ring.space() };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+
+    struct iovec iov;
+    iov.iov_base = &req;
+    iov.iov_len = sizeof(req);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(m_fd, &msg, MSG_NOSIGNAL) < 0)
+    {
+      close();
+      return false;
+    }
+
+    // Answer of the daemon
+    struct pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    submit::Reply reply;
+    if (poll(&pfd, 1, CONNECT_TIMEOUT) <= 0 || recv(m_fd, &reply, sizeof(reply), 0) != sizeof(reply)
+        || reply.status != submit::QUEUED)
+    {
+      close();
+      return false;
+    }
+
+    return true;
+  }
+
+  void ShmClient::close()
+  {
+    m_ring.close();
+
+    if (m_fd >= 0)
+    {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+  }
+
+} /* namespace lora */
@@ -0,0 +1,137 @@
+//============================================================================
+// Name        : shmclient.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Client of the lora_daemon shared memory submission ring
+//============================================================================
+#ifndef _LORA_SHMCLIENT_H_
+#define _LORA_SHMCLIENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include "shmring.h"
+
+namespace lora
+{
+  /**
+   * @brief The ShmClient class submits messages to lora_daemon through a
+   * shared ring.
+   *
+   * connect() creates a ring (lora::ShmRing) and passes it to the daemon on
+   * its submission socket. Then send() writes a message in the ring without
+   * system calls while the daemon is busy; the daemon sends the message
+   * straight from the shared memory. When the ring is full send() returns
+   * false and wait() blocks until the daemon frees enough space.
+   *
+   * Example:
+   *
+   *    lora::ShmClient client;
+   *    if (client.connect("/tmp/lora.sock"))
+   *    {
+   *      while (!client.send(dest, 0, msg, len))
+   *        client.wait(len, -1);
+   *    }
+   *
+   * The object must be used by a single thread.
+   *
+   */
+  class ShmClient
+  {
+    public:
+      /// Time limit of the answer of the daemon (msec).
+      static const int CONNECT_TIMEOUT = 5000;
+
+      /**
+       * @brief Creates a client not connected.
+       *
+       */
+      ShmClient();
+
+      /**
+       * @brief Closes the connection.
+       *
+       */
+      virtual ~ShmClient();
+
+      /**
+       * @brief Creates a ring and attaches it to the daemon.
+       *
+       * @param[in] path path of the submission socket.
+       * @param[in] size minimum size of the ring (bytes).
+       *
+       * @returns false if the daemon isn't available or refuses the ring.
+       */
+      bool connect(const std::string &path, size_t size = ShmRing::DEFAULT_SIZE);
+
+      /**
+       * @brief Closes the connection. The messages already in the ring are
+       * sent by the daemon.
+       *
+       */
+      void close();
+
+      /**
+       * @brief Returns true if the ring is attached.
+       *
+       */
+      bool connected() const
+      {
+        return m_fd >= 0;
+      }
+
+      /**
+       * @brief Writes a message in the ring.
+       *
+       * @param[in] dest address of the destination node.
+       * @param[in] priority priority (0 is the lowest).
+       * @param[in] msg message.
+       * @param[in] len length of the message.
+       * @param[in] ttl lifetime in seconds (0 for the default of the daemon).
+       *
+       * @returns false if the ring is full or the message too long.
+       */
+      bool send(uint8_t dest, uint8_t priority, const uint8_t *msg, size_t len, uint16_t ttl = 0)
+      {
+        return m_ring.push(dest, priority, ttl, msg, len);
+      }
+
+      /**
+       * @brief Waits until a message can be written.
+       *
+       * @param[in] len length of the message.
+       * @param[in] timeout maximum wait in milliseconds, -1 waits forever.
+       *
+       * @returns false on timeout or if the message is too long.
+       */
+      bool wait(size_t len, int timeout)
+      {
+        return m_ring.wait(len, timeout);
+      }
+
+      /**
+       * @brief Gets the number of system calls done by send() and wait().
+       *
+       */
+      unsigned long syscalls() const
+      {
+        return m_ring.syscalls();
+      }
+
+    private:
+      /// Copy is not allowed
+      ShmClient(const ShmClient &c);
+
+      /// Assignment is not allowed
+      ShmClient & operator=(const ShmClient &c);
+
+      //! Connection with the daemon
+      int m_fd;
+
+      //! Shared ring
+      ShmRing m_ring;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_SHMCLIENT_H_ */
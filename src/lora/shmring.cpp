@@ -0,0 +1,341 @@
+//============================================================================
+// Name        : shmring.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Shared memory submission ring
+//============================================================================
+
+#include "shmring.h"
+#include "submit.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+namespace lora
+{
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring needs lock-free 64 bits atomics");
+
+  ShmRing::ShmRing() :
+      m_header(0), m_data(0), m_capacity(0), m_page(sysconf(_SC_PAGESIZE)), m_memfd(-1), m_doorbell(
+          -1), m_space(-1), m_headCache(0), m_syscalls(0), m_cursor(0), m_seq(0), m_taken(false), m_corrupted(
+          false)
+  {
+  }
+
+  ShmRing::~ShmRing()
+  {
+    close();
+  }
+
+  bool ShmRing::create(size_t size)
+  {
+    close();
+
+    size_t capacity = m_page;
+    while (capacity < size && capacity < MAX_SIZE)
+      capacity <<= 1;
+
+    m_memfd = memfd_create("lora-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (m_memfd < 0)
+      return false;
+
+    // The consumer accepts only a ring that can't shrink under it
+    if (ftruncate(m_memfd, m_page + capacity) < 0
+        || fcntl(m_memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0
+        || !map(capacity))
+    {
+      close();
+      return false;
+    }
+
+    new (m_header) Header();
+    m_header->magic = MAGIC;
+    m_header->version = VERSION;
+    m_header->capacity = capacity;
+    m_header->tail.store(0);
+    m_header->waiting.store(0);
+    m_header->head.store(0);
+    m_header->sleeping.store(0);
+
+    m_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_space = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_doorbell < 0 || m_space < 0)
+    {
+      close();
+      return false;
+    }
+
+    return true;
+  }
+
+  bool ShmRing::attach(int memfd, int doorbell, int space)
+  {
+    close();
+
+    m_memfd = memfd;
+    m_doorbell = doorbell;
+    m_space = space;
+
+    struct stat st;
+    if (fstat(memfd, &st) < 0 || (size_t) st.st_size <= m_page)
+    {
+      close();
+      return false;
+    }
+
+    int seals = fcntl(memfd, F_GET_SEALS);
+    size_t capacity = st.st_size - m_page;
+
+    if (seals < 0 || !(seals & F_SEAL_SHRINK) || capacity > MAX_SIZE
+        || (capacity & (capacity - 1)) != 0 || capacity % m_page != 0 || !map(capacity))
+    {
+      close();
+      return false;
+    }
+
+    if (m_header->magic != MAGIC || m_header->version != VERSION
+        || m_header->capacity != capacity)
+    {
+      close();
+      return false;
+    }
+
+    m_cursor = m_header->head.load(std::memory_order_acquire);
+    m_seq = 0;
+    m_taken.clear();
+    m_corrupted = false;
+
+    return true;
+  }
+
+  bool ShmRing::map(size_t capacity)
+  {
+    // Reserve the address range, then map the header and the data area
+    // twice on it
+    size_t total = m_page + 2 * capacity;
+    uint8_t *base = (uint8_t *) mmap(NULL, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+      return false;
+
+    if (mmap(base, m_page + capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_memfd, 0)
+        == MAP_FAILED
+        || mmap(base + m_page + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+            m_memfd, m_page) == MAP_FAILED)
+    {
+      munmap(base, total);
+      return false;
+    }
+
+    m_header = (Header *) base;
+    m_data = base + m_page;
+    m_capacity = capacity;
+
+    return true;
+  }
+
+  void ShmRing::close()
+  {
+    if (m_header)
+    {
+      munmap(m_header, m_page + 2 * m_capacity);
+      m_header = 0;
+      m_data = 0;
+      m_capacity = 0;
+    }
+
+    if (m_memfd >= 0)
+      ::close(m_memfd);
+    if (m_doorbell >= 0)
+      ::close(m_doorbell);
+    if (m_space >= 0)
+      ::close(m_space);
+
+    m_memfd = -1;
+    m_doorbell = -1;
+    m_space = -1;
+    m_headCache = 0;
+    m_cursor = 0;
+    m_seq = 0;
+    m_taken.clear();
+  }
+
+  void ShmRing::signal(int fd)
+  {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0)
+    {
+      // The counter is already signalled
+    }
+  }
+
+  bool ShmRing::push(uint8_t dest, uint8_t priority, uint16_t ttl, const uint8_t *msg, size_t len)
+  {
+    if (m_header == 0 || len > submit::MAX_MESSAGE)
+      return false;
+
+    size_t need = recordSize(len);
+    uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+
+    if (m_capacity - (tail - m_headCache) < need)
+    {
+      m_headCache = m_header->head.load(std::memory_order_acquire);
+      if (m_capacity - (tail - m_headCache) < need)
+        return false;
+    }
+
+    Record *r = (Record *) &m_data[tail & (m_capacity - 1)];
+    r->size = (uint32_t) len;
+    r->ttl = ttl;
+    r->dest = dest;
+    r->priority = priority;
+    memcpy(r + 1, msg, len);
+
+    // The tail is published before the sleeping flag is read
+    m_header->tail.store(tail + need, std::memory_order_seq_cst);
+
+    if (m_header->sleeping.load(std::memory_order_seq_cst)
+        && m_header->sleeping.exchange(0, std::memory_order_seq_cst))
+    {
+      signal(m_doorbell);
+      m_syscalls++;
+    }
+
+    return true;
+  }
+
+  bool ShmRing::wait(size_t len, int timeout)
+  {
+    if (m_header == 0)
+      return false;
+
+    size_t need = recordSize(len);
+    if (need > m_capacity)
+      return false;
+
+    while (true)
+    {
+      uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+      m_headCache = m_header->head.load(std::memory_order_acquire);
+      if (m_capacity - (tail - m_headCache) >= need)
+        return true;
+
+      // The head is read again after the waiting flag is set
+      m_header->waiting.store(1, std::memory_order_seq_cst);
+      m_headCache = m_header->head.load(std::memory_order_seq_cst);
+      if (m_capacity - (tail - m_headCache) >= need)
+      {
+        m_header->waiting.store(0, std::memory_order_relaxed);
+        return true;
+      }
+
+      struct pollfd pfd;
+      pfd.fd = m_space;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      int n = poll(&pfd, 1, timeout);
+      if (n <= 0)
+        return false;
+
+      uint64_t count = 0;
+      if (read(m_space, &count, sizeof(count)) < 0)
+      {
+        // Already read
+      }
+      m_syscalls++;
+    }
+  }
+
+  bool ShmRing::pending() const
+  {
+    return m_header && !m_corrupted
+        && m_header->tail.load(std::memory_order_acquire) != m_cursor;
+  }
+
+  const uint8_t* ShmRing::next(Record &rec, uint64_t &seq)
+  {
+    if (m_header == 0 || m_corrupted || m_taken.full())
+      return 0;
+
+    uint64_t tail = m_header->tail.load(std::memory_order_acquire);
+    uint64_t available = tail - m_cursor;
+    if (available == 0)
+      return 0;
+
+    // The producer is not trusted: the record must be inside the bytes
+    // written, the header is read once
+    const uint8_t *r = &m_data[m_cursor & (m_capacity - 1)];
+    memcpy(&rec, r, sizeof(rec));
+    size_t used = recordSize(rec.size);
+    if (available > m_capacity || available < sizeof(Record) || rec.size > submit::MAX_MESSAGE
+        || used > available)
+    {
+      m_corrupted = true;
+      return 0;
+    }
+
+    m_cursor += used;
+
+    Entry e;
+    e.end = m_cursor;
+    e.done = false;
+    seq = m_seq + m_taken.size();
+    m_taken.push(e);
+
+    return r + sizeof(Record);
+  }
+
+  bool ShmRing::sleep()
+  {
+    if (m_header == 0)
+      return true;
+
+    // The tail is read again after the sleeping flag is set
+    m_header->sleeping.store(1, std::memory_order_seq_cst);
+    if (m_header->tail.load(std::memory_order_seq_cst) != m_cursor)
+    {
+      m_header->sleeping.store(0, std::memory_order_relaxed);
+      return false;
+    }
+
+    return true;
+  }
+
+  void ShmRing::release(uint64_t seq)
+  {
+    if (seq < m_seq || seq - m_seq >= m_taken.size())
+      return;
+
+    m_taken[seq - m_seq].done = true;
+
+    // The head moves over the released records at the front
+    bool moved = false;
+    uint64_t head = 0;
+    Entry e;
+    while (!m_taken.empty() && m_taken[0].done && m_taken.pop(e))
+    {
+      head = e.end;
+      moved = true;
+      m_seq++;
+    }
+
+    if (!moved || m_header == 0)
+      return;
+
+    m_header->head.store(head, std::memory_order_seq_cst);
+
+    if (m_header->waiting.load(std::memory_order_seq_cst)
+        && m_header->waiting.exchange(0, std::memory_order_seq_cst))
+    {
+      signal(m_space);
+      m_syscalls++;
+    }
+  }
+
+} /* namespace lora */
@@ -0,0 +1,337 @@
+//============================================================================
+// Name        : shmring.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Shared memory submission ring
+//============================================================================
+#ifndef _LORA_SHMRING_H_
+#define _LORA_SHMRING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "circularbuffer.h"
+
+namespace lora
+{
+  /**
+   * @brief The ShmRing class is a ring of messages in shared memory between
+   * a producer process and lora_daemon.
+   *
+   * The ring is a memfd with a header page followed by the data area. Both
+   * processes map the data area twice, one copy after the other, so every
+   * record is contiguous in memory. A record is a Record header followed by
+   * the message, aligned to ALIGN bytes. The producer writes records at the
+   * tail and the daemon frees them at the head; head and tail are
+   * free-running byte counters on different cache lines.
+   *
+   * Two eventfd descriptors complete the ring:
+   *
+   *    - doorbell: the daemon sets the sleeping flag before waiting on the
+   *      doorbell and the producer rings it only if the flag is set, so
+   *      while the daemon is busy a message costs no system call;
+   *    - space: the producer waiting for free space (wait()) sets the
+   *      waiting flag and the daemon signals it when records are freed.
+   *
+   * The flags are checked again after they are set (sequentially consistent
+   * operations), so a wake-up is never lost.
+   *
+   * The daemon doesn't copy the messages: they are sent from the ring and a
+   * record is freed by release() when its message has a final status.
+   * Records are freed in order, so the head moves only over the released
+   * records at the front. The daemon trusts nothing written by the
+   * producer: sizes are checked against the published bytes, the memfd
+   * must be sealed against shrinking and a corrupted ring is abandoned.
+   *
+   * The producer side (create(), push(), wait()) is used by the client
+   * library (lora::ShmClient); the consumer side (attach(), next(), sleep(),
+   * release()) by the daemon.
+   *
+   */
+  class ShmRing
+  {
+    public:
+      /// Identifier of the header ("LoRA").
+      static const uint32_t MAGIC = 0x4C6F5241;
+
+      /// Version of the ring layout.
+      static const uint32_t VERSION = 1;
+
+      /// Default size of the data area (bytes).
+      static const size_t DEFAULT_SIZE = 1024 * 1024;
+
+      /// Maximum size of the data area (bytes).
+      static const size_t MAX_SIZE = 64 * 1024 * 1024;
+
+      /// Alignment of the records (bytes).
+      static const size_t ALIGN = 8;
+
+      /// Maximum number of records taken by the consumer and not released.
+      static const unsigned int MAX_TAKEN = 256;
+
+      /**
+       * @brief Header of a record, followed by the message.
+       */
+      struct Record
+      {
+          /// Length of the message.
+          uint32_t size;
+
+          /// Lifetime in seconds (0 for the default of the daemon).
+          uint16_t ttl;
+
+          /// Address of the destination node.
+          uint8_t dest;
+
+          /// Priority (0 is the lowest).
+          uint8_t priority;
+      };
+
+      /**
+       * @brief Creates a ring not mapped.
+       *
+       */
+      ShmRing();
+
+      /**
+       * @brief Unmaps the ring and closes its descriptors.
+       *
+       */
+      virtual ~ShmRing();
+
+      /**
+       * @brief Creates a new ring (producer).
+       *
+       * @param[in] size minimum size of the data area (rounded up to a power
+       * of two, at least a page).
+       *
+       * @returns false if the ring can't be created.
+       */
+      bool create(size_t size = DEFAULT_SIZE);
+
+      /**
+       * @brief Maps a ring created by another process (consumer).
+       *
+       * The descriptors are owned by the ring (closed by close()) also if
+       * the ring isn't valid.
+       *
+       * @param[in] memfd memory file of the ring.
+       * @param[in] doorbell eventfd signalled by the producer.
+       * @param[in] space eventfd signalled by the consumer.
+       *
+       * @returns false if the ring isn't valid.
+       */
+      bool attach(int memfd, int doorbell, int space);
+
+      /**
+       * @brief Unmaps the ring and closes its descriptors.
+       *
+       */
+      void close();
+
+      /// Memory file of the ring (-1 if not mapped).
+      int memfd() const
+      {
+        return m_memfd;
+      }
+
+      /// Eventfd signalled by the producer.
+      int doorbell() const
+      {
+        return m_doorbell;
+      }
+
+      /// Eventfd signalled by the consumer.
+      int space() const
+      {
+        return m_space;
+      }
+
+      /// Size of the data area (bytes).
+      size_t capacity() const
+      {
+        return m_capacity;
+      }
+
+      /**
+       * @brief Gets the bytes used by a record.
+       *
+       * @param[in] len length of the message.
+       */
+      static size_t recordSize(size_t len)
+      {
+        return (sizeof(Record) + len + ALIGN - 1) & ~(ALIGN - 1);
+      }
+
+      /**
+       * @brief Writes a message (producer).
+       *
+       * No system call is done unless the consumer is sleeping.
+       *
+       * @param[in] dest address of the destination node.
+       * @param[in] priority priority of the message.
+       * @param[in] ttl lifetime in seconds (0 for the default).
+       * @param[in] msg message.
+       * @param[in] len length of the message.
+       *
+       * @returns false if the ring is full (see wait()).
+       */
+      bool push(uint8_t dest, uint8_t priority, uint16_t ttl, const uint8_t *msg, size_t len);
+
+      /**
+       * @brief Waits for free space (producer).
+       *
+       * @param[in] len length of the message to write.
+       * @param[in] timeout maximum wait in milliseconds, -1 waits forever.
+       *
+       * @returns true if a message of len bytes can be written.
+       */
+      bool wait(size_t len, int timeout);
+
+      /// Number of system calls of this side (doorbells, waits and space signals).
+      unsigned long syscalls() const
+      {
+        return m_syscalls;
+      }
+
+      /**
+       * @brief Takes the next record (consumer).
+       *
+       * The message stays in the ring until release(). The header is copied
+       * (the producer can't change the size after the check).
+       *
+       * @param[out] rec header of the record.
+       * @param[out] seq sequence number of the record, for release().
+       *
+       * @returns the message, 0 if there isn't a new record (or too many
+       * records are taken, or the ring is corrupted).
+       */
+      const uint8_t* next(Record &rec, uint64_t &seq);
+
+      /**
+       * @brief Prepares the consumer to wait for the doorbell.
+       *
+       * @returns true if the ring is empty and the producer will ring the
+       * doorbell, false if a record has been written meanwhile.
+       */
+      bool sleep();
+
+      /**
+       * @brief Frees a record taken with next() (consumer).
+       *
+       * @param[in] seq sequence number of the record.
+       */
+      void release(uint64_t seq);
+
+      /// Number of records taken and not released.
+      size_t taken() const
+      {
+        return m_taken.size();
+      }
+
+      /// Returns true if the producer has written records not taken yet.
+      bool pending() const;
+
+      /// Returns true if a record isn't valid: the ring must be abandoned.
+      bool corrupted() const
+      {
+        return m_corrupted;
+      }
+
+    private:
+      /**
+       * @brief Header page of the ring.
+       */
+      struct Header
+      {
+          /// MAGIC
+          uint32_t magic;
+
+          /// VERSION
+          uint32_t version;
+
+          /// Size of the data area
+          uint64_t capacity;
+
+          /// Producer: bytes written
+          alignas(64) std::atomic<uint64_t> tail;
+
+          /// Producer: waiting for free space
+          std::atomic<uint32_t> waiting;
+
+          /// Consumer: bytes freed
+          alignas(64) std::atomic<uint64_t> head;
+
+          /// Consumer: waiting for the doorbell
+          std::atomic<uint32_t> sleeping;
+      };
+
+      /**
+       * @brief Record taken by the consumer.
+       */
+      struct Entry
+      {
+          /// Position after the record
+          uint64_t end;
+
+          /// True if released
+          bool done;
+      };
+
+      /// Copy is not allowed
+      ShmRing(const ShmRing &r);
+
+      /// Assignment is not allowed
+      ShmRing & operator=(const ShmRing &r);
+
+      /**
+       * @brief Maps the memory file: header page and data area twice.
+       *
+       */
+      bool map(size_t capacity);
+
+      /**
+       * @brief Signals an eventfd.
+       *
+       */
+      static void signal(int fd);
+
+      //! Header page (0 if not mapped)
+      Header *m_header;
+
+      //! Data area
+      uint8_t *m_data;
+
+      //! Size of the data area
+      size_t m_capacity;
+
+      //! Size of a page
+      size_t m_page;
+
+      //! Descriptors
+      int m_memfd;
+      int m_doorbell;
+      int m_space;
+
+      //! Producer: last value of the head read
+      uint64_t m_headCache;
+
+      //! Number of system calls
+      unsigned long m_syscalls;
+
+      //! Consumer: position of the next record
+      uint64_t m_cursor;
+
+      //! Consumer: sequence number of the first taken record
+      uint64_t m_seq;
+
+      //! Consumer: records taken, oldest first
+      CircularBuffer<Entry, MAX_TAKEN> m_taken;
+
+      //! Consumer: true if a record isn't valid
+      bool m_corrupted;
+  };
+
+} /* namespace lora */
+#endif /* _LORA_SHMRING_H_ */
@@ -0,0 +1,301 @@
+//============================================================================
+// Name        : spscbuffer.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Lock-free single-producer single-consumer circular buffer
+//============================================================================
+#ifndef _LORA_SPSCBUFFER_H_
+#define _LORA_SPSCBUFFER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+namespace lora
+{
+  /**
+   * @brief The SpscBuffer class is a lock-free variant of CircularBuffer for
+   * one producer thread and one consumer thread.
+   *
+   * The producer only moves the tail and the consumer only moves the head,
+   * so no lock is needed: the producer publishes the elements with a release
+   * store of the tail and the consumer frees them with a release store of
+   * the head. Head and tail are free-running counters (the number of
+   * elements is tail - head) and the capacity is a power of two, so the
+   * position in the array is a mask instead of a modulo.
+   *
+   * Head and tail are on different cache lines, each with a copy of the
+   * other index: a thread reads the index of the other one only when its
+   * copy says that the buffer is full (producer) or empty (consumer).
+   *
+   * read() and write() copy blocks with memcpy (two blocks at most, when
+   * the elements wrap around the end of the array), so T must be trivially
+   * copyable. The functions never block: the caller decides how to wait.
+   *
+   * Only write() and push() can be called by the producer; read(), pop()
+   * and drop() by the consumer. resize() and clear() need both threads
+   * stopped.
+   *
+   */
+  template<typename T>
+  class SpscBuffer
+  {
+      static_assert(std::is_trivially_copyable<T>::value, "SpscBuffer elements are copied with memcpy");
+
+    public:
+      /// Size of a cache line (bytes).
+      static const size_t CACHE_LINE = 64;
+
+      /**
+       * @brief Creates a buffer.
+       *
+       * @param[in] n minimum capacity (rounded up to a power of two).
+       */
+      explicit SpscBuffer(size_t n = 0) :
+          m_buffer(0), m_mask(0), m_capacity(0)
+      {
+        m_tail.store(0, std::memory_order_relaxed);
+        m_head.store(0, std::memory_order_relaxed);
+        m_headCache = 0;
+        m_tailCache = 0;
+
+        if (n)
+          resize(n);
+      }
+
+      /**
+       * @brief Destroys the buffer.
+       *
+       */
+      ~SpscBuffer()
+      {
+        delete[] m_buffer;
+      }
+
+      /**
+       * @brief Changes the capacity of the buffer. The buffer becomes empty.
+       *
+       * This function may throw bad_alloc. It must not be called while
+       * the producer or the consumer are running.
+       *
+       * @param[in] n minimum capacity (rounded up to a power of two).
+       */
+      void resize(size_t n)
+      {
+        size_t c = 1;
+        while (c < n)
+          c <<= 1;
+
+        T *buffer = new T[c];
+        delete[] m_buffer;
+
+        m_buffer = buffer;
+        m_capacity = c;
+        m_mask = c - 1;
+        clear();
+      }
+
+      /**
+       * @brief Deletes all elements. Producer and consumer must be stopped.
+       *
+       */
+      void clear()
+      {
+        m_tail.store(0, std::memory_order_relaxed);
+        m_head.store(0, std::memory_order_relaxed);
+        m_headCache = 0;
+        m_tailCache = 0;
+      }
+
+      /**
+       * @brief Gets the capacity of the buffer.
+       *
+       */
+      size_t capacity() const
+      {
+        return m_capacity;
+      }
+
+      /**
+       * @brief Gets the number of elements stored in the buffer.
+       *
+       * The value is exact only for the consumer (it can grow) and for the
+       * producer (it can decrease).
+       */
+      size_t size() const
+      {
+        size_t head = m_head.load(std::memory_order_acquire);
+        return m_tail.load(std::memory_order_acquire) - head;
+      }
+
+      /**
+       * @brief Returns true if the buffer is empty.
+       *
+       */
+      bool empty() const
+      {
+        return size() == 0;
+      }
+
+      /**
+       * @brief Gets the free space of the buffer (producer).
+       *
+       * @returns number of elements that can be written.
+       */
+      size_t space()
+      {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        m_headCache = m_head.load(std::memory_order_acquire);
+        return m_capacity - (tail - m_headCache);
+      }
+
+      /**
+       * @brief Writes elements into the buffer (producer).
+       *
+       * @param[in] buf elements to store.
+       * @param[in] n number of elements.
+       *
+       * @returns number of elements written: less than n if the buffer is
+       * full.
+       */
+      size_t write(const T *buf, size_t n)
+      {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (m_capacity - (tail - m_headCache) < n)
+          m_headCache = m_head.load(std::memory_order_acquire);
+
+        size_t free = m_capacity - (tail - m_headCache);
+        if (n > free)
+          n = free;
+
+        if (n == 0)
+          return 0;
+
+        size_t pos = tail & m_mask;
+        size_t first = m_capacity - pos;
+        if (first > n)
+          first = n;
+
+        memcpy(&m_buffer[pos], buf, first * sizeof(T));
+        if (n > first)
+          memcpy(m_buffer, &buf[first], (n - first) * sizeof(T));
+
+        m_tail.store(tail + n, std::memory_order_release);
+
+        return n;
+      }
+
+      /**
+       * @brief Reads and deletes elements from the buffer (consumer).
+       *
+       * @param[out] buf array where the elements are saved.
+       * @param[in] n maximum number of elements to read.
+       *
+       * @returns number of elements read.
+       */
+      size_t read(T *buf, size_t n)
+      {
+        size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (m_tailCache - head < n)
+          m_tailCache = m_tail.load(std::memory_order_acquire);
+
+        size_t used = m_tailCache - head;
+        if (n > used)
+          n = used;
+
+        if (n == 0)
+          return 0;
+
+        size_t pos = head & m_mask;
+        size_t first = m_capacity - pos;
+        if (first > n)
+          first = n;
+
+        memcpy(buf, &m_buffer[pos], first * sizeof(T));
+        if (n > first)
+          memcpy(&buf[first], m_buffer, (n - first) * sizeof(T));
+
+        m_head.store(head + n, std::memory_order_release);
+
+        return n;
+      }
+
+      /**
+       * @brief Stores an element (producer).
+       *
+       * @returns false if the buffer is full.
+       */
+      bool push(const T &elt)
+      {
+        return write(&elt, 1) == 1;
+      }
+
+      /**
+       * @brief Gets and deletes the first element (consumer).
+       *
+       * @returns false if the buffer is empty.
+       */
+      bool pop(T &elt)
+      {
+        return read(&elt, 1) == 1;
+      }
+
+      /**
+       * @brief Deletes elements without reading them (consumer).
+       *
+       * @param[in] n number of elements to delete.
+       *
+       * @returns number of elements deleted.
+       */
+      size_t drop(size_t n)
+      {
+        size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (m_tailCache - head < n)
+          m_tailCache = m_tail.load(std::memory_order_acquire);
+
+        size_t used = m_tailCache - head;
+        if (n > used)
+          n = used;
+
+        m_head.store(head + n, std::memory_order_release);
+
+        return n;
+      }
+
+    private:
+      SpscBuffer(const SpscBuffer&);
+      SpscBuffer& operator=(const SpscBuffer&);
+
+      //! Elements (read only after resize())
+      T *m_buffer;
+
+      //! Capacity - 1
+      size_t m_mask;
+
+      //! Capacity (a power of two)
+      size_t m_capacity;
+
+      //! Producer: index of the next element written
+      alignas(CACHE_LINE) std::atomic<size_t> m_tail;
+
+      //! Producer: last value of the head read
+      size_t m_headCache;
+
+      //! Consumer: index of the next element read
+      alignas(CACHE_LINE) std::atomic<size_t> m_head;
+
+      //! Consumer: last value of the tail read
+      size_t m_tailCache;
+
+      //! The next member doesn't share the consumer cache line
+      char m_padding[CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+  };
+
+} /* namespace lora */
+#endif /* _LORA_SPSCBUFFER_H_ */
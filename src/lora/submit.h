@@ -0,0 +1,140 @@
+//============================================================================
+// Name        : submit.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Messages of the lora_daemon submission socket
+//============================================================================
+#ifndef _LORA_SUBMIT_H_
+#define _LORA_SUBMIT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace lora
+{
+  /**
+   * @brief Messages exchanged by lora_daemon and its clients on the
+   * submission socket (Unix domain socket of type SOCK_SEQPACKET).
+   *
+   * A client sends one datagram per message: a Request header followed by
+   * the bytes of the message (at most MAX_MESSAGE, no new line needed).
+   * The daemon answers with Reply datagrams, in order:
+   *
+   *    - QUEUED with the identifier of the message (or REJECTED with
+   *      identifier 0 if the request isn't valid);
+   *    - SENT when the last frame of the message is given to the module;
+   *    - the final status: ACKED, EXPIRED, FAILED or REJECTED.
+   *
+   * A client can also attach a shared ring (lora::ShmRing, see
+   * lora::ShmClient): the request has the ATTACH flag, no message and the
+   * descriptors of the ring (memory file, doorbell and space eventfd) as
+   * SCM_RIGHTS ancillary data. The daemon answers QUEUED with identifier 0
+   * if the ring is accepted, REJECTED otherwise. The messages of the ring
+   * have no replies.
+   *
+   * A request with the CAPTURE flag and no message asks the daemon to write
+   * the capture of the serial traffic in its capture file (see
+   * lora::Capture): the answer is QUEUED with identifier 0 if the file is
+   * written, REJECTED otherwise.
+   *
+   * Fields are in host byte order (the socket is local).
+   *
+   */
+  namespace submit
+  {
+    /// Version of the request header.
+    static const uint8_t VERSION = 1;
+
+    /// Maximum length of a message.
+    static const size_t MAX_MESSAGE = 64 * 1024;
+
+    /// Request flag: attach a shared ring.
+    static const uint8_t ATTACH = 0x01;
+
+    /// Request flag: write the capture of the serial traffic (no message).
+    static const uint8_t CAPTURE = 0x02;
+
+    /// Number of descriptors of a shared ring.
+    static const size_t ATTACH_FDS = 3;
+
+    /**
+     * @brief Status of a message.
+     */
+    enum _STATUS
+    {
+      /// Message accepted and queued.
+      QUEUED = 0,
+
+      /// All frames of the message given to the module.
+      SENT,
+
+      /// All frames acknowledged by the module (final).
+      ACKED,
+
+      /// Lifetime or acknowledge timeout exceeded (final).
+      EXPIRED,
+
+      /// The module answered ERROR (final).
+      FAILED,
+
+      /// Request not valid or message that can't be sent (final).
+      REJECTED,
+    };
+
+    /**
+     * @brief Header of a request.
+     */
+    struct Request
+    {
+        /// Version of the header (VERSION).
+        uint8_t version;
+
+        /// Address of the destination node (0 for broadcast).
+        uint8_t dest;
+
+        /// Priority (0 is the lowest).
+        uint8_t priority;
+
+        /// Flags (ATTACH, CAPTURE or 0).
+        uint8_t flags;
+
+        /// Lifetime in seconds (0 for the default of the daemon).
+        uint16_t ttl;
+
+        /// Reserved, must be 0.
+        uint16_t reserved;
+    };
+
+    /**
+     * @brief Status notification.
+     */
+    struct Reply
+    {
+        /// Identifier of the message (0 if the request is rejected).
+        uint32_t id;
+
+        /// Status (_STATUS).
+        uint8_t status;
+
+        /// Reserved.
+        uint8_t reserved[3];
+    };
+
+    /**
+     * @brief Gets the name of a status.
+     *
+     * @param[in] status status code.
+     *
+     * @returns name of the status.
+     */
+    inline const char* statusName(uint8_t status)
+    {
+      static const char *names[] = { "queued", "sent", "acked", "expired", "failed", "rejected" };
+      return (status <= REJECTED) ? names[status] : "unknown";
+    }
+
+  } /* namespace submit */
+
+} /* namespace lora */
+#endif /* _LORA_SUBMIT_H_ */
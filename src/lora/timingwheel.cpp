@@ -0,0 +1,118 @@
+//============================================================================
+// Name        : timingwheel.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Hashed timing wheel for many one-shot timers
+//============================================================================
+
+#include "timingwheel.h"
+
+namespace lora
+{
+  TimingWheel::TimingWheel(uint64_t now, uint64_t resolution) :
+      m_resolution((resolution) ? resolution : 1), m_tick(now / m_resolution), m_size(0)
+  {
+    for (unsigned int i = 0; i < SLOTS; i++)
+    {
+      m_slots[i] = 0;
+    }
+  }
+
+  TimingWheel::~TimingWheel()
+  {
+  }
+
+  void TimingWheel::schedule(Timer &timer, uint64_t when)
+  {
+    cancel(timer);
+
+    // A timer in the past expires at the next check
+    uint64_t tick = when / m_resolution;
+    if (tick < m_tick)
+      tick = m_tick;
+
+    timer.expires = when;
+    timer.armed = true;
+    timer.slot = tick & (SLOTS - 1);
+    timer.prev = 0;
+    timer.next = m_slots[timer.slot];
+    if (timer.next)
+      timer.next->prev = &timer;
+    m_slots[timer.slot] = &timer;
+    m_size++;
+  }
+
+  void TimingWheel::cancel(Timer &timer)
+  {
+    if (!timer.armed)
+      return;
+
+    if (timer.prev)
+      timer.prev->next = timer.next;
+    else
+      m_slots[timer.slot] = timer.next;
+
+    if (timer.next)
+      timer.next->prev = timer.prev;
+
+    timer.armed = false;
+    timer.prev = 0;
+    timer.next = 0;
+    m_size--;
+  }
+
+  TimingWheel::Timer* TimingWheel::expire(uint64_t now)
+  {
+    if (m_size == 0)
+    {
+      m_tick = now / m_resolution;
+      return 0;
+    }
+
+    // The slots of the last turn cover every tick not checked yet
+    uint64_t last = now / m_resolution;
+    if (last >= m_tick + SLOTS)
+      m_tick = last - SLOTS + 1;
+
+    for (; m_tick <= last; m_tick++)
+    {
+      for (Timer *t = m_slots[m_tick & (SLOTS - 1)]; t; t = t->next)
+      {
+        if (t->expires <= now)
+        {
+          cancel(*t);
+          return t;
+        }
+      }
+
+      // Timers of the current tick not expired yet are checked again
+      if (m_tick == last)
+        break;
+    }
+
+    return 0;
+  }
+
+  uint64_t TimingWheel::next() const
+  {
+    uint64_t earliest = 0;
+
+    // The first slot with a timer of this turn gives the earliest time
+    for (unsigned int i = 0; i < SLOTS && m_size; i++)
+    {
+      uint64_t end = (m_tick + i + 1) * m_resolution;
+      for (const Timer *t = m_slots[(m_tick + i) & (SLOTS - 1)]; t; t = t->next)
+      {
+        if (earliest == 0 || t->expires < earliest)
+          earliest = t->expires;
+      }
+
+      if (earliest && earliest < end)
+        return earliest;
+    }
+
+    return earliest;
+  }
+
+} /* namespace lora */
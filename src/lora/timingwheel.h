@@ -0,0 +1,149 @@
+//============================================================================
+// Name        : timingwheel.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Hashed timing wheel for many one-shot timers
+//============================================================================
+#ifndef _LORA_TIMINGWHEEL_H_
+#define _LORA_TIMINGWHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace lora
+{
+  /**
+   * @brief The TimingWheel class keeps many one-shot timers with a single
+   * clock (i.e. one timerfd of the reactor).
+   *
+   * Time is divided in ticks of a fixed resolution and a timer is linked in
+   * the slot of its tick, modulo SLOTS: scheduling and cancelling a timer
+   * cost O(1) and don't allocate memory (the timers are nodes of the
+   * objects that use them). A timer further than a turn of the wheel stays
+   * in its slot until its time comes.
+   *
+   * Example:
+   *
+   *    struct Frame: public lora::TimingWheel::Timer { ... };
+   *
+   *    wheel.schedule(frame, now + timeout);
+   *    ...
+   *    // When the clock rings (wheel.next())
+   *    while ((t = wheel.expire(now)) != 0)
+   *      handle(static_cast<Frame *>(t));
+   *
+   */
+  class TimingWheel
+  {
+    public:
+      /// Number of slots of the wheel (a power of two).
+      static const unsigned int SLOTS = 256;
+
+      /// Default duration of a tick (usec).
+      static const uint64_t DEFAULT_RESOLUTION = 10000;
+
+      /**
+       * @brief Timer of the wheel (node of a slot).
+       */
+      struct Timer
+      {
+          /// Expiration time (usec).
+          uint64_t expires;
+
+          /// True if the timer is in the wheel.
+          bool armed;
+
+          /// Slot of the timer.
+          unsigned int slot;
+
+          /// Previous and next timer of the slot.
+          Timer *prev;
+          Timer *next;
+
+          /**
+           * @brief Creates a timer not armed.
+           *
+           */
+          Timer() :
+              expires(0), armed(false), slot(0), prev(0), next(0)
+          {
+          }
+      };
+
+      /**
+       * @brief Creates an empty wheel.
+       *
+       * @param[in] now current time (usec).
+       * @param[in] resolution duration of a tick (usec).
+       */
+      TimingWheel(uint64_t now, uint64_t resolution = DEFAULT_RESOLUTION);
+
+      /**
+       * @brief Destroys the wheel.
+       *
+       */
+      virtual ~TimingWheel();
+
+      /**
+       * @brief Arms a timer (it is moved if already armed).
+       *
+       * @param[in,out] timer timer.
+       * @param[in] when expiration time (usec).
+       */
+      void schedule(Timer &timer, uint64_t when);
+
+      /**
+       * @brief Disarms a timer (nothing is done if it isn't armed).
+       *
+       * @param[in,out] timer timer.
+       */
+      void cancel(Timer &timer);
+
+      /**
+       * @brief Removes an expired timer from the wheel.
+       *
+       * @param[in] now current time (usec).
+       *
+       * @returns the timer, 0 if no timer has expired.
+       */
+      Timer* expire(uint64_t now);
+
+      /**
+       * @brief Gets the earliest expiration time.
+       *
+       * @returns the time (usec), 0 if no timer is armed.
+       */
+      uint64_t next() const;
+
+      /**
+       * @brief Gets the number of armed timers.
+       *
+       */
+      size_t size() const
+      {
+        return m_size;
+      }
+
+    private:
+      /// Copy is not allowed
+      TimingWheel(const TimingWheel &w);
+
+      /// Assignment is not allowed
+      TimingWheel & operator=(const TimingWheel &w);
+
+      //! Duration of a tick (usec)
+      uint64_t m_resolution;
+
+      //! Next tick to check
+      uint64_t m_tick;
+
+      //! Number of armed timers
+      size_t m_size;
+
+      //! First timer of each slot
+      Timer *m_slots[SLOTS];
+  };
+
+} /* namespace lora */
+#endif /* _LORA_TIMINGWHEEL_H_ */
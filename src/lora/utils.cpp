@@ -40,6 +40,35 @@ void convertIntToSting(int val, std::string &str)
 }
 
 
+size_t convertIntToChars(int val, uint8_t *buffer, size_t size)
+{
+  uint8_t digits[12];
+  size_t n = 0;
+  size_t index = 0;
+
+  // Digits are generated from the lowest one
+  unsigned int v = (val < 0) ? 0U - (unsigned int) val : (unsigned int) val;
+  do
+  {
+    digits[n++] = '0' + (v % 10);
+    v /= 10;
+  } while (v);
+
+  if (buffer == 0 || size < n + (val < 0))
+    return 0;
+
+  if (val < 0)
+    buffer[index++] = '-';
+
+  while (n)
+  {
+    buffer[index++] = digits[--n];
+  }
+
+  return index;
+}
+
+
 uint8_t convertHexCharToInt(uint8_t val)
 {
   uint8_t c = 0;
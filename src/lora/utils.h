@@ -9,6 +9,7 @@
 #define UTILS_H_
 
 #include <stdint.h>
+#include <stddef.h>
 #include <sstream>
 #include <iomanip>
 
@@ -40,6 +41,20 @@ uint8_t convertHexToChar(uint8_t val);
  */
 void convertIntToSting(int val, std::string &str);
 
+/**
+ * Converts an integer value into its decimal ASCII characters.
+ *
+ * No memory is allocated: characters are written in the buffer (without
+ * terminator).
+ *
+ * \param[in] val value to converter
+ * \param[out] buffer array where characters are written
+ * \param[in] size size of the buffer
+ *
+ * \return number of characters written, 0 if the buffer is too small.
+ */
+size_t convertIntToChars(int val, uint8_t *buffer, size_t size);
+
 /**
  * Converts a character with an hexadecimal digit into a number.
  *
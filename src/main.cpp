@@ -29,6 +29,18 @@
 #endif
 #endif
 #endif
+#ifdef LORA_PERF
+#include "main_perf.h"
+#endif
+#ifdef LORA_GWSIM
+#include "main_gwsim.h"
+#endif
+#ifdef LORA_BENCH
+#include "main_bench.h"
+#endif
+#ifdef LORA_REPLAY
+#include "main_replay.h"
+#endif
 
 /*************************************************************************
  * MACROS
@@ -65,6 +77,18 @@ int main(int argc, char **argv)
 #endif
 #ifdef LORA_DAEMON
   ret = main_daemon(argc, argv);
+#endif
+#ifdef LORA_PERF
+  ret = main_perf(argc, argv);
+#endif
+#ifdef LORA_GWSIM
+  ret = main_gwsim(argc, argv);
+#endif
+#ifdef LORA_BENCH
+  ret = main_bench(argc, argv);
+#endif
+#ifdef LORA_REPLAY
+  ret = main_replay(argc, argv);
 #endif
   return ret;
 }
@@ -0,0 +1,1010 @@
+//============================================================================
+// Name        : main_bench.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Main for the "Lo-Ra daemon load generator"
+//============================================================================
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "global.h"
+#include "verbose.h"
+#include "main_bench.h"
+#include "lora/utils.h"
+#include "lora/reactor.h"
+#include "lora/gwsim.h"
+#include "lora/submit.h"
+#include "lora/coalesce.h"
+#include "lora/histogram.h"
+
+#ifdef LORA_BENCH
+/*****************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************/
+/**
+ * @brief Distribution of the message lengths.
+ */
+struct Sizes
+{
+    /// Kind of distribution.
+    enum
+    {
+      FIXED, UNIFORM, EXPONENTIAL
+    } kind;
+
+    /// Length (fixed), minimum (uniform) or mean (exponential).
+    size_t a;
+
+    /// Maximum (uniform).
+    size_t b;
+};
+
+/**
+ * @brief Results of a run.
+ */
+struct Results
+{
+    /// Messages generated.
+    unsigned long offered;
+
+    /// Messages accepted by the pipe or the socket.
+    unsigned long submitted;
+
+    /// Messages not accepted (the input of the daemon is full).
+    unsigned long refused;
+
+    /// Messages acknowledged by the gateway.
+    unsigned long acked;
+
+    /// Bytes of the messages acknowledged.
+    unsigned long long bytes;
+
+    /// ACKs of messages already acknowledged (the gateway wrote the last frame again).
+    unsigned long duplicates;
+
+    /// Replies of the socket, according to lora::submit::_STATUS enum.
+    unsigned long status[lora::submit::REJECTED + 1];
+
+    /// First submission (usec).
+    uint64_t first;
+
+    /// Last submission (usec).
+    uint64_t last;
+
+    /// Last ACK (usec).
+    uint64_t lastAck;
+
+    /// Time from the submission to the ACK of every message (usec).
+    std::vector<uint64_t> latency;
+
+    /// Histogram of the latency.
+    lora::Histogram histogram;
+};
+
+/**
+ * @brief Reactor handler that submits the messages to the daemon and
+ * matches the ACK of the gateway.
+ *
+ * Every message ends with its sequence number between two '~' (e.g.
+ * "qwerty~12~"), so the ACK of the last frame of a message (a fragment or
+ * a coalesced frame) identifies it.
+ */
+class LoadGenerator: public lora::Reactor::Handler, public lora::GatewaySim::Observer
+{
+  public:
+    LoadGenerator(lora::Reactor &reactor, const Sizes &sizes, unsigned long total, double rate,
+        bool poisson, unsigned int seed, size_t max) :
+        m_reactor(reactor), m_sizes(sizes), m_total(total), m_rate(rate), m_poisson(poisson),
+            m_seed(seed), m_max(max), m_fd(-1), m_socket(false), m_dest(0), m_tfd(-1), m_next(0),
+            m_draining(false), m_sent(total, 0), m_done(total, false),
+            m_buffer(sizeof(lora::submit::Request) + max + 1)
+    {
+      m_results.offered = 0;
+      m_results.submitted = 0;
+      m_results.refused = 0;
+      m_results.acked = 0;
+      m_results.bytes = 0;
+      m_results.duplicates = 0;
+      memset(m_results.status, 0, sizeof(m_results.status));
+      m_results.first = 0;
+      m_results.last = 0;
+      m_results.lastAck = 0;
+      m_results.latency.reserve(total);
+    }
+
+    /**
+     * @brief Starts to submit the messages.
+     *
+     * @param[in] fd pipe or socket of the daemon.
+     * @param[in] socket true if fd is the socket.
+     * @param[in] dest destination of the messages.
+     */
+    void start(int fd, bool socket, uint8_t dest)
+    {
+      m_fd = fd;
+      m_socket = socket;
+      m_dest = dest;
+
+      if (m_socket)
+        m_reactor.add(m_fd, this);
+
+      m_tfd = m_reactor.addTimer(this);
+      m_next = lora::Reactor::now();
+      generate();
+    }
+
+    virtual void handleEvent(int fd, uint32_t events)
+    {
+      if (fd == m_fd)
+      {
+        replies();
+        return;
+      }
+
+      if (m_draining)
+      {
+        // The last ACKs didn't arrive
+        m_reactor.stop();
+        return;
+      }
+
+      generate();
+    }
+
+    virtual void onAck(const uint8_t *msg, size_t len)
+    {
+      if (lora::Splitter::coalesced(msg, len))
+      {
+        lora::Splitter splitter;
+        splitter.begin(msg, len);
+        while (splitter.next())
+        {
+          acked(splitter.message(), splitter.size());
+        }
+      }
+      else
+      {
+        acked(msg, len);
+      }
+
+      checkEnd();
+    }
+
+    const Results& results() const
+    {
+      return m_results;
+    }
+
+  private:
+    /**
+     * @brief Submits the messages whose time has come.
+     */
+    void generate()
+    {
+      uint64_t now = lora::Reactor::now();
+
+      while (m_results.offered < m_total && m_next <= now)
+      {
+        submit(m_results.offered++, now);
+
+        double gap = 1e6 / m_rate;
+        if (m_poisson)
+          gap *= -log(uniform());
+        m_next += (uint64_t) gap;
+      }
+
+      if (m_results.offered < m_total)
+      {
+        m_reactor.armTimer(m_tfd, m_next - now);
+        return;
+      }
+
+      // All messages submitted: wait for the last ACKs
+      m_draining = true;
+      checkEnd();
+    }
+
+    /**
+     * @brief Submits a message to the pipe or to the socket.
+     */
+    void submit(unsigned long seq, uint64_t now)
+    {
+      char trailer[24];
+      size_t tlen = snprintf(trailer, sizeof(trailer), "~%lu~", seq);
+
+      size_t len = length();
+      if (len < tlen)
+        len = tlen;
+
+      size_t h = (m_socket) ? sizeof(lora::submit::Request) : 0;
+      uint8_t *msg = &m_buffer[h];
+      for (size_t i = 0; i < len - tlen; i++)
+      {
+        msg[i] = 'a' + rand_r(&m_seed) % 26;
+      }
+      memcpy(&msg[len - tlen], trailer, tlen);
+
+      ssize_t n = 0;
+      if (m_socket)
+      {
+        lora::submit::Request req;
+        memset(&req, 0, sizeof(req));
+        req.version = lora::submit::VERSION;
+        req.dest = m_dest;
+        memcpy(&m_buffer[0], &req, sizeof(req));
+
+        n = send(m_fd, &m_buffer[0], h + len, MSG_DONTWAIT | MSG_NOSIGNAL);
+      }
+      else
+      {
+        // A line not longer than PIPE_BUF is written whole or not at all
+        msg[len] = '\n';
+        n = write(m_fd, msg, len + 1);
+      }
+
+      if (n <= 0)
+      {
+        m_results.refused++;
+        return;
+      }
+
+      m_sent[seq] = now;
+      m_results.submitted++;
+      if (m_results.first == 0)
+        m_results.first = now;
+      m_results.last = now;
+    }
+
+    /**
+     * @brief Records the ACK of a message.
+     */
+    void acked(const uint8_t *msg, size_t len)
+    {
+      // Sequence number between the last two '~'
+      if (len < 3 || msg[len - 1] != '~')
+        return;
+
+      size_t i = len - 1;
+      unsigned long seq = 0;
+      unsigned long weight = 1;
+      while (i > 0 && msg[i - 1] >= '0' && msg[i - 1] <= '9')
+      {
+        seq += (msg[--i] - '0') * weight;
+        weight *= 10;
+      }
+
+      // Not the last fragment of a message
+      if (i == len - 1 || i == 0 || msg[i - 1] != '~' || seq >= m_total || m_sent[seq] == 0)
+        return;
+
+      if (m_done[seq])
+      {
+        m_results.duplicates++;
+        return;
+      }
+
+      uint64_t now = lora::Reactor::now();
+      m_done[seq] = true;
+      m_results.acked++;
+      m_results.bytes += len;
+      m_results.lastAck = now;
+      m_results.latency.push_back(now - m_sent[seq]);
+      m_results.histogram.add(now - m_sent[seq]);
+    }
+
+    /**
+     * @brief Reads the replies of the socket.
+     */
+    void replies()
+    {
+      lora::submit::Reply reply;
+      while (recv(m_fd, &reply, sizeof(reply), MSG_DONTWAIT) == sizeof(reply))
+      {
+        if (reply.status <= lora::submit::REJECTED)
+          m_results.status[reply.status]++;
+      }
+
+      checkEnd();
+    }
+
+    /**
+     * @brief Stops the run when every message submitted has a final status:
+     * the final reply of the socket, the ACK of the gateway or a failure
+     * reply for the pipe. Until then the run ends after BENCH_DRAIN seconds
+     * without ACKs or replies.
+     */
+    void checkEnd()
+    {
+      if (!m_draining)
+        return;
+
+      unsigned long done = m_results.status[lora::submit::EXPIRED]
+          + m_results.status[lora::submit::FAILED] + m_results.status[lora::submit::REJECTED];
+      done += (m_socket) ? m_results.status[lora::submit::ACKED] : m_results.acked;
+
+      if (done >= m_results.submitted)
+      {
+        m_reactor.stop();
+        return;
+      }
+
+      m_reactor.armTimer(m_tfd, (uint64_t) BENCH_DRAIN * 1000000);
+    }
+
+    /**
+     * @brief Draws the length of a message.
+     */
+    size_t length()
+    {
+      double len = m_sizes.a;
+
+      switch (m_sizes.kind)
+      {
+        case Sizes::UNIFORM:
+          len = m_sizes.a + rand_r(&m_seed) % (m_sizes.b - m_sizes.a + 1);
+          break;
+
+        case Sizes::EXPONENTIAL:
+          len = -log(uniform()) * m_sizes.a;
+          break;
+
+        default:
+          break;
+      }
+
+      if (len < 1)
+        len = 1;
+      if (len > m_max)
+        len = m_max;
+
+      return (size_t) len;
+    }
+
+    /**
+     * @brief Draws a number in (0, 1].
+     */
+    double uniform()
+    {
+      return (rand_r(&m_seed) + 1.0) / ((double) RAND_MAX + 1.0);
+    }
+
+    //! Event loop
+    lora::Reactor &m_reactor;
+
+    //! Distribution of the lengths
+    Sizes m_sizes;
+
+    //! Number of messages
+    unsigned long m_total;
+
+    //! Offered load (messages per second)
+    double m_rate;
+
+    //! True for exponential times between the messages
+    bool m_poisson;
+
+    //! State of the random generator
+    unsigned int m_seed;
+
+    //! Maximum length of a message
+    size_t m_max;
+
+    //! Pipe or socket of the daemon
+    int m_fd;
+
+    //! True if m_fd is the socket
+    bool m_socket;
+
+    //! Destination of the messages
+    uint8_t m_dest;
+
+    //! Timer of the next message and of the end of the run
+    int m_tfd;
+
+    //! Time of the next message (usec)
+    uint64_t m_next;
+
+    //! True when all messages are submitted
+    bool m_draining;
+
+    //! Submission time of every message (0 if not submitted)
+    std::vector<uint64_t> m_sent;
+
+    //! True for the messages acknowledged
+    std::vector<bool> m_done;
+
+    //! Request being written
+    std::vector<uint8_t> m_buffer;
+
+    //! Results
+    Results m_results;
+};
+
+/*****************************************************************************
+ * FUNCTIONS
+ ****************************************************************************/
+/**
+ * @brief Parses a distribution of the message lengths.
+ *
+ * @returns false if the distribution isn't valid.
+ */
+static bool parseSizes(const std::string &arg, size_t max, Sizes &sizes)
+{
+  std::string kind = arg.substr(0, arg.find(':'));
+  std::string values = (kind.size() < arg.size()) ? arg.substr(kind.size() + 1) : "";
+  std::string a = values.substr(0, values.find(':'));
+  std::string b = (a.size() < values.size()) ? values.substr(a.size() + 1) : "";
+
+  if (!is_number(a) || atol(a.c_str()) < 1 || (size_t) atol(a.c_str()) > max)
+    return false;
+
+  sizes.a = atol(a.c_str());
+  sizes.b = sizes.a;
+
+  if (kind == "fixed" && b.empty())
+    sizes.kind = Sizes::FIXED;
+  else if (kind == "exp" && b.empty())
+    sizes.kind = Sizes::EXPONENTIAL;
+  else if (kind == "uniform" && is_number(b) && (size_t) atol(b.c_str()) >= sizes.a
+      && (size_t) atol(b.c_str()) <= max)
+  {
+    sizes.kind = Sizes::UNIFORM;
+    sizes.b = atol(b.c_str());
+  }
+  else
+    return false;
+
+  return true;
+}
+
+/**
+ * @brief Starts the daemon.
+ *
+ * @param[in] args arguments (the executable first).
+ * @param[in] log file of the daemon output.
+ *
+ * @returns process id, -1 if the process can't be created.
+ */
+static pid_t spawn(const std::vector<std::string> &args, const std::string &log)
+{
+  std::vector<char *> argv;
+  for (size_t i = 0; i < args.size(); i++)
+  {
+    argv.push_back((char *) args[i].c_str());
+  }
+  argv.push_back(NULL);
+
+  pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+
+  int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0)
+  {
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+  }
+
+  execv(argv[0], &argv[0]);
+  perror("Error: execv( ) ");
+  _exit(127);
+}
+
+/**
+ * @brief Opens the input of the daemon.
+ *
+ * @returns file descriptor, -1 if the daemon isn't ready.
+ */
+static int connectInput(const std::string &path, bool socket)
+{
+  if (!socket)
+  {
+    // The daemon keeps the pipe open: it is ready when the pipe exists
+    return open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/**
+ * @brief Gets a percentile of the sorted latencies.
+ */
+static uint64_t percentile(const std::vector<uint64_t> &sorted, double percent)
+{
+  if (sorted.empty())
+    return 0;
+
+  size_t i = (size_t) ceil(percent * sorted.size() / 100.0);
+  return sorted[(i) ? i - 1 : 0];
+}
+
+int main_bench(int argc, char **argv)
+{
+  int opt = 0;
+  std::string daemon = BENCH_DAEMON;
+  std::string input = "socket";
+  std::string sizesArg = BENCH_SIZES;
+  std::string log = "/dev/null";
+  double rate = BENCH_RATE;
+  unsigned long total = BENCH_MESSAGES;
+  bool poisson = false;
+  bool json = false;
+  int dest = 1;
+  int sf = 7;
+  int band = 900;
+  double scale = 1;
+  double loss = 0;
+  double comError = 0;
+  unsigned int seed = 1;
+
+  // Parse command line
+  while ((opt = getopt(argc, argv, "v:a:c:D:f:i:jl:L:n:pr:s:x:z:h")) != -1)
+  {
+    switch (opt)
+    {
+      // Destination
+      case 'a':
+      {
+        dest = atoi(optarg);
+        if (!is_number(optarg) || dest > 255)
+        {
+          std::cerr << "Error: destination address must be a number between 0 and 255."
+              << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // COM_ERROR rate
+      case 'c':
+      {
+        comError = atof(optarg) / 100.0;
+        if (comError < 0 || comError > 1)
+        {
+          std::cerr << "Error: COM_ERROR rate must be between 0 and 100." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Daemon executable
+      case 'D':
+      {
+        daemon = optarg;
+      }
+        break;
+
+        // Frequency band
+      case 'f':
+      {
+        band = atoi(optarg);
+        if (band != 868 && band != 900)
+        {
+          std::cerr << "Error: frequency band must be 868 or 900." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Input of the daemon
+      case 'i':
+      {
+        input = optarg;
+        if (input != "socket" && input != "pipe")
+        {
+          std::cerr << "Error: input must be socket or pipe." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // JSON output
+      case 'j':
+      {
+        json = true;
+      }
+        break;
+
+        // Loss rate
+      case 'l':
+      {
+        loss = atof(optarg) / 100.0;
+        if (loss < 0 || loss > 1)
+        {
+          std::cerr << "Error: loss rate must be between 0 and 100." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Output of the daemon
+      case 'L':
+      {
+        log = optarg;
+      }
+        break;
+
+        // Number of messages
+      case 'n':
+      {
+        total = strtoul(optarg, NULL, 10);
+        if (!is_number(optarg) || total == 0)
+        {
+          std::cerr << "Error: Invalid number of messages!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Poisson arrivals
+      case 'p':
+      {
+        poisson = true;
+      }
+        break;
+
+        // Rate
+      case 'r':
+      {
+        char *end = 0;
+        rate = strtod(optarg, &end);
+        if (end == optarg || *end != '\0' || rate <= 0)
+        {
+          std::cerr << "Error: Invalid rate!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Spreading factor
+      case 's':
+      {
+        sf = atoi(optarg);
+        if (!is_number(optarg) || sf < 6 || sf > 12)
+        {
+          std::cerr << "Error: spreading factor must between 6 and 12." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Scale of the time on air
+      case 'x':
+      {
+        char *end = 0;
+        scale = strtod(optarg, &end);
+        if (end == optarg || *end != '\0' || scale < 0)
+        {
+          std::cerr << "Error: Invalid time scale!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Lengths of the messages
+      case 'z':
+      {
+        sizesArg = optarg;
+      }
+        break;
+
+        // Print help
+      case 'h':
+        print_help();
+        return 0;
+
+      case 'v':
+        // Verbose level
+        v_verbosity(atoi(optarg));
+        break;
+
+      default:
+        std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+  }
+
+  // A line of the pipe is written atomically
+  bool socket = (input == "socket");
+  size_t max = (socket) ? lora::submit::MAX_MESSAGE : PIPE_BUF - 1;
+
+  Sizes sizes;
+  if (!parseSizes(sizesArg, max, sizes))
+  {
+    std::cerr << "Error: Invalid lengths '" << sizesArg << "' (fixed:N, uniform:MIN:MAX or exp:MEAN, at most "
+        << max << " bytes)!" << std::endl;
+    std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+    return 1;
+  }
+
+  char base[64];
+  snprintf(base, sizeof(base), "/tmp/lora_bench.%d", (int) getpid());
+  std::string pipe = std::string(base) + ".pipe";
+  std::string sock = std::string(base) + ".sock";
+
+  std::vector<std::string> args;
+  args.push_back(daemon);
+  args.push_back("-v");
+  args.push_back("0");
+  args.push_back("-p");
+  args.push_back(pipe);
+  args.push_back("-u");
+  args.push_back(sock);
+  args.push_back("-a");
+  args.push_back(std::to_string(dest));
+
+  // Other arguments are passed to the daemon (i.e. -m 100)
+  for (int i = optind; i < argc; i++)
+  {
+    args.push_back(argv[i]);
+  }
+
+  // The pipe can be closed by the daemon
+  signal(SIGPIPE, SIG_IGN);
+
+  struct rusage usage;
+  memset(&usage, 0, sizeof(usage));
+  pid_t pid = -1;
+  int fd = -1;
+  bool ok = false;
+
+  try
+  {
+    lora::Reactor reactor;
+    LoadGenerator generator(reactor, sizes, total, rate, poisson, seed, max);
+
+    // Simulated gateway
+    lora::GatewaySim gw;
+    gw.config().setFrequency((band == 900) ? lora::ConfigCommand::F_900 : lora::ConfigCommand::F_868);
+    gw.config().setChannel((band == 900) ? lora::ConfigCommand::CH_00 : lora::ConfigCommand::CH_10);
+    gw.config().setSpreadingFactor(sf - 6);
+    gw.setTimeScale(scale);
+    gw.setFaults(loss, 0, comError);
+    gw.setSeed(seed);
+
+    if (!gw.open())
+    {
+      perror("Error: pseudo terminal not available ");
+      return 1;
+    }
+
+    gw.attach(reactor);
+    gw.setObserver(&generator);
+
+    args.push_back("-d");
+    args.push_back(gw.device());
+
+    pid = spawn(args, log);
+    if (pid < 0)
+    {
+      perror("Error: fork( ) ");
+      return 1;
+    }
+
+    // The gateway answers the daemon while it starts
+    uint64_t deadline = lora::Reactor::now() + (uint64_t) BENCH_START * 1000000;
+    while (lora::Reactor::now() < deadline)
+    {
+      reactor.runOnce(100);
+
+      if (waitpid(pid, NULL, WNOHANG) == pid)
+      {
+        pid = -1;
+        break;
+      }
+
+      if ((fd = connectInput((socket) ? sock : pipe, socket)) >= 0)
+        break;
+    }
+
+    if (fd < 0)
+    {
+      std::cerr << "Error: " << daemon << " didn't start (see -L)." << std::endl;
+    }
+    else
+    {
+      V_INFO("Daemon %d ready on %s\n", (int) pid, gw.device().c_str());
+
+      generator.start(fd, socket, dest);
+      reactor.run();
+      ok = true;
+    }
+
+    // CPU time of the daemon
+    if (pid > 0)
+    {
+      kill(pid, SIGINT);
+
+      deadline = lora::Reactor::now() + (uint64_t) BENCH_EXIT * 1000000;
+      while (wait4(pid, NULL, WNOHANG, &usage) == 0)
+      {
+        if (lora::Reactor::now() > deadline)
+        {
+          kill(pid, SIGKILL);
+          wait4(pid, NULL, 0, &usage);
+          break;
+        }
+        reactor.runOnce(10);
+      }
+    }
+
+    if (fd >= 0)
+      close(fd);
+    unlink(pipe.c_str());
+    unlink(sock.c_str());
+
+    if (ok)
+    {
+      Results r = generator.results();
+      const lora::GatewaySim::Stats &g = gw.stats();
+
+      std::sort(r.latency.begin(), r.latency.end());
+      uint64_t avg = r.histogram.mean();
+      uint64_t p50 = percentile(r.latency, 50);
+      uint64_t p90 = percentile(r.latency, 90);
+      uint64_t p99 = percentile(r.latency, 99);
+
+      uint64_t end = (r.lastAck > r.last) ? r.lastAck : r.last;
+      double duration = (end > r.first) ? (end - r.first) / 1e6 : 0;
+      double throughput = (duration > 0) ? r.acked / duration : 0;
+      double bytes = (duration > 0) ? r.bytes / duration : 0;
+      double user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+      double system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+      double perMessage = (r.submitted) ? (user + system) * 1e6 / r.submitted : 0;
+      unsigned long lost = r.submitted - r.acked;
+
+      // Every message acknowledged by the gateway is ACKED by the daemon
+      bool match = !socket || r.status[lora::submit::ACKED] == r.acked;
+
+      if (json)
+      {
+        printf("{\"input\":\"%s\",\"rate\":%.3f,\"arrivals\":\"%s\",\"sizes\":\"%s\","
+            "\"band\":%d,\"sf\":%d,\"scale\":%.3f,\"loss\":%.3f,\"com_error\":%.3f,"
+            "\"offered\":%lu,\"submitted\":%lu,\"refused\":%lu,\"acked\":%lu,\"lost\":%lu,"
+            "\"dropped\":%lu,\"duplicate_acks\":%lu,\"expired\":%lu,\"failed\":%lu,\"rejected\":%lu,"
+            "\"duration_s\":%.3f,\"throughput_msg_s\":%.3f,\"throughput_bytes_s\":%.1f,"
+            "\"latency_us\":{\"avg\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu},"
+            "\"daemon_cpu_s\":{\"user\":%.3f,\"system\":%.3f},\"cpu_us_per_msg\":%.1f,"
+            "\"gateway\":{\"data\":%lu,\"lost\":%lu,\"com_errors\":%lu,\"airtime_s\":%.3f},"
+            "\"acked_match\":%s}\n",
+            input.c_str(), rate, (poisson) ? "poisson" : "constant", sizesArg.c_str(), band, sf,
+            scale, loss * 100, comError * 100, r.offered, r.submitted, r.refused, r.acked, lost,
+            r.refused + lost, r.duplicates, r.status[lora::submit::EXPIRED],
+            r.status[lora::submit::FAILED], r.status[lora::submit::REJECTED], duration,
+            throughput, bytes, (unsigned long long) avg, (unsigned long long) p50,
+            (unsigned long long) p90, (unsigned long long) p99,
+            (unsigned long long) r.histogram.max(), user, system, perMessage,
+            g.commands[lora::Command::DATA], g.lost, g.comErrors, g.airtime / 1e6,
+            (match) ? "true" : "false");
+      }
+      else
+      {
+        printf("Load           : %s, %.1f msg/s (%s), lengths %s, %d MHz SF%d, time scale %.2f\n",
+            input.c_str(), rate, (poisson) ? "poisson" : "constant", sizesArg.c_str(), band, sf,
+            scale);
+        printf("Messages       : %lu offered, %lu submitted, %lu refused, %lu acked, %lu lost (%lu duplicate ACKs)\n",
+            r.offered, r.submitted, r.refused, r.acked, lost, r.duplicates);
+        if (socket)
+          printf("Replies        : %lu queued, %lu sent, %lu acked, %lu expired, %lu failed, %lu rejected\n",
+              r.status[lora::submit::QUEUED], r.status[lora::submit::SENT],
+              r.status[lora::submit::ACKED], r.status[lora::submit::EXPIRED],
+              r.status[lora::submit::FAILED], r.status[lora::submit::REJECTED]);
+        printf("Throughput     : %.2f msg/s, %.1f bytes/s (%.1f s)\n", throughput, bytes, duration);
+        printf("Latency        : avg %.1f ms, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+            avg / 1e3, p50 / 1e3, p90 / 1e3, p99 / 1e3, r.histogram.max() / 1e3);
+        for (unsigned int b = 0; b < lora::Histogram::BUCKETS; b++)
+        {
+          // Lower bound in usec, so the sub-millisecond buckets stay apart
+          if (r.histogram.count(b))
+            printf("Latency %9llu us+: %llu\n", (unsigned long long) lora::Histogram::lower(b),
+                (unsigned long long) r.histogram.count(b));
+        }
+        printf("Daemon CPU     : user %.3f s, system %.3f s (%.1f us per message)\n", user, system,
+            perMessage);
+        printf("Gateway        : %lu DATA, %lu answers lost, %lu COM_ERROR, time on air %.3f s\n",
+            g.commands[lora::Command::DATA], g.lost, g.comErrors, g.airtime / 1e6);
+      }
+      fflush(stdout);
+
+      if (!match)
+      {
+        std::cerr << "Error: " << r.status[lora::submit::ACKED] << " messages ACKED by the daemon, "
+            << r.acked << " acknowledged by the gateway!" << std::endl;
+        ok = false;
+      }
+    }
+  }
+  catch (lora::Reactor::Exception &e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
+
+void print_help(void)
+{
+  std::cerr << "WaspMote Lo-Ra - " << LORA_NAME << " v" << LORA_VERSION << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "Usage: " << LORA_NAME
+      << " [-v 0|1|2] [-D daemon] [-L log] [-i socket|pipe] [-r rate] [-p] [-n messages] [-z lengths] [-a [0-255]] [-f 868|900] [-s 6-12] [-x scale] [-l loss] [-c com_error] [-j] [-- daemon options]"
+      << std::endl;
+  std::cerr << "       " << LORA_NAME << " -h" << std::endl << std::endl;
+  std::cerr << " -a : destination of the messages. Default value is 1." << std::endl;
+  std::cerr << " -c : rate of the DATA commands failed with COM_ERROR (percent). Default value is 0."
+      << std::endl;
+  std::cerr << " -D : daemon executable. Default value is " << BENCH_DAEMON << "." << std::endl;
+  std::cerr
+      << " -f : frequency band of the gateway [868|900]. Default value is 900 (no duty cycle limit)."
+      << std::endl;
+  std::cerr << " -h : display this message." << std::endl;
+  std::cerr << " -i : input of the daemon [socket|pipe]. Default value is socket." << std::endl;
+  std::cerr << " -j : print the results as a JSON object (one line)." << std::endl;
+  std::cerr << " -l : rate of the answers of the gateway lost (percent). Default value is 0." << std::endl;
+  std::cerr << " -L : file of the daemon output. Default value is /dev/null." << std::endl;
+  std::cerr << " -n : number of messages. Default value is " << BENCH_MESSAGES << "." << std::endl;
+  std::cerr << " -p : Poisson arrivals (exponential times between the messages). Default is a constant rate."
+      << std::endl;
+  std::cerr << " -r : offered load in messages per second. Default value is " << BENCH_RATE << "."
+      << std::endl;
+  std::cerr << " -s : spreading factor of the gateway [6-12]. Default value is 7." << std::endl;
+  std::cerr << " -v : set verbosity level [0|1|2]." << std::endl;
+  std::cerr << " -x : scale of the time on air of the gateway (0 answers at once). Default value is 1."
+      << std::endl;
+  std::cerr
+      << " -z : lengths of the messages: fixed:N, uniform:MIN:MAX or exp:MEAN (bytes). Default value is "
+      << BENCH_SIZES << "." << std::endl;
+
+  std::cerr << std::endl;
+  std::cerr
+      << "The latency is the time from the submission of a message to the ACK of its last frame written by the gateway. A message is lost if it is submitted but never acknowledged (the run ends "
+      << BENCH_DRAIN << " s after the last message without ACKs or replies); refused if the pipe or the socket of the daemon is full."
+      << std::endl;
+  std::cerr
+      << "With the socket the messages ACKED by the daemon must be the messages acknowledged by the gateway, otherwise the exit status is 1."
+      << std::endl;
+  std::cerr << std::endl;
+}
+
+#endif
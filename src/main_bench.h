@@ -0,0 +1,67 @@
+//============================================================================
+// Name        : main_bench.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Header of the main for the "Lo-Ra daemon load generator"
+//============================================================================
+#ifndef MAIN_BENCH_H_
+#define MAIN_BENCH_H_
+
+//#define LORA_BENCH
+#ifdef LORA_BENCH
+
+/*****************************************************************************
+ * MACROS
+ ****************************************************************************/
+#ifndef LORA_NAME
+#define LORA_NAME             "lora_bench"
+#define LORA_VERSION          "1.0"
+#endif
+
+#define BENCH_DAEMON          "./lora_daemon"       // Default daemon executable
+
+#define BENCH_RATE            10                    // Default offered load (messages per second)
+
+#define BENCH_MESSAGES        1000                  // Default number of messages
+
+#define BENCH_SIZES           "fixed:16"            // Default distribution of the message lengths
+
+#define BENCH_START           20                    // Maximum wait of the daemon start (sec)
+
+#define BENCH_DRAIN           30                    // Maximum wait without ACKs or replies after the last message (sec)
+
+#define BENCH_EXIT            5                     // Maximum wait of the daemon exit (sec)
+
+/*****************************************************************************
+ * FUNCTIONS
+ ****************************************************************************/
+/**
+ * @brief Prints the help message of the command.
+ *
+ * This function prints on standard error the help of the \elora_bench
+ * command.
+ *
+ */
+void print_help(void);
+
+/**
+ * @brief Main function for the Lo-Ra daemon load generator.
+ *
+ * This command starts lora_daemon on a simulated gateway (lora::GatewaySim)
+ * and submits messages through the pipe or the socket of the daemon at a
+ * given rate. The time from the submission of a message to its ACK is
+ * measured at the gateway. At the end the throughput, the messages lost,
+ * the latency and the CPU time of the daemon are printed (as text or as a
+ * JSON object).
+ *
+ * @param[in] argc number of strings pointed to by argv
+ * @param[in] argv arguments vector
+ *
+ * @returns 0 if the benchmark ran, 1 otherwise (exit status).
+ */
+int main_bench(int argc, char **argv);
+
+#endif
+
+#endif /* MAIN_BENCH_H_ */
@@ -19,6 +19,12 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <pthread.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 
 #include "global.h"
 #include "verbose.h"
@@ -26,13 +32,19 @@
 #include "lora/utils.h"
 #include "lora/serial.h"
 #include "lora/command.h"
+#include "lora/reactor.h"
+#include "lora/parser.h"
+#include "lora/scheduler.h"
+#include "lora/outbox.h"
+#include "lora/submit.h"
+#include "lora/shmring.h"
+#include "linereader.h"
 
 //#define LORA_DAEMON
 
 #ifdef LORA_DAEMON
 
-int running = 1;
-pthread_mutex_t lock_x;
+std::atomic<int> running(1);
 
 /*****************************************************************************
  * FUNCTIONS
@@ -42,11 +54,27 @@ int main_daemon(int argc, char **argv)
   int opt = 0;
 
   uint8_t dest = 0;
-  uint8_t timeout = TX_TIMEOUT;
+  uint8_t timeout = 0;
+  uint16_t ttl = MESSAGE_TTL;
+  uint16_t maxWait = LANE_MAX_WAIT;
+  int32_t coalesce = -1;
+  uint8_t retries = RETRY_MAX;
+  unsigned int weights[lora::Outbox::LANES];
+  int band = 868;
+  int ch = 10;
+  int bw = 125;
+  int cr = 5;
+  int sf = 12;
   std::string pipe = PIPE_NAME;
+  std::string sock = SOCKET_NAME;
   std::string msg = "";
   std::string device = SERIAL_DEVICE;
   unsigned long bitrate = SERIAL_BITRATE;
+  std::string capturePath = CAPTURE_NAME;
+  unsigned long captureSize = 0;
+
+  // Capture of the serial traffic, always on (it outlives the device)
+  lora::Capture capture;
 
   // Serial device handler
   lora::Serial serial;
@@ -56,9 +84,19 @@ int main_daemon(int argc, char **argv)
   pthread_t t_read;
 
   running = 1;
+  parseWeights(LANE_WEIGHTS, weights);
 
   // Try to catch CTRL-C signal and calling the corresponding routine
   signal(SIGINT, signalCallbackHandler);
+  signal(SIGTERM, signalCallbackHandler);
+
+  // SIGUSR1 (print the statistics) and SIGUSR2 (save the capture) are read
+  // by the 'write' thread only
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
 
   if (argc == 1)
   {
@@ -67,7 +105,7 @@ int main_daemon(int argc, char **argv)
   }
 
   // Parse command line
-  while ((opt = getopt(argc, argv, "v:a:b:d:p:t:")) != -1)
+  while ((opt = getopt(argc, argv, "v:a:b:c:d:e:f:g:hk:l:m:n:o:p:r:s:t:u:w:")) != -1)
   {
     switch (opt)
     {
@@ -124,6 +162,19 @@ int main_daemon(int argc, char **argv)
       }
         break;
 
+        // Channel
+      case 'c':
+      {
+        if (!is_number(optarg) || atoi(optarg) > 17)
+        {
+          std::cerr << "Error: channel must between 0 and 17." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+        ch = atoi(optarg);
+      }
+        break;
+
         // Serial device
       case 'd':
       {
@@ -131,11 +182,109 @@ int main_daemon(int argc, char **argv)
       }
         break;
 
+        // Lifetime of the messages
+      case 'e':
+      {
+        if (!is_number(optarg) || atoi(optarg) > 65535)
+        {
+          std::cerr << "Error: message lifetime must be between 0 and 65535 seconds." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+        ttl = (uint16_t) atoi(optarg);
+      }
+        break;
+
+        // Frequency band
+      case 'f':
+      {
+        band = atoi(optarg);
+        if (!is_number(optarg) || (band != 868 && band != 900))
+        {
+          std::cerr << "Error: frequency must be 868 or 900." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+      }
+        break;
+
+        // Maximum wait of a message
+      case 'g':
+      {
+        if (!is_number(optarg) || atoi(optarg) > 65535)
+        {
+          std::cerr << "Error: maximum wait must be between 0 and 65535 seconds." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+        maxWait = (uint16_t) atoi(optarg);
+      }
+        break;
+
         // Print help
       case 'h':
         print_help();
         return 1;
 
+        // Capture file
+      case 'k':
+      {
+        capturePath = optarg;
+      }
+        break;
+
+        // Weights of the priority lanes
+      case 'l':
+      {
+        if (!parseWeights(optarg, weights))
+        {
+          std::cerr << "Error: lane weights must be at most " << lora::Outbox::LANES
+              << " numbers between 1 and 255 separated by commas." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+      }
+        break;
+
+        // Coalescing window
+      case 'm':
+      {
+        if (!is_number(optarg) || atoi(optarg) > 65535)
+        {
+          std::cerr << "Error: coalescing window must be between 0 and 65535 milliseconds." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+        coalesce = atoi(optarg);
+      }
+        break;
+
+        // Retransmissions
+      case 'n':
+      {
+        if (!is_number(optarg) || atoi(optarg) > 16)
+        {
+          std::cerr << "Error: retransmissions must be between 0 and 16." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+        retries = (uint8_t) atoi(optarg);
+      }
+        break;
+
+        // Continuous capture
+      case 'o':
+      {
+        if (!is_number(optarg) || atoi(optarg) > 1048576)
+        {
+          std::cerr << "Error: capture file size must be between 0 and 1048576 KB." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+        captureSize = strtoul(optarg, NULL, 10);
+      }
+        break;
+
         // Message
       case 'p':
       {
@@ -144,6 +293,32 @@ int main_daemon(int argc, char **argv)
       }
         break;
 
+        // Coding rate
+      case 'r':
+      {
+        cr = atoi(optarg);
+        if (!is_number(optarg) || cr < 5 || cr > 8)
+        {
+          std::cerr << "Error: coding rate must be must between 5 and 8." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+      }
+        break;
+
+        // Spreading factor
+      case 's':
+      {
+        sf = atoi(optarg);
+        if (!is_number(optarg) || sf < 6 || sf > 12)
+        {
+          std::cerr << "Error: spreading factor must between 6 and 12." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+      }
+        break;
+
         // Timeout
       case 't':
       {
@@ -178,10 +353,31 @@ int main_daemon(int argc, char **argv)
       }
         break;
 
+        // Submission socket
+      case 'u':
+      {
+        sock = optarg;
+      }
+        break;
+
       case 'v':
         // Verbose level
         v_verbosity(atoi(optarg));
         break;
+
+        // Bandwidth
+      case 'w':
+      {
+        bw = atoi(optarg);
+        if (!is_number(optarg) || (bw != 125 && bw != 250 && bw != 500))
+        {
+          std::cerr << "Error: bandwidth must be 125, 250 or 500." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+      }
+        break;
+
       default:
         std::cerr << "Type '" << LORA_NAME << "-h' for help." << std::endl;
         std::cerr << std::endl;
@@ -192,6 +388,15 @@ int main_daemon(int argc, char **argv)
   V_DEBUG("Serial device : %s\n", device.c_str());
   V_DEBUG("Serial bitrate: %ld\n", bitrate);
 
+  const lora::Region *region = lora::Region::find(
+      (band == 900) ? lora::ConfigCommand::F_900 : lora::ConfigCommand::F_868);
+
+  if (region->channel(ch) == 0)
+  {
+    std::cerr << "Error: channel " << ch << " isn't in the " << band << " MHz band." << std::endl;
+    return 0;
+  }
+
   try
   {
     serial.setDevice(device);
@@ -207,6 +412,24 @@ int main_daemon(int argc, char **argv)
     return 0;
   }
 
+  // From now on SIGINT and SIGTERM are read by the 'write' thread too (the
+  // capture flusher and the serial writer inherit the mask): both threads
+  // stop and the capture is flushed before the exit
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  serial.setCapture(&capture);
+  if (captureSize)
+  {
+    if (!capture.start(capturePath, captureSize * 1024, CAPTURE_FILES, CAPTURE_PERIOD))
+    {
+      std::cerr << "Error: capture file " << capturePath << " not available." << std::endl;
+      return 0;
+    }
+    V_INFO("Capture %s (%lu KB, %d old files)\n", capturePath.c_str(), captureSize, CAPTURE_FILES);
+  }
+
   V_INFO("Open serial device\n");
   if (openSerial(serial))
   {
@@ -227,15 +450,90 @@ int main_daemon(int argc, char **argv)
     // Empty Rx serial buffer
     rx_buffer_flush(serial);
 
+    // Frames are released according to the settings of the module: the
+    // command line settings are used if they can't be read
+    lora::command::Info info;
+    bool settings = readSettings(serial, info);
+    if (settings)
+    {
+      const lora::Region *r = lora::Region::find(info.frequency());
+      settings = (r && r->channel(info.channel()) && lora::Airtime::compute(info, 0));
+      if (settings)
+        region = r;
+    }
+
+    lora::Scheduler scheduler(*region);
+    if (settings)
+    {
+      scheduler.configure(info, lora::Reactor::now());
+    }
+    else
+    {
+      std::cerr << "Warning: module settings not available, the command line settings are used."
+          << std::endl;
+      scheduler.configure(ch, sf, bw, cr, lora::Reactor::now());
+    }
+
+    V_INFO("Duty cycle %.1f%% (%s), burst %lu ms, frame of %lu bytes %lu us\n",
+        scheduler.duty() / 10.0, region->name,
+        (unsigned long) (scheduler.budget(lora::Reactor::now()) / 1000),
+        (unsigned long) lora::Scheduler::MAX_MESSAGE,
+        (unsigned long) scheduler.airtime(lora::Scheduler::MAX_MESSAGE));
+
+    // Reads and writes run at the same time: the write thread queues frames
+    // and a writer thread of the serial device sends them.
+    try
+    {
+      serial.setFullDuplex(true);
+    }
+    catch (lora::Serial::Exception &e)
+    {
+      std::cerr << "Error (serial connection): " << e.what() << std::endl;
+      closeSerial(serial);
+      return 0;
+    }
+
+    // Answers of the module, from the 'read' thread to the 'write' thread
+    lora::SpscBuffer<uint8_t> acks(ANSWER_QUEUE_SIZE);
+    std::atomic<bool> awaiting(false);
+    int ackfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int stopfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int dumpfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ackfd < 0 || stopfd < 0 || dumpfd < 0)
+    {
+      perror("Error: eventfd ");
+      closeSerial(serial);
+      return 0;
+    }
+
     tx_param pt;
     pt.timeout = timeout;
+    pt.ttl = ttl;
+    pt.maxWait = maxWait;
+    pt.coalesce = coalesce;
+    pt.retries = retries;
+    memcpy(pt.weights, weights, sizeof(pt.weights));
+    pt.scheduler = &scheduler;
     pt.dest = dest;
     pt.error = 0;
     pt.pipe = &pipe;
+    pt.socket = &sock;
+    pt.acks = &acks;
+    pt.ackfd = ackfd;
+    pt.awaiting = &awaiting;
+    pt.stopfd = stopfd;
+    pt.dumpfd = dumpfd;
     pt.serial = &serial;
+    pt.capture = &capture;
+    pt.capturePath = &capturePath;
 
     rx_param pr;
     pr.error = 0;
+    pr.acks = &acks;
+    pr.ackfd = ackfd;
+    pr.awaiting = &awaiting;
+    pr.stopfd = stopfd;
+    pr.dumpfd = dumpfd;
     pr.serial = &serial;
 
     int rc = 0;
@@ -258,6 +556,10 @@ int main_daemon(int argc, char **argv)
 
     pthread_cancel(t_write);
     pthread_cancel(t_read);
+
+    close(dumpfd);
+    close(stopfd);
+    close(ackfd);
   }
   else
   {
@@ -265,6 +567,7 @@ int main_daemon(int argc, char **argv)
   }
 
   closeSerial(serial);
+  capture.stop();
 
   /* Last thing that main() should do */
   pthread_exit(NULL);
@@ -272,327 +575,1872 @@ int main_daemon(int argc, char **argv)
   return 0;
 }
 
-void* t_write_function(void *arg)
+/**
+ * @brief Front end of the 'write' thread: an object that submits messages
+ * to the sender.
+ *
+ * A producer stops reading when the outbox is full, so that its writers
+ * are blocked; resume() is called when slots are released.
+ */
+class Producer
 {
-  int pp = 0;
-  uint8_t timeout = 0;
-  uint8_t dest = 0;
-  std::string *pipe = 0;
-  lora::Serial *serial = 0;
-  tx_param *p = (tx_param*) arg;
+  public:
+    virtual ~Producer()
+    {
+    }
 
-  timeout = p->timeout;
-  dest = p->dest;
-  pipe = p->pipe;
-  serial = p->serial;
+    /**
+     * @brief Called when the outbox has free slots.
+     *
+     */
+    virtual void resume() = 0;
+};
+
+/**
+ * @brief Reactor handler of the 'write' thread that sends the messages.
+ *
+ * It takes the messages of the outbox by priority and sends a DATA command
+ * for each message (one per fragment for long messages, one per send
+ * operation). Frames are released by the scheduler as soon as the duty
+ * cycle of the sub-band allows (and not before the optional minimum time
+ * between two send operations): the outbox gives the most urgent message
+ * whose first frame fits the budget now, so a short alarm isn't delayed by
+ * a long frame waiting for the duty cycle.
+ *
+ * The module answers every DATA command with ACK or ERROR: the 'read'
+ * thread passes the answers through an event queue, only while a DATA
+ * command waits for one (tx_param::awaiting). Answers carry no frame
+ * identifier, so one frame at a time waits for an answer: the next frame is
+ * released only after its answer or its time limit, and an answer that
+ * arrives when no frame is waiting is dropped. Every frame sent is kept in a
+ * table of MAX_INFLIGHT frames until it is acknowledged: a frame answered with ERROR
+ * or without answer within ACK_TIMEOUT seconds after the time on air is
+ * sent again after a backoff (RETRY_BACKOFF seconds, doubled every time),
+ * before the new frames, at most tx_param::retries times. The timers of the
+ * frames (answer time limit, backoff) are kept in a timing wheel with a
+ * single timerfd. A message is ACKED when all its frames are acknowledged,
+ * EXPIRED if its lifetime ends before it is sent or a frame is never
+ * answered, FAILED if the module answers ERROR to every transmission of a
+ * frame. The status changes are sent to the client of the message, if any.
+ * The time from the transmission of a frame to its ACK and the frames
+ * delivered to every node are recorded for the statistics.
+ */
+class Sender: public lora::Reactor::Handler, public lora::Outbox::Selector
+{
+  public:
+    /// Maximum number of frames not acknowledged (one waiting for the
+    /// answer of the module, the others for their retransmission).
+    static const unsigned int MAX_INFLIGHT = 16;
+
+    Sender(lora::Reactor &reactor, tx_param *p, lora::Outbox &outbox) :
+        m_reactor(reactor), m_param(p), m_outbox(outbox), m_waiting(false), m_msg(0), m_data(0), m_size(
+            0), m_header(false), m_fragmenter(m_cache), m_free(false), m_pending(0), m_retries(false), m_wheel(
+            lora::Reactor::now()), m_acked(0), m_expired(0), m_failed(0), m_rejected(0), m_batches(0), m_coalesced(
+            0), m_saved(0), m_retransmitted(0), m_dropped(0)
+    {
+      for (unsigned int i = 0; i < MAX_INFLIGHT; i++)
+      {
+        m_free.push(&m_frames[i]);
+      }
+      for (unsigned int d = 0; d < lora::Outbox::DESTINATIONS; d++)
+      {
+        m_nodes[d].frames = 0;
+        m_nodes[d].retries = 0;
+        m_nodes[d].delivered = 0;
+        m_nodes[d].lost = 0;
+      }
 
-//  time_t now;
-//  time_t end;
+      m_tfd = m_reactor.addTimer(this);
+      m_afd = m_reactor.addTimer(this);
+      m_reactor.add(m_param->ackfd, this);
+      m_last = lora::Reactor::now();
+    }
 
-  time_t t0;
-  time_t t1;
+    /**
+     * @brief Adds a front end, resumed when slots of the outbox are released.
+     *
+     */
+    void addProducer(Producer *producer)
+    {
+      m_producers.push_back(producer);
+    }
 
-  uint8_t tx_buffer[buf_sz] = { 0 };
+    /**
+     * @brief Queues a message taken from the outbox and sends it as soon as
+     * possible.
+     *
+     */
+    void submit(lora::Outbox::Message *msg)
+    {
+      m_outbox.submit(msg);
+      notify(*msg, lora::submit::QUEUED);
 
-//  size_t t = 0;
+      // No message in progress: the new one may be sent before the others
+      if (m_msg == 0)
+        m_waiting = false;
 
-  Buffer cPipeBuffer;
+      sendMessages();
+    }
 
-  V_INFO("Start write treahd!\n");
+    virtual uint64_t release(const lora::Outbox::Message &msg, uint64_t now)
+    {
+      // Expired or too long messages are taken at once and dropped
+      if (msg.deadline && msg.deadline <= now)
+        return now;
+
+      uint64_t next = releaseTime(lora::Fragmenter::fragmentSize(msg.data, msg.size, 0), now);
+      if (next == lora::Scheduler::NEVER)
+        return now;
+
+      // A short message waits for others to the same node until the
+      // coalesced frame is full or the window is over
+      size_t limit = batchLimit();
+      if (m_param->coalesce > 0 && msg.size < limit
+          && m_outbox.pendingBytes(msg.dest) + m_outbox.pending(msg.dest) < limit)
+      {
+        uint64_t window = msg.time + (uint64_t) m_param->coalesce * 1000;
+        if (window > next)
+          next = window;
+      }
 
-  t0 = time(&t0);
-  t1 = time(&t1);
+      return next;
+    }
 
-  try
-  {
-    cPipeBuffer.resize(buf_sz);
-  }
-  catch (std::exception &e)
-  {
-    throw(e);
-    p->error = 1;
-    return NULL;
-  }
+    virtual void handleEvent(int fd, uint32_t events)
+    {
+      if (fd == m_tfd)
+      {
+        // The next frame can be released
+        m_waiting = false;
+      }
+      else if (fd == m_afd)
+      {
+        expireFrames(lora::Reactor::now());
+      }
+      else
+      {
+        receiveAnswers();
+      }
 
-  // Prepare command
-  ssize_t sz = 0;
+      sendMessages();
 
-  // Check if pipe exists
-  if (fileExists(pipe->c_str()))
-  {
-    V_INFO("Pipe %s exists!\n", pipe->c_str());
-  }
-  else
-  {
-    V_INFO("Create pipe %s.\n", pipe->c_str());
+      // The front ends read again if slots have been released
+      for (size_t i = 0; i < m_producers.size() && !m_outbox.full(); i++)
+      {
+        m_producers[i]->resume();
+      }
+    }
 
-    if (mkfifo(pipe->c_str(), 0666) < 0)
+    /**
+     * @brief Prints the statistics of the sent frames.
+     *
+     */
+    void dump()
     {
-      perror("Error: mkfifo( ): ");
-      p->error = 1;
-      return NULL;
+      lora::Scheduler &s = *m_param->scheduler;
+      V_INFO("Sent frames    : %lu (time on air %lu ms)\n", s.frames(),
+          (unsigned long) (s.totalAirtime() / 1000));
+      V_INFO("Duty cycle waits: %lu (max %lu ms)\n", s.delayed(),
+          (unsigned long) (s.maxDelay() / 1000));
+      V_INFO("Messages       : %lu (acked %lu, expired %lu, failed %lu, rejected %lu)\n",
+          m_outbox.submitted(), m_acked, m_expired, m_failed, m_rejected);
+      if (m_param->coalesce >= 0)
+      {
+        V_INFO("Coalesced      : %lu messages in %lu frames (%lu frames, %lu ms on air saved)\n",
+            m_coalesced, m_batches, m_coalesced - m_batches, (unsigned long) (m_saved / 1000));
+      }
+      V_INFO("Frames sent again: %lu, waiting %lu, answers dropped %lu\n", m_retransmitted,
+          (unsigned long) (MAX_INFLIGHT - m_free.size()), m_dropped);
+      V_INFO("ACK time       : %lu frames, avg %lu ms, p50 %lu ms, p99 %lu ms, max %lu ms\n",
+          (unsigned long) m_rtt.count(), (unsigned long) (m_rtt.mean() / 1000),
+          (unsigned long) (m_rtt.percentile(50) / 1000), (unsigned long) (m_rtt.percentile(99) / 1000),
+          (unsigned long) (m_rtt.max() / 1000));
+      for (unsigned int b = 0; b < lora::Histogram::BUCKETS; b++)
+      {
+        if (m_rtt.count(b))
+        {
+          // Bounds in usec: the buckets below 1 ms would all print as 0 ms
+          V_INFO("ACK time %9lu us+: %lu\n", (unsigned long) lora::Histogram::lower(b),
+              (unsigned long) m_rtt.count(b));
+        }
+      }
+
+      for (unsigned int l = lora::Outbox::LANES; l > 0; l--)
+      {
+        const lora::Outbox::Lane &st = m_outbox.stats(l - 1);
+        uint64_t avg = (st.messages) ? st.wait / st.messages : 0;
+        V_INFO("Lane %u (w %2u)  : depth %lu (max %lu), taken %lu (aged %lu), wait avg %lu ms max %lu ms\n",
+            l - 1, m_outbox.weight(l - 1), (unsigned long) m_outbox.depth(l - 1),
+            (unsigned long) st.maxDepth, st.messages, st.aged, (unsigned long) (avg / 1000),
+            (unsigned long) (st.maxWait / 1000));
+      }
+
+      for (unsigned int d = 0; d < lora::Outbox::DESTINATIONS; d++)
+      {
+        if (m_outbox.taken(d) == 0 && m_outbox.pending(d) == 0)
+          continue;
+
+        const Node &node = m_nodes[d];
+        unsigned long settled = node.delivered + node.lost;
+        V_INFO("Node %3u       : queued %lu, taken %lu (%llu bytes), frames %lu (sent again %lu,"
+            " lost %lu), delivery %.1f%%, ACK time avg %lu ms p99 %lu ms\n", d,
+            (unsigned long) m_outbox.pending(d), m_outbox.taken(d),
+            (unsigned long long) m_outbox.bytes(d), node.frames, node.retries, node.lost,
+            (settled) ? node.delivered * 100.0 / settled : 100.0,
+            (unsigned long) (node.rtt.mean() / 1000), (unsigned long) (node.rtt.percentile(99) / 1000));
+      }
     }
-    close(pp);
-  }
 
-  V_INFO("Open pipe %s.\n", pipe->c_str());
-  pp = open(pipe->c_str(), O_RDONLY, 0);
-  if (pp == -1)
-  {
-    perror("Error: open while opening pipe!");
-    p->error = 1;
-    return NULL;
-  }
+  private:
+    /**
+     * @brief Frame sent and not acknowledged yet: it waits for the answer of
+     * the module or to be sent again. Its timer (answer time limit or
+     * backoff) is in the timing wheel.
+     */
+    struct Frame: public lora::TimingWheel::Timer
+    {
+        /// First message of the frame (the messages coalesced are chained)
+        lora::Outbox::Message *msg;
 
-  while (running == 1)
-  {
+        /// Address of the destination node
+        uint8_t dest;
 
-    memset(tx_buffer, 0, buf_sz);
-    size_t nr = cPipeBuffer.capacity() - cPipeBuffer.size();
-    nr = ( nr > (buf_sz - 1) )?( buf_sz - 1 ):nr;
+        /// DATA command
+        uint8_t command[buf_sz];
 
-    long int n = read(pp, (void*) tx_buffer, (unsigned long) nr /*(buf_sz - 1)*/ );
+        /// Length of the DATA command
+        size_t size;
 
-    if (n < 0)
-    {
-      perror("Error: read pipe ");
-      p->error = 1;
-      return NULL;
-    }
+        /// Length of the DATA message field (time on air)
+        size_t len;
+
+        /// Number of transmissions
+        unsigned int sends;
+
+        /// Time of the last transmission (usec)
+        uint64_t sent;
+
+        /// True while waiting for the answer, false during the backoff
+        bool answer;
+    };
 
-    if (n != 0)
+    /**
+     * @brief Delivery statistics of a destination.
+     */
+    struct Node
     {
-/*
-      std::cout << "-------------------" << std::endl;
-      std::cout << "n: " << n << std::endl;
-      std::cout << tx_buffer << std::endl;
-      std::cout << "-------------------" << std::endl;
-*/
-      if (cPipeBuffer.size() == cPipeBuffer.capacity())
-      {
-        V_DEBUG("Pipe buffer is full. It will be cleaned!\n");
-        std::cout << "Buffer full" << std::endl;
-        cPipeBuffer.drop(cPipeBuffer.capacity());
-      }
-      else
-      {
-        //size_t nw = 
-        cPipeBuffer.write(tx_buffer, n);
-        //std::cout << "nw: " << nw << std::endl;
+        /// Frames sent (the first time)
+        unsigned long frames;
 
-        size_t j = 0;
-        size_t tot = 0;
-        uint8_t buffer[buf_sz] = { 0 };
-        memset(buffer, 0, buf_sz);
+        /// Frames sent again
+        unsigned long retries;
 
-        for (unsigned int i = 0; i < cPipeBuffer.size(); i++)
-        {
-          buffer[j] = cPipeBuffer.at(i);
+        /// Frames acknowledged
+        unsigned long delivered;
 
-          //std::cout << "i: " << std::dec << i ;
-          //std::cout << "     j: " << std::dec << j ;
-          //std::cout << "     tot: " << std::dec << tot << std::endl;
-          //std::cout << buffer << std::endl;
+        /// Frames given up
+        unsigned long lost;
 
-          if (buffer[j] == '\n')
-          {
-            buffer[j] = 0;
+        /// Time from the last transmission of a frame to its ACK (usec)
+        lora::Histogram rtt;
+    };
 
-            std::cout << "Message: " << buffer << std::endl;
+    void sendMessages()
+    {
+      while (!m_waiting)
+      {
+        // The answer of the module can't be told apart: the next frame
+        // waits for the answer or the time limit of the frame sent
+        if (m_pending)
+          return;
 
-            //Create Data Command
-            std::string msg = ((char*) buffer);
-            uint8_t cmd_buffer[buf_sz] = { 0 };
-            sz = createDataCommand(cmd_buffer, dest, msg);
+        uint64_t now = lora::Reactor::now();
 
-            //std::cout << msg_string(cmd_buffer, sz) << std::endl;
+        if (!m_retries.empty())
+        {
+          // The frames to send again go before the new ones
+          Frame *f = m_retries[0];
+          uint64_t next = releaseTime(f->len, now);
+          if (next == lora::Scheduler::NEVER)
+          {
+            m_retries.pop(f);
+            settle(*f, lora::submit::REJECTED);
+            continue;
+          }
 
-            if (sz)
-            {
-              // Process Message
-              V_INFO("Send command\n");
+          if (now < next)
+          {
+            V_DEBUG("Wait %lu us\n", (unsigned long) (next - now));
+            m_reactor.armTimer(m_tfd, next - now);
+            m_waiting = true;
+            return;
+          }
 
-              t1 = time(&t1);
+          m_retries.pop(f);
+          m_retransmitted++;
+          m_nodes[f->dest].retries++;
+          V_INFO("Frame of message %u sent again (transmission %u)\n", f->msg->id, f->sends + 1);
+          transmit(*f, now);
+          continue;
+        }
 
-              while ( t1 < (t0 + timeout) )
+        if (m_fragmenter.done())
+        {
+          if (m_msg)
+          {
+            // No other frame of the message (or messages coalesced) will be sent
+            for (lora::Outbox::Message *m = m_msg; m; m = m->next)
+            {
+              m->done = true;
+              if (m->status == lora::submit::QUEUED)
               {
-                usleep(100);
-                t1 = time(&t1);
+                m->status = lora::submit::SENT;
+                notify(*m, lora::submit::SENT);
               }
-              //std::cout << "Time: " << (int) t1 - t0 << std::endl;
-              t0 = t1;
-
-              pthread_mutex_lock(&lock_x);
-              size_t n = serial->send((const char*) cmd_buffer, sz);
-              V_INFO("Sent %d bytes.\n", n);
-              pthread_mutex_unlock(&lock_x);
             }
-
-            memset(buffer, 0, buf_sz);
-            j = 0;
-            tot = i;
+            finish(m_msg);
+            m_msg = 0;
           }
-          else
+
+          // Most urgent message that the duty cycle allows now
+          uint64_t wake = 0;
+          lora::Outbox::Message *msg = m_outbox.next(now, *this, wake);
+          if (msg == 0)
           {
-            buffer[j++] = cPipeBuffer.at(i);
+            if (wake)
+            {
+              V_DEBUG("Wait %lu us\n", (unsigned long) (wake - now));
+              m_reactor.armTimer(m_tfd, wake - now);
+              m_waiting = true;
+            }
+            return;
+          }
 
+          if (msg->deadline && msg->deadline <= now)
+          {
+            msg->done = true;
+            fail(*msg, lora::submit::EXPIRED);
+            finish(msg);
+            continue;
           }
 
-        }
+          m_msg = msg;
+          m_data = msg->data;
+          m_size = msg->size;
+          m_header = false;
+          if (m_param->coalesce >= 0 || lora::Splitter::coalesced(msg->data, msg->size))
+            coalesce(now);
 
-        //std::cout << "Drop " << tot + 1 << std::endl;
-        cPipeBuffer.drop(tot + 1);
-        //cPipeBuffer.dump();
+          for (lora::Outbox::Message *m = m_msg; m; m = m->next)
+          {
+            std::cout << "Message: ";
+            std::cout.write((const char *) m->data, m->size);
+            std::cout << std::endl;
+          }
 
-      }
+          m_fragmenter.begin(msg->dest, m_data, m_size, m_header);
 
+          if (m_fragmenter.count() > 1)
+          {
+            V_INFO("Message of %lu bytes: %lu fragments\n", (unsigned long) m_size,
+                (unsigned long) m_fragmenter.count());
+          }
+        }
 
-    }
-    usleep(100);
-  }
+        // Every frame sent is kept until it is acknowledged: the sender
+        // goes on when a frame is answered or given up
+        if (m_free.empty())
+          return;
 
-  //close(pp);
-  std::cout << std::endl << "exit write" << std::endl;
+        size_t len = lora::Fragmenter::fragmentSize(m_data, m_size, m_fragmenter.index(),
+            m_header);
 
-  return  NULL;
-}
+        uint64_t next = releaseTime(len, now);
+        if (next == lora::Scheduler::NEVER)
+        {
+          std::cout << "Message can't be sent: frame too long for the dwell time or the duty cycle"
+              << std::endl;
+          fail(*m_msg, lora::submit::REJECTED);
+          continue;
+        }
+
+        if (now < next)
+        {
+          // Sleep until the frame can be released
+          V_DEBUG("Wait %lu us\n", (unsigned long) (next - now));
+          m_reactor.armTimer(m_tfd, next - now);
+          m_waiting = true;
+          return;
+        }
+
+        //Create Data Command
+        Frame *f = 0;
+        m_free.pop(f);
+        f->size = createDataCommand(f->command, m_fragmenter);
+
+        if (f->size)
+        {
+          f->msg = m_msg;
+          f->dest = m_msg->dest;
+          f->len = len;
+          f->sends = 0;
+          for (lora::Outbox::Message *m = m_msg; m; m = m->next)
+          {
+            m->outstanding++;
+          }
+
+          m_nodes[f->dest].frames++;
+          transmit(*f, now);
+        }
+        else
+        {
+          // The message can't be sent: skip the other fragments
+          m_free.push(f);
+          fail(*m_msg, lora::submit::FAILED);
+        }
+      }
+    }
+
+    /**
+     * @brief Gets the earliest time a frame can be sent: the duty cycle,
+     * then the minimum time between two send operations.
+     *
+     * @returns the time (usec), lora::Scheduler::NEVER if the frame can't
+     * be sent.
+     */
+    uint64_t releaseTime(size_t len, uint64_t now)
+    {
+      uint64_t next = m_param->scheduler->release(len, now);
+      if (next == lora::Scheduler::NEVER)
+        return next;
+
+      uint64_t gap = m_last + (uint64_t) m_param->timeout * 1000000;
+      if (m_param->timeout && gap > next)
+        next = gap;
+
+      return next;
+    }
+
+    /**
+     * @brief Sends a frame to the module and waits for its answer, at most
+     * ACK_TIMEOUT seconds after the time on air.
+     *
+     */
+    void transmit(Frame &f, uint64_t now)
+    {
+      V_INFO("Send command\n");
+      m_last = now;
+
+      uint64_t t = m_param->scheduler->commit(f.len, now);
+      V_INFO("Time on air %lu us, budget %lu us\n", (unsigned long) t,
+          (unsigned long) m_param->scheduler->budget(now));
+
+      // The 'read' thread passes the next answer of the module
+      m_param->awaiting->store(true);
+
+      // Full-duplex: the frame is queued, the read thread doesn't delay it
+      size_t n = m_param->serial->send((const char*) f.command, f.size);
+      V_INFO("Sent %d bytes.\n", n);
+
+      f.sends++;
+      f.sent = now;
+      f.answer = true;
+
+      m_pending = &f;
+
+      m_wheel.schedule(f, now + t + (uint64_t) ACK_TIMEOUT * 1000000);
+      armWheel(now);
+
+      if (V_DEBUG_REQUIRED)
+      {
+        unsigned long frames = 0;
+        uint64_t avg = 0;
+        uint64_t max = 0;
+        m_param->serial->txLatency(frames, avg, max);
+        V_DEBUG("TX latency: %lu frames, avg %lu us, max %lu us\n", frames,
+            (unsigned long) avg, (unsigned long) max);
+        V_DEBUG("Frame templates: %lu hits, %lu misses\n", m_cache.hits(), m_cache.misses());
+      }
+    }
+
+    /**
+     * @brief Gets the longest coalesced frame allowed by the current radio
+     * settings (maximum length of the region, dwell time and duty cycle).
+     *
+     */
+    size_t batchLimit() const
+    {
+      size_t limit = m_param->scheduler->maxMessage();
+      return (limit < lora::Coalescer::MAX_SIZE) ? limit : lora::Coalescer::MAX_SIZE;
+    }
+
+    /**
+     * @brief Packs in the frame of the message being sent the other
+     * messages queued for its node, while they fit. A message that starts
+     * with the mark of the coalesced frames is sent as a frame of one
+     * message, so that the receiver doesn't split it, or with the fragment
+     * header if it doesn't fit in a frame once escaped.
+     *
+     */
+    void coalesce(uint64_t now)
+    {
+      m_batch.begin(batchLimit());
+      if (!m_batch.add(m_msg->data, m_msg->size))
+      {
+        m_header = lora::Splitter::coalesced(m_msg->data, m_msg->size);
+        return;
+      }
+
+      if (m_param->coalesce < 0)
+      {
+        m_data = m_batch.data();
+        m_size = m_batch.size();
+        return;
+      }
+
+      lora::Scheduler &s = *m_param->scheduler;
+      uint64_t separate = s.airtime(lora::Fragmenter::fragmentSize(m_msg->data, m_msg->size, 0));
+      lora::Outbox::Message *last = m_msg;
+      lora::Outbox::Message *msg = 0;
+
+      while ((msg = m_outbox.head(m_msg->dest)) != 0)
+      {
+        if (msg->deadline && msg->deadline <= now)
+        {
+          m_outbox.remove(msg, now);
+          msg->done = true;
+          fail(*msg, lora::submit::EXPIRED);
+          finish(msg);
+          continue;
+        }
+
+        if (!m_batch.add(msg->data, msg->size))
+          break;
+
+        // The messages of the frame are chained after the first one
+        m_outbox.remove(msg, now);
+        last->next = msg;
+        last = msg;
+        separate += s.airtime(lora::Fragmenter::fragmentSize(msg->data, msg->size, 0));
+      }
+
+      m_data = m_batch.data();
+      m_size = m_batch.size();
+      if (m_batch.count() < 2)
+        return;
+
+      uint64_t t = s.airtime(m_size);
+      m_batches++;
+      m_coalesced += m_batch.count();
+      if (separate > t)
+        m_saved += separate - t;
+
+      V_INFO("%lu messages in a frame of %lu bytes: time on air %lu us instead of %lu us\n",
+          (unsigned long) m_batch.count(), (unsigned long) m_size, (unsigned long) t,
+          (unsigned long) separate);
+    }
+
+    /**
+     * @brief Reads the answers of the module passed by the 'read' thread.
+     * An answer is for the frame waiting, if any.
+     *
+     */
+    void receiveAnswers()
+    {
+      uint64_t count = 0;
+      if (read(m_param->ackfd, &count, sizeof(count)) < 0)
+        return;
+
+      uint64_t now = lora::Reactor::now();
+      uint8_t type = 0;
+      while (m_param->acks->pop(type))
+      {
+        Frame *f = m_pending;
+        if (f == 0)
+        {
+          V_DEBUG("Answer without frame: dropped\n");
+          m_dropped++;
+          continue;
+        }
+
+        m_pending = 0;
+        m_wheel.cancel(*f);
+
+        if (type == lora::Command::ACK)
+        {
+          Node &node = m_nodes[f->dest];
+          node.delivered++;
+          node.rtt.add(now - f->sent);
+          m_rtt.add(now - f->sent);
+          settle(*f, lora::submit::ACKED);
+        }
+        else
+        {
+          retry(*f, now, lora::submit::FAILED);
+        }
+      }
+
+      armWheel(now);
+    }
+
+    /**
+     * @brief Handles the timers of the frames: an answer not arrived in
+     * time or a backoff over.
+     *
+     */
+    void expireFrames(uint64_t now)
+    {
+      lora::TimingWheel::Timer *t = 0;
+      while ((t = m_wheel.expire(now)) != 0)
+      {
+        Frame *f = static_cast<Frame *>(t);
+        if (f->answer)
+        {
+          // The answer has just been passed: it settles the frame
+          if (!m_param->awaiting->exchange(false))
+            continue;
+
+          V_DEBUG("No answer for message %u\n", f->msg->id);
+          m_pending = 0;
+          retry(*f, now, lora::submit::EXPIRED);
+        }
+        else
+        {
+          // Sent again when the duty cycle allows
+          m_retries.push(f);
+        }
+      }
+
+      armWheel(now);
+    }
+
+    /**
+     * @brief Sends a frame again after a backoff that doubles at every
+     * transmission, or gives it up when the transmissions are over or the
+     * lifetime of its message has ended.
+     *
+     * @param[in] f frame not acknowledged.
+     * @param[in] now current time (usec).
+     * @param[in] status status of the messages if the frame is given up.
+     */
+    void retry(Frame &f, uint64_t now, uint8_t status)
+    {
+      if (f.sends > m_param->retries || (f.msg->deadline && f.msg->deadline <= now))
+      {
+        V_INFO("Frame of message %u lost after %u transmissions\n", f.msg->id, f.sends);
+        m_nodes[f.dest].lost++;
+        settle(f, status);
+        return;
+      }
+
+      uint64_t backoff = ((uint64_t) RETRY_BACKOFF * 1000000) << (f.sends - 1);
+      V_DEBUG("Frame of message %u sent again in %lu ms\n", f.msg->id,
+          (unsigned long) (backoff / 1000));
+
+      f.answer = false;
+      m_wheel.schedule(f, now + backoff);
+    }
+
+    /**
+     * @brief Releases a frame acknowledged or given up and updates its
+     * messages.
+     *
+     */
+    void settle(Frame &f, uint8_t status)
+    {
+      answered(f.msg);
+      if (status != lora::submit::ACKED)
+        fail(*f.msg, status);
+      finish(f.msg);
+
+      m_free.push(&f);
+    }
+
+    /**
+     * @brief Counts the answer of a frame for its messages.
+     *
+     */
+    void answered(lora::Outbox::Message *msg)
+    {
+      for (; msg; msg = msg->next)
+      {
+        msg->outstanding--;
+      }
+    }
+
+    /**
+     * @brief Arms the clock of the timing wheel for its earliest timer.
+     *
+     */
+    void armWheel(uint64_t now)
+    {
+      uint64_t next = m_wheel.next();
+      if (next == 0)
+      {
+        m_reactor.disarmTimer(m_afd);
+        return;
+      }
+
+      m_reactor.armTimer(m_afd, (next > now) ? next - now : 1);
+    }
+
+    /**
+     * @brief Sets the final status of a message (and of the messages
+     * coalesced with it) after an error. The frames not sent yet are skipped.
+     *
+     */
+    void fail(lora::Outbox::Message &msg, uint8_t status)
+    {
+      for (lora::Outbox::Message *m = &msg; m; m = m->next)
+      {
+        if (m->status == lora::submit::QUEUED || m->status == lora::submit::SENT)
+          m->status = status;
+      }
+
+      if (&msg == m_msg)
+        m_fragmenter.cancel();
+    }
+
+    /**
+     * @brief Notifies the final status and releases the message (and the
+     * messages coalesced with it) when all its frames are answered.
+     *
+     */
+    void finish(lora::Outbox::Message *msg)
+    {
+      for (lora::Outbox::Message *next = 0; msg; msg = next)
+      {
+        next = msg->next;
+        if (!msg->done || msg->outstanding)
+          continue;
+
+        uint8_t status = (msg->status == lora::submit::SENT) ? lora::submit::ACKED : msg->status;
+        switch (status)
+        {
+          case lora::submit::ACKED:
+            m_acked++;
+            break;
+          case lora::submit::EXPIRED:
+            m_expired++;
+            break;
+          case lora::submit::FAILED:
+            m_failed++;
+            break;
+          default:
+            m_rejected++;
+            break;
+        }
+
+        notify(*msg, status);
+        m_outbox.release(msg);
+      }
+    }
+
+    /**
+     * @brief Sends a status change to the client of the message.
+     *
+     */
+    void notify(const lora::Outbox::Message &msg, uint8_t status)
+    {
+      V_INFO("Message %u: %s\n", msg.id, lora::submit::statusName(status));
+
+      if (msg.client < 0)
+        return;
+
+      lora::submit::Reply reply;
+      memset(&reply, 0, sizeof(reply));
+      reply.id = msg.id;
+      reply.status = status;
+
+      // The client is never waited: if its socket is full the reply is lost
+      if (send(msg.client, &reply, sizeof(reply), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+      {
+        V_DEBUG("Reply to client %d lost\n", msg.client);
+      }
+    }
+
+    //! Event loop
+    lora::Reactor &m_reactor;
+
+    //! Thread parameters
+    tx_param *m_param;
+
+    //! Messages to send
+    lora::Outbox &m_outbox;
+
+    //! Front ends
+    std::vector<Producer *> m_producers;
+
+    //! Timer for the release of the next frame
+    int m_tfd;
+
+    //! Timer of the timing wheel (answer time limits, backoffs)
+    int m_afd;
+
+    //! True while waiting the release of the next frame
+    bool m_waiting;
+
+    //! Time of the last send operation (usec, monotonic clock)
+    uint64_t m_last;
+
+    //! Message being sent (the first of the coalesced frame)
+    lora::Outbox::Message *m_msg;
+
+    //! Bytes sent for the message (the coalesced frame if any)
+    const uint8_t *m_data;
+    size_t m_size;
+
+    //! The message is sent with the fragment header (it can't be coalesced)
+    bool m_header;
+
+    //! Templates of the DATA frames
+    lora::command::FrameCache m_cache;
+
+    //! Fragments of the message being sent
+    lora::Fragmenter m_fragmenter;
+
+    //! Frame of the coalesced messages
+    lora::Coalescer m_batch;
+
+    //! Frames not acknowledged yet
+    Frame m_frames[MAX_INFLIGHT];
+
+    //! Frames not used
+    CircularBuffer<Frame *, MAX_INFLIGHT> m_free;
+
+    //! Frame waiting for the answer of the module (0 if none)
+    Frame *m_pending;
+
+    //! Frames to send again (backoff over), in order
+    CircularBuffer<Frame *, MAX_INFLIGHT> m_retries;
+
+    //! Timers of the frames
+    lora::TimingWheel m_wheel;
+
+    //! Delivery statistics of each destination
+    Node m_nodes[lora::Outbox::DESTINATIONS];
+
+    //! Time from the transmission of a frame to its ACK (usec)
+    lora::Histogram m_rtt;
+
+    //! Statistics
+    unsigned long m_acked;
+    unsigned long m_expired;
+    unsigned long m_failed;
+    unsigned long m_rejected;
+    unsigned long m_batches;
+    unsigned long m_coalesced;
+    uint64_t m_saved;
+    unsigned long m_retransmitted;
+    unsigned long m_dropped;
+};
+
+/**
+ * @brief Reactor handler of the 'write' thread that reads the pipe.
+ *
+ * It splits the byte stream of the pipe in messages (one per line) and
+ * submits them to the sender, with the destination address and the
+ * lifetime of the command line. A line that starts with "!" followed by a
+ * digit and a space has that priority (0, the lowest, by default); then a
+ * node address followed by ":" selects the destination of the line. While the outbox is full the pipe is not
+ * read, so that writers are blocked.
+ */
+class PipeReader: public lora::Reactor::Handler, public Producer
+{
+  public:
+    PipeReader(lora::Reactor &reactor, tx_param *p, int pp, lora::Outbox &outbox, Sender &sender) :
+        m_reactor(reactor), m_param(p), m_pp(pp), m_outbox(outbox), m_sender(sender), m_paused(
+            false), m_lines(msg_sz)
+    {
+      V_DEBUG("Pipe buffer: %s\n", m_lines.mirrored() ? "mirrored" : "not mirrored");
+    }
+
+    virtual void handleEvent(int fd, uint32_t events)
+    {
+      // Bytes are read directly in the free space of the line reader
+      long int n = m_lines.fill(m_pp);
+
+      if (n < 0)
+      {
+        if (errno == EAGAIN || errno == EINTR)
+          return;
+
+        perror("Error: read pipe ");
+        m_param->error = 1;
+        m_reactor.stop();
+        return;
+      }
+
+      if (n == 0)
+        return;
+
+      readLines();
+    }
+
+    virtual void resume()
+    {
+      if (!m_paused)
+        return;
+
+      m_paused = false;
+      m_reactor.modify(m_pp, EPOLLIN);
+      readLines();
+    }
+
+    /**
+     * @brief Prints the statistics of the pipe.
+     *
+     */
+    void dump()
+    {
+      V_INFO("Pipe lines     : %lu (%lu too long, %llu bytes)\n", m_lines.lines(),
+          m_lines.oversize(), m_lines.bytes());
+    }
+
+  private:
+    void readLines()
+    {
+      while (!m_outbox.full())
+      {
+        const uint8_t *line = 0;
+        size_t len = 0;
+        int status = m_lines.next(line, len);
+        if (status == LineReader::LINE_NONE)
+          return;
+
+        if (status == LineReader::LINE_OVERSIZE)
+        {
+          std::cout << "Message too long (more than " << msg_sz << " bytes)" << std::endl;
+          continue;
+        }
+
+        // Optional priority prefix: "!<0-9> "
+        uint8_t priority = 0;
+        if (len >= 3 && line[0] == '!' && line[1] >= '0' && line[1] <= '9' && line[2] == ' ')
+        {
+          priority = line[1] - '0';
+          line += 3;
+          len -= 3;
+        }
+
+        // Optional destination prefix: "<0-255>:"
+        uint8_t dest = m_param->dest;
+        size_t digits = 0;
+        unsigned int addr = 0;
+        while (digits < 3 && digits < len && line[digits] >= '0' && line[digits] <= '9')
+        {
+          addr = addr * 10 + (line[digits] - '0');
+          digits++;
+        }
+        if (digits > 0 && digits < len && line[digits] == ':' && addr <= 255)
+        {
+          dest = (uint8_t) addr;
+          line += digits + 1;
+          len -= digits + 1;
+        }
+
+        uint64_t now = lora::Reactor::now();
+        lora::Outbox::Message *msg = m_outbox.create(now);
+        msg->dest = dest;
+        msg->priority = priority;
+        if (m_param->ttl)
+          msg->deadline = now + (uint64_t) m_param->ttl * 1000000;
+        msg->assign(line, len);
+
+        m_sender.submit(msg);
+      }
+
+      // The pipe is read again when a slot is released
+      V_DEBUG("Outbox is full\n");
+      m_reactor.modify(m_pp, 0);
+      m_paused = true;
+    }
+
+    //! Event loop
+    lora::Reactor &m_reactor;
+
+    //! Thread parameters
+    tx_param *m_param;
+
+    //! Pipe file descriptor
+    int m_pp;
+
+    //! Messages to send
+    lora::Outbox &m_outbox;
+
+    //! Sender of the messages
+    Sender &m_sender;
+
+    //! True while the pipe isn't read
+    bool m_paused;
+
+    //! Lines received from the pipe
+    LineReader m_lines;
+};
+
+/**
+ * @brief Reactor handler of the 'write' thread that drains a shared ring.
+ *
+ * The ring (lora::ShmRing) is attached by a client of the submission
+ * socket. The messages are submitted without copy: the outbox slots point
+ * into the ring and a record is freed when its message is released. The
+ * doorbell is waited only when the ring is empty, so a busy client writes
+ * its messages without system calls. While the outbox is full the ring is
+ * not read.
+ */
+class ShmReader: public lora::Reactor::Handler, public lora::Outbox::Owner
+{
+  public:
+    ShmReader(lora::Reactor &reactor, tx_param *p, lora::Outbox &outbox, Sender &sender) :
+        m_reactor(reactor), m_param(p), m_outbox(outbox), m_sender(sender), m_paused(false), m_closed(
+            true), m_messages(0)
+    {
+    }
+
+    virtual ~ShmReader()
+    {
+      if (!m_closed)
+        m_reactor.remove(m_ring.doorbell());
+    }
+
+    /**
+     * @brief Attaches a ring and submits the messages already written.
+     *
+     * @param[in] fds memory file, doorbell and space eventfd (the reader
+     * owns them, also on error).
+     *
+     * @returns false if the ring isn't valid.
+     */
+    bool attach(const int *fds)
+    {
+      if (!m_ring.attach(fds[0], fds[1], fds[2]))
+        return false;
+
+      m_closed = false;
+      m_reactor.add(m_ring.doorbell(), this);
+      drain();
+
+      return true;
+    }
+
+    virtual void handleEvent(int fd, uint32_t events)
+    {
+      uint64_t count = 0;
+      if (read(fd, &count, sizeof(count)) < 0)
+      {
+        // Already read
+      }
+
+      drain();
+    }
+
+    /**
+     * @brief Reads the ring again after slots have been released.
+     *
+     */
+    void resume()
+    {
+      if (!m_paused)
+        return;
+
+      m_paused = false;
+      drain();
+    }
+
+    /**
+     * @brief Stops waiting for the doorbell (the client is gone): the
+     * messages already written are still sent.
+     *
+     */
+    void close()
+    {
+      if (m_closed)
+        return;
+
+      m_closed = true;
+      m_reactor.remove(m_ring.doorbell());
+      drain();
+    }
+
+    /**
+     * @brief Returns true if the reader can be destroyed: closed, drained
+     * and no message in the outbox.
+     *
+     */
+    bool finished() const
+    {
+      return m_closed && !m_paused && m_ring.taken() == 0;
+    }
+
+    virtual void released(const lora::Outbox::Message &msg)
+    {
+      m_ring.release(msg.ref);
+    }
+
+    /// Number of messages read from the ring.
+    unsigned long messages() const
+    {
+      return m_messages;
+    }
+
+  private:
+    void drain()
+    {
+      while (true)
+      {
+        if (m_outbox.full())
+        {
+          m_paused = true;
+          return;
+        }
+
+        lora::ShmRing::Record rec;
+        uint64_t seq = 0;
+        const uint8_t *data = m_ring.next(rec, seq);
+        if (data == 0)
+        {
+          if (m_ring.corrupted())
+          {
+            if (!m_closed)
+            {
+              std::cout << "Shared ring corrupted: it is not read any more" << std::endl;
+              m_closed = true;
+              m_reactor.remove(m_ring.doorbell());
+            }
+
+            m_paused = false;
+            return;
+          }
+
+          // Too many records taken: the ring is read again when one is freed
+          if (m_ring.pending())
+          {
+            m_paused = true;
+            return;
+          }
+
+          if (m_closed || m_ring.sleep())
+            return;
+
+          continue;
+        }
+
+        uint64_t now = lora::Reactor::now();
+        lora::Outbox::Message *msg = m_outbox.create(now);
+        msg->dest = rec.dest;
+        msg->priority = rec.priority;
+        msg->data = data;
+        msg->size = rec.size;
+        msg->owner = this;
+        msg->ref = seq;
+
+        unsigned int ttl = (rec.ttl) ? rec.ttl : m_param->ttl;
+        if (ttl)
+          msg->deadline = now + (uint64_t) ttl * 1000000;
+
+        m_messages++;
+        m_sender.submit(msg);
+      }
+    }
+
+    //! Event loop
+    lora::Reactor &m_reactor;
+
+    //! Thread parameters
+    tx_param *m_param;
+
+    //! Messages to send
+    lora::Outbox &m_outbox;
+
+    //! Sender of the messages
+    Sender &m_sender;
+
+    //! Shared ring
+    lora::ShmRing m_ring;
+
+    //! True while the ring isn't read
+    bool m_paused;
+
+    //! True when the doorbell isn't waited
+    bool m_closed;
+
+    //! Statistics
+    unsigned long m_messages;
+};
+
+/**
+ * @brief Reactor handler of the 'write' thread that serves the submission
+ * socket.
+ *
+ * It accepts the clients on a Unix domain socket of type SOCK_SEQPACKET:
+ * every datagram is a message with its header (lora::submit::Request) and
+ * the client receives the status changes of its messages
+ * (lora::submit::Reply). A client can instead attach a shared ring, read
+ * by a ShmReader that lives until all its messages are released. While the
+ * outbox is full the clients are not read, so that they are blocked.
+ */
+class SocketServer: public lora::Reactor::Handler, public Producer
+{
+  public:
+    /// Maximum number of datagrams read from a client at once.
+    static const int BATCH = 16;
+
+    SocketServer(lora::Reactor &reactor, tx_param *p, lora::Outbox &outbox, Sender &sender) :
+        m_reactor(reactor), m_param(p), m_outbox(outbox), m_sender(sender), m_sfd(-1), m_paused(
+            false), m_buffer(sizeof(lora::submit::Request) + msg_sz + 1), m_clientsServed(0), m_invalid(
+            0), m_ringsAttached(0), m_ringMessages(0)
+    {
+    }
+
+    virtual ~SocketServer()
+    {
+      for (size_t i = 0; i < m_clients.size(); i++)
+      {
+        close(m_clients[i].fd);
+      }
+
+      for (size_t i = 0; i < m_rings.size(); i++)
+      {
+        delete m_rings[i];
+      }
+
+      if (m_sfd >= 0)
+      {
+        close(m_sfd);
+        unlink(m_path.c_str());
+      }
+    }
+
+    /**
+     * @brief Creates the socket and waits for the clients.
+     *
+     * @param[in] path path of the socket. A socket already present is
+     * replaced.
+     *
+     * @returns true if the socket is ready, false otherwise.
+     */
+    bool open(const std::string &path)
+    {
+      struct sockaddr_un addr;
+      if (path.size() >= sizeof(addr.sun_path))
+      {
+        std::cerr << "Error: socket path too long." << std::endl;
+        return false;
+      }
+
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+      // A socket left by a previous daemon is removed, other files are not
+      struct stat st;
+      if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path.c_str());
+
+      m_sfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (m_sfd < 0)
+      {
+        perror("Error: socket ");
+        return false;
+      }
+
+      if (bind(m_sfd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+          || chmod(path.c_str(), 0666) < 0 || listen(m_sfd, SOMAXCONN) < 0)
+      {
+        perror("Error: socket ");
+        close(m_sfd);
+        m_sfd = -1;
+        return false;
+      }
+
+      m_path = path;
+      m_reactor.add(m_sfd, this);
+
+      return true;
+    }
+
+    virtual void handleEvent(int fd, uint32_t events)
+    {
+      if (fd == m_sfd)
+      {
+        acceptClients();
+      }
+      else if (events & EPOLLIN)
+      {
+        receive(fd);
+      }
+      else if (m_paused)
+      {
+        // Hang up while the outbox is full: the last messages are read later
+        Client *c = client(fd);
+        if (c)
+        {
+          m_reactor.remove(fd);
+          c->hangup = true;
+        }
+      }
+      else
+      {
+        closeClient(fd);
+      }
+    }
+
+    virtual void resume()
+    {
+      // The messages of the rings are already written: they go first
+      for (size_t i = 0; i < m_rings.size() && !m_outbox.full(); i++)
+      {
+        m_rings[i]->resume();
+      }
+
+      reap();
+
+      if (!m_paused || m_outbox.full())
+        return;
+
+      m_paused = false;
+
+      // A client can be closed by receive(): the list is scanned from the end
+      for (size_t i = m_clients.size(); i > 0 && !m_paused; i--)
+      {
+        if (m_clients[i - 1].hangup)
+          receive(m_clients[i - 1].fd);
+        else
+          m_reactor.modify(m_clients[i - 1].fd, EPOLLIN);
+      }
+    }
+
+    /**
+     * @brief Prints the statistics of the socket.
+     *
+     */
+    void dump()
+    {
+      if (m_sfd < 0)
+        return;
+
+      V_INFO("Socket clients : %lu (invalid requests %lu)\n", m_clientsServed, m_invalid);
+
+      unsigned long messages = m_ringMessages;
+      for (size_t i = 0; i < m_rings.size(); i++)
+      {
+        messages += m_rings[i]->messages();
+      }
+      V_INFO("Shared rings   : %lu (messages %lu)\n", m_ringsAttached, messages);
+    }
+
+  private:
+    /**
+     * @brief Client connection.
+     */
+    struct Client
+    {
+        /// Socket
+        int fd;
+
+        /// True if the client has closed the connection
+        bool hangup;
+
+        /// Shared ring attached by the client (0 if none)
+        ShmReader *shm;
+    };
+
+    Client* client(int fd)
+    {
+      for (size_t i = 0; i < m_clients.size(); i++)
+      {
+        if (m_clients[i].fd == fd)
+          return &m_clients[i];
+      }
+
+      return 0;
+    }
+
+    void acceptClients()
+    {
+      while (true)
+      {
+        int fd = accept4(m_sfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+          if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            perror("Error: accept ");
+          return;
+        }
+
+        Client c;
+        c.fd = fd;
+        c.hangup = false;
+        c.shm = 0;
+        m_clients.push_back(c);
+        m_clientsServed++;
+
+        m_reactor.add(fd, this, m_paused ? 0 : EPOLLIN);
+        V_INFO("Client %d connected\n", fd);
+      }
+    }
+
+    void closeClient(int fd)
+    {
+      for (size_t i = 0; i < m_clients.size(); i++)
+      {
+        if (m_clients[i].fd != fd)
+          continue;
+
+        if (!m_clients[i].hangup)
+          m_reactor.remove(fd);
+        if (m_clients[i].shm)
+          m_clients[i].shm->close();
+        m_clients.erase(m_clients.begin() + i);
+        break;
+      }
+
+      close(fd);
+
+      // The replies of the pending messages are not sent
+      size_t n = m_outbox.detach(fd);
+      V_INFO("Client %d disconnected (%lu messages pending)\n", fd, (unsigned long) n);
+    }
+
+    void receive(int fd)
+    {
+      // A client that has closed the connection is read until the end
+      Client *c = client(fd);
+      bool all = (c && c->hangup);
+
+      for (int i = 0; i < BATCH || all; i++)
+      {
+        if (m_outbox.full())
+        {
+          pause();
+          return;
+        }
+
+        // Descriptors passed by the client (shared ring)
+        int fds[lora::submit::ATTACH_FDS];
+        size_t nfds = 0;
+
+        ssize_t n = receiveRequest(fd, fds, nfds);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+          return;
+
+        if (n <= 0)
+        {
+          closeClient(fd);
+          return;
+        }
+
+        request(fd, (size_t) n, fds, nfds);
+      }
+    }
+
+    ssize_t receiveRequest(int fd, int *fds, size_t &nfds)
+    {
+      char control[CMSG_SPACE(sizeof(int) * lora::submit::ATTACH_FDS)];
+
+      struct iovec iov;
+      iov.iov_base = &m_buffer[0];
+      iov.iov_len = m_buffer.size();
+
+      struct msghdr mh;
+      memset(&mh, 0, sizeof(mh));
+      mh.msg_iov = &iov;
+      mh.msg_iovlen = 1;
+      mh.msg_control = control;
+      mh.msg_controllen = sizeof(control);
+
+      ssize_t n = recvmsg(fd, &mh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+      if (n < 0)
+        return n;
+
+      for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg))
+      {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+          continue;
+
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++)
+        {
+          int d = -1;
+          memcpy(&d, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+          if (nfds < lora::submit::ATTACH_FDS)
+            fds[nfds++] = d;
+          else
+            close(d);
+        }
+      }
+
+      // Descriptors lost: a ring can't be attached
+      if (mh.msg_flags & MSG_CTRUNC)
+      {
+        closeAll(fds, nfds);
+        nfds = 0;
+      }
+
+      return n;
+    }
+
+    void request(int fd, size_t n, int *fds, size_t nfds)
+    {
+      lora::submit::Request req;
+      const size_t header = sizeof(req);
+      memcpy(&req, &m_buffer[0], (n < header) ? n : header);
+
+      if (n < header || req.version != lora::submit::VERSION)
+      {
+        V_INFO("Invalid request from client %d\n", fd);
+        closeAll(fds, nfds);
+        reject(fd);
+        return;
+      }
+
+      if (req.flags & lora::submit::ATTACH)
+      {
+        attach(fd, n - header, fds, nfds);
+        return;
+      }
+
+      // Descriptors are expected only with ATTACH
+      closeAll(fds, nfds);
+
+      if (req.flags & lora::submit::CAPTURE)
+      {
+        if (n == header && saveCapture(m_param))
+          answer(fd, lora::submit::QUEUED);
+        else
+          reject(fd);
+        return;
+      }
+
+      if (n - header > msg_sz)
+      {
+        std::cout << "Message too long (more than " << msg_sz << " bytes)" << std::endl;
+        reject(fd);
+        return;
+      }
+
+      uint64_t now = lora::Reactor::now();
+      lora::Outbox::Message *msg = m_outbox.create(now);
+      msg->dest = req.dest;
+      msg->priority = req.priority;
+      msg->client = fd;
+
+      unsigned int ttl = (req.ttl) ? req.ttl : m_param->ttl;
+      if (ttl)
+        msg->deadline = now + (uint64_t) ttl * 1000000;
+      msg->assign(&m_buffer[header], n - header);
+
+      m_sender.submit(msg);
+    }
+
+    void attach(int fd, size_t len, int *fds, size_t nfds)
+    {
+      Client *c = client(fd);
+      if (c == 0 || c->shm || len != 0 || nfds != lora::submit::ATTACH_FDS)
+      {
+        V_INFO("Invalid ring from client %d\n", fd);
+        closeAll(fds, nfds);
+        reject(fd);
+        return;
+      }
+
+      ShmReader *r = new ShmReader(m_reactor, m_param, m_outbox, m_sender);
+      if (!r->attach(fds))
+      {
+        V_INFO("Invalid ring from client %d\n", fd);
+        delete r;
+        reject(fd);
+        return;
+      }
+
+      m_rings.push_back(r);
+      c->shm = r;
+
+      m_ringsAttached++;
+      V_INFO("Client %d attached a shared ring\n", fd);
+      answer(fd, lora::submit::QUEUED);
+    }
+
+    void reap()
+    {
+      for (size_t i = m_rings.size(); i > 0; i--)
+      {
+        ShmReader *r = m_rings[i - 1];
+        if (!r->finished())
+          continue;
+
+        for (size_t j = 0; j < m_clients.size(); j++)
+        {
+          if (m_clients[j].shm == r)
+            m_clients[j].shm = 0;
+        }
+
+        m_ringMessages += r->messages();
+        m_rings.erase(m_rings.begin() + (i - 1));
+        delete r;
+      }
+    }
+
+    static void closeAll(int *fds, size_t nfds)
+    {
+      for (size_t i = 0; i < nfds; i++)
+      {
+        close(fds[i]);
+      }
+    }
+
+    void reject(int fd)
+    {
+      m_invalid++;
+      answer(fd, lora::submit::REJECTED);
+    }
+
+    void answer(int fd, uint8_t status)
+    {
+      lora::submit::Reply reply;
+      memset(&reply, 0, sizeof(reply));
+      reply.status = status;
 
-void* t_read_function(void *arg)
-{
-  uint8_t rx_buffer[buf_sz] = { 0 };
-  Buffer cRxBuffer;
+      if (send(fd, &reply, sizeof(reply), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+      {
+        V_DEBUG("Reply to client %d lost\n", fd);
+      }
+    }
 
-  lora::Serial *serial = 0;
+    void pause()
+    {
+      // The clients are read again when a slot is released
+      V_DEBUG("Outbox is full\n");
+      m_paused = true;
+      for (size_t i = 0; i < m_clients.size(); i++)
+      {
+        if (!m_clients[i].hangup)
+          m_reactor.modify(m_clients[i].fd, 0);
+      }
+    }
 
-  V_INFO("Start read treahd!\n");
+    //! Event loop
+    lora::Reactor &m_reactor;
 
-  rx_param *p = (rx_param*) arg;
-  serial = p->serial;
+    //! Thread parameters
+    tx_param *m_param;
 
-  try
-  {
-    cRxBuffer.resize(buf_sz);
-  }
-  catch (std::exception &e)
-  {
-    throw(e);
-    p->error = 1;
-    return NULL;
-  }
+    //! Messages to send
+    lora::Outbox &m_outbox;
 
-  time_t now;
-//  time_t end;
+    //! Sender of the messages
+    Sender &m_sender;
 
-  time_t t0;
-  time_t t1;
+    //! Listening socket
+    int m_sfd;
 
-  size_t t = 0;
+    //! Path of the socket
+    std::string m_path;
 
-  t0 = time(&t0);
-  t1 = time(&t1);
+    //! True while the clients aren't read
+    bool m_paused;
 
-  while (running == 1)
-  {
-    bool endPck = false;
+    //! Connected clients
+    std::vector<Client> m_clients;
 
-    memset(rx_buffer, 0, buf_sz);
-    V_INFO("Waiting response\n");
-    while ( !endPck )
-    {
+    //! Datagram received (a byte more than the longest request)
+    std::vector<uint8_t> m_buffer;
 
-      // Receive data
-      size_t nr = cRxBuffer.capacity() - cRxBuffer.size();
-      nr = ( nr > (buf_sz - 1) )?( buf_sz - 1 ):nr;
+    //! Readers of the shared rings (also of clients gone)
+    std::vector<ShmReader *> m_rings;
 
-      pthread_mutex_lock(&lock_x);
-      //long int n = serial.receive((char*) &rx_buffer[t], nr);
-      long int n = serial->receive((char*) &rx_buffer[0], (unsigned long) nr /*buf_sz */);
-      pthread_mutex_unlock(&lock_x);
+    //! Statistics
+    unsigned long m_clientsServed;
+    unsigned long m_invalid;
+    unsigned long m_ringsAttached;
+    unsigned long m_ringMessages;
+};
 
-      //std::cout << now << "  " << end << std::endl;
-      // Process data received
-      if ( n > 0 )
-      {
-        V_DEBUG("Received %d bytes\n", n);
+/**
+ * @brief Reactor handler of the 'write' thread that prints the statistics
+ * (send, priority lanes, pipe, socket, capture, and receive by the 'read'
+ * thread) when the daemon receives SIGUSR1 and saves the capture of the
+ * serial traffic on SIGUSR2. On SIGINT or SIGTERM it stops the loops of
+ * both threads.
+ */
+class Statistics: public lora::Reactor::Handler
+{
+  public:
+    Statistics(tx_param *p, Sender &sender, PipeReader &reader, SocketServer &server) :
+        m_param(p), m_sender(sender), m_reader(reader), m_server(server)
+    {
+    }
 
-        for (uint16_t i = 0; i < n; i++)
-        {
-          V_DEBUG("[%d] %x\n", t + i, rx_buffer[i]);
-        }
+    virtual void handleEvent(int fd, uint32_t events)
+    {
+      bool stats = false;
+      bool capture = false;
+      bool stop = false;
 
-        if (cRxBuffer.size() == cRxBuffer.capacity())
+      struct signalfd_siginfo si;
+      while (read(fd, &si, sizeof(si)) == sizeof(si))
+      {
+        if (si.ssi_signo == SIGINT || si.ssi_signo == SIGTERM)
         {
-          V_DEBUG("Receiver buffer is full. It will be cleaned!\n");
-          cRxBuffer.drop(cRxBuffer.capacity());
+          V_INFO("Signal %d\n", (int) si.ssi_signo);
+          stop = true;
         }
+        else if (si.ssi_signo == SIGUSR2)
+          capture = true;
         else
-        {
-/*
-          cRxBuffer.write(rx_buffer, n);
+          stats = true;
+      }
 
-          enum _state_0
-          {
-            LOOKFOR_SOH, LOOKFOR_EOT, CMD_FOUND
-          };
+      if (capture && !saveCapture(m_param))
+        std::cerr << "Warning: capture file " << *m_param->capturePath << " not written." << std::endl;
 
-          uint8_t state = LOOKFOR_SOH;
-          endPck = false;
+      if (stats)
+      {
+        dump();
 
-          for (unsigned int i = 0; i < cRxBuffer.size() && !endPck; i++)
-          {
-            //V_DEBUG("[%d] %x\n", t + i, rx_buffer[t + i]);
-            unsigned long index = i;
-            //if (rx_buffer[t + i] == lora::Command::EOT)
+        // The receive counters are printed by the 'read' thread
+        uint64_t one = 1;
+        if (write(m_param->dumpfd, &one, sizeof(one)) < 0)
+          perror("Error: read thread statistics not requested ");
+      }
 
-            V_DEBUG("State: %d , endPck: %d, [%d] %x\n", state, endPck, index, cRxBuffer.at(index));
+      // The loops of both threads end: the 'read' thread is woken up
+      if (stop)
+      {
+        running = 0;
+        uint64_t one = 1;
+        if (write(m_param->stopfd, &one, sizeof(one)) < 0)
+          perror("Error: read thread not stopped ");
+      }
+    }
 
-            switch (state)
-            {
-              case LOOKFOR_SOH:
-              {
-                if (cRxBuffer.at(index) == lora::Command::SOH)
-                {
-                  V_DEBUG("Found SOH\n");
-                  state = LOOKFOR_EOT;
-                }
+    void dump()
+    {
+      m_sender.dump();
+      m_reader.dump();
+      m_server.dump();
+
+      lora::Capture &c = *m_param->capture;
+      V_INFO("Capture        : %llu slots of %lu (%llu lost by the continuous capture)\n",
+          (unsigned long long) c.slots(), (unsigned long) c.capacity(),
+          (unsigned long long) c.lost());
+    }
 
-              }
-                break;
-              case LOOKFOR_EOT:
-              {
-                if (cRxBuffer.at(index) == lora::Command::EOT)
-                {
-                  V_DEBUG("Found EOT\n");
-                  state = CMD_FOUND;
-                  //cRxBuffer.dump(true);
-                  endPck = true;
-                }
+  private:
+    //! Thread parameters
+    tx_param *m_param;
 
-              }
-                break;
-            }
+    //! Sender of the messages
+    Sender &m_sender;
 
-          }
+    //! Reader of the pipe
+    PipeReader &m_reader;
 
-          t += n;
-*/
-          memset(rx_buffer, 0, buf_sz);
-        }
+    //! Submission socket
+    SocketServer &m_server;
+};
 
-      }
-      usleep(100);
-      time(&now);
+/**
+ * @brief Reactor handler of the 'read' thread.
+ *
+ * It reads the byte stream from the serial device into a receive window and
+ * passes it to the frame parser, that processes every complete command and
+ * skips noise and corrupted frames.
+ */
+class SerialListener: public lora::Reactor::Handler, public lora::FrameParser::Listener
+{
+  public:
+    SerialListener(rx_param *p) :
+        m_param(p), m_size(0)
+    {
+      m_unexpected[0] = 0;
+      m_unexpected[1] = 0;
     }
 
-    if (!t)
+    virtual void handleEvent(int fd, uint32_t events)
     {
-      std::cerr << "No response CMD received!" << std::endl;
+      // The 'write' thread asks to stop: the loop checks the running flag
+      if (fd == m_param->stopfd)
+      {
+        uint64_t count = 0;
+        if (read(fd, &count, sizeof(count)) < 0)
+          V_DEBUG("Stop request not read\n");
+        return;
+      }
+
+      // SIGUSR1 read by the 'write' thread: the counters are printed here
+      if (fd == m_param->dumpfd)
+      {
+        uint64_t count = 0;
+        if (read(fd, &count, sizeof(count)) >= 0)
+          dump();
+        return;
+      }
+
+      if (m_size == sizeof(m_window))
+      {
+        V_DEBUG("Receiver buffer is full. It will be cleaned!\n");
+        m_parser.reset();
+        m_size = 0;
+      }
+
+      // Receive data after the bytes not consumed yet
+      long int n = m_param->serial->receive((char*) &m_window[m_size],
+          (unsigned long) (sizeof(m_window) - m_size));
+
+      if (n <= 0)
+        return;
+
+      V_DEBUG("Received %d bytes\n", n);
+      m_size += n;
+
+      size_t consumed = m_parser.parse(m_window, m_size, *this);
+
+      if (m_parser.skipped())
+      {
+        V_DEBUG("Skipped %lu bytes\n", (unsigned long) m_parser.skipped());
+      }
+
+      // Remove processed bytes from the window
+      m_size -= consumed;
+      if (consumed && m_size)
+      {
+        memmove(m_window, &m_window[consumed], m_size);
+      }
     }
-    else
+
+    virtual void onFrame(const lora::Frame &frame)
     {
-      unsigned long n = cRxBuffer.read(rx_buffer, t);
+      V_DEBUG("COMMAND: %s\n", msg_string((uint8_t *) frame.data, frame.size).c_str());
+
+      if (frame.type == lora::Command::ACK || frame.type == lora::Command::ERROR)
+      {
+        if (m_param->awaiting->exchange(false))
+        {
+          // Answer to the DATA command: it is matched by the 'write' thread
+          uint64_t one = 1;
+          if (!m_param->acks->push(frame.type) || write(m_param->ackfd, &one, sizeof(one)) < 0)
+          {
+            V_DEBUG("Answer of the module lost\n");
+          }
+        }
+        else
+        {
+          // Not caused by a DATA command (i.e. an error of the module or an
+          // answer after the time limit): only reported
+          m_unexpected[(frame.type == lora::Command::ACK) ? 0 : 1]++;
+          V_INFO("Answer of the module without DATA command: %s\n",
+              msg_string((uint8_t *) frame.data, frame.size).c_str());
+        }
+      }
+
+      if (frame.type == lora::Command::DATA)
+      {
+        receiveData(frame);
+        return;
+      }
 
-      uint8_t err = process_buffer((uint8_t *) rx_buffer, (size_t) t);
+      uint8_t err = process_frame(frame);
 
       if (err == COM_ERROR)
       {
@@ -600,13 +2448,230 @@ void* t_read_function(void *arg)
         perror("Com error!");
         //running = 0;
       }
+    }
+
+    virtual void onError(uint8_t code, const uint8_t *data, size_t size)
+    {
+      process_error(code);
+    }
+
+    /**
+     * @brief Prints the statistics of the received frames.
+     *
+     */
+    void dump()
+    {
+      V_INFO("Received frames: %lu\n", m_parser.frames());
+      V_INFO("CRC errors     : %lu\n", m_parser.errors(lora::Command::INVALID_CRC));
+      V_INFO("Bytes skipped  : %llu\n", m_parser.bytesSkipped());
+      V_INFO("Answers without DATA command: %lu ACK, %lu ERROR\n", m_unexpected[0],
+          m_unexpected[1]);
+      V_INFO("Messages rebuilt from fragments: %lu (expired %lu, dropped %lu)\n",
+          m_reassembler.completed(), m_reassembler.expired(), m_reassembler.dropped());
+      V_INFO("Reassembly memory peak: %lu bytes\n", (unsigned long) m_reassembler.peakMemory());
+    }
+
+  private:
+    /**
+     * @brief Processes a DATA command: a message (or a fragment) sent by a node.
+     *
+     */
+    void receiveData(const lora::Frame &frame)
+    {
+      lora::command::Data data;
+      if (data.createFromBuffer((uint8_t *) frame.payload, frame.p_size) == 0)
+      {
+        std::cout << "Lo-Ra invalid DATA command received!" << std::endl;
+        return;
+      }
+
+      const std::string &msg = data.data();
+      if (m_splitter.begin((const uint8_t *) msg.data(), msg.size()))
+      {
+        // Several messages coalesced in the frame
+        while (m_splitter.next())
+        {
+          std::cout << "Message from " << (int) data.dest() << ": ";
+          std::cout.write((const char *) m_splitter.message(), m_splitter.size());
+          std::cout << std::endl;
+        }
+        return;
+      }
+
+      if (m_reassembler.add(data.dest(), (const uint8_t *) msg.data(), msg.size(),
+          lora::Reactor::now()))
+      {
+        std::cout << "Message from " << (int) m_reassembler.source() << ": ";
+        std::cout.write((const char *) m_reassembler.message(), m_reassembler.size());
+        std::cout << std::endl;
+      }
+      else
+      {
+        V_DEBUG("Fragment received, %lu messages pending (%lu bytes)\n",
+            (unsigned long) m_reassembler.pending(), (unsigned long) m_reassembler.memory());
+      }
+    }
+
+    //! Thread parameters
+    rx_param *m_param;
+
+    //! Parser of the received byte stream
+    lora::FrameParser m_parser;
+
+    //! Receive window: bytes received and not consumed by the parser
+    uint8_t m_window[2 * lora::FrameParser::MAX_FRAME_SIZE];
+
+    //! Number of bytes in the receive window
+    size_t m_size;
+
+    //! Messages received in fragments
+    lora::Reassembler m_reassembler;
+
+    //! Messages received in coalesced frames
+    lora::Splitter m_splitter;
+
+    //! ACK and ERROR received while no DATA command waits for an answer
+    unsigned long m_unexpected[2];
+};
+
+void* t_write_function(void *arg)
+{
+  int pp = 0;
+  std::string *pipe = 0;
+  tx_param *p = (tx_param*) arg;
+
+  pipe = p->pipe;
+
+  V_INFO("Start write treahd!\n");
+
+  // Check if pipe exists
+  if (fileExists(pipe->c_str()))
+  {
+    V_INFO("Pipe %s exists!\n", pipe->c_str());
+  }
+  else
+  {
+    V_INFO("Create pipe %s.\n", pipe->c_str());
+
+    if (mkfifo(pipe->c_str(), 0666) < 0)
+    {
+      perror("Error: mkfifo( ): ");
+      p->error = 1;
+      return NULL;
+    }
+  }
+
+  // The pipe is opened also for writing: when the last writer closes, the
+  // pipe doesn't report an end of file and the event loop doesn't spin.
+  V_INFO("Open pipe %s.\n", pipe->c_str());
+  pp = open(pipe->c_str(), O_RDWR | O_NONBLOCK, 0);
+  if (pp == -1)
+  {
+    perror("Error: open while opening pipe!");
+    p->error = 1;
+    return NULL;
+  }
+
+  try
+  {
+    lora::Reactor reactor;
+    lora::Outbox outbox;
+    Sender sender(reactor, p, outbox);
+    PipeReader reader(reactor, p, pp, outbox, sender);
+    SocketServer server(reactor, p, outbox, sender);
+    Statistics stats(p, sender, reader, server);
+
+    for (unsigned int l = 0; l < lora::Outbox::LANES; l++)
+    {
+      outbox.setWeight(l, p->weights[l]);
+    }
+    outbox.setMaxWait((uint64_t) p->maxWait * 1000000);
+
+    // SIGUSR1, SIGUSR2, SIGINT and SIGTERM are blocked in all threads and
+    // read here
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd >= 0)
+      reactor.add(sfd, &stats);
+
+    reactor.add(pp, &reader);
+    sender.addProducer(&reader);
+
+    if (!p->socket->empty())
+    {
+      if (server.open(*p->socket))
+      {
+        V_INFO("Socket %s ready\n", p->socket->c_str());
+        sender.addProducer(&server);
+      }
+      else
+      {
+        std::cerr << "Warning: socket " << *p->socket << " not available, only the pipe is read."
+            << std::endl;
+      }
+    }
+
+    while (running == 1 && reactor.running())
+    {
+      if (reactor.runOnce(-1) < 0)
+        break;
+    }
+
+    stats.dump();
+
+    if (sfd >= 0)
+    {
+      reactor.remove(sfd);
+      close(sfd);
+    }
+  }
+  catch (std::exception &e)
+  {
+    V_ERROR("%s\n", e.what());
+    p->error = 1;
+  }
 
-      cRxBuffer.drop(n);
+  close(pp);
+  std::cout << std::endl << "exit write" << std::endl;
+
+  return  NULL;
+}
+
+void* t_read_function(void *arg)
+{
+  rx_param *p = (rx_param*) arg;
+
+  V_INFO("Start read treahd!\n");
+
+  try
+  {
+    lora::Reactor reactor;
+    SerialListener listener(p);
+
+    reactor.add(p->serial->fd(), &listener);
+    reactor.add(p->stopfd, &listener);
+    reactor.add(p->dumpfd, &listener);
+
+    V_INFO("Waiting response\n");
+    while (running == 1 && reactor.running())
+    {
+      if (reactor.runOnce(-1) < 0)
+        break;
     }
-    usleep(100);
+
+    listener.dump();
+  }
+  catch (std::exception &e)
+  {
+    V_ERROR("%s\n", e.what());
+    p->error = 1;
   }
 
-  //close(pp);
   std::cout << std::endl << "exit read" << std::endl;
 
   return NULL;
@@ -617,26 +2682,79 @@ void print_help(void)
   std::cerr << "WaspMote Lo-Ra - " << LORA_NAME << " v" << LORA_VERSION << std::endl;
   std::cerr << std::endl;
   std::cerr << "Usage: " << LORA_NAME
-      << " [-v 0|1|2] [-d serial_device] [-b serial_bitrate] [-a [0-255]] [-p <pipe-path>] [-t timeout]"
-      << std::endl;
+      << " [-v 0|1|2] [-d serial_device] [-b serial_bitrate] [-a [0-255]] [-p <pipe-path>] [-u <socket-path>] [-t timeout] [-e lifetime] [-l weights] [-g wait] [-m window] [-n retries] [-k <capture-path>] [-o size]"
+      << " [-f 868|900] [-c channel] [-w 125|250|500] [-r 5-8] [-s 6-12]" << std::endl;
   std::cerr << "       " << LORA_NAME << " -h" << std::endl << std::endl;
 
   std::cerr
-      << " -a : destination address. It must be a number between 1 and 255, 0 is for broadcast message. Default value is 0 (broadcast)"
+      << " -a : destination address of the pipe lines without address. It must be a number between 1 and 255, 0 is for broadcast message. Default value is 0 (broadcast)"
       << std::endl;
   std::cerr
       << " -b : serial bitrate [1200|2400|4800|9600|19200|38400|57600|115200]. Default value is "
       << SERIAL_BITRATE << "." << std::endl;
+  std::cerr
+      << " -c : channel, used if the settings can't be read from the module. Channel allowed are 10 to 17 for 868 MHz band and 0 to 12 for 900 MHz band. Default channel is 10."
+      << std::endl;
   std::cerr << " -d : serial device. Default value is " << SERIAL_DEVICE << "." << std::endl;
+  std::cerr
+      << " -e : lifetime of a message not sent in seconds, 0 if messages never expire. Default value is "
+      << MESSAGE_TTL << "." << std::endl;
+  std::cerr
+      << " -f : frequency band [868|900], used if the settings can't be read from the module. Default value is 868."
+      << std::endl;
+  std::cerr
+      << " -g : wait in seconds after which a message is sent before the more urgent ones, 0 to disable. Default value is "
+      << LANE_MAX_WAIT << "." << std::endl;
   std::cerr << " -h : display this message." << std::endl;
+  std::cerr << " -k : capture file of the serial traffic. Default value is " << CAPTURE_NAME << "."
+      << std::endl;
+  std::cerr
+      << " -l : weights of the priority lanes 0 to 3, lowest first (messages of a lane sent in a round). Default value is "
+      << LANE_WEIGHTS << "." << std::endl;
+  std::cerr
+      << " -m : coalescing window in milliseconds: short messages to the same node are packed in one frame and a message waits at most this time for others. Default is no coalescing."
+      << std::endl;
+  std::cerr
+      << " -n : retransmissions of a frame not acknowledged by the module, with a backoff of "
+      << RETRY_BACKOFF << " s doubled every time. Default value is " << RETRY_MAX << "."
+      << std::endl;
+  std::cerr
+      << " -o : size in KB of the capture file written continuously (every " << CAPTURE_PERIOD
+      << " ms, " << CAPTURE_FILES << " old files kept), 0 to write it only on demand. Default value is 0."
+      << std::endl;
   std::cerr << " -p : pipe used for receiving data to send. Default value is " << PIPE_NAME << "."
       << std::endl;
   std::cerr
-      << " -t : minimum time between two send operation. if it is 0 no response are waited. Default value is "
-      << TX_TIMEOUT << " seconds" << std::endl;
+      << " -r : coding rate [5-8], used if the settings can't be read from the module. Default value is 5."
+      << std::endl;
+  std::cerr
+      << " -s : spreading factor [6-12], used if the settings can't be read from the module. Default value is 12."
+      << std::endl;
+  std::cerr
+      << " -t : minimum time between two send operations in seconds, in addition to the duty cycle limit. Default value is 0 (frames are sent as soon as the duty cycle allows)."
+      << std::endl;
+  std::cerr << " -u : submission socket, an empty path disables it. Default value is "
+      << SOCKET_NAME << "." << std::endl;
   std::cerr << " -v : set verbosity level  [0|1|2]." << std::endl;
+  std::cerr
+      << " -w : bandwidth [125|250|500], used if the settings can't be read from the module. Default value is 125."
+      << std::endl;
 
   std::cerr << std::endl;
+  std::cerr
+      << "A line of the pipe that starts with '!' followed by a digit and a space is sent with that priority; then a node address followed by ':' (e.g. '!3 12:alarm') overrides -a. A received frame that starts with '|' holds coalesced messages. SIGUSR1 prints the statistics (verbosity 1 or more). SIGINT and SIGTERM stop the daemon after the last write of the capture file. The serial traffic is always recorded in memory: SIGUSR2 or a socket request with the capture flag writes it in the capture file."
+      << std::endl;
+  std::cerr << std::endl;
+}
+
+bool saveCapture(tx_param *p)
+{
+  lora::Capture &c = *p->capture;
+  bool ok = (c.running()) ? c.sync() : c.save(*p->capturePath);
+
+  V_INFO("Capture %s %s\n", p->capturePath->c_str(), ok ? "written" : "not written");
+
+  return ok;
 }
 
 bool fileExists(const char* file)
@@ -645,6 +2763,33 @@ bool fileExists(const char* file)
   return (stat(file, &buf) == 0);
 }
 
+bool parseWeights(const char *arg, unsigned int *weights)
+{
+  unsigned int parsed[lora::Outbox::LANES];
+  unsigned int n = 0;
+  std::stringstream ss(arg);
+  std::string item;
+
+  while (std::getline(ss, item, ','))
+  {
+    if (n == lora::Outbox::LANES || !is_number(item) || item.size() > 3 || atoi(item.c_str()) < 1
+        || atoi(item.c_str()) > 255)
+      return false;
+
+    parsed[n++] = atoi(item.c_str());
+  }
+
+  if (n == 0)
+    return false;
+
+  for (unsigned int i = 0; i < n; i++)
+  {
+    weights[i] = parsed[i];
+  }
+
+  return true;
+}
+
 void signalCallbackHandler(int signum)
 {
   // Set global running flag to 0 (terminate reading loop)
@@ -653,18 +2798,46 @@ void signalCallbackHandler(int signum)
   exit(0);
 }
 
-uint8_t createDataCommand(uint8_t *buffer, uint8_t dest, std::string &msg)
+bool readSettings(lora::Serial &serial, lora::command::Info &info)
 {
-  // Create DATA command
-  lora::command::Data cmd;
+  uint8_t tx_buffer[buf_sz] = { 0 };
+  uint8_t rx_buffer[buf_sz] = { 0 };
+  uint8_t payload[buf_sz] = { 0 };
 
-  V_INFO("Create DATA command\n");
-  V_INFO("Destination Address: %d\n", dest);
-  V_INFO("Message            : %s\n", msg.c_str());
-  cmd.setDest(dest);
-  cmd.setData(msg);
+  V_INFO("Read module settings\n");
+  lora::command::Read cmd;
+  size_t sz = cmd.serialize(tx_buffer, buf_sz);
+
+  if (!serial.send((const char*) tx_buffer, sz))
+    return false;
+
+  size_t t = rx_wait_response(serial, rx_buffer, buf_sz, INFO_TIMEOUT);
+  if (!t)
+    return false;
+
+  uint8_t type = 0;
+  size_t psize = 0;
+  uint16_t crc = 0;
+  if (lora::Command::process(rx_buffer, t, type, payload, psize, crc) != lora::Command::NO_ERROR
+      || type != lora::Command::INFO)
+    return false;
 
-  return cmd.serialize(buffer, buf_sz);
+  if (psize >= buf_sz)
+    psize = buf_sz - 1;
+
+  return info.createFromBuffer(payload, psize) != 0;
+}
+
+size_t createDataCommand(uint8_t *buffer, lora::Fragmenter &fragmenter)
+{
+  // Create DATA command
+  V_INFO("Create DATA command\n");
+  if (fragmenter.count() > 1)
+  {
+    V_INFO("Fragment           : %lu/%lu\n", (unsigned long) fragmenter.index() + 1,
+        (unsigned long) fragmenter.count());
+  }
 
+  return fragmenter.next(buffer, buf_sz);
 }
 #endif
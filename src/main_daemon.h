@@ -21,7 +21,47 @@
 
 #define PIPE_NAME "/tmp/lora.pipe"
 
+#define SOCKET_NAME "/tmp/lora.sock"
+
+#define INFO_TIMEOUT 5                               // Module settings timeout (sec)
+
+#define ACK_TIMEOUT 5                                // Answer to a DATA command timeout, after the time on air (sec)
+
+#define RETRY_MAX 3                                  // Default transmissions of a frame not acknowledged, after the first
+
+#define RETRY_BACKOFF 1                              // Wait before the first retransmission, doubled at every retransmission (sec)
+
+#define MESSAGE_TTL 600                              // Default lifetime of a message not sent (sec)
+
+#define ANSWER_QUEUE_SIZE 64                         // Answers of the module passed to the 'write' thread
+
+#define LANE_WEIGHTS "1,2,4,8"                       // Default weights of the priority lanes (lowest first)
+
+#define LANE_MAX_WAIT 120                            // Default wait of a message before it goes first (sec)
+
+#define CAPTURE_NAME "/tmp/lora_daemon.cap"          // Default capture file of the serial traffic
+
+#define CAPTURE_FILES 4                              // Old capture files kept by the continuous capture
+
+#define CAPTURE_PERIOD 1000                          // Flush period of the continuous capture (msec)
+
+#include <atomic>
 #include "circularbuffer.h"
+#include "lora/framecache.h"
+#include "lora/fragment.h"
+#include "lora/scheduler.h"
+#include "lora/spscbuffer.h"
+#include "lora/outbox.h"
+#include "lora/coalesce.h"
+#include "lora/timingwheel.h"
+#include "lora/histogram.h"
+#include "lora/capture.h"
+/**
+ * Maximum length of a message read from the pipe. Longer lines are
+ * discarded.
+ */
+const size_t msg_sz = 64 * 1024;
+
 /**
  * Data buffer.
  */
@@ -34,17 +74,59 @@ typedef struct _tx_param{
     /// Address of the destination node
     uint8_t dest;
 
-    /// Minimum time between two write operation
+    /// Minimum time between two write operation (sec, 0 if only the duty cycle is respected)
     uint8_t timeout;
 
+    /// Pointer to the scheduler of the frames
+    lora::Scheduler *scheduler;
+
+    /// Lifetime of a message not sent (sec, 0 if messages never expire)
+    uint16_t ttl;
+
+    /// Weights of the priority lanes
+    unsigned int weights[lora::Outbox::LANES];
+
+    /// Wait of a message before it goes first (sec, 0 if messages never age)
+    uint16_t maxWait;
+
+    /// Wait of a short message for others to the same node (msec, -1 if messages are not coalesced)
+    int32_t coalesce;
+
+    /// Retransmissions of a frame not acknowledged
+    uint8_t retries;
+
     /// Pointer to the pipe path
     std::string *pipe;
 
+    /// Pointer to the submission socket path (empty if not used)
+    std::string *socket;
+
+    /// Answers of the module (ACK or ERROR) received by the 'read' thread
+    lora::SpscBuffer<uint8_t> *acks;
+
+    /// Event file descriptor signalled for every answer
+    int ackfd;
+
+    /// True while a DATA command waits for the answer of the module
+    std::atomic<bool> *awaiting;
+
+    /// Event file descriptor signalled to stop the 'read' thread
+    int stopfd;
+
+    /// Event file descriptor signalled to print the statistics of the 'read' thread
+    int dumpfd;
+
     /// Pointer to the error code
     uint8_t error;
 
     /// Pointer to the serial connection
     lora::Serial *serial;
+
+    /// Pointer to the capture of the serial traffic
+    lora::Capture *capture;
+
+    /// Pointer to the capture file path
+    std::string *capturePath;
 } tx_param;
 
 /**
@@ -54,6 +136,21 @@ typedef struct _rx_param{
     /// Pointer to the error code
     uint8_t error;
 
+    /// Answers of the module (ACK or ERROR) for the 'write' thread
+    lora::SpscBuffer<uint8_t> *acks;
+
+    /// Event file descriptor signalled for every answer
+    int ackfd;
+
+    /// True while a DATA command waits for the answer of the module
+    std::atomic<bool> *awaiting;
+
+    /// Event file descriptor signalled when the thread has to stop
+    int stopfd;
+
+    /// Event file descriptor signalled when the statistics have to be printed
+    int dumpfd;
+
     /// Pointer to the serial connection
     lora::Serial *serial;
 } rx_param;
@@ -74,7 +171,8 @@ void print_help(void);
  * @brief Main function for the Lo-Ra daemon.
  *
  * This command opens a serial connection with the LoRa gateway and
- * transmits messages received from a pipe /tmp/lora
+ * transmits messages received from a pipe /tmp/lora.pipe (one per line) and
+ * from the clients of the submission socket /tmp/lora.sock
  *
  * @param[in] argc number of strings pointed to by argv
  * @param[in] argv arguments vector
@@ -95,7 +193,8 @@ void signalCallbackHandler(int signum);
  * @brief Function for the thread that writes to the serial device.
  *
  * This function is the core of the 'write' thread. It reads messages from
- * the pipe, creates LoRa packet and then writes them to the serial device.
+ * the pipe and from the submission socket, creates LoRa packet and then
+ * writes them to the serial device.
  *
  * @param[out] arg pointer to the function parameter (@tx_param type).
  *
@@ -124,16 +223,56 @@ void* t_read_function(void *arg);
  */
 bool fileExists(const char* file);
 
+/**
+ * @brief Reads the settings of the module.
+ *
+ * This function sends a READ command and waits for the INFO response
+ * (INFO_TIMEOUT seconds).
+ *
+ * @param[in] serial serial device.
+ * @param[out] info settings of the module.
+ *
+ * @returns true if the settings are read, false otherwise.
+ */
+bool readSettings(lora::Serial &serial, lora::command::Info &info);
+
+/**
+ * @brief Writes the capture of the serial traffic in the capture file.
+ *
+ * With the continuous capture the new traffic is appended to the current
+ * file, otherwise the whole ring is written in a new file.
+ *
+ * @param[in] p parameters of the 'write' thread.
+ *
+ * @returns true if the file is written, false otherwise.
+ */
+bool saveCapture(tx_param *p);
+
+/**
+ * @brief Parses the weights of the priority lanes.
+ *
+ * @param[in] arg comma separated weights, lowest priority first (at most
+ * lora::Outbox::LANES, each between 1 and 255).
+ * @param[out] weights weights of the lanes. Lanes not in the list keep
+ * their weight.
+ *
+ * @returns true if the list is valid, false otherwise.
+ */
+bool parseWeights(const char *arg, unsigned int *weights);
+
 /**
  * @brief Creates a LoRa command of type DATA.
  *
- * This function creates a DATA command.
+ * This function creates the DATA command of the next fragment of the
+ * message started with lora::Fragmenter::begin(). Frames are built from
+ * the templates of the destination: only the message is copied and hashed.
  *
  * @param[out] buffer DATA command created by the function
- * @param[in] dest destination address
- * @param[in] msg message
+ * @param[in,out] fragmenter fragmenter of the message to send
+ *
+ * @returns number of bytes of the command, 0 if there was an error.
  */
-uint8_t createDataCommand(uint8_t *buffer, uint8_t dest, std::string &msg);
+size_t createDataCommand(uint8_t *buffer, lora::Fragmenter &fragmenter);
 
 #endif
 
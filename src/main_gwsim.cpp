@@ -0,0 +1,338 @@
+//============================================================================
+// Name        : main_gwsim.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Main for the "Lo-Ra gateway simulator"
+//============================================================================
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include "global.h"
+#include "verbose.h"
+#include "main_gwsim.h"
+#include "lora/utils.h"
+#include "lora/reactor.h"
+#include "lora/gwsim.h"
+
+#ifdef LORA_GWSIM
+/*****************************************************************************
+ * FUNCTIONS
+ ****************************************************************************/
+/**
+ * @brief Parses a rate in percent (0 to 100).
+ *
+ * @returns false if the rate isn't valid.
+ */
+static bool parseRate(const char *arg, double &rate)
+{
+  char *end = 0;
+  double v = strtod(arg, &end);
+  if (end == arg || *end != '\0' || v < 0 || v > 100)
+    return false;
+
+  rate = v / 100.0;
+  return true;
+}
+
+/**
+ * @brief Prints the counters of the simulator.
+ *
+ */
+static void dump(lora::GatewaySim &gw)
+{
+  const lora::GatewaySim::Stats &s = gw.stats();
+
+  printf("Commands       : %lu READ, %lu SET, %lu DATA, %lu bad frames\n",
+      s.commands[lora::Command::READ], s.commands[lora::Command::SET],
+      s.commands[lora::Command::DATA], s.badFrames);
+  printf("Answers        : %lu sent, %lu lost, %lu corrupted, %lu COM_ERROR, %lu not written\n",
+      s.answers, s.lost, s.corrupted, s.comErrors, s.overflows);
+  printf("Time on air    : %.3f s\n", s.airtime / 1e6);
+  fflush(stdout);
+}
+
+/**
+ * @brief Reactor handler of the signals and of the end of the simulation.
+ *
+ */
+class Control: public lora::Reactor::Handler
+{
+  public:
+    Control(lora::Reactor &reactor, lora::GatewaySim &gw, int sfd) :
+        m_reactor(reactor), m_gw(gw), m_sfd(sfd)
+    {
+    }
+
+    virtual void handleEvent(int fd, uint32_t events)
+    {
+      if (fd != m_sfd)
+      {
+        // Duration elapsed
+        m_reactor.stop();
+        return;
+      }
+
+      struct signalfd_siginfo si;
+      while (read(fd, &si, sizeof(si)) == sizeof(si))
+      {
+        if (si.ssi_signo == SIGUSR1)
+          dump(m_gw);
+        else
+          m_reactor.stop();
+      }
+    }
+
+  private:
+    //! Event loop
+    lora::Reactor &m_reactor;
+
+    //! Simulator
+    lora::GatewaySim &m_gw;
+
+    //! Signal file descriptor
+    int m_sfd;
+};
+
+int main_gwsim(int argc, char **argv)
+{
+  int opt = 0;
+  std::string link = GWSIM_LINK;
+  int addr = 1;
+  int sf = 12;
+  double loss = 0;
+  double corruption = 0;
+  double comError = 0;
+  double scale = 1;
+  unsigned int seed = 1;
+  unsigned int duration = 0;
+
+  // Parse command line
+  while ((opt = getopt(argc, argv, "v:a:c:d:e:l:r:s:t:x:h")) != -1)
+  {
+    switch (opt)
+    {
+      // Address
+      case 'a':
+      {
+        addr = atoi(optarg);
+        if (!is_number(optarg) || addr < 1 || addr > 255)
+        {
+          std::cerr << "Error: address must be a number between 1 and 255." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // COM_ERROR rate
+      case 'c':
+      {
+        if (!parseRate(optarg, comError))
+        {
+          std::cerr << "Error: COM_ERROR rate must be between 0 and 100." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Link to the slave device
+      case 'd':
+      {
+        link = optarg;
+      }
+        break;
+
+        // Corruption rate
+      case 'e':
+      {
+        if (!parseRate(optarg, corruption))
+        {
+          std::cerr << "Error: corruption rate must be between 0 and 100." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Loss rate
+      case 'l':
+      {
+        if (!parseRate(optarg, loss))
+        {
+          std::cerr << "Error: loss rate must be between 0 and 100." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Seed
+      case 'r':
+      {
+        if (!is_number(optarg))
+        {
+          std::cerr << "Error: Invalid seed!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+        seed = strtoul(optarg, NULL, 10);
+      }
+        break;
+
+        // Spreading factor
+      case 's':
+      {
+        sf = atoi(optarg);
+        if (!is_number(optarg) || sf < 6 || sf > 12)
+        {
+          std::cerr << "Error: spreading factor must between 6 and 12." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Duration
+      case 't':
+      {
+        if (!is_number(optarg))
+        {
+          std::cerr << "Error: Invalid duration!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+        duration = strtoul(optarg, NULL, 10);
+      }
+        break;
+
+        // Scale of the time on air
+      case 'x':
+      {
+        char *end = 0;
+        scale = strtod(optarg, &end);
+        if (end == optarg || *end != '\0' || scale < 0)
+        {
+          std::cerr << "Error: Invalid time scale!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Print help
+      case 'h':
+        print_help();
+        return 0;
+
+      case 'v':
+        // Verbose level
+        v_verbosity(atoi(optarg));
+        break;
+
+      default:
+        std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+  }
+
+  lora::GatewaySim gw;
+  gw.config().setAddress(addr);
+  gw.config().setSpreadingFactor(sf - 6);
+  gw.setFaults(loss, corruption, comError);
+  gw.setTimeScale(scale);
+  gw.setSeed(seed);
+
+  if (!gw.open(link))
+  {
+    perror("Error: pseudo terminal not available ");
+    return 1;
+  }
+
+  // The slave device is the first line, for the scripts
+  printf("%s\n", gw.device().c_str());
+  fflush(stdout);
+  if (!link.empty())
+    V_INFO("Link %s -> %s\n", link.c_str(), gw.device().c_str());
+
+  // Signals are read by the event loop
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGUSR1);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+
+  try
+  {
+    lora::Reactor reactor;
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    Control control(reactor, gw, sfd);
+
+    gw.attach(reactor);
+    if (sfd >= 0)
+      reactor.add(sfd, &control);
+
+    if (duration)
+    {
+      int tfd = reactor.addTimer(&control);
+      reactor.armTimer(tfd, (uint64_t) duration * 1000000);
+    }
+
+    reactor.run();
+
+    gw.close();
+    if (sfd >= 0)
+      close(sfd);
+  }
+  catch (lora::Reactor::Exception &e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  dump(gw);
+
+  return 0;
+}
+
+void print_help(void)
+{
+  std::cerr << "WaspMote Lo-Ra - " << LORA_NAME << " v" << LORA_VERSION << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "Usage: " << LORA_NAME
+      << " [-v 0|1|2] [-d link] [-a address] [-s sf] [-x scale] [-l loss] [-e corruption] [-c com_error] [-r seed] [-t seconds]"
+      << std::endl;
+  std::cerr << "       " << LORA_NAME << " -h" << std::endl << std::endl;
+  std::cerr << " -a : address of the module [1-255]. Default value is 1." << std::endl;
+  std::cerr << " -c : rate of the DATA commands answered with ERROR#COM_ERROR (percent). Default value is 0."
+      << std::endl;
+  std::cerr << " -d : symbolic link to the slave device, an empty path disables it. Default value is "
+      << GWSIM_LINK << "." << std::endl;
+  std::cerr << " -e : rate of the answers with a bit flipped (percent). Default value is 0." << std::endl;
+  std::cerr << " -h : display this message." << std::endl;
+  std::cerr << " -l : rate of the answers lost (percent). Default value is 0." << std::endl;
+  std::cerr << " -r : seed of the injected faults. Default value is 1." << std::endl;
+  std::cerr << " -s : spreading factor [6-12], until a SET command changes it. Default value is 12."
+      << std::endl;
+  std::cerr << " -t : duration of the simulation in seconds. Default value is 0 (until SIGINT or SIGTERM)."
+      << std::endl;
+  std::cerr << " -v : set verbosity level [0|1|2]." << std::endl;
+  std::cerr << " -x : scale of the time on air before an ACK (0 answers at once). Default value is 1."
+      << std::endl;
+
+  std::cerr << std::endl;
+  std::cerr
+      << "The slave device is printed on the first line of the standard output: the tools use it (or the link) as serial device (-d). SIGUSR1 prints the counters."
+      << std::endl;
+  std::cerr << std::endl;
+}
+
+#endif
@@ -0,0 +1,55 @@
+//============================================================================
+// Name        : main_gwsim.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Header of the main for the "Lo-Ra gateway simulator"
+//============================================================================
+#ifndef MAIN_GWSIM_H_
+#define MAIN_GWSIM_H_
+
+//#define LORA_GWSIM
+#ifdef LORA_GWSIM
+
+/*****************************************************************************
+ * MACROS
+ ****************************************************************************/
+#ifndef LORA_NAME
+#define LORA_NAME             "lora_gwsim"
+#define LORA_VERSION          "1.0"
+#endif
+
+/// Default symbolic link to the slave device (the device of the tools)
+#define GWSIM_LINK            "/tmp/ttyLORA"
+
+/*****************************************************************************
+ * FUNCTIONS
+ ****************************************************************************/
+/**
+ * @brief Prints the help message of the command.
+ *
+ * This function prints on standard error the help of the \elora_gwsim
+ * command.
+ *
+ */
+void print_help(void);
+
+/**
+ * @brief Main function for the Lo-Ra gateway simulator.
+ *
+ * This command opens a pseudo terminal and answers the commands of the
+ * tools (lora_setup, lora_sender, lora_daemon) as the Libelium gateway
+ * does (see lora::GatewaySim). The slave device is printed on the first
+ * line of the standard output. The counters are printed at the end and
+ * when the simulator receives SIGUSR1.
+ *
+ * @param[in] argc number of strings pointed to by argv
+ * @param[in] argv arguments vector
+ *
+ * @returns 0 if the simulator ran, 1 otherwise (exit status).
+ */
+int main_gwsim(int argc, char **argv);
+
+#endif
+
+#endif /* MAIN_GWSIM_H_ */
@@ -0,0 +1,2933 @@
+//============================================================================
+// Name        : main_perf.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Main for the "Lo-Ra microbenchmarks"
+//============================================================================
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <termios.h>
+#include <new>
+#include "global.h"
+#include "verbose.h"
+#include "main_perf.h"
+#include "lora/utils.h"
+#include "lora/crc16.h"
+#include "lora/scanner.h"
+#include "lora/parser.h"
+#include "lora/command.h"
+#include "lora/serial.h"
+#include "lora/framecache.h"
+#include "lora/fragment.h"
+#include "lora/scheduler.h"
+#include "lora/spscbuffer.h"
+#include "lora/shmring.h"
+#include "lora/submit.h"
+#include "lora/outbox.h"
+#include "lora/coalesce.h"
+#include "lora/timingwheel.h"
+#include "lora/histogram.h"
+#include "lora/capture.h"
+#include "circularbuffer.h"
+#include "linereader.h"
+#include <vector>
+#include <algorithm>
+
+#ifdef LORA_PERF
+
+/*****************************************************************************
+ * GLOBALS
+ ****************************************************************************/
+//! Minimum duration of a benchmark in nanoseconds
+static uint64_t min_time = (uint64_t) PERF_TIME * 1000000;
+
+//! Warmup before a benchmark of the core suite in nanoseconds
+static uint64_t warmup_time = (uint64_t) PERF_WARMUP * 1000000;
+
+//! Verbosity level (the core suite changes it to measure v_log)
+static int verbosity = 0;
+
+//! Sink for results, so that the compiler can't remove the measured code
+volatile uint64_t perf_sink = 0;
+
+//! Number of heap allocations
+static volatile unsigned long perf_allocs = 0;
+
+/*****************************************************************************
+ * COUNTING ALLOCATOR
+ ****************************************************************************/
+void* operator new(size_t size)
+{
+  perf_allocs = perf_allocs + 1;
+
+  void *p = malloc(size ? size : 1);
+  if (p == 0)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept
+{
+  free(p);
+}
+
+/*****************************************************************************
+ * FUNCTIONS
+ ****************************************************************************/
+/**
+ * @brief Gets the monotonic clock in nanoseconds.
+ *
+ */
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Fills a buffer with pseudo-random bytes.
+ *
+ */
+static void fill_random(uint8_t *buffer, size_t size, unsigned int seed)
+{
+  srand(seed);
+  for (size_t i = 0; i < size; i++)
+  {
+    buffer[i] = rand() & 0xFF;
+  }
+}
+
+int main_perf(int argc, char **argv)
+{
+  int opt = 0;
+  std::string suite = "all";
+  int cpu = -1;
+
+  // Parse command line
+  while ((opt = getopt(argc, argv, "v:c:s:t:w:h")) != -1)
+  {
+    switch (opt)
+    {
+      // CPU
+      case 'c':
+      {
+        if (is_number(optarg))
+        {
+          cpu = atoi(optarg);
+        }
+        else
+        {
+          std::cerr << "Error: Invalid CPU!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+      // Benchmark suite
+      case 's':
+      {
+        suite = optarg;
+      }
+        break;
+
+      // Minimum duration
+      case 't':
+      {
+        if (is_number(optarg) && atoi(optarg) > 0)
+        {
+          min_time = (uint64_t) atoi(optarg) * 1000000;
+        }
+        else
+        {
+          std::cerr << "Error: Invalid duration!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+      // Warmup
+      case 'w':
+      {
+        if (is_number(optarg))
+        {
+          warmup_time = (uint64_t) atoi(optarg) * 1000000;
+        }
+        else
+        {
+          std::cerr << "Error: Invalid warmup!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+      // Print help
+      case 'h':
+        print_help();
+        return 0;
+
+      case 'v':
+        // Verbose level
+        verbosity = atoi(optarg);
+        v_verbosity(verbosity);
+        break;
+
+      default:
+        std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+  }
+
+  // The threads of the benchmarks inherit the CPU
+  if (cpu >= 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+    {
+      perror("Error: impossible pin the CPU ");
+      return 1;
+    }
+  }
+
+  bool ok = true;
+  bool found = false;
+
+  printf("%-32s %8s %12s %12s %12s\n", "# benchmark", "bytes", "ns/op", "MB/s", "allocs/op");
+
+  if (suite == "all" || suite == "core")
+  {
+    found = true;
+    ok = perf_core() && ok;
+  }
+
+  if (suite == "all" || suite == "crc")
+  {
+    found = true;
+    ok = perf_crc() && ok;
+  }
+
+  if (suite == "all" || suite == "scan")
+  {
+    found = true;
+    ok = perf_scan() && ok;
+  }
+
+  if (suite == "all" || suite == "serialize")
+  {
+    found = true;
+    ok = perf_serialize() && ok;
+  }
+
+  if (suite == "all" || suite == "serial")
+  {
+    found = true;
+    ok = perf_serial() && ok;
+  }
+
+  if (suite == "all" || suite == "fragment")
+  {
+    found = true;
+    ok = perf_fragment() && ok;
+  }
+
+  if (suite == "all" || suite == "ring")
+  {
+    found = true;
+    ok = perf_ring() && ok;
+  }
+
+  if (suite == "all" || suite == "fifo")
+  {
+    found = true;
+    ok = perf_fifo() && ok;
+  }
+
+  if (suite == "all" || suite == "shm")
+  {
+    found = true;
+    ok = perf_shm() && ok;
+  }
+
+  if (suite == "all" || suite == "outbox")
+  {
+    found = true;
+    ok = perf_outbox() && ok;
+  }
+
+  if (suite == "all" || suite == "coalesce")
+  {
+    found = true;
+    ok = perf_coalesce() && ok;
+  }
+
+  if (suite == "all" || suite == "wheel")
+  {
+    found = true;
+    ok = perf_wheel() && ok;
+  }
+
+  if (suite == "all" || suite == "scheduler")
+  {
+    found = true;
+    ok = perf_scheduler() && ok;
+  }
+
+  if (!found)
+  {
+    std::cerr << "Error: unknown benchmark suite '" << suite << "'!" << std::endl;
+    return 1;
+  }
+
+  return ok ? 0 : 1;
+}
+
+void perf_result(const char *name, size_t size, uint64_t ops, uint64_t ns, unsigned long allocs)
+{
+  double ns_op = (ops) ? (double) ns / ops : 0;
+  double allocs_op = (ops) ? (double) allocs / ops : 0;
+
+  if (size)
+  {
+    double mbs = (ns) ? ((double) size * ops * 1000.0) / ns : 0;
+    printf("%-32s %8lu %12.1f %12.1f %12.2f\n", name, (unsigned long) size, ns_op, mbs,
+        allocs_op);
+  }
+  else
+  {
+    printf("%-32s %8s %12.1f %12s %12.2f\n", name, "-", ns_op, "-", allocs_op);
+  }
+  fflush(stdout);
+}
+
+bool perf_crc(void)
+{
+  static const size_t sizes[] = { 16, 64, 268, 1024, 4096, 65536 };
+  static const size_t n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  const size_t max_size = sizes[n_sizes - 1];
+  uint8_t *buffer = new uint8_t[max_size + 16];
+
+  fill_random(buffer, max_size + 16, 1);
+
+  // Check engines against the reference implementation (unaligned too)
+  for (size_t len = 0; len < 2048; len++)
+  {
+    const uint8_t *p = &buffer[len % 16];
+    uint16_t ref = lora::Crc16::compute(lora::Crc16::BITWISE, p, len);
+
+    for (int e = lora::Crc16::TABLE; e < lora::Crc16::N_ENGINES; e++)
+    {
+      if (lora::Crc16::compute((lora::Crc16::Engine) e, p, len) != ref)
+      {
+        std::cerr << "Error: CRC engine " << lora::Crc16::engineName((lora::Crc16::Engine) e)
+            << " fails on " << len << " bytes!" << std::endl;
+        delete[] buffer;
+        return false;
+      }
+    }
+  }
+
+  V_INFO("CRC engine selected: %s\n", lora::Crc16::engineName(lora::Crc16::engine()));
+
+  for (int e = lora::Crc16::BITWISE; e < lora::Crc16::N_ENGINES; e++)
+  {
+    lora::Crc16::Engine engine = (lora::Crc16::Engine) e;
+
+    if (!lora::Crc16::supported(engine))
+      continue;
+
+    std::string name = std::string("crc16/") + lora::Crc16::engineName(engine);
+
+    for (size_t s = 0; s < n_sizes; s++)
+    {
+      uint64_t ops = 0;
+      uint64_t batch = 1 + (1 << 20) / sizes[s];
+      uint16_t crc = lora::Crc16::INIT;
+
+      unsigned long allocs = perf_allocs;
+      uint64_t start = now_ns();
+      uint64_t elapsed = 0;
+      do
+      {
+        for (uint64_t i = 0; i < batch; i++)
+        {
+          crc = lora::Crc16::compute(engine, buffer, sizes[s], crc);
+        }
+        ops += batch;
+        elapsed = now_ns() - start;
+      } while (elapsed < min_time);
+
+      perf_sink += crc;
+      perf_result(name.c_str(), sizes[s], ops, elapsed, perf_allocs - allocs);
+    }
+  }
+
+  delete[] buffer;
+  return true;
+}
+
+/**
+ * @brief Frame parser listener that counts frames.
+ *
+ */
+class FrameCounter: public lora::FrameParser::Listener
+{
+  public:
+    FrameCounter() :
+        frames(0), errors(0)
+    {
+    }
+
+    virtual void onFrame(const lora::Frame &frame)
+    {
+      frames++;
+    }
+
+    virtual void onError(uint8_t code, const uint8_t *data, size_t size)
+    {
+      errors++;
+    }
+
+    //! Number of frames
+    unsigned long frames;
+
+    //! Number of errors
+    unsigned long errors;
+};
+
+/**
+ * @brief Fills a buffer with DATA frames, mixed with random bytes.
+ *
+ * @param[out] buffer buffer to fill.
+ * @param[in] size buffer size.
+ * @param[in] noise percentage of random bytes.
+ *
+ * @returns number of frames written.
+ */
+static unsigned long fill_frames(uint8_t *buffer, size_t size, unsigned int noise)
+{
+  lora::command::Data cmd;
+  uint8_t frame[buf_sz] = { 0 };
+  unsigned long n = 0;
+
+  std::string msg = "Sensor 42 temperature 21.5 humidity 48 battery 3.61 V";
+  cmd.setDest(1);
+  cmd.setData(msg);
+  size_t sz = cmd.serialize(frame, buf_sz);
+
+  // Random bytes between two frames so that they are "noise" percent of all bytes
+  size_t gap = (noise < 100) ? (sz * noise) / (100 - noise) : size;
+
+  srand(2);
+  size_t i = 0;
+  while (i < size)
+  {
+    for (size_t g = 0; g < gap && i < size; g++)
+    {
+      buffer[i++] = rand() & 0xFF;
+    }
+
+    if (i + sz > size)
+      break;
+
+    memcpy(&buffer[i], frame, sz);
+    i += sz;
+    n++;
+  }
+
+  // Frames can't be split at the end of the buffer
+  for (; i < size; i++)
+  {
+    buffer[i] = 0;
+  }
+
+  return n;
+}
+
+bool perf_scan(void)
+{
+  const size_t size = 1 << 20;
+  uint8_t *buffer = new uint8_t[size];
+  bool ok = true;
+
+  lora::Scanner::Engine selected = lora::Scanner::engine();
+
+  // Scan without delimiters: it measures the raw speed of the engines
+  memset(buffer, 'a', size);
+  for (int e = lora::Scanner::SCALAR; e < lora::Scanner::N_ENGINES; e++)
+  {
+    lora::Scanner::Engine engine = (lora::Scanner::Engine) e;
+
+    if (!lora::Scanner::select(engine))
+      continue;
+
+    std::string name = std::string("scan/") + lora::Scanner::engineName(engine);
+
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    do
+    {
+      perf_sink += lora::Scanner::find(buffer, size, lora::Command::SOH);
+      perf_sink += lora::Scanner::findAny(buffer, size, lora::Command::LF, lora::Command::SOH,
+          lora::Command::EOT);
+      ops += 2;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result(name.c_str(), size, ops, elapsed, perf_allocs - allocs);
+  }
+
+  // Frame parser on clean and noisy input
+  static const unsigned int noise[] = { 0, 50 };
+  for (size_t k = 0; k < sizeof(noise) / sizeof(noise[0]); k++)
+  {
+    unsigned long expected = fill_frames(buffer, size, noise[k]);
+
+    for (int e = lora::Scanner::SCALAR; e < lora::Scanner::N_ENGINES; e++)
+    {
+      lora::Scanner::Engine engine = (lora::Scanner::Engine) e;
+
+      if (!lora::Scanner::select(engine))
+        continue;
+
+      char name[64];
+      snprintf(name, sizeof(name), "parse/%s/noise-%u%%", lora::Scanner::engineName(engine),
+          noise[k]);
+
+      uint64_t ops = 0;
+      unsigned long allocs = perf_allocs;
+      uint64_t start = now_ns();
+      uint64_t elapsed = 0;
+      do
+      {
+        lora::FrameParser parser;
+        FrameCounter counter;
+
+        parser.parse(buffer, size, counter);
+        ops++;
+
+        if (counter.frames != expected)
+        {
+          std::cerr << "Error: parser (" << lora::Scanner::engineName(engine) << ") found "
+              << counter.frames << " frames of " << expected << "!" << std::endl;
+          ok = false;
+          break;
+        }
+        elapsed = now_ns() - start;
+      } while (elapsed < min_time);
+
+      perf_result(name, size, ops, elapsed, perf_allocs - allocs);
+    }
+  }
+
+  lora::Scanner::select(selected);
+
+  delete[] buffer;
+  return ok;
+}
+
+/**
+ * @brief Thread that reads and discards the bytes written on a pseudo
+ * terminal.
+ *
+ */
+static void* drain_function(void *arg)
+{
+  int fd = *(int *) arg;
+  uint8_t buffer[4096];
+
+  while (read(fd, buffer, sizeof(buffer)) > 0)
+    ;
+
+  return NULL;
+}
+
+bool perf_serialize(void)
+{
+  const char *msg = "Sensor 42 temperature 21.5 humidity 48 battery 3.61 V";
+  const size_t len = strlen(msg);
+
+  uint8_t buffer[buf_sz] = { 0 };
+  bool ok = true;
+
+  // DATA command reused for every frame
+  {
+    lora::command::Data cmd;
+    cmd.setDest(12);
+    cmd.setData((const uint8_t *) msg, len);
+
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    size_t sz = 0;
+    do
+    {
+      for (int i = 0; i < 1000; i++)
+      {
+        cmd.setData((const uint8_t *) msg, len);
+        sz = cmd.serialize(buffer, buf_sz);
+        perf_sink += buffer[sz - 2];
+      }
+      ops += 1000;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("serialize/data", sz, ops, elapsed, perf_allocs - allocs);
+    ok = (perf_allocs == allocs) && ok;
+  }
+
+  // New command and message for every frame (how the daemon worked before)
+  {
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    size_t sz = 0;
+    do
+    {
+      for (int i = 0; i < 1000; i++)
+      {
+        std::string data = msg;
+        lora::command::Data cmd;
+        cmd.setDest(12);
+        cmd.setData(data);
+        sz = cmd.serialize(buffer, buf_sz);
+        perf_sink += buffer[sz - 2];
+      }
+      ops += 1000;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("serialize/data-new-object", sz, ops, elapsed, perf_allocs - allocs);
+  }
+
+  // SET command
+  {
+    lora::command::Set cmd;
+    cmd.setAddress(3);
+    cmd.setFrequency(lora::ConfigCommand::F_868);
+    cmd.setChannel(lora::ConfigCommand::CH_12);
+    cmd.setBandwidth(lora::ConfigCommand::BW_125);
+    cmd.setCodingRate(lora::ConfigCommand::CR_5);
+    cmd.setSpreadingFactor(lora::ConfigCommand::SF_12);
+
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    size_t sz = 0;
+    do
+    {
+      for (int i = 0; i < 1000; i++)
+      {
+        sz = cmd.serialize(buffer, buf_sz);
+        perf_sink += buffer[sz - 2];
+      }
+      ops += 1000;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("serialize/set", sz, ops, elapsed, perf_allocs - allocs);
+    ok = (perf_allocs == allocs) && ok;
+  }
+
+  // Batch of DATA commands in a contiguous buffer
+  {
+    static const size_t N = 16;
+    lora::command::Data cmds[N];
+    size_t offsets[N + 1];
+    uint8_t batch[N * buf_sz];
+
+    for (size_t i = 0; i < N; i++)
+    {
+      cmds[i].setDest(i + 1);
+      cmds[i].setData((const uint8_t *) msg, len - i);
+    }
+
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    do
+    {
+      for (int i = 0; i < 100; i++)
+      {
+        if (lora::command::Data::serialize(cmds, N, batch, sizeof(batch), offsets) != N)
+        {
+          std::cerr << "Error: batch serialization failed!" << std::endl;
+          return false;
+        }
+        perf_sink += offsets[N];
+      }
+      ops += 100 * N;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("serialize/data-batch-16", offsets[N] / N, ops, elapsed, perf_allocs - allocs);
+    ok = (perf_allocs == allocs) && ok;
+  }
+
+  // Frame templates against serialization, for several message lengths
+  {
+    static const size_t lengths[] = { 8, 64, 200 };
+    uint8_t data[200];
+    memset(data, 'x', sizeof(data));
+
+    lora::command::FrameCache cache;
+
+    for (size_t k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++)
+    {
+      char name[64];
+      lora::command::Data cmd;
+      cmd.setDest(12);
+      cmd.setData(data, lengths[k]);
+
+      uint64_t ops = 0;
+      unsigned long allocs = perf_allocs;
+      uint64_t start = now_ns();
+      uint64_t elapsed = 0;
+      size_t sz = 0;
+      do
+      {
+        for (int i = 0; i < 1000; i++)
+        {
+          cmd.setData(data, lengths[k]);
+          sz = cmd.serialize(buffer, buf_sz);
+          perf_sink += buffer[sz - 2];
+        }
+        ops += 1000;
+        elapsed = now_ns() - start;
+      } while (elapsed < min_time);
+
+      snprintf(name, sizeof(name), "serialize/data-%lu", (unsigned long) lengths[k]);
+      perf_result(name, sz, ops, elapsed, perf_allocs - allocs);
+
+      ops = 0;
+      allocs = perf_allocs;
+      start = now_ns();
+      do
+      {
+        for (int i = 0; i < 1000; i++)
+        {
+          sz = cache.data(12, data, lengths[k], buffer, buf_sz);
+          perf_sink += buffer[sz - 2];
+        }
+        ops += 1000;
+        elapsed = now_ns() - start;
+      } while (elapsed < min_time);
+
+      snprintf(name, sizeof(name), "template/data-%lu", (unsigned long) lengths[k]);
+      perf_result(name, sz, ops, elapsed, perf_allocs - allocs);
+      ok = (perf_allocs == allocs) && ok;
+    }
+
+    lora::command::Read read;
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    size_t sz = 0;
+    do
+    {
+      for (int i = 0; i < 1000; i++)
+      {
+        sz = read.serialize(buffer, buf_sz);
+        perf_sink += buffer[sz - 2];
+      }
+      ops += 1000;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("template/read", sz, ops, elapsed, perf_allocs - allocs);
+    ok = (perf_allocs == allocs) && ok;
+
+    printf("# frame templates: %lu hits, %lu misses\n", cache.hits(), cache.misses());
+  }
+
+  // Send path: DATA frame template and full-duplex send on a pseudo terminal
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+  {
+    perror("Error: posix_openpt( ) ");
+    return false;
+  }
+
+  try
+  {
+    lora::Serial serial;
+    serial.setDevice(ptsname(master));
+    serial.setBitrate(SERIAL_BITRATE);
+    serial.openDev();
+    serial.setFullDuplex(true);
+
+    pthread_t drain;
+    pthread_create(&drain, NULL, drain_function, &master);
+
+    lora::command::FrameCache cache;
+
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    size_t sz = 0;
+    do
+    {
+      for (int i = 0; i < 100; i++)
+      {
+        sz = cache.data(12, (const uint8_t *) msg, len, buffer, buf_sz);
+        serial.send((const char *) buffer, sz);
+      }
+      ops += 100;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("send/data-full-duplex", sz, ops, elapsed, perf_allocs - allocs);
+    ok = (perf_allocs == allocs) && ok;
+
+    serial.closeDev();
+    close(master);
+    pthread_join(drain, NULL);
+  }
+  catch (std::exception &e)
+  {
+    V_ERROR("%s\n", e.what());
+    close(master);
+    return false;
+  }
+
+  if (!ok)
+  {
+    std::cerr << "Error: the send path allocates memory!" << std::endl;
+  }
+
+  return ok;
+}
+
+/**
+ * @brief Parameters of the reader thread of the serial latency check.
+ */
+struct SerialReader
+{
+    //! Serial device
+    lora::Serial *serial;
+
+    //! Mutex held around receive() (NULL in full-duplex mode)
+    pthread_mutex_t *lock;
+
+    //! Set to stop the thread
+    volatile bool stop;
+};
+
+/**
+ * @brief Thread that waits for bytes on a serial device, as the 'read'
+ * thread of lora_daemon did.
+ *
+ */
+static void* serial_reader(void *arg)
+{
+  SerialReader *r = (SerialReader *) arg;
+  char buffer[256];
+
+  while (!r->stop)
+  {
+    if (r->lock)
+      pthread_mutex_lock(r->lock);
+    r->serial->receive(buffer, sizeof(buffer));
+    if (r->lock)
+      pthread_mutex_unlock(r->lock);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Sends DATA frames while a reader waits on the device and measures
+ * the time to their arrival on the pseudo terminal.
+ *
+ * @param[in] fullDuplex full-duplex mode, otherwise half-duplex with a
+ * mutex between the reader and the sender.
+ * @param[out] latency latency of every frame (ns).
+ * @param[out] queue average and maximum time in the transmission queue
+ * (full-duplex mode, usec).
+ *
+ * @returns false if a frame doesn't arrive.
+ */
+static bool serial_latency(bool fullDuplex, std::vector<uint64_t> &latency, uint64_t queue[2])
+{
+  const char *msg = "Sensor 42 temperature 21.5 humidity 48 battery 3.61 V";
+  uint8_t buffer[buf_sz] = { 0 };
+  uint8_t echo[buf_sz];
+  bool ok = true;
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+  {
+    perror("Error: posix_openpt( ) ");
+    return false;
+  }
+
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock, NULL);
+
+  try
+  {
+    lora::Serial serial;
+    serial.setDevice(ptsname(master));
+    serial.setBitrate(SERIAL_BITRATE);
+    serial.openDev();
+
+    if (fullDuplex)
+    {
+      serial.setFullDuplex(true);
+
+      // The read timeout of the old 'read' thread: receive() blocks
+      struct termios tio;
+      tcgetattr(serial.fd(), &tio);
+      tio.c_cc[VMIN] = 0;
+      tio.c_cc[VTIME] = 5;
+      tcsetattr(serial.fd(), TCSANOW, &tio);
+    }
+
+    SerialReader r;
+    r.serial = &serial;
+    r.lock = (fullDuplex) ? NULL : &lock;
+    r.stop = false;
+
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, serial_reader, (void *) &r))
+    {
+      std::cerr << "Error: impossible create reader thread!" << std::endl;
+      serial.closeDev();
+      close(master);
+      pthread_mutex_destroy(&lock);
+      return false;
+    }
+
+    lora::command::FrameCache cache;
+    size_t sz = cache.data(12, (const uint8_t *) msg, strlen(msg), buffer, buf_sz);
+
+    for (unsigned int i = 0; i < SERIAL_FRAMES && ok; i++)
+    {
+      // Frames at different points of the read window
+      usleep(((i * 97) % 500 + 10) * 1000);
+
+      uint64_t start = now_ns();
+      if (!fullDuplex)
+        pthread_mutex_lock(&lock);
+      serial.send((const char *) buffer, sz);
+      if (!fullDuplex)
+        pthread_mutex_unlock(&lock);
+
+      size_t got = 0;
+      while (got < sz)
+      {
+        struct pollfd pfd = { master, POLLIN, 0 };
+        if (poll(&pfd, 1, 2000) <= 0)
+        {
+          std::cerr << "Error: frame " << i << " not received on the pseudo terminal!" << std::endl;
+          ok = false;
+          break;
+        }
+
+        ssize_t n = read(master, echo, sizeof(echo));
+        if (n > 0)
+          got += n;
+      }
+
+      latency.push_back(now_ns() - start);
+    }
+
+    r.stop = true;
+    pthread_join(reader, NULL);
+
+    unsigned long frames = 0;
+    serial.txLatency(frames, queue[0], queue[1]);
+
+    serial.closeDev();
+  }
+  catch (std::exception &e)
+  {
+    V_ERROR("%s\n", e.what());
+    ok = false;
+  }
+
+  close(master);
+  pthread_mutex_destroy(&lock);
+
+  return ok;
+}
+
+bool perf_serial(void)
+{
+  const char *modes[] = { "serial/send-half-duplex-lock", "serial/send-full-duplex" };
+  uint64_t avg[2] = { 0, 0 };
+  uint64_t max[2] = { 0, 0 };
+
+  for (int m = 0; m < 2; m++)
+  {
+    std::vector<uint64_t> latency;
+    uint64_t queue[2] = { 0, 0 };
+    if (!serial_latency(m == 1, latency, queue))
+      return false;
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < latency.size(); i++)
+    {
+      sum += latency[i];
+    }
+    std::sort(latency.begin(), latency.end());
+    avg[m] = sum / latency.size();
+    max[m] = latency.back();
+
+    perf_result(modes[m], 0, latency.size(), sum, 0);
+    printf("# %s: p50 %.3f ms, max %.3f ms\n", modes[m], latency[latency.size() / 2] / 1e6,
+        max[m] / 1e6);
+    if (m == 1)
+      printf("# %s: transmission queue avg %lu us, max %lu us\n", modes[m],
+          (unsigned long) queue[0], (unsigned long) queue[1]);
+  }
+
+  printf("# serial: full-duplex send %.0fx faster than with the lock (average)\n",
+      (avg[1]) ? (double) avg[0] / avg[1] : 0);
+
+  if (max[1] >= (uint64_t) SERIAL_MAX_LATENCY * 1000000)
+  {
+    std::cerr << "Error: full-duplex send latency " << max[1] / 1000000 << " ms with a reader blocked"
+        << " (limit " << SERIAL_MAX_LATENCY << " ms)!" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Listener that passes the DATA messages to a reassembler.
+ *
+ */
+class FragmentListener: public lora::FrameParser::Listener
+{
+  public:
+    FragmentListener(lora::Reassembler &r) :
+        reassembler(r), messages(0), size(0), coalesced(0)
+    {
+    }
+
+    virtual void onFrame(const lora::Frame &frame)
+    {
+      // Payload: "#12#ASCII#" + message
+      static const size_t header = 10;
+
+      if (frame.p_size < header || memcmp(frame.payload, "#12#ASCII#", header) != 0)
+        return;
+
+      // The receiver splits these frames before the reassembly
+      if (lora::Splitter::coalesced(&frame.payload[header], frame.p_size - header))
+        coalesced++;
+
+      if (reassembler.add(12, &frame.payload[header], frame.p_size - header, 0))
+      {
+        messages++;
+        size = reassembler.size();
+      }
+    }
+
+    //! Reassembler of the messages
+    lora::Reassembler &reassembler;
+
+    //! Number of complete messages
+    unsigned long messages;
+
+    //! Length of the last message
+    size_t size;
+
+    //! Number of frames taken for coalesced frames
+    unsigned long coalesced;
+};
+
+bool perf_fragment(void)
+{
+  static const size_t sizes[] = { 1024, 4096, 16384, 65536 };
+  static const size_t n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  const size_t max_size = sizes[n_sizes - 1];
+  const size_t max_frames = lora::Fragmenter::fragments(0, max_size);
+  uint8_t *msg = new uint8_t[max_size];
+  uint8_t *stream = new uint8_t[max_frames * buf_sz];
+  bool ok = true;
+
+  // Printable message: it is sent as ASCII
+  for (size_t i = 0; i < max_size; i++)
+  {
+    msg[i] = 'a' + (i % 26);
+  }
+
+  for (size_t k = 0; k < n_sizes && ok; k++)
+  {
+    size_t len = sizes[k];
+    char name[64];
+
+    lora::command::FrameCache cache;
+    lora::Fragmenter fragmenter(cache);
+
+    // Send: message split in DATA frames
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    size_t wire = 0;
+    do
+    {
+      wire = 0;
+      fragmenter.begin(12, msg, len);
+      while (!fragmenter.done())
+      {
+        wire += fragmenter.next(&stream[wire], buf_sz);
+      }
+      ops++;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    snprintf(name, sizeof(name), "fragment/tx-%luk", (unsigned long) len / 1024);
+    perf_result(name, len, ops, elapsed, perf_allocs - allocs);
+
+    // Receive: frames parsed and message rebuilt
+    lora::Reassembler reassembler;
+    FragmentListener listener(reassembler);
+
+    ops = 0;
+    allocs = perf_allocs;
+    start = now_ns();
+    elapsed = 0;
+    do
+    {
+      lora::FrameParser parser;
+      parser.parse(stream, wire, listener);
+      ops++;
+
+      if (listener.messages != ops || listener.size != len
+          || memcmp(reassembler.message(), msg, len) != 0)
+      {
+        std::cerr << "Error: message of " << len << " bytes not rebuilt!" << std::endl;
+        ok = false;
+        break;
+      }
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    snprintf(name, sizeof(name), "fragment/rx-%luk", (unsigned long) len / 1024);
+    perf_result(name, len, ops, elapsed, perf_allocs - allocs);
+
+    printf("# fragment/%luk: %lu frames, %lu bytes on the wire (+%.1f%%), reassembly memory %lu bytes\n",
+        (unsigned long) len / 1024, (unsigned long) fragmenter.count(), (unsigned long) wire,
+        (double) (wire - len) * 100.0 / len, (unsigned long) reassembler.peakMemory());
+  }
+
+  delete[] stream;
+  delete[] msg;
+  return ok;
+}
+
+/**
+ * @brief Selector of the outbox benchmark: the duty cycle scheduler, or
+ * every message at once without scheduler.
+ */
+class PerfSelector: public lora::Outbox::Selector
+{
+  public:
+    PerfSelector(lora::Scheduler *scheduler) :
+        m_scheduler(scheduler)
+    {
+    }
+
+    virtual uint64_t release(const lora::Outbox::Message &msg, uint64_t now)
+    {
+      if (m_scheduler == 0)
+        return now;
+
+      uint64_t t = m_scheduler->release(msg.size, now);
+      return (t == lora::Scheduler::NEVER) ? now : t;
+    }
+
+  private:
+    //! Duty cycle scheduler (0 if none)
+    lora::Scheduler *m_scheduler;
+};
+
+/**
+ * @brief Simulates a saturated SF12 sender with bulk messages and alarms.
+ *
+ * @param[in] alarm priority of the alarms.
+ * @param[out] alarms number of alarms.
+ *
+ * @returns longest wait of an alarm (usec).
+ */
+static uint64_t outbox_alarms(uint8_t alarm, unsigned long &alarms)
+{
+  static const uint64_t hours = 3;
+  static const uint64_t period = 600ULL * 1000000;
+  static const size_t bulk = 100;
+  static const size_t backlog = 32;
+  static uint8_t data[bulk];
+
+  lora::Scheduler scheduler(lora::EU868);
+  scheduler.configure(lora::ConfigCommand::CH_10, 12, 125, 5, 0);
+  PerfSelector selector(&scheduler);
+  PerfSelector all(0);
+
+  lora::Outbox outbox;
+  uint64_t clock = 0;
+  uint64_t next_alarm = period / 2;
+  uint64_t worst = 0;
+  alarms = 0;
+
+  while (clock < hours * lora::Scheduler::PERIOD)
+  {
+    // Bulk messages always queued, an alarm every period
+    while (outbox.queued() < backlog)
+    {
+      lora::Outbox::Message *msg = outbox.create(clock);
+      msg->data = data;
+      msg->size = bulk;
+      outbox.submit(msg);
+    }
+
+    if (clock >= next_alarm)
+    {
+      lora::Outbox::Message *msg = outbox.create(clock);
+      msg->data = data;
+      msg->size = 10;
+      msg->priority = alarm;
+      msg->ref = 1;
+      outbox.submit(msg);
+      next_alarm += period;
+      alarms++;
+    }
+
+    uint64_t wake = 0;
+    lora::Outbox::Message *msg = outbox.next(clock, selector, wake);
+    if (msg == 0)
+    {
+      clock = (wake < next_alarm) ? wake : next_alarm;
+      continue;
+    }
+
+    if (msg->ref && clock - msg->time > worst)
+      worst = clock - msg->time;
+
+    clock += scheduler.commit(msg->size, clock);
+    outbox.release(msg);
+  }
+
+  // Alarms not sent yet: they have waited until the end
+  uint64_t wake = 0;
+  lora::Outbox::Message *msg;
+  while ((msg = outbox.next(clock, all, wake)) != 0)
+  {
+    if (msg->ref && clock - msg->time > worst)
+      worst = clock - msg->time;
+    outbox.release(msg);
+  }
+
+  return worst;
+}
+
+bool perf_outbox(void)
+{
+  bool ok = true;
+  uint8_t data[16] = { 0 };
+  PerfSelector all(0);
+  uint64_t wake = 0;
+
+  // Submission and selection, the lanes in turn
+  {
+    lora::Outbox outbox;
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    do
+    {
+      for (unsigned int i = 0; i < 64; i++)
+      {
+        lora::Outbox::Message *msg = outbox.create(ops);
+        msg->data = data;
+        msg->size = sizeof(data);
+        msg->priority = i % lora::Outbox::LANES;
+        outbox.submit(msg);
+      }
+
+      lora::Outbox::Message *msg;
+      while ((msg = outbox.next(ops, all, wake)) != 0)
+      {
+        perf_sink += msg->id;
+        outbox.release(msg);
+        ops++;
+      }
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("outbox/submit-next", sizeof(data), ops, elapsed, perf_allocs - allocs);
+  }
+
+  // Saturated lanes: a round gives each lane its weight
+  {
+    lora::Outbox outbox;
+    const unsigned int rounds = 4;
+    unsigned long taken[lora::Outbox::LANES] = { 0 };
+    unsigned int round = 0;
+
+    for (unsigned int l = 0; l < lora::Outbox::LANES; l++)
+    {
+      outbox.setWeight(l, 1 << l);
+      round += outbox.weight(l);
+      for (unsigned int i = 0; i < 60; i++)
+      {
+        lora::Outbox::Message *msg = outbox.create(0);
+        msg->priority = l;
+        outbox.submit(msg);
+      }
+    }
+
+    for (unsigned int i = 0; i < rounds * round; i++)
+    {
+      lora::Outbox::Message *msg = outbox.next(0, all, wake);
+      if (msg == 0)
+        break;
+      taken[lora::Outbox::lane(msg->priority)]++;
+      outbox.release(msg);
+    }
+
+    for (unsigned int l = 0; l < lora::Outbox::LANES; l++)
+    {
+      if (taken[l] != rounds * outbox.weight(l))
+      {
+        std::cerr << "Error: lane " << l << " gave " << taken[l] << " messages in " << rounds
+            << " rounds (weight " << outbox.weight(l) << ")!" << std::endl;
+        ok = false;
+      }
+    }
+    printf("# outbox/weights: %u rounds, lanes 3..0 gave %lu %lu %lu %lu messages\n", rounds,
+        taken[3], taken[2], taken[1], taken[0]);
+  }
+
+  // Destinations of a lane: short messages against long fragmented ones,
+  // the frames are shared evenly
+  {
+    lora::Outbox outbox;
+    static uint8_t data[4 * lora::Fragmenter::FRAGMENT_SIZE];
+    const uint8_t dests[] = { 1, 2, 3 };
+    const size_t sizes[] = { 20, sizeof(data), 20 };
+    const unsigned int n_dests = sizeof(dests) / sizeof(dests[0]);
+    unsigned long frames[n_dests] = { 0 };
+    unsigned long total = 0;
+
+    for (unsigned int i = 0; i < 60; i++)
+    {
+      for (unsigned int d = 0; d < n_dests; d++)
+      {
+        lora::Outbox::Message *msg = outbox.create(0);
+        msg->dest = dests[d];
+        msg->data = data;
+        msg->size = sizes[d];
+        outbox.submit(msg);
+      }
+    }
+
+    lora::Outbox::Message *msg;
+    while (total < 120 && (msg = outbox.next(0, all, wake)) != 0)
+    {
+      size_t f = lora::Fragmenter::fragments(msg->data, msg->size);
+      frames[msg->dest - 1] += f;
+      total += f;
+      outbox.release(msg);
+    }
+
+    for (unsigned int d = 0; d < n_dests; d++)
+    {
+      long diff = (long) frames[d] - (long) (total / n_dests);
+      if (diff > 4 || diff < -4)
+      {
+        std::cerr << "Error: node " << (int) dests[d] << " sent " << frames[d] << " frames of "
+            << total << "!" << std::endl;
+        ok = false;
+      }
+    }
+    printf("# outbox/destinations: %lu frames, nodes 1..3 sent %lu %lu %lu frames (node 2: 4 frames a message)\n",
+        total, frames[0], frames[1], frames[2]);
+
+    // Cost with every destination in the round
+    while ((msg = outbox.next(0, all, wake)) != 0)
+      outbox.release(msg);
+
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    do
+    {
+      for (unsigned int i = 0; i < lora::Outbox::CAPACITY; i++)
+      {
+        msg = outbox.create(ops);
+        msg->dest = i;
+        msg->data = data;
+        msg->size = 20;
+        outbox.submit(msg);
+      }
+
+      while ((msg = outbox.next(ops, all, wake)) != 0)
+      {
+        perf_sink += msg->id;
+        outbox.release(msg);
+        ops++;
+      }
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("outbox/submit-next-256-nodes", 20, ops, elapsed, perf_allocs - allocs);
+  }
+
+  // Alarms behind bulk telemetry at SF12
+  unsigned long alarms = 0;
+  unsigned long fifo_alarms = 0;
+  uint64_t lanes = outbox_alarms(3, alarms);
+  uint64_t fifo = outbox_alarms(0, fifo_alarms);
+  printf("# outbox/alarms: %lu alarms in 3 hours, max wait %lu s with lanes, %lu s in FIFO order\n",
+      alarms, (unsigned long) (lanes / 1000000), (unsigned long) (fifo / 1000000));
+
+  if (alarms == 0 || lanes >= fifo)
+  {
+    std::cerr << "Error: alarms aren't sent before the bulk messages!" << std::endl;
+    ok = false;
+  }
+
+  return ok;
+}
+
+bool perf_coalesce(void)
+{
+  static const uint8_t sfs[] = { 7, 12 };
+  bool ok = true;
+
+  // Round trip of messages with marks, escapes and fragment headers
+  {
+    static const char *messages[] = { "t=21.5", "a|b", "c\\d", "|", "", "^01000002x", "\\|\\" };
+    static const size_t n = sizeof(messages) / sizeof(messages[0]);
+
+    lora::Coalescer coalescer;
+    coalescer.begin(lora::Coalescer::MAX_SIZE);
+    for (size_t i = 0; i < n; i++)
+    {
+      ok = coalescer.add((const uint8_t *) messages[i], strlen(messages[i])) && ok;
+    }
+
+    lora::Splitter splitter;
+    size_t i = 0;
+    ok = splitter.begin(coalescer.data(), coalescer.size()) && ok;
+    for (; splitter.next() && i < n; i++)
+    {
+      ok = (splitter.size() == strlen(messages[i])
+          && memcmp(splitter.message(), messages[i], splitter.size()) == 0) && ok;
+    }
+    ok = (i == n && coalescer.count() == n) && ok;
+
+    if (!ok)
+    {
+      std::cerr << "Error: coalesced messages not split back!" << std::endl;
+      return false;
+    }
+  }
+
+  // A message that starts with the mark and doesn't fit in a frame once
+  // escaped is sent with the fragment header, not as it is
+  {
+    uint8_t msg[201];
+    msg[0] = lora::Coalescer::MARK;
+    for (size_t i = 1; i < sizeof(msg); i += 2)
+    {
+      msg[i] = lora::Coalescer::MARK;
+      msg[i + 1] = 'a';
+    }
+
+    lora::Coalescer coalescer;
+    coalescer.begin(lora::Coalescer::MAX_SIZE);
+    ok = !coalescer.add(msg, sizeof(msg)) && ok;
+
+    lora::command::FrameCache cache;
+    lora::Fragmenter fragmenter(cache);
+    uint8_t stream[2 * buf_sz];
+    size_t wire = 0;
+    fragmenter.begin(12, msg, sizeof(msg), true);
+    while (!fragmenter.done() && wire + buf_sz <= sizeof(stream))
+    {
+      wire += fragmenter.next(&stream[wire], buf_sz);
+    }
+
+    lora::Reassembler reassembler;
+    FragmentListener listener(reassembler);
+    lora::FrameParser parser;
+    parser.parse(stream, wire, listener);
+
+    ok = (fragmenter.count() == 1 && listener.coalesced == 0 && listener.messages == 1
+        && listener.size == sizeof(msg) && memcmp(reassembler.message(), msg, sizeof(msg)) == 0)
+        && ok;
+    if (!ok)
+    {
+      std::cerr << "Error: message starting with the mark not sent with the fragment header!"
+          << std::endl;
+      return false;
+    }
+  }
+
+  // Ten readings packed and split
+  {
+    uint8_t reading[16];
+    memset(reading, 'r', sizeof(reading));
+    reading[4] = lora::Coalescer::MARK;
+
+    lora::Coalescer coalescer;
+    lora::Splitter splitter;
+    uint64_t ops = 0;
+    unsigned long allocs = 0;
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    do
+    {
+      coalescer.begin(lora::Coalescer::MAX_SIZE);
+      for (unsigned int i = 0; i < 10; i++)
+      {
+        coalescer.add(reading, sizeof(reading));
+      }
+
+      splitter.begin(coalescer.data(), coalescer.size());
+      while (splitter.next())
+      {
+        perf_sink += splitter.size();
+      }
+
+      // The first round sizes the buffer of the splitter
+      if (ops++ == 0)
+      {
+        allocs = perf_allocs;
+        start = now_ns();
+      }
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("coalesce/pack-split-10", coalescer.size(), ops - 1, elapsed,
+        perf_allocs - allocs);
+    ok = (perf_allocs == allocs) && ok;
+  }
+
+  // Time on air of short readings sent alone and coalesced
+  for (size_t k = 0; k < sizeof(sfs) / sizeof(sfs[0]); k++)
+  {
+    static const size_t count = 60;
+    static const size_t len = 16;
+
+    lora::Scheduler scheduler(lora::EU868);
+    scheduler.configure(lora::ConfigCommand::CH_10, sfs[k], 125, 5, 0);
+
+    uint8_t reading[len];
+    memset(reading, 'r', sizeof(reading));
+
+    uint64_t alone = 0;
+    uint64_t coalesced = 0;
+    size_t frames = 0;
+    lora::Coalescer coalescer;
+    coalescer.begin(lora::Coalescer::MAX_SIZE);
+    for (size_t i = 0; i < count; i++)
+    {
+      alone += scheduler.airtime(len);
+      if (!coalescer.add(reading, len))
+      {
+        coalesced += scheduler.airtime(coalescer.size());
+        frames++;
+        coalescer.begin(lora::Coalescer::MAX_SIZE);
+        coalescer.add(reading, len);
+      }
+    }
+    coalesced += scheduler.airtime(coalescer.size());
+    frames++;
+
+    printf("# coalesce/sf%d: %lu messages of %lu bytes, %lu frames %lu ms on air alone,"
+        " %lu frames %lu ms coalesced (%.0f%% saved)\n", sfs[k], (unsigned long) count,
+        (unsigned long) len, (unsigned long) count, (unsigned long) (alone / 1000),
+        (unsigned long) frames, (unsigned long) (coalesced / 1000),
+        100.0 - (double) coalesced * 100.0 / alone);
+
+    if (coalesced >= alone)
+    {
+      std::cerr << "Error: coalesced frames take more time on air!" << std::endl;
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+bool perf_wheel(void)
+{
+  static const size_t count = 4096;
+  static const uint64_t step = 7000;
+  static const uint64_t span = 60000000;
+  bool ok = true;
+
+  static lora::TimingWheel::Timer timers[count];
+
+  // Timers up to a minute ahead (many turns of the wheel) expire in the
+  // step of the clock that reaches them, and next() is the earliest one
+  {
+    lora::TimingWheel wheel(0);
+    srand(1);
+    for (size_t i = 0; i < count; i++)
+    {
+      wheel.schedule(timers[i], ((uint64_t) rand() * 1000) % span);
+    }
+
+    // A quarter is cancelled
+    for (size_t i = 0; i < count; i += 4)
+    {
+      wheel.cancel(timers[i]);
+    }
+
+    size_t expired = 0;
+    uint64_t clock = 0;
+    for (uint64_t now = 0; now <= span && ok; now += step)
+    {
+      if (now % (step * 100) == 0)
+      {
+        uint64_t earliest = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+          if (timers[i].armed && (earliest == 0 || timers[i].expires < earliest))
+            earliest = timers[i].expires;
+        }
+        ok = (wheel.next() == earliest) && ok;
+      }
+
+      lora::TimingWheel::Timer *t = 0;
+      while ((t = wheel.expire(now)) != 0)
+      {
+        ok = (t->expires <= now && (now == 0 || t->expires > clock) && !t->armed
+            && (t - &timers[0]) % 4 != 0) && ok;
+        expired++;
+      }
+      clock = now;
+    }
+
+    ok = (expired == count - count / 4 && wheel.size() == 0) && ok;
+    if (!ok)
+    {
+      std::cerr << "Error: timer expired at the wrong time!" << std::endl;
+      return false;
+    }
+  }
+
+  // Schedule and cancel (a frame acknowledged before its time limit)
+  {
+    lora::TimingWheel wheel(0);
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    do
+    {
+      for (size_t i = 0; i < 256; i++)
+      {
+        wheel.schedule(timers[i], ops * 1000 + i * 20011);
+      }
+      for (size_t i = 0; i < 256; i++)
+      {
+        wheel.cancel(timers[i]);
+      }
+      ops += 256;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("wheel/schedule-cancel", 0, ops, elapsed, perf_allocs - allocs);
+    ok = (perf_allocs == allocs) && ok;
+  }
+
+  // Schedule and expire, the clock running with the timers
+  {
+    lora::TimingWheel wheel(0);
+    uint64_t ops = 0;
+    uint64_t clock = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    do
+    {
+      for (size_t i = 0; i < 256; i++)
+      {
+        wheel.schedule(timers[i], clock + 1000 + i * 20011);
+      }
+
+      while (wheel.size())
+      {
+        clock = wheel.next();
+        while (wheel.expire(clock) != 0)
+          ops++;
+      }
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    perf_result("wheel/schedule-expire", 0, ops, elapsed, perf_allocs - allocs);
+    ok = (perf_allocs == allocs) && ok;
+  }
+
+  // Percentiles of the histogram: 1 to 1000 ms
+  {
+    lora::Histogram h;
+    for (uint64_t v = 1; v <= 1000; v++)
+    {
+      h.add(v * 1000);
+    }
+
+    uint64_t p50 = h.percentile(50);
+    uint64_t p99 = h.percentile(99);
+    ok = (p50 >= 500000 && p50 < 1000000 && p99 >= 990000 && p99 <= h.max() && h.min() == 1000
+        && h.mean() == 500500) && ok;
+
+    printf("# histogram: 1000 values from 1 to 1000 ms, p50 <= %lu ms, p99 <= %lu ms\n",
+        (unsigned long) (p50 / 1000), (unsigned long) (p99 / 1000));
+
+    if (!ok)
+      std::cerr << "Error: wrong percentiles!" << std::endl;
+  }
+
+  return ok;
+}
+
+bool perf_scheduler(void)
+{
+  static const uint8_t sfs[] = { 7, 12 };
+  static const size_t len = 50;
+  static const uint64_t hours = 3;
+  bool ok = true;
+
+  for (size_t k = 0; k < sizeof(sfs) / sizeof(sfs[0]) && ok; k++)
+  {
+    char name[64];
+
+    // Cost of a decision: the simulated clock jumps to the release time
+    lora::Scheduler bench(lora::EU868);
+    bench.configure(lora::ConfigCommand::CH_10, sfs[k], 125, 5, 0);
+
+    uint64_t ops = 0;
+    uint64_t clock = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    do
+    {
+      clock = bench.release(len, clock);
+      bench.commit(len, clock);
+      ops++;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    snprintf(name, sizeof(name), "scheduler/release-sf%d", sfs[k]);
+    perf_result(name, 0, ops, elapsed, perf_allocs - allocs);
+
+    // Saturated sender for some hours: the time on air of every window of
+    // one hour must respect the duty cycle
+    lora::Scheduler scheduler(lora::EU868);
+    scheduler.configure(lora::ConfigCommand::CH_10, sfs[k], 125, 5, 0);
+
+    // The longest message is the one of the region for the spreading factor
+    size_t longest = lora::EU868.payload(sfs[k]);
+    if (longest > lora::Scheduler::MAX_MESSAGE)
+      longest = lora::Scheduler::MAX_MESSAGE;
+    if (scheduler.maxMessage() != longest)
+    {
+      std::cerr << "Error: longest message of " << scheduler.maxMessage() << " bytes at SF"
+          << (int) sfs[k] << "!" << std::endl;
+      ok = false;
+      break;
+    }
+
+    std::vector<uint64_t> sent;
+    uint64_t airtime = scheduler.airtime(len);
+    uint64_t budget = (uint64_t) scheduler.duty() * lora::Scheduler::PERIOD / 1000;
+    clock = 0;
+    while (clock < hours * lora::Scheduler::PERIOD)
+    {
+      clock = scheduler.release(len, clock);
+      if (!sent.empty() && clock < sent.back() + airtime)
+      {
+        std::cerr << "Error: frame released while the channel is busy!" << std::endl;
+        ok = false;
+        break;
+      }
+      scheduler.commit(len, clock);
+      sent.push_back(clock);
+    }
+
+    uint64_t worst = 0;
+    size_t last = 0;
+    for (size_t first = 0; first < sent.size(); first++)
+    {
+      while (last < sent.size() && sent[last] < sent[first] + lora::Scheduler::PERIOD)
+        last++;
+
+      uint64_t window = (uint64_t) (last - first) * airtime;
+      if (window > worst)
+        worst = window;
+    }
+
+    if (worst > budget)
+    {
+      std::cerr << "Error: duty cycle exceeded (" << worst << " us in one hour)!" << std::endl;
+      ok = false;
+    }
+
+    printf("# scheduler/sf%d: %lu frames of %lu us in %lu hours, worst hour %.3f%% (limit %.1f%%),"
+        " %lu waits (max %lu ms)\n", sfs[k], (unsigned long) sent.size(), (unsigned long) airtime,
+        (unsigned long) hours, (double) worst * 100.0 / lora::Scheduler::PERIOD,
+        scheduler.duty() / 10.0, scheduler.delayed(), (unsigned long) (scheduler.maxDelay() / 1000));
+  }
+
+  return ok;
+}
+
+/**
+ * @brief Sets the size of a CircularBuffer (heap array).
+ *
+ */
+static void ring_init(CircularBuffer<uint8_t> &ring, size_t n)
+{
+  ring.resize(n);
+}
+
+/**
+ * @brief Sets the size of a CircularBuffer (inline array: size fixed).
+ *
+ */
+template<unsigned int N>
+static void ring_init(CircularBuffer<uint8_t, N> &ring, size_t n)
+{
+}
+
+/**
+ * @brief CircularBuffer with the interface of lora::SpscBuffer.
+ *
+ * If Locked is true every operation holds a mutex, so the buffer can be
+ * shared by two threads. N is the size of an inline array (0 for the heap).
+ */
+template<bool Locked, unsigned int N = 0>
+class RingAdapter
+{
+  public:
+    RingAdapter(size_t n)
+    {
+      pthread_mutex_init(&m_lock, NULL);
+      ring_init(m_ring, n);
+      m_ring.setOverWrite(false);
+    }
+
+    ~RingAdapter()
+    {
+      pthread_mutex_destroy(&m_lock);
+    }
+
+    size_t write(const uint8_t *buf, size_t n)
+    {
+      if (Locked)
+        pthread_mutex_lock(&m_lock);
+      size_t w = m_ring.write((uint8_t *) buf, n);
+      if (Locked)
+        pthread_mutex_unlock(&m_lock);
+      return w;
+    }
+
+    size_t read(uint8_t *buf, size_t n)
+    {
+      if (Locked)
+        pthread_mutex_lock(&m_lock);
+      size_t r = m_ring.read(buf, n);
+      if (Locked)
+        pthread_mutex_unlock(&m_lock);
+      return r;
+    }
+
+  private:
+    //! Buffer
+    CircularBuffer<uint8_t, N> m_ring;
+
+    //! Lock of the buffer
+    pthread_mutex_t m_lock;
+};
+
+/**
+ * @brief Parameters of the consumer thread of the ring benchmarks.
+ */
+template<typename Ring>
+struct RingConsumer
+{
+    //! Shared buffer
+    Ring *ring;
+
+    //! Bytes to read
+    size_t total;
+
+    //! Bytes read per operation
+    size_t chunk;
+
+    //! False if a byte is lost or out of order
+    bool ok;
+};
+
+/**
+ * @brief Thread that reads a sequence of bytes from a ring.
+ *
+ */
+template<typename Ring>
+static void* ring_consumer(void *arg)
+{
+  RingConsumer<Ring> *c = (RingConsumer<Ring> *) arg;
+  uint8_t buffer[4096];
+  size_t got = 0;
+
+  c->ok = true;
+  while (got < c->total)
+  {
+    size_t n = c->ring->read(buffer, c->chunk);
+    if (n == 0)
+    {
+      sched_yield();
+      continue;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+      if (buffer[i] != (uint8_t) (got + i))
+        c->ok = false;
+    }
+    got += n;
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Measures a ring: one thread (write and read) and two threads
+ * (producer and consumer).
+ *
+ * @returns false if the consumer receives wrong bytes.
+ */
+template<typename Ring>
+static bool perf_ring_type(const char *type, Ring &ring, size_t chunk, bool threads)
+{
+  uint8_t data[4096 + 256];
+  char name[64];
+
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t) i;
+  }
+
+  if (!threads)
+  {
+    uint8_t buffer[4096];
+    uint64_t ops = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    do
+    {
+      ring.write(data, chunk);
+      perf_sink += ring.read(buffer, chunk);
+      ops++;
+      elapsed = now_ns() - start;
+    } while (elapsed < min_time);
+
+    snprintf(name, sizeof(name), "ring/%s-%lu", type, (unsigned long) chunk);
+    perf_result(name, chunk, ops, elapsed, perf_allocs - allocs);
+    return true;
+  }
+
+  // Producer in this thread, consumer in a new one
+  RingConsumer<Ring> c;
+  c.ring = &ring;
+  c.total = RING_BYTES;
+  c.chunk = chunk;
+  c.ok = false;
+
+  pthread_t t;
+  uint64_t start = now_ns();
+  if (pthread_create(&t, NULL, ring_consumer<Ring>, (void *) &c))
+  {
+    std::cerr << "Error: impossible create consumer thread!" << std::endl;
+    return false;
+  }
+
+  size_t sent = 0;
+  while (sent < c.total)
+  {
+    size_t n = c.total - sent;
+    if (n > chunk)
+      n = chunk;
+
+    size_t w = ring.write(&data[sent & 0xFF], n);
+    if (w == 0)
+      sched_yield();
+    sent += w;
+  }
+
+  pthread_join(t, NULL);
+  uint64_t elapsed = now_ns() - start;
+
+  snprintf(name, sizeof(name), "ring/%s-2threads-%lu", type, (unsigned long) chunk);
+  perf_result(name, chunk, c.total / chunk, elapsed, 0);
+
+  if (!c.ok)
+    std::cerr << "Error: " << type << " ring lost or reordered bytes!" << std::endl;
+
+  return c.ok;
+}
+
+bool perf_ring(void)
+{
+  static const size_t chunks[] = { 16, 64, 256 };
+  const size_t size = lora::Serial::TX_QUEUE_SIZE;
+  bool ok = true;
+
+  for (int threads = 0; threads < 2; threads++)
+  {
+    for (size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]); k++)
+    {
+      if (threads)
+      {
+        RingAdapter<true> locked(size);
+        ok = perf_ring_type("mutex", locked, chunks[k], true) && ok;
+      }
+      else
+      {
+        RingAdapter<false> plain(size);
+        ok = perf_ring_type("circular", plain, chunks[k], false) && ok;
+
+        RingAdapter<false, lora::Serial::TX_QUEUE_SIZE> fixed(size);
+        ok = perf_ring_type("circular-fixed", fixed, chunks[k], false) && ok;
+      }
+
+      lora::SpscBuffer<uint8_t> spsc(size);
+      ok = perf_ring_type("spsc", spsc, chunks[k], threads) && ok;
+    }
+  }
+
+  return ok;
+}
+
+/**
+ * @brief Parameters of the writer thread of the FIFO benchmark.
+ */
+struct FifoWriter
+{
+    //! Path of the FIFO
+    const char *path;
+
+    //! Block of lines written
+    const uint8_t *data;
+
+    //! Block size
+    size_t size;
+
+    //! Number of times the block is written
+    size_t repeat;
+};
+
+/**
+ * @brief Thread that writes the lines in a FIFO, PIPE_BUF bytes at a time
+ * (as several small writers), so lines are split across reads.
+ *
+ */
+static void* fifo_writer(void *arg)
+{
+  FifoWriter *w = (FifoWriter *) arg;
+
+  int fd = open(w->path, O_WRONLY);
+  if (fd < 0)
+    return NULL;
+
+  for (size_t r = 0; r < w->repeat; r++)
+  {
+    size_t sent = 0;
+    while (sent < w->size)
+    {
+      size_t n = w->size - sent;
+      if (n > PIPE_BUF)
+        n = PIPE_BUF;
+
+      ssize_t k = write(fd, &w->data[sent], n);
+      if (k <= 0)
+      {
+        close(fd);
+        return NULL;
+      }
+      sent += k;
+    }
+  }
+
+  close(fd);
+  return NULL;
+}
+
+/**
+ * @brief Splits the lines read from a FIFO with the LineReader.
+ *
+ */
+static void fifo_memchr(int fd, unsigned long &lines, unsigned long &oversize)
+{
+  LineReader reader(FIFO_LINE);
+  const uint8_t *line = 0;
+  size_t len = 0;
+
+  while (reader.fill(fd) > 0)
+  {
+    int status;
+    while ((status = reader.next(line, len)) != LineReader::LINE_NONE)
+    {
+      if (status == LineReader::LINE_OK)
+        perf_sink += len;
+    }
+  }
+
+  lines = reader.lines();
+  oversize = reader.oversize();
+}
+
+/**
+ * @brief Splits the lines read from a FIFO as the daemon did before the
+ * LineReader: bytes are copied in a CircularBuffer, scanned one at a time
+ * with at() and each line is copied out.
+ *
+ */
+static void fifo_bytewise(int fd, unsigned long &lines, unsigned long &oversize)
+{
+  CircularBuffer<uint8_t> ring(FIFO_LINE + 1);
+  std::vector<uint8_t> message(FIFO_LINE + 1);
+  uint8_t buffer[PIPE_BUF];
+  unsigned int scan = 0;
+  bool discard = false;
+  long int n;
+
+  lines = 0;
+  oversize = 0;
+  ring.setOverWrite(false);
+
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+  {
+    long int done = 0;
+    while (done < n)
+    {
+      done += ring.write(&buffer[done], n - done);
+
+      for (; scan < ring.size(); scan++)
+      {
+        if (ring.at(scan) != '\n')
+          continue;
+
+        ring.read(&message[0], scan + 1);
+        if (discard)
+          discard = false;
+        else
+        {
+          perf_sink += scan;
+          lines++;
+        }
+        scan = 0;
+      }
+
+      if (ring.size() == ring.capacity())
+      {
+        // Line too long
+        ring.drop(ring.size());
+        scan = 0;
+        if (!discard)
+          oversize++;
+        discard = true;
+      }
+    }
+  }
+}
+
+bool perf_fifo(void)
+{
+  const char *engines[] = { "memchr", "bytewise" };
+  bool ok = true;
+
+  // Block of short lines and one line too long
+  std::string block;
+  unsigned long lines = 0;
+  char line[128];
+  while (block.size() < 1024 * 1024)
+  {
+    int n = snprintf(line, sizeof(line), "Sensor %05lu temperature 21.5 humidity 48 battery 3.61 V\n",
+        lines);
+    block.append(line, n);
+    lines++;
+  }
+  block.append(FIFO_LINE + 4464, 'x');
+  block.append(1, '\n');
+
+  const size_t repeat = RING_BYTES / block.size() + 1;
+  const size_t avg = block.size() / lines;
+
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/lora_perf.%d", (int) getpid());
+
+  for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+  {
+    unlink(path);
+    if (mkfifo(path, 0600) < 0)
+    {
+      perror("Error: mkfifo ");
+      return false;
+    }
+
+    FifoWriter w;
+    w.path = path;
+    w.data = (const uint8_t *) block.data();
+    w.size = block.size();
+    w.repeat = repeat;
+
+    pthread_t t;
+    if (pthread_create(&t, NULL, fifo_writer, (void *) &w))
+    {
+      std::cerr << "Error: impossible create writer thread!" << std::endl;
+      unlink(path);
+      return false;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+      perror("Error: open FIFO ");
+      pthread_join(t, NULL);
+      unlink(path);
+      return false;
+    }
+
+    unsigned long got = 0;
+    unsigned long oversize = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+
+    if (e == 0)
+      fifo_memchr(fd, got, oversize);
+    else
+      fifo_bytewise(fd, got, oversize);
+
+    uint64_t elapsed = now_ns() - start;
+    allocs = perf_allocs - allocs;
+
+    close(fd);
+    pthread_join(t, NULL);
+    unlink(path);
+
+    char name[64];
+    snprintf(name, sizeof(name), "fifo/%s", engines[e]);
+    perf_result(name, avg, got, elapsed, allocs);
+
+    if (got != lines * repeat || oversize != repeat)
+    {
+      std::cerr << "Error: " << engines[e] << " splitter found " << got << " lines and "
+          << oversize << " long lines (expected " << lines * repeat << " and " << repeat << ")!"
+          << std::endl;
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+/**
+ * @brief Parameters of the producer thread of the shared ring benchmark.
+ */
+struct ShmProducer
+{
+    //! Producer side of the ring (0 for the socket)
+    lora::ShmRing *ring;
+
+    //! Socket of the producer (-1 for the ring)
+    int fd;
+
+    //! Number of system calls of the producer
+    unsigned long syscalls;
+};
+
+/**
+ * @brief Thread that submits the messages, numbered in order.
+ *
+ */
+static void* shm_producer(void *arg)
+{
+  ShmProducer *p = (ShmProducer *) arg;
+  uint8_t msg[sizeof(lora::submit::Request) + SHM_LENGTH];
+  memset(msg, 'a', sizeof(msg));
+
+  lora::submit::Request req;
+  memset(&req, 0, sizeof(req));
+  req.version = lora::submit::VERSION;
+  req.dest = 5;
+  memcpy(msg, &req, sizeof(req));
+
+  uint8_t *payload = &msg[sizeof(req)];
+  for (uint64_t i = 0; i < SHM_MESSAGES; i++)
+  {
+    memcpy(payload, &i, sizeof(i));
+
+    if (p->ring)
+    {
+      // The consumer has given up if no space is freed for a second
+      bool stop = false;
+      while (!stop && !p->ring->push(5, 0, 0, payload, SHM_LENGTH))
+        stop = !p->ring->wait(SHM_LENGTH, 1000);
+      if (stop)
+        break;
+    }
+    else
+    {
+      if (send(p->fd, msg, sizeof(msg), 0) != (ssize_t) sizeof(msg))
+        break;
+      p->syscalls++;
+    }
+  }
+
+  if (p->ring)
+    p->syscalls = p->ring->syscalls();
+
+  return NULL;
+}
+
+/**
+ * @brief Drains the shared ring as the daemon: records are released after
+ * use and the doorbell is waited only when the ring is empty.
+ *
+ */
+static uint64_t shm_consume(lora::ShmRing &ring, unsigned long &syscalls)
+{
+  uint64_t expected = 0;
+  lora::ShmRing::Record rec;
+  uint64_t seq = 0;
+
+  while (expected < SHM_MESSAGES)
+  {
+    const uint8_t *msg = ring.next(rec, seq);
+    if (msg == 0)
+    {
+      if (ring.corrupted())
+        break;
+
+      // A record written meanwhile: no need to wait
+      if (!ring.sleep())
+        continue;
+
+      struct pollfd pfd;
+      pfd.fd = ring.doorbell();
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      uint64_t count = 0;
+      if (poll(&pfd, 1, 1000) <= 0 || read(ring.doorbell(), &count, sizeof(count)) < 0)
+        break;
+      syscalls += 2;
+      continue;
+    }
+
+    uint64_t i = 0;
+    memcpy(&i, msg, sizeof(i));
+    if (i != expected || rec.size != SHM_LENGTH || rec.dest != 5)
+      break;
+
+    perf_sink += msg[SHM_LENGTH - 1];
+    expected++;
+    ring.release(seq);
+  }
+
+  syscalls += ring.syscalls();
+  return expected;
+}
+
+/**
+ * @brief Receives the datagrams of the socket pair.
+ *
+ */
+static uint64_t socket_consume(int fd, unsigned long &syscalls)
+{
+  uint8_t msg[sizeof(lora::submit::Request) + SHM_LENGTH + 1];
+  uint64_t expected = 0;
+
+  while (expected < SHM_MESSAGES)
+  {
+    ssize_t n = recv(fd, msg, sizeof(msg), 0);
+    syscalls++;
+    if (n != (ssize_t) (sizeof(lora::submit::Request) + SHM_LENGTH))
+      break;
+
+    uint64_t i = 0;
+    memcpy(&i, &msg[sizeof(lora::submit::Request)], sizeof(i));
+    if (i != expected)
+      break;
+
+    perf_sink += msg[n - 1];
+    expected++;
+  }
+
+  return expected;
+}
+
+bool perf_shm(void)
+{
+  const char *engines[] = { "ring", "socket" };
+  bool ok = true;
+
+  for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+  {
+    lora::ShmRing producer;
+    lora::ShmRing consumer;
+    int sv[2] = { -1, -1 };
+
+    if (e == 0)
+    {
+      // The consumer gets its own descriptors, as the daemon
+      if (!producer.create(lora::ShmRing::DEFAULT_SIZE)
+          || !consumer.attach(dup(producer.memfd()), dup(producer.doorbell()),
+              dup(producer.space())))
+      {
+        std::cerr << "Error: impossible create the shared ring!" << std::endl;
+        return false;
+      }
+    }
+    else if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+      perror("Error: socketpair ");
+      return false;
+    }
+
+    ShmProducer p;
+    p.ring = (e == 0) ? &producer : 0;
+    p.fd = sv[0];
+    p.syscalls = 0;
+
+    unsigned long syscalls = 0;
+    unsigned long allocs = perf_allocs;
+    uint64_t start = now_ns();
+
+    pthread_t t;
+    if (pthread_create(&t, NULL, shm_producer, (void *) &p))
+    {
+      std::cerr << "Error: impossible create producer thread!" << std::endl;
+      return false;
+    }
+
+    uint64_t got = (e == 0) ? shm_consume(consumer, syscalls) : socket_consume(sv[1], syscalls);
+
+    // The producer is stopped if the consumer has given up
+    if (sv[1] >= 0)
+      shutdown(sv[1], SHUT_RDWR);
+
+    pthread_join(t, NULL);
+    uint64_t elapsed = now_ns() - start;
+    allocs = perf_allocs - allocs;
+
+    if (sv[0] >= 0)
+    {
+      close(sv[0]);
+      close(sv[1]);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "shm/%s", engines[e]);
+    perf_result(name, SHM_LENGTH, got, elapsed, allocs);
+    printf("# shm/%s: %.4f system calls per message (producer %lu, consumer %lu)\n", engines[e],
+        (double) (p.syscalls + syscalls) / SHM_MESSAGES, p.syscalls, syscalls);
+
+    if (got != SHM_MESSAGES)
+    {
+      std::cerr << "Error: " << engines[e] << " delivered " << got << " messages in order (expected "
+          << SHM_MESSAGES << ")!" << std::endl;
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+/**
+ * @brief Measures an operation after a warmup.
+ *
+ * The operation runs for the warmup time (caches, branch predictors and
+ * CPU frequency settle), then in batches of 100 until the minimum duration.
+ *
+ * @param[in] name benchmark name.
+ * @param[in] size bytes processed by an operation (0 if not meaningful).
+ * @param[in] op functor: op() runs the operation once and returns a value
+ * for the sink.
+ *
+ * @returns number of heap allocations per operation.
+ */
+template<class Op>
+static double perf_run(const char *name, size_t size, Op &op)
+{
+  uint64_t start = now_ns();
+  while (now_ns() - start < warmup_time)
+  {
+    for (int i = 0; i < 100; i++)
+    {
+      perf_sink += op();
+    }
+  }
+
+  uint64_t ops = 0;
+  unsigned long allocs = perf_allocs;
+  uint64_t elapsed = 0;
+  start = now_ns();
+  do
+  {
+    for (int i = 0; i < 100; i++)
+    {
+      perf_sink += op();
+    }
+    ops += 100;
+    elapsed = now_ns() - start;
+  } while (elapsed < min_time);
+
+  allocs = perf_allocs - allocs;
+  perf_result(name, size, ops, elapsed, allocs);
+
+  return (double) allocs / ops;
+}
+
+/**
+ * @brief Builds a frame (SOH, command, payload, CR LF, CRC, EOT).
+ *
+ * @returns frame size.
+ */
+static size_t make_frame(const char *body, uint8_t *buffer, size_t size)
+{
+  size_t len = strlen(body);
+  if (len + 8 > size)
+    return 0;
+
+  buffer[0] = lora::Command::SOH;
+  memcpy(&buffer[1], body, len);
+  buffer[len + 1] = lora::Command::CR;
+  buffer[len + 2] = lora::Command::LF;
+  snprintf((char *) &buffer[len + 3], 5, "%04X",
+      lora::Crc16::compute((const uint8_t *) body, len));
+  buffer[len + 7] = lora::Command::EOT;
+
+  return len + 8;
+}
+
+/**
+ * @brief Functor: Command::CRC16 on a buffer.
+ *
+ */
+struct CrcOp
+{
+    uint8_t *buffer;
+    size_t size;
+
+    uint64_t operator()()
+    {
+      return lora::Command::CRC16(buffer, size);
+    }
+};
+
+/**
+ * @brief Functor: Command::process on a frame.
+ *
+ */
+struct ProcessOp
+{
+    const uint8_t *frame;
+    size_t size;
+    uint8_t payload[buf_sz];
+
+    uint64_t operator()()
+    {
+      uint8_t type = 0;
+      size_t p_size = 0;
+      uint16_t crc = 0;
+
+      return lora::Command::process(frame, size, type, payload, p_size, crc) + p_size;
+    }
+};
+
+/**
+ * @brief Functor: createFromBuffer of an input command on a payload.
+ *
+ */
+template<class Cmd>
+struct ParseOp
+{
+    uint8_t *payload;
+    size_t size;
+    Cmd cmd;
+
+    uint64_t operator()()
+    {
+      return cmd.createFromBuffer(payload, size);
+    }
+};
+
+/**
+ * @brief Functor: serialize of an output command.
+ *
+ */
+template<class Cmd>
+struct SerializeOp
+{
+    Cmd cmd;
+    uint8_t buffer[buf_sz];
+
+    uint64_t operator()()
+    {
+      return cmd.serialize(buffer, buf_sz);
+    }
+};
+
+/**
+ * @brief Functor: msg_string on a frame.
+ *
+ */
+struct MsgStringOp
+{
+    uint8_t *frame;
+    size_t size;
+
+    uint64_t operator()()
+    {
+      return msg_string(frame, size).size();
+    }
+};
+
+/**
+ * @brief Functor: one operation of a CircularBuffer.
+ *
+ * The buffer is kept half full, so every operation finds both elements and
+ * free room: push/pop, write/read and write/drop of a chunk.
+ */
+struct CircularOp
+{
+    enum _op
+    {
+      PUSH_POP, WRITE_READ, WRITE_DROP
+    };
+
+    CircularBuffer<uint8_t> ring;
+    int op;
+    unsigned int chunk;
+    uint8_t data[256];
+
+    uint64_t operator()()
+    {
+      switch (op)
+      {
+        case PUSH_POP:
+        {
+          uint8_t c = 0;
+          ring.push(data[0]);
+          ring.pop(c);
+          return c;
+        }
+
+        case WRITE_READ:
+          ring.write(data, chunk);
+          return ring.read(data, chunk);
+
+        default:
+          ring.write(data, chunk);
+          return ring.drop(chunk);
+      }
+    }
+};
+
+/**
+ * @brief Functor: a record of the capture of the serial traffic.
+ *
+ */
+struct CaptureOp
+{
+    lora::Capture *capture;
+    const uint8_t *data;
+    size_t size;
+
+    uint64_t operator()()
+    {
+      capture->record(lora::Capture::RX, data, size);
+      return size;
+    }
+};
+
+/**
+ * @brief Functor: a V_DEBUG message.
+ *
+ */
+struct LogOp
+{
+    unsigned int seq;
+
+    uint64_t operator()()
+    {
+      V_DEBUG("Received %d bytes\n", seq++);
+      return seq;
+    }
+};
+
+bool perf_core(void)
+{
+  const char *msg = "Sensor 42 temperature 21.5 humidity 48 battery 3.61 V";
+  const char *info = "INFO#FREC:CH_10_868;ADDR:1;BW:BW_125;CR:CR_5;SF:SF_12;RSSI:-80;SNR:7";
+  bool ok = true;
+
+  uint8_t data_frame[buf_sz];
+  uint8_t info_frame[buf_sz];
+  uint8_t error_frame[buf_sz];
+
+  lora::command::Data data;
+  data.setDest(12);
+  data.setData((const uint8_t *) msg, strlen(msg));
+  size_t data_sz = data.serialize(data_frame, buf_sz);
+  size_t info_sz = make_frame(info, info_frame, buf_sz);
+  size_t error_sz = make_frame("ERROR#COM_ERROR", error_frame, buf_sz);
+
+  // Command::CRC16 on the bytes covered by the CRC of the frames
+  {
+    CrcOp op;
+    op.buffer = &data_frame[1];
+    op.size = data_sz - 8;
+    perf_run("core/crc16-data", op.size, op);
+
+    op.buffer = &info_frame[1];
+    op.size = info_sz - 8;
+    perf_run("core/crc16-info", op.size, op);
+  }
+
+  // Command::process: DATA, INFO, ERROR and a frame with a wrong CRC
+  {
+    ProcessOp op;
+    op.frame = data_frame;
+    op.size = data_sz;
+    perf_run("core/process-data", data_sz, op);
+
+    op.frame = info_frame;
+    op.size = info_sz;
+    perf_run("core/process-info", info_sz, op);
+
+    op.frame = error_frame;
+    op.size = error_sz;
+    perf_run("core/process-error", error_sz, op);
+
+    uint8_t bad[buf_sz];
+    memcpy(bad, data_frame, data_sz);
+    bad[data_sz - 2] ^= 0x01;
+    op.frame = bad;
+    op.size = data_sz;
+    perf_run("core/process-bad-crc", data_sz, op);
+  }
+
+  // Info::createFromBuffer and Error::createFromBuffer on the payloads
+  {
+    ProcessOp frame;
+    uint8_t type = 0;
+    size_t p_size = 0;
+    uint16_t crc = 0;
+
+    lora::Command::process(info_frame, info_sz, type, frame.payload, p_size, crc);
+
+    ParseOp<lora::command::Info> info_op;
+    info_op.payload = frame.payload;
+    info_op.size = p_size;
+    perf_run("core/info-parse", p_size, info_op);
+
+    if (info_op.cmd.spreadingFactor() != lora::ConfigCommand::SF_12 || info_op.cmd.address() != 1)
+    {
+      std::cerr << "Error: INFO payload not parsed!" << std::endl;
+      ok = false;
+    }
+
+    lora::Command::process(error_frame, error_sz, type, frame.payload, p_size, crc);
+
+    ParseOp<lora::command::Error> error_op;
+    error_op.payload = frame.payload;
+    error_op.size = p_size;
+    perf_run("core/error-parse", p_size, error_op);
+
+    if (error_op.cmd.error() != "COM_ERROR")
+    {
+      std::cerr << "Error: ERROR payload not parsed!" << std::endl;
+      ok = false;
+    }
+  }
+
+  // Data::serialize and Set::serialize
+  {
+    SerializeOp<lora::command::Data> data_op;
+    data_op.cmd.setDest(12);
+    data_op.cmd.setData((const uint8_t *) msg, strlen(msg));
+    perf_run("core/data-serialize", data_sz, data_op);
+
+    SerializeOp<lora::command::Set> set_op;
+    set_op.cmd.setAddress(3);
+    set_op.cmd.setFrequency(lora::ConfigCommand::F_868);
+    set_op.cmd.setChannel(lora::ConfigCommand::CH_12);
+    set_op.cmd.setBandwidth(lora::ConfigCommand::BW_125);
+    set_op.cmd.setCodingRate(lora::ConfigCommand::CR_5);
+    set_op.cmd.setSpreadingFactor(lora::ConfigCommand::SF_12);
+    perf_run("core/set-serialize", set_op(), set_op);
+  }
+
+  // msg_string (the frames printed by the debug messages)
+  {
+    MsgStringOp op;
+    op.frame = data_frame;
+    op.size = data_sz;
+    perf_run("core/msg_string", data_sz, op);
+  }
+
+  // CircularBuffer of the serial receiver
+  {
+    static const unsigned int chunks[] = { 16, 256 };
+
+    CircularOp op;
+    ring_init(op.ring, 4096);
+    memcpy(op.data, msg, strlen(msg));
+    op.ring.write(op.data, 2048 - 128);
+
+    op.op = CircularOp::PUSH_POP;
+    op.chunk = 1;
+    perf_run("core/circular-push-pop", 1, op);
+
+    for (size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]); k++)
+    {
+      char name[64];
+      op.chunk = chunks[k];
+
+      op.op = CircularOp::WRITE_READ;
+      snprintf(name, sizeof(name), "core/circular-write-read-%u", chunks[k]);
+      perf_run(name, chunks[k], op);
+
+      op.op = CircularOp::WRITE_DROP;
+      snprintf(name, sizeof(name), "core/circular-write-drop-%u", chunks[k]);
+      perf_run(name, chunks[k], op);
+    }
+  }
+
+  // Capture of the serial traffic: the cost at full UART rate is a record
+  // per byte in the worst case (115200 bps, 11520 bytes per second)
+  {
+    static const size_t sizes[] = { 1, 16, 64 };
+
+    lora::Capture capture;
+    CaptureOp op;
+    op.capture = &capture;
+    op.data = data_frame;
+
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++)
+    {
+      char name[64];
+      op.size = sizes[k];
+      snprintf(name, sizeof(name), "core/capture-record-%lu", (unsigned long) sizes[k]);
+
+      if (perf_run(name, sizes[k], op) != 0)
+      {
+        std::cerr << "Error: capture allocates memory!" << std::endl;
+        ok = false;
+      }
+
+      if (sizes[k] == 1)
+      {
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < 11520; i++)
+        {
+          op();
+        }
+        printf("# core/capture: %.3f%% of a CPU at 115200 bps (a record per byte)\n",
+            (double) (now_ns() - t0) * 100.0 / 1e9);
+      }
+    }
+  }
+
+  // v_log below the verbosity (filtered) and printed (on /dev/null)
+  {
+    LogOp op;
+    op.seq = 0;
+
+    v_verbosity(1);
+    perf_run("core/v_log-filtered", 0, op);
+
+    int null = open("/dev/null", O_WRONLY);
+    int err = dup(STDERR_FILENO);
+    if (null >= 0 && err >= 0)
+    {
+      fflush(stderr);
+      dup2(null, STDERR_FILENO);
+      v_verbosity(2);
+      perf_run("core/v_log-printed", 0, op);
+      fflush(stderr);
+      dup2(err, STDERR_FILENO);
+    }
+
+    if (null >= 0)
+      close(null);
+    if (err >= 0)
+      close(err);
+  }
+
+  v_verbosity(verbosity);
+
+  return ok;
+}
+
+void print_help(void)
+{
+  std::cerr << "WaspMote Lo-Ra - " << LORA_NAME << " v" << LORA_VERSION << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "Usage: " << LORA_NAME
+      << " [-v 0|1|2] [-c cpu] [-s suite] [-t milliseconds] [-w milliseconds]" << std::endl;
+  std::cerr << "       " << LORA_NAME << " -h" << std::endl << std::endl;
+  std::cerr << " -c : pin the benchmarks on a CPU (also the threads of ring, fifo and shm)." << std::endl;
+  std::cerr << " -h : display this message." << std::endl;
+  std::cerr << " -s : benchmark suite [all|core|crc|scan|serialize|serial|fragment|ring|fifo|shm|outbox|coalesce|wheel|scheduler]. Default value is all." << std::endl;
+  std::cerr << " -t : minimum duration of each benchmark in milliseconds. Default value is "
+      << PERF_TIME << "." << std::endl;
+  std::cerr << " -v : set verbosity level [0|1|2]." << std::endl;
+  std::cerr << " -w : warmup before each benchmark of the core suite in milliseconds. Default value is "
+      << PERF_WARMUP << "." << std::endl;
+
+  std::cerr << std::endl;
+}
+
+#endif
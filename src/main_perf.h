@@ -0,0 +1,255 @@
+//============================================================================
+// Name        : main_perf.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Header of the main for the "Lo-Ra microbenchmarks"
+//============================================================================
+#ifndef MAIN_PERF_H_
+#define MAIN_PERF_H_
+
+//#define LORA_PERF
+#ifdef LORA_PERF
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*****************************************************************************
+ * MACROS
+ ****************************************************************************/
+#ifndef LORA_NAME
+#define LORA_NAME             "lora_perf"
+#define LORA_VERSION          "1.0"
+#endif
+
+/// Default minimum duration of a benchmark in milliseconds
+#define PERF_TIME             200
+
+/// Default warmup before a benchmark of the core suite in milliseconds
+#define PERF_WARMUP           20
+
+/// Bytes moved between two threads by the ring benchmarks
+#define RING_BYTES            (32 * 1024 * 1024)
+
+/// Longest line of the FIFO benchmark (as lora_daemon)
+#define FIFO_LINE             (64 * 1024)
+
+/// Messages submitted by the shared ring benchmark
+#define SHM_MESSAGES          1000000
+
+/// Length of a message of the shared ring benchmark
+#define SHM_LENGTH            48
+
+/// Frames sent by the latency check of the serial suite
+#define SERIAL_FRAMES         10
+
+/// Maximum send latency in full-duplex mode with a reader blocked (milliseconds)
+#define SERIAL_MAX_LATENCY    50
+
+/*****************************************************************************
+ * FUNCTIONS
+ ****************************************************************************/
+/**
+ * @brief Prints the help message of the command.
+ *
+ * This function prints on standard error the help of the \elora_perf
+ * command.
+ *
+ */
+void print_help(void);
+
+/**
+ * @brief Main function for the Lo-Ra microbenchmarks.
+ *
+ * This command measures the hot paths of the Lo-Ra library (CRC, frame
+ * parsing, ...) and prints the time and the throughput of each operation.
+ *
+ * @param[in] argc number of strings pointed to by argv
+ * @param[in] argv arguments vector
+ *
+ * @returns 0 if all benchmarks complete, 1 otherwise (exit status).
+ */
+int main_perf(int argc, char **argv);
+
+/**
+ * @brief Prints the result of a benchmark.
+ *
+ * @param[in] name benchmark name.
+ * @param[in] size bytes processed by an operation (0 if not meaningful).
+ * @param[in] ops number of operations.
+ * @param[in] ns total time in nanoseconds.
+ * @param[in] allocs number of heap allocations.
+ *
+ */
+void perf_result(const char *name, size_t size, uint64_t ops, uint64_t ns, unsigned long allocs);
+
+/**
+ * @brief Benchmark of the basic operations of the tools.
+ *
+ * Command::CRC16, Command::process, the parsing of INFO and ERROR payloads,
+ * the DATA and SET serializers, msg_string, the CircularBuffer operations,
+ * the capture of the serial traffic (lora::Capture) and v_log (filtered and
+ * printed on /dev/null) are measured after a warmup.
+ * The time, the throughput and the heap allocations of each operation are
+ * the baseline of the optimizations.
+ *
+ * @returns false if an INFO or ERROR payload isn't parsed or the capture
+ * allocates memory, true otherwise.
+ */
+bool perf_core(void);
+
+/**
+ * @brief Benchmark of the CRC16 engines.
+ *
+ * All engines are checked against the bitwise one, then each engine is
+ * measured on frame sized and multi-KB buffers.
+ *
+ * @returns false if an engine gives a wrong result, true otherwise.
+ */
+bool perf_crc(void);
+
+/**
+ * @brief Benchmark of the delimiter scanner and of the frame parser.
+ *
+ * Each scanner engine is measured looking for SOH in a buffer without
+ * delimiters, then the frame parser is measured on clean input (only frames)
+ * and on noisy input (50% of random bytes between frames).
+ *
+ * @returns false if the engines give different results, true otherwise.
+ */
+bool perf_scan(void);
+
+/**
+ * @brief Benchmark of the command serializers.
+ *
+ * Heap allocations are counted (global operator new): serialization, frame
+ * templates and the send path (DATA frame template and full-duplex serial
+ * send on a pseudo terminal) must not allocate memory.
+ *
+ * @returns false if the send path allocates memory, true otherwise.
+ */
+bool perf_serialize(void);
+
+/**
+ * @brief Check of the send latency on a serial device with a blocked reader.
+ *
+ * A reader thread waits in lora::Serial::receive() with the read timeout
+ * of 0.5 seconds (VTIME=5) the 'read' thread had, while DATA frames are
+ * sent at different points of the read window. The latency is the time
+ * from the send() call to the arrival of the whole frame at the other side
+ * of a pseudo terminal. It is measured in full-duplex mode and in
+ * half-duplex mode with a mutex held around receive() and send(), as the
+ * lock_x mutex of lora_daemon was.
+ *
+ * @returns false if a frame doesn't arrive or the full-duplex latency
+ * reaches SERIAL_MAX_LATENCY milliseconds, true otherwise.
+ */
+bool perf_serial(void);
+
+/**
+ * @brief Benchmark of the fragmentation of long messages.
+ *
+ * Messages from 1 KB to 64 KB are split in DATA frames, then the frames are
+ * parsed and the messages rebuilt. The number of frames, the bytes on the
+ * wire and the memory used by the reassembler are printed for each size.
+ *
+ * @returns false if a message isn't rebuilt correctly, true otherwise.
+ */
+bool perf_fragment(void);
+
+/**
+ * @brief Benchmark of the ring buffers.
+ *
+ * CircularBuffer (heap and inline array) and lora::SpscBuffer (capacity of
+ * the serial transmission queue) are measured with one thread writing and
+ * reading, then as a
+ * handoff between two threads: the mutex guarded CircularBuffer against
+ * the lock-free SpscBuffer. The consumer checks the order of the bytes.
+ *
+ * @returns false if a byte is lost or reordered, true otherwise.
+ */
+bool perf_ring(void);
+
+/**
+ * @brief Benchmark of the line splitter of the daemon pipe.
+ *
+ * A thread writes 60 bytes lines and a line too long in a FIFO, PIPE_BUF
+ * bytes at a time; the lines are split by the LineReader (memchr on the
+ * ring, lines in place) and by the old byte by byte scan with copies.
+ *
+ * @returns false if a line is lost or a line too long isn't detected,
+ * true otherwise.
+ */
+bool perf_fifo(void);
+
+/**
+ * @brief Benchmark of the submission of messages to the daemon.
+ *
+ * A thread submits SHM_MESSAGES messages through a shared ring
+ * (lora::ShmRing, as lora::ShmClient) and through a SOCK_SEQPACKET socket
+ * pair (one datagram per message, as the submission socket). The consumer
+ * drains the ring as the daemon does: doorbell waited only when the ring is
+ * empty, records released after use. The system calls per message are
+ * printed for each transport.
+ *
+ * @returns false if a message is lost or reordered, true otherwise.
+ */
+bool perf_shm(void);
+
+/**
+ * @brief Benchmark of the priority lanes of the daemon outbox.
+ *
+ * The cost of a submission and of a selection is measured, then the lanes
+ * are saturated to check that every lane gets its weight and the
+ * destinations of a lane share the frames (deficit round robin), also when
+ * one sends long fragmented messages. Last a saturated
+ * SF12 sender is simulated for three hours with long bulk messages and a
+ * short alarm every ten minutes: the wait of the alarms is printed with
+ * the alarms in their lane and in the bulk lane (FIFO order).
+ *
+ * @returns false if a lane or a node doesn't get its share or the alarms aren't
+ * faster than in FIFO order, true otherwise.
+ */
+bool perf_outbox(void);
+
+/**
+ * @brief Benchmark of the coalescing of short messages.
+ *
+ * Messages with marks and escapes are packed in a frame and split back,
+ * then the cost of packing and splitting ten readings is measured. Last
+ * the time on air of sixty short readings sent alone and coalesced is
+ * printed at SF7 and SF12.
+ *
+ * @returns false if a message isn't split back, the split allocates memory
+ * or the coalesced frames aren't shorter on air, true otherwise.
+ */
+bool perf_coalesce(void);
+
+/**
+ * @brief Benchmark of the timing wheel of the frame timers.
+ *
+ * Timers up to a minute ahead are scheduled (a quarter cancelled) and the
+ * clock runs in steps of 7 ms: every timer must expire in the step that
+ * reaches it and next() must give the earliest timer. Then the cost of
+ * scheduling and cancelling or expiring a timer is measured, and the
+ * percentiles of the histogram of the ACK times are checked.
+ *
+ * @returns false if a timer expires at the wrong time, a percentile is
+ * wrong or a timer allocates memory, true otherwise.
+ */
+bool perf_wheel(void);
+
+/**
+ * @brief Benchmark of the duty cycle scheduler.
+ *
+ * The cost of a release decision is measured, then a saturated sender is
+ * simulated for three hours: frames must never overlap and the time on air
+ * of every window of one hour must respect the duty cycle of the sub-band.
+ *
+ * @returns false if a frame is released too early, true otherwise.
+ */
+bool perf_scheduler(void);
+
+#endif
+
+#endif /* MAIN_PERF_H_ */
@@ -0,0 +1,613 @@
+//============================================================================
+// Name        : main_replay.cpp
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Main for the "Lo-Ra capture replay"
+//============================================================================
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "global.h"
+#include "verbose.h"
+#include "main_replay.h"
+#include "lora/utils.h"
+#include "lora/command.h"
+#include "lora/parser.h"
+#include "lora/capture.h"
+
+#ifdef LORA_REPLAY
+/*****************************************************************************
+ * FUNCTIONS
+ ****************************************************************************/
+/**
+ * @brief Gets the name of an error of the frame parser.
+ *
+ * @param[in] code error code, according to lora::Command::_ERROR_CODE enum.
+ */
+static const char* errorName(uint8_t code)
+{
+  switch (code)
+  {
+    case lora::Command::NULL_BUFFER_IN:
+      return "NULL_BUFFER_IN";
+
+    case lora::Command::NULL_BUFFER_OUT:
+      return "NULL_BUFFER_OUT";
+
+    case lora::Command::INVALID_CMD:
+      return "INVALID_CMD";
+
+    case lora::Command::INVALID_PAYLOAD_1:
+      return "INVALID_PAYLOAD_1";
+
+    case lora::Command::INVALID_PAYLOAD_2:
+      return "INVALID_PAYLOAD_2";
+
+    case lora::Command::INVALID_CRC:
+      return "INVALID_CRC";
+
+    case lora::Command::INVALID_EOT:
+      return "INVALID_EOT";
+
+    case lora::Command::CMD_NOT_FOUND:
+      return "CMD_NOT_FOUND";
+
+    default:
+      break;
+  }
+
+  return "UNKNOWN";
+}
+
+/**
+ * @brief Gets a percentile of the sorted latencies.
+ */
+static uint64_t percentile(const std::vector<uint64_t> &sorted, double percent)
+{
+  if (sorted.empty())
+    return 0;
+
+  size_t i = (size_t) ceil(percent * sorted.size() / 100.0);
+  return sorted[(i) ? i - 1 : 0];
+}
+
+/**
+ * @brief Frame parser listener that decodes the received commands.
+ *
+ * The received bytes are passed to the frame parser in a window, as the
+ * 'read' thread of lora_daemon does. Every command is decoded as
+ * process_frame() does (copy of the payload, INFO, ERROR and DATA parsed),
+ * without printing it unless required. The decode latency of a frame is the
+ * time from the delivery of the bytes that complete it to the end of its
+ * decoding.
+ */
+class Replayer: public lora::FrameParser::Listener
+{
+  public:
+    /// Number of command types counted (lora::Command::CMD_TYPE).
+    static const unsigned int TYPES = lora::Command::ACK + 1;
+
+    Replayer(bool print) :
+        m_print(print), m_size(0), m_start(0), m_busy(0), m_rxBytes(0), m_txBytes(0), m_rxRecords(0),
+            m_txRecords(0), m_lost(0), m_resets(0), m_skipped(0), m_frames(0), m_other(0),
+            m_invalid(0), m_comErrors(0), m_moduleErrors(0), m_parseErrors(0)
+    {
+      memset(m_types, 0, sizeof(m_types));
+      memset(m_errors, 0, sizeof(m_errors));
+    }
+
+    /**
+     * @brief Passes a record of the capture: received bytes are parsed, a
+     * LOST record drops the bytes of an incomplete frame.
+     *
+     */
+    void record(const lora::Capture::Record &r)
+    {
+      switch (r.dir)
+      {
+        case lora::Capture::RX:
+          m_rxRecords++;
+          m_rxBytes += r.size;
+          receive(r.data, r.size);
+          break;
+
+        case lora::Capture::TX:
+          m_txRecords++;
+          m_txBytes += r.size;
+          break;
+
+        case lora::Capture::LOST:
+        {
+          // Bytes missing: a frame in the window can't be completed
+          uint64_t slots = 0;
+          memcpy(&slots, r.data, (r.size < sizeof(slots)) ? r.size : sizeof(slots));
+          m_lost += slots;
+          m_parser.reset();
+          m_size = 0;
+        }
+          break;
+
+        default:
+          break;
+      }
+    }
+
+    virtual void onFrame(const lora::Frame &frame)
+    {
+      m_frames++;
+      if (frame.type < TYPES)
+        m_types[frame.type]++;
+      else
+        m_other++;
+
+      if (m_print)
+        process_frame(frame);
+      else
+        decode(frame);
+
+      m_latency.push_back(lora::Capture::now() - m_start);
+    }
+
+    virtual void onError(uint8_t code, const uint8_t *data, size_t size)
+    {
+      m_parseErrors++;
+      m_errors[code]++;
+    }
+
+  private:
+    void receive(const uint8_t *data, size_t size)
+    {
+      while (size)
+      {
+        if (m_size == sizeof(m_window))
+        {
+          m_resets++;
+          m_parser.reset();
+          m_size = 0;
+        }
+
+        size_t n = sizeof(m_window) - m_size;
+        if (n > size)
+          n = size;
+
+        memcpy(&m_window[m_size], data, n);
+        m_size += n;
+        data += n;
+        size -= n;
+
+        m_start = lora::Capture::now();
+        size_t consumed = m_parser.parse(m_window, m_size, *this);
+        m_skipped += m_parser.skipped();
+        m_busy += lora::Capture::now() - m_start;
+
+        m_size -= consumed;
+        if (consumed && m_size)
+          memmove(m_window, &m_window[consumed], m_size);
+      }
+    }
+
+    void decode(const lora::Frame &frame)
+    {
+      // As process_frame(): commands parse a private copy of the payload
+      uint8_t payload[buf_sz] = { 0 };
+      size_t psize = (frame.p_size < (size_t) (buf_sz - 1)) ? frame.p_size : (buf_sz - 1);
+      memcpy(payload, frame.payload, psize);
+
+      switch (frame.type)
+      {
+        case lora::Command::INFO:
+        {
+          lora::command::Info m;
+          if (m.createFromBuffer(payload, psize) == 0
+              || m.spreadingFactor() == lora::ConfigCommand::SF_UNKN)
+            m_invalid++;
+        }
+          break;
+
+        case lora::Command::ERROR:
+        {
+          lora::command::Error m;
+          m.createFromBuffer(payload, psize);
+
+          if (m.error() == "COM_ERROR")
+            m_comErrors++;
+          else
+            m_moduleErrors++;
+        }
+          break;
+
+        case lora::Command::DATA:
+        {
+          lora::command::Data m;
+          if (m.createFromBuffer(payload, psize) == 0)
+            m_invalid++;
+        }
+          break;
+
+        default:
+          break;
+      }
+    }
+
+  public:
+    //! Decode latency of every frame (ns)
+    std::vector<uint64_t> m_latency;
+
+    //! Commands printed as the tools do
+    bool m_print;
+
+    //! Parser of the received bytes
+    lora::FrameParser m_parser;
+
+    //! Receive window
+    uint8_t m_window[2 * lora::FrameParser::MAX_FRAME_SIZE];
+
+    //! Bytes in the window
+    size_t m_size;
+
+    //! Delivery time of the bytes being parsed (ns)
+    uint64_t m_start;
+
+    //! Time spent parsing and decoding (ns)
+    uint64_t m_busy;
+
+    //! Received bytes
+    unsigned long long m_rxBytes;
+
+    //! Sent bytes (not parsed)
+    unsigned long long m_txBytes;
+
+    //! Records of received bytes
+    unsigned long m_rxRecords;
+
+    //! Records of sent bytes
+    unsigned long m_txRecords;
+
+    //! Slots lost in the capture
+    unsigned long long m_lost;
+
+    //! Windows cleaned because full
+    unsigned long m_resets;
+
+    //! Bytes skipped by the parser (noise)
+    unsigned long long m_skipped;
+
+    //! Frames found
+    unsigned long m_frames;
+
+    //! Frames of each command type
+    unsigned long m_types[TYPES];
+
+    //! Frames of unknown type
+    unsigned long m_other;
+
+    //! Frames whose command can't be decoded
+    unsigned long m_invalid;
+
+    //! ERROR#COM_ERROR commands
+    unsigned long m_comErrors;
+
+    //! Other ERROR commands
+    unsigned long m_moduleErrors;
+
+    //! Errors of the parser
+    unsigned long m_parseErrors;
+
+    //! Errors of the parser by code
+    unsigned long m_errors[256];
+};
+
+/**
+ * @brief Replays a capture file.
+ *
+ * With a speed the records are delivered at their time in the capture
+ * divided by the speed, from the first record of the replay (base); with
+ * speed 0 as fast as possible.
+ *
+ * @param[in] path capture file.
+ * @param[in] replayer receiver of the records.
+ * @param[in] speed replay speed (0 as fast as possible).
+ * @param[in,out] base time of the first record in the capture and in the
+ * replay (ns), 0 before the first record.
+ * @param[in,out] lag maximum delay of a record from its replay time (ns).
+ *
+ * @returns false if the file isn't a capture file.
+ */
+static bool replay(const char *path, Replayer &replayer, double speed, uint64_t base[2],
+    uint64_t &lag)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    perror((std::string("Error: ") + path + " ").c_str());
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t) st.st_size < lora::Capture::HEADER_SIZE)
+  {
+    std::cerr << "Error: " << path << " isn't a capture file!" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  size_t size = st.st_size;
+  const uint8_t *file = (const uint8_t *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (file == (const uint8_t *) MAP_FAILED)
+  {
+    perror((std::string("Error: ") + path + " ").c_str());
+    return false;
+  }
+  madvise((void *) file, size, MADV_SEQUENTIAL);
+
+  if (!lora::Capture::checkHeader(file, size))
+  {
+    std::cerr << "Error: " << path << " isn't a capture file!" << std::endl;
+    munmap((void *) file, size);
+    return false;
+  }
+
+  size_t pos = lora::Capture::HEADER_SIZE;
+  while (pos < size)
+  {
+    lora::Capture::Record r;
+    size_t n = lora::Capture::decode(&file[pos], size - pos, r);
+    if (n == 0)
+    {
+      // The last record is being written
+      std::cerr << "Warning: " << path << " is truncated (" << (size - pos) << " bytes)."
+          << std::endl;
+      break;
+    }
+    pos += n;
+
+    if (speed > 0)
+    {
+      if (base[0] == 0)
+      {
+        base[0] = r.time;
+        base[1] = lora::Capture::now();
+      }
+
+      uint64_t due = base[1] + (uint64_t) ((r.time - base[0]) / speed);
+      if (r.time < base[0])
+        due = base[1];
+
+      uint64_t now = lora::Capture::now();
+      if (due > now)
+      {
+        struct timespec ts;
+        ts.tv_sec = due / 1000000000ULL;
+        ts.tv_nsec = due % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+          ;
+      }
+      else if (now - due > lag)
+      {
+        lag = now - due;
+      }
+    }
+
+    replayer.record(r);
+  }
+
+  munmap((void *) file, size);
+  return true;
+}
+
+int main_replay(int argc, char **argv)
+{
+  int opt = 0;
+  double speed = 1;
+  unsigned int loops = 1;
+  bool print = false;
+  bool json = false;
+
+  // Parse command line
+  while ((opt = getopt(argc, argv, "v:jn:px:h")) != -1)
+  {
+    switch (opt)
+    {
+      // JSON output
+      case 'j':
+      {
+        json = true;
+      }
+        break;
+
+        // Number of replays
+      case 'n':
+      {
+        if (!is_number(optarg) || atoi(optarg) < 1)
+        {
+          std::cerr << "Error: Invalid number of replays!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+        loops = strtoul(optarg, NULL, 10);
+      }
+        break;
+
+        // Print the commands
+      case 'p':
+      {
+        print = true;
+      }
+        break;
+
+        // Speed
+      case 'x':
+      {
+        char *end = 0;
+        speed = strtod(optarg, &end);
+        if (end == optarg || *end != '\0' || speed < 0)
+        {
+          std::cerr << "Error: Invalid speed!" << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 1;
+        }
+      }
+        break;
+
+        // Print help
+      case 'h':
+        print_help();
+        return 0;
+
+      case 'v':
+        // Verbose level
+        v_verbosity(atoi(optarg));
+        break;
+
+      default:
+        std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+  }
+
+  if (optind >= argc)
+  {
+    std::cerr << "Error: no capture file!" << std::endl;
+    std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+    return 1;
+  }
+
+  Replayer replayer(print);
+  uint64_t lag = 0;
+  uint64_t start = lora::Capture::now();
+
+  for (unsigned int l = 0; l < loops; l++)
+  {
+    // Every replay starts at once
+    uint64_t base[2] = { 0, 0 };
+
+    for (int i = optind; i < argc; i++)
+    {
+      if (!replay(argv[i], replayer, speed, base, lag))
+        return 1;
+    }
+  }
+
+  double elapsed = (lora::Capture::now() - start) / 1e9;
+  double busy = replayer.m_busy / 1e9;
+
+  std::vector<uint64_t> &latency = replayer.m_latency;
+  std::sort(latency.begin(), latency.end());
+  uint64_t sum = 0;
+  for (size_t i = 0; i < latency.size(); i++)
+  {
+    sum += latency[i];
+  }
+  uint64_t avg = (latency.empty()) ? 0 : sum / latency.size();
+  uint64_t p50 = percentile(latency, 50);
+  uint64_t p99 = percentile(latency, 99);
+  uint64_t max = (latency.empty()) ? 0 : latency.back();
+
+  double fps = (elapsed > 0) ? replayer.m_frames / elapsed : 0;
+  double decodeFps = (busy > 0) ? replayer.m_frames / busy : 0;
+  double decodeMbs = (busy > 0) ? replayer.m_rxBytes / busy / 1e6 : 0;
+
+  if (json)
+  {
+    printf("{\"files\":%d,\"loops\":%u,\"speed\":%.3f,\"rx_bytes\":%llu,\"tx_bytes\":%llu,"
+        "\"lost_slots\":%llu,\"skipped_bytes\":%llu,\"frames\":%lu,"
+        "\"commands\":{\"info\":%lu,\"data\":%lu,\"error\":%lu,\"ack\":%lu,\"other\":%lu},"
+        "\"com_errors\":%lu,\"module_errors\":%lu,\"invalid\":%lu,\"parser_errors\":{",
+        argc - optind, loops, speed, replayer.m_rxBytes, replayer.m_txBytes, replayer.m_lost,
+        replayer.m_skipped, replayer.m_frames, replayer.m_types[lora::Command::INFO],
+        replayer.m_types[lora::Command::DATA], replayer.m_types[lora::Command::ERROR],
+        replayer.m_types[lora::Command::ACK],
+        replayer.m_other + replayer.m_types[lora::Command::READ]
+            + replayer.m_types[lora::Command::SET], replayer.m_comErrors,
+        replayer.m_moduleErrors, replayer.m_invalid);
+    const char *sep = "";
+    for (unsigned int c = 0; c < 256; c++)
+    {
+      if (replayer.m_errors[c])
+      {
+        printf("%s\"%s\":%lu", sep, errorName(c), replayer.m_errors[c]);
+        sep = ",";
+      }
+    }
+    printf("},\"elapsed_s\":%.6f,\"frames_s\":%.1f,\"decode_s\":%.6f,\"decode_frames_s\":%.1f,"
+        "\"decode_mb_s\":%.3f,\"latency_ns\":{\"avg\":%llu,\"p50\":%llu,\"p99\":%llu,\"max\":%llu},"
+        "\"max_lag_us\":%llu}\n", elapsed, fps, busy, decodeFps, decodeMbs,
+        (unsigned long long) avg, (unsigned long long) p50, (unsigned long long) p99,
+        (unsigned long long) max, (unsigned long long) (lag / 1000));
+  }
+  else
+  {
+    printf("Capture        : %d files, %lu RX records (%llu bytes), %lu TX records (%llu bytes), %llu slots lost\n",
+        argc - optind, replayer.m_rxRecords, replayer.m_rxBytes, replayer.m_txRecords,
+        replayer.m_txBytes, replayer.m_lost);
+    printf("Frames         : %lu (%lu INFO, %lu DATA, %lu ERROR, %lu ACK, %lu other), %llu bytes skipped\n",
+        replayer.m_frames, replayer.m_types[lora::Command::INFO],
+        replayer.m_types[lora::Command::DATA], replayer.m_types[lora::Command::ERROR],
+        replayer.m_types[lora::Command::ACK],
+        replayer.m_other + replayer.m_types[lora::Command::READ]
+            + replayer.m_types[lora::Command::SET], replayer.m_skipped);
+    if (!print)
+      printf("Commands       : %lu COM_ERROR, %lu other errors, %lu not decoded\n",
+          replayer.m_comErrors, replayer.m_moduleErrors, replayer.m_invalid);
+    printf("Parser errors  : %lu", replayer.m_parseErrors);
+    for (unsigned int c = 0; c < 256; c++)
+    {
+      if (replayer.m_errors[c])
+        printf(", %lu %s", replayer.m_errors[c], errorName(c));
+    }
+    printf("\n");
+    if (replayer.m_resets)
+      printf("Window full    : %lu\n", replayer.m_resets);
+    printf("Replay         : %u x, %.3f s, %.1f frames/s", loops, elapsed, fps);
+    if (speed > 0)
+      printf(" (speed %.2f, max lag %.3f ms)\n", speed, lag / 1e6);
+    else
+      printf(" (full speed)\n");
+    printf("Decode         : %.3f s, %.1f frames/s, %.2f MB/s\n", busy, decodeFps, decodeMbs);
+    printf("Decode latency : avg %llu ns, p50 %llu ns, p99 %llu ns, max %llu ns\n",
+        (unsigned long long) avg, (unsigned long long) p50, (unsigned long long) p99,
+        (unsigned long long) max);
+  }
+  fflush(stdout);
+
+  return 0;
+}
+
+void print_help(void)
+{
+  std::cerr << "WaspMote Lo-Ra - " << LORA_NAME << " v" << LORA_VERSION << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "Usage: " << LORA_NAME << " [-v 0|1|2] [-x speed] [-n times] [-p] [-j] capture..."
+      << std::endl;
+  std::cerr << "       " << LORA_NAME << " -h" << std::endl << std::endl;
+  std::cerr << " -h : display this message." << std::endl;
+  std::cerr << " -j : print the results as a JSON object (one line)." << std::endl;
+  std::cerr << " -n : number of replays of the captures. Default value is 1." << std::endl;
+  std::cerr << " -p : print the commands as the tools do (the time is in the decode latency)."
+      << std::endl;
+  std::cerr << " -v : set verbosity level [0|1|2]." << std::endl;
+  std::cerr
+      << " -x : speed of the replay (2 is twice as fast as the capture), 0 as fast as possible. Default value is 1."
+      << std::endl;
+
+  std::cerr << std::endl;
+  std::cerr
+      << "The captures are written by lora_daemon (-k, -o): rotated files are given oldest first (e.g. cap.2 cap.1 cap). Only the received bytes are parsed."
+      << std::endl;
+  std::cerr << std::endl;
+}
+
+#endif
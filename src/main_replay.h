@@ -0,0 +1,53 @@
+//============================================================================
+// Name        : main_replay.h
+// Author      : Marco Boeris Frusca
+// Version     : 1.0
+// Copyright   : GNU GENERAL PUBLIC LICENSE
+// Description : Header of the main for the "Lo-Ra capture replay"
+//============================================================================
+#ifndef MAIN_REPLAY_H_
+#define MAIN_REPLAY_H_
+
+//#define LORA_REPLAY
+#ifdef LORA_REPLAY
+
+/*****************************************************************************
+ * MACROS
+ ****************************************************************************/
+#ifndef LORA_NAME
+#define LORA_NAME             "lora_replay"
+#define LORA_VERSION          "1.0"
+#endif
+
+/*****************************************************************************
+ * FUNCTIONS
+ ****************************************************************************/
+/**
+ * @brief Prints the help message of the command.
+ *
+ * This function prints on standard error the help of the \elora_replay
+ * command.
+ *
+ */
+void print_help(void);
+
+/**
+ * @brief Main function for the Lo-Ra capture replay.
+ *
+ * This command maps capture files of the serial traffic (see lora::Capture)
+ * and passes the received bytes to the frame parser, as lora_daemon reads
+ * them from the serial device, with the timing of the capture, faster or as
+ * fast as possible. Every command is decoded as process_frame() does. At
+ * the end the frames per second, the commands, the errors of the parser and
+ * the decode latency are printed.
+ *
+ * @param[in] argc number of strings pointed to by argv
+ * @param[in] argv arguments vector
+ *
+ * @returns 0 if the captures are replayed, 1 otherwise (exit status).
+ */
+int main_replay(int argc, char **argv);
+
+#endif
+
+#endif /* MAIN_REPLAY_H_ */
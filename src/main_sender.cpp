@@ -11,12 +11,16 @@
 #include <cstring>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
 #include "global.h"
 #include "verbose.h"
 #include "main_sender.h"
 #include "lora/utils.h"
 #include "lora/serial.h"
 #include "lora/command.h"
+#include "lora/fragment.h"
+#include "lora/airtime.h"
 
 #ifdef LORA_SENDER
 
@@ -32,6 +36,20 @@ int main_sender(int argc, char **argv)
   std::string device = SERIAL_DEVICE;
   unsigned long bitrate = SERIAL_BITRATE;
 
+  // Radio settings for the estimate (0 means all values)
+  bool estimate = false;
+  int band = 868;
+  int ch = 10;
+  int bw = 0;
+  int cr = 0;
+  int sf = 0;
+
+  static const struct option long_options[] =
+  {
+    { "estimate", no_argument, 0, 'e' },
+    { 0, 0, 0, 0 }
+  };
+
   // Serial device handler
   lora::Serial serial;
 
@@ -42,10 +60,80 @@ int main_sender(int argc, char **argv)
   }
 
   // Parse command line
-  while ((opt = getopt(argc, argv, "v:a:b:d:hm:t:")) != -1)
+  while ((opt = getopt_long(argc, argv, "v:a:b:c:d:ef:hm:r:s:t:w:", long_options, NULL)) != -1)
   {
     switch (opt)
     {
+      // Channel
+      case 'c':
+      {
+        if (!is_number(optarg) || atoi(optarg) > 17)
+        {
+          std::cerr << "Error: channel must between 0 and 17." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+        ch = atoi(optarg);
+      }
+        break;
+
+        // Estimate the time on air
+      case 'e':
+        estimate = true;
+        break;
+
+        // Frequency band
+      case 'f':
+      {
+        band = atoi(optarg);
+        if (!is_number(optarg) || (band != 868 && band != 900))
+        {
+          std::cerr << "Error: frequency must be 868 or 900." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+      }
+        break;
+
+        // Coding rate
+      case 'r':
+      {
+        cr = atoi(optarg);
+        if (!is_number(optarg) || cr < 5 || cr > 8)
+        {
+          std::cerr << "Error: coding rate must be must between 5 and 8." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+      }
+        break;
+
+        // Spreading factor
+      case 's':
+      {
+        sf = atoi(optarg);
+        if (!is_number(optarg) || sf < 6 || sf > 12)
+        {
+          std::cerr << "Error: spreading factor must between 6 and 12." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+      }
+        break;
+
+        // Bandwidth
+      case 'w':
+      {
+        bw = atoi(optarg);
+        if (!is_number(optarg) || (bw != 125 && bw != 250 && bw != 500))
+        {
+          std::cerr << "Error: bandwidth must be 125, 250 or 500." << std::endl;
+          std::cerr << "Type '" << LORA_NAME << " -h' for help." << std::endl;
+          return 0;
+        }
+      }
+        break;
+
       // Destination address
       case 'a':
       {
@@ -164,6 +252,21 @@ int main_sender(int argc, char **argv)
     }
   }
 
+  if (estimate)
+  {
+    const lora::Region *region = lora::Region::find(
+        (band == 900) ? lora::ConfigCommand::F_900 : lora::ConfigCommand::F_868);
+
+    if (region->channel(ch) == 0)
+    {
+      std::cerr << "Error: channel " << ch << " isn't in the " << band << " MHz band." << std::endl;
+      return 0;
+    }
+
+    print_estimate(msg, *region, ch, sf, bw, cr);
+    return 1;
+  }
+
   V_DEBUG("Serial device : %s\n", device.c_str());
   V_DEBUG("Serial bitrate: %ld\n", bitrate);
 
@@ -185,13 +288,7 @@ int main_sender(int argc, char **argv)
   V_INFO("Open serial device\n");
   if (openSerial(serial))
   {
-    time_t now;
-    time_t end;
-
     size_t t = 0;
-    size_t n = 0;
-
-    const uint8_t buf_sz = 255;
 
     uint8_t tx_buffer[buf_sz] = { 0 };
     uint8_t rx_buffer[buf_sz] = { 0 };
@@ -202,70 +299,41 @@ int main_sender(int argc, char **argv)
     // Prepare command
     ssize_t sz = 0;
 
-    // Create DATA command
-    lora::command::Data cmd;
+    // Create DATA command: a long message is sent in several fragments
+    lora::command::FrameCache cache;
+    lora::Fragmenter fragmenter(cache);
 
     V_INFO("Create DATA command\n");
     V_INFO("Destination Address: %d\n", dest);
     V_INFO("Message            : %s\n", msg.c_str());
-    cmd.setDest(dest);
-    cmd.setData(msg);
-    sz = cmd.serialize(tx_buffer, buf_sz);
-    /*
-     }
-     break;
-     }
-     */
-    // Send command
-    V_INFO("Send command\n");
-    if (serial.send((const char*) tx_buffer, sz))
+    if (!fragmenter.begin(dest, (const uint8_t *) msg.data(), msg.size()))
+    {
+      std::cerr << "Error: message too long!" << std::endl;
+    }
+    else if (fragmenter.count() > 1)
     {
+      V_INFO("Fragments          : %lu\n", (unsigned long) fragmenter.count());
+    }
 
-      if (timeout)
+    while (!fragmenter.done())
+    {
+      sz = fragmenter.next(tx_buffer, buf_sz);
+      if (sz == 0)
       {
-        n = 0;
-        t = 0;
-        bool endPck = false;
+        std::cerr << "Error: impossible create DATA command!" << std::endl;
+        break;
+      }
 
-        time(&now);
-        end = now + timeout;
-        memset(rx_buffer, 0, buf_sz);
+      // Send command
+      V_INFO("Send command\n");
+      if (!serial.send((const char*) tx_buffer, sz))
+        break;
 
+      if (timeout)
+      {
         V_INFO("Waiting response\n");
-        while ((now < end) && !endPck)
-        {
-
-          // Receive data
-          ssize_t nb = buf_sz - t;
-          n = serial.receive((char*) &rx_buffer[t], nb);
-
-          //std::cout << now << "  " << end << std::endl;
-          // Process data received
-          if (n)
-          {
-            V_DEBUG("Received %d bytes\n", n);
-
-            if (nb == 0)
-            {
-              V_DEBUG("Receiver buffer is full\n");
-            }
-            else
-            {
-              for (uint16_t i = 0; i < n; i++)
-              {
-                V_DEBUG("[%d] %x\n", t + i, rx_buffer[t + i]);
-                if (rx_buffer[t + i] == 0x04)
-                {
-                  V_DEBUG("Found EOT\n");
-                  endPck = true;
-                }
-              }
-              t += n;
-            }
-          }
-          usleep(100);
-          time(&now);
-        }
+        memset(rx_buffer, 0, buf_sz);
+        t = rx_wait_response(serial, rx_buffer, buf_sz, timeout);
 
         if (!t)
         {
@@ -290,6 +358,82 @@ int main_sender(int argc, char **argv)
   return 0;
 }
 
+void print_estimate(const std::string &msg, const lora::Region &region, uint8_t ch, int sf, int bw,
+    int cr)
+{
+  static const int bandwidths[] = { 125, 250, 500 };
+
+  const uint8_t *data = (const uint8_t *) msg.data();
+  size_t len = msg.size();
+  size_t frames = lora::Fragmenter::fragments(data, len);
+
+  const lora::Channel *channel = region.channel(ch);
+  const lora::SubBand *subBand = region.subBand(ch);
+
+  printf("Message   : %lu bytes, %lu frame(s)\n", (unsigned long) len, (unsigned long) frames);
+  printf("Region    : %s, channel %d (%.3f MHz)\n", region.name, ch, channel->frequency / 1000.0);
+  printf("Sub-band  : %.3f - %.3f MHz, duty cycle %.1f%%", subBand->low / 1000.0,
+      subBand->high / 1000.0, subBand->duty / 10.0);
+  if (region.dwell)
+    printf(", dwell time %u ms", region.dwell / 1000);
+  printf("\n\n");
+
+  printf("%3s %4s %3s %10s %12s %12s %12s  %s\n", "SF", "BW", "CR", "symbol(us)", "frame(ms)",
+      "message(ms)", "msg/hour", "notes");
+
+  for (int s = 6; s <= 12; s++)
+  {
+    if (sf && s != sf)
+      continue;
+
+    for (size_t b = 0; b < sizeof(bandwidths) / sizeof(bandwidths[0]); b++)
+    {
+      if (bw && bandwidths[b] != bw)
+        continue;
+
+      for (int c = 5; c <= 8; c++)
+      {
+        if (cr && c != cr)
+          continue;
+
+        // Time on air of every frame of the message
+        uint64_t total = 0;
+        uint64_t longest = 0;
+        size_t largest = 0;
+        for (size_t i = 0; i < frames; i++)
+        {
+          size_t sz = lora::Fragmenter::fragmentSize(data, len, i);
+          uint64_t t = lora::Airtime::compute(s, bandwidths[b], c,
+              sz + lora::Airtime::FRAME_OVERHEAD);
+
+          total += t;
+          longest = (t > longest) ? t : longest;
+          largest = (sz > largest) ? sz : largest;
+        }
+
+        // Messages per hour allowed by the duty cycle
+        double rate = (total) ? (3600e6 * subBand->duty / 1000.0) / total : 0;
+
+        std::string notes;
+        if (bandwidths[b] == 125 && region.payload(s) == 0)
+          notes += "SF not allowed, ";
+        else if (bandwidths[b] == 125 && largest > region.payload(s))
+          notes += "longer than max payload, ";
+        if (region.dwell && longest > region.dwell)
+          notes += "dwell time exceeded, ";
+        if (lora::Airtime::lowDataRate(s, bandwidths[b]))
+          notes += "low data rate, ";
+        if (!notes.empty())
+          notes.erase(notes.size() - 2);
+
+        printf("%3d %4d 4/%d %10u %12.3f %12.3f %12.1f  %s\n", s, bandwidths[b], c,
+            lora::Airtime::symbolTime(s, bandwidths[b]), longest / 1000.0, total / 1000.0, rate,
+            notes.c_str());
+      }
+    }
+  }
+}
+
 void print_help(void)
 {
   std::cerr << "WaspMote Lo-Ra - " << LORA_NAME << " v" << LORA_VERSION << std::endl;
@@ -297,6 +441,9 @@ void print_help(void)
   std::cerr << "Usage: " << LORA_NAME
       << " [-v 0|1|2] [-d serial_device] [-b serial_bitrate] [-a [0-255]] [-m \"message\"] [-t timeot]"
       << std::endl;
+  std::cerr << "       " << LORA_NAME
+      << " --estimate [-m \"message\"] [-f frequency] [-c channel] [-w bandwidth] [-r coding_rate] [-s spreading_factor]"
+      << std::endl;
   std::cerr << "       " << LORA_NAME << " -h" << std::endl << std::endl;
 
   std::cerr
@@ -305,13 +452,25 @@ void print_help(void)
   std::cerr
       << " -b : serial bitrate [1200|2400|4800|9600|19200|38400|57600|115200]. Default value is "
       << SERIAL_BITRATE << "." << std::endl;
+  std::cerr << " -c : channel (estimate). Channel allowed are 10 to 17 for 868 MHz band and 0 to 12 for 900 MHz band. Default channel is 10."
+      << std::endl;
   std::cerr << " -d : serial device. Default value is " << SERIAL_DEVICE << "." << std::endl;
+  std::cerr << " -e, --estimate : print the time on air of the message and the messages per hour allowed by the duty cycle, without sending it."
+      << std::endl;
+  std::cerr << " -f : frequency band (estimate). Bands allowed are 900 and 868 MHz. Default value is 868."
+      << std::endl;
   std::cerr << " -h : display this message." << std::endl;
   std::cerr << " -m : message to send. It must be a string ASCII." << std::endl;
+  std::cerr << " -r : coding rate (estimate). It must be a number between 5 and 8. Default: all values."
+      << std::endl;
+  std::cerr << " -s : spreading factor (estimate). It must be a number between 6 and 12. Default: all values."
+      << std::endl;
   std::cerr
       << " -t : timeout to wait response in seconds. if it is 0 no response are waited. Default value is "
       << RX_TIMEOUT << " seconds" << std::endl;
   std::cerr << " -v : set verbosity level  [0|1|2]." << std::endl;
+  std::cerr << " -w : bandwidth (estimate). Bandwidth allowed are 125, 250 and 500 kHz. Default: all values."
+      << std::endl;
 
   std::cerr << std::endl;
 }
@@ -19,6 +19,8 @@
 #define LORA_VERSION          "1.0"
 #endif
 
+#include "lora/airtime.h"
+
 /*****************************************************************************
  * FUNCTIONS
  ****************************************************************************/
@@ -41,6 +43,26 @@ void print_help(void);
  */
 int main_sender(int argc, char **argv);
 
+/**
+ * @brief Prints the time on air of a message.
+ *
+ * This function prints, for every spreading factor, bandwidth and coding
+ * rate selected, the time on air of the frames of the message (long
+ * messages are fragmented) and the number of messages per hour allowed by
+ * the duty cycle of the channel. Regional limits (maximum payload, dwell
+ * time) are checked.
+ *
+ * @param[in] msg message.
+ * @param[in] region regional parameters of the frequency band.
+ * @param[in] ch channel code.
+ * @param[in] sf spreading factor (6 to 12, 0 for all values).
+ * @param[in] bw bandwidth in kHz (125, 250 or 500, 0 for all values).
+ * @param[in] cr coding rate (5 to 8, 0 for all values).
+ *
+ */
+void print_estimate(const std::string &msg, const lora::Region &region, uint8_t ch, int sf, int bw,
+    int cr);
+
 #endif
 
 #endif /* MAIN_SENDER_H_ */
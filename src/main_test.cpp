@@ -100,11 +100,7 @@ int main_test(int argc, char **argv)
   if (openSerial(serial))
   {
 
-    time_t now;
-    time_t end;
-
     size_t t = 0;
-    size_t n = 0;
 
     uint8_t tx_buffer[buf_sz] = { 0 };
     uint8_t rx_buffer[buf_sz] = { 0 };
@@ -167,55 +163,9 @@ int main_test(int argc, char **argv)
     if (serial.send((const char*) tx_buffer, sz))
     {
 
-      n = 0;
-      t = 0;
-      bool endPck = false;
-
-      time(&now);
-      end = now + 180;
-      memset(rx_buffer, 0, buf_sz);
-
       V_DEBUG("Receive data\n");
-      while ((now < end) && !endPck)
-      {
-
-        // Receive data
-        ssize_t nb = buf_sz - t;
-        n = serial.receive((char*) &rx_buffer[t], nb);
-
-        // Process data received
-        if (n)
-        {
-          V_DEBUG("Received %d bytes\n", n);
-
-          if (nb == 0)
-          {
-            V_DEBUG("Receiver buffer is full\n");
-          }
-          else
-          {
-            for (uint16_t i = 0; i < n; i++)
-            {
-              V_DEBUG("[%d] %x\n", t + i, rx_buffer[t + i]);
-              if (rx_buffer[t + i] == 0x04)
-              {
-                V_DEBUG("Found EOT\n");
-                endPck = true;
-              }
-            }
-          /*
-           std::cerr << "n: " << std::dec << (int) n << std::endl;
-           std::cerr << "t: " << std::dec << (int) t << std::endl;
-           */
-            t += n;
-          /*
-           std::cerr << "t: " << std::dec << (int) t << std::endl;
-           */
-          }
-        }
-        usleep(100);
-        time(&now);
-      }
+      memset(rx_buffer, 0, buf_sz);
+      t = rx_wait_response(serial, rx_buffer, buf_sz, 180);
 
       if (!t)
       {